@@ -44,6 +44,7 @@
 // To support installation of headers for analysis tools into a single
 // separate directory we omit common/ here and rely on -I.
 #include "memref.h"
+#include <stddef.h>
 #include <string>
 
 /**
@@ -75,6 +76,15 @@
  * process_memref() create data on a newly seen traced thread and invoking
  * parallel_shard_memref() to do its work.
  *
+ * For parallel operation, a tool whose per-entry work is small can additionally
+ * override parallel_shard_memref_batch() and return true from
+ * parallel_shard_memref_batch_supported() to receive consecutive entries of a shard
+ * in groups, amortizing the cost of a virtual call per entry.
+ * A tool whose shard results can be combined can additionally return true from
+ * parallel_shard_range_supported() to let the analyzer split a large shard into
+ * consecutive ranges processed concurrently, whose results are combined through
+ * parallel_shard_merge().
+ *
  * For both parallel and serial operation, the function print_results() should be
  * overridden.  It is called just once after processing all trace data and it should
  * present the results of the analysis.  For parallel operation, any desired
@@ -211,6 +221,78 @@ public:
     {
         return false;
     }
+    /**
+     * Returns whether this tool overrides parallel_shard_memref_batch() with an
+     * implementation that is cheaper than its default of invoking
+     * parallel_shard_memref() for each entry.  If so, the analyzer delivers this
+     * tool's shard entries via parallel_shard_memref_batch(), while tools returning
+     * false continue to receive each entry via parallel_shard_memref().  A tool
+     * should thus not rely on the order in which different tools see an entry.
+     */
+    virtual bool
+    parallel_shard_memref_batch_supported()
+    {
+        return false;
+    }
+    /**
+     * Identical to parallel_shard_memref() but operates on \p count consecutive
+     * trace entries from the same shard, stored contiguously starting at \p
+     * memrefs.  The entries are only valid for the duration of the call.  The
+     * return value indicates whether all of the entries were processed
+     * successfully: a tool should stop at the first failure.  On failure,
+     * parallel_shard_error() returns a descriptive message.
+     */
+    virtual bool
+    parallel_shard_memref_batch(void *shard_data, const memref_t *memrefs, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i) {
+            if (!parallel_shard_memref(shard_data, memrefs[i]))
+                return false;
+        }
+        return true;
+    }
+    /**
+     * Returns whether this tool can analyze a shard as several consecutive ranges,
+     * processed independently and possibly concurrently by different workers,
+     * whose results are combined by parallel_shard_merge().  The analyzer may
+     * split large shards this way when there are fewer shards than workers.  Each
+     * range is passed through parallel_shard_init() (or
+     * parallel_shard_range_init()), parallel_shard_memref(), and
+     * parallel_shard_exit() as though it were a shard of its own, with its own \p
+     * shard_index, so per-shard results should only be reported once merged.
+     */
+    virtual bool
+    parallel_shard_range_supported()
+    {
+        return false;
+    }
+    /**
+     * Invoked in place of parallel_shard_init() for each range of a split shard
+     * other than the shard's first range.  Such a range starts partway through
+     * the shard at an instruction fetch, without the shard's initial markers.
+     * The default implementation invokes parallel_shard_init().
+     */
+    virtual void *
+    parallel_shard_range_init(int shard_index, void *worker_data)
+    {
+        return parallel_shard_init(shard_index, worker_data);
+    }
+    /**
+     * Combines the results of a shard range, whose parallel_shard_init() return
+     * value is \p src_shard_data, into \p dst_shard_data, which holds the results
+     * of all earlier ranges of the same shard.  The ranges of each shard are merged
+     * in trace order after all shards have been processed and before
+     * print_results() is invoked.  The analyzer does not use \p src_shard_data
+     * again, so the tool should free it and drop it from any table of shards.
+     * The return value indicates whether this function was successful.  On
+     * failure, parallel_shard_error() for \p dst_shard_data returns a descriptive
+     * message.
+     */
+    virtual bool
+    parallel_shard_merge(void *dst_shard_data, void *src_shard_data)
+    {
+        return false;
+    }
     /** Returns a description of the last error for this shard. */
     virtual std::string
     parallel_shard_error(void *shard_data)
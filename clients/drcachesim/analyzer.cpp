@@ -30,7 +30,12 @@
  * DAMAGE.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <limits>
 #include <thread>
 #include "analysis_tool.h"
 #include "analyzer.h"
@@ -41,6 +46,7 @@
 #ifdef HAS_SNAPPY
 #    include "reader/snappy_file_reader.h"
 #endif
+#include "common/trace_chunk_index.h"
 #include "common/utils.h"
 
 #ifdef HAS_ZLIB
@@ -74,13 +80,12 @@ ends_with(const std::string &str, const std::string &with)
 #endif
 
 static std::unique_ptr<reader_t>
-get_reader(const std::string &path, int verbosity)
+get_reader(const std::string &path, int verbosity, int prefetch_chunks)
 {
 #ifdef HAS_SNAPPY
-    if (ends_with(path, ".sz"))
-        return std::unique_ptr<reader_t>(new snappy_file_reader_t(path, verbosity));
+    bool is_snappy = ends_with(path, ".sz");
     // If path is a directory, and any file in it ends in .sz, return a snappy reader.
-    if (directory_iterator_t::is_directory(path)) {
+    if (!is_snappy && directory_iterator_t::is_directory(path)) {
         directory_iterator_t end;
         directory_iterator_t iter(path);
         if (!iter) {
@@ -90,14 +95,33 @@ get_reader(const std::string &path, int verbosity)
         }
         for (; iter != end; ++iter) {
             if (ends_with(*iter, ".sz")) {
-                return std::unique_ptr<reader_t>(
-                    new snappy_file_reader_t(path, verbosity));
+                is_snappy = true;
+                break;
             }
         }
     }
+    if (is_snappy) {
+        snappy_file_reader_t *reader = new snappy_file_reader_t(path, verbosity);
+        reader->set_prefetch_chunks(prefetch_chunks);
+        return std::unique_ptr<reader_t>(reader);
+    }
 #endif
     // No snappy support, or didn't find a .sz file, try the default reader.
-    return std::unique_ptr<reader_t>(new default_file_reader_t(path, verbosity));
+    default_file_reader_t *reader = new default_file_reader_t(path, verbosity);
+    reader->set_prefetch_chunks(prefetch_chunks);
+    return std::unique_ptr<reader_t>(reader);
+}
+
+static uint64_t
+get_file_size(const std::string &path)
+{
+    std::ifstream file(path, std::ifstream::binary | std::ifstream::ate);
+    if (!file)
+        return 0;
+    std::streampos size = file.tellg();
+    if (size < 0)
+        return 0;
+    return static_cast<uint64_t>(size);
 }
 
 bool
@@ -108,11 +132,16 @@ analyzer_t::init_file_reader(const std::string &trace_path, int verbosity)
         ERRMSG("Trace file name is empty\n");
         return false;
     }
+    batch_tool_.assign(num_tools_, false);
     for (int i = 0; i < num_tools_; ++i) {
         if (parallel_ && !tools_[i]->parallel_shard_supported()) {
             parallel_ = false;
             break;
         }
+        if (tools_[i]->parallel_shard_memref_batch_supported()) {
+            batch_tool_[i] = true;
+            use_memref_batch_ = true;
+        }
     }
     if (parallel_ && directory_iterator_t::is_directory(trace_path)) {
         directory_iterator_t end;
@@ -127,29 +156,25 @@ analyzer_t::init_file_reader(const std::string &trace_path, int verbosity)
             if (fname == "." || fname == "..")
                 continue;
             const std::string path = trace_path + DIRSEP + fname;
-            std::unique_ptr<reader_t> reader = get_reader(path, verbosity);
+            std::unique_ptr<reader_t> reader =
+                get_reader(path, verbosity, reader_prefetch_chunks_);
             if (!reader) {
                 return false;
             }
-            thread_data_.push_back(analyzer_shard_data_t(
-                static_cast<int>(thread_data_.size()), std::move(reader), path));
+            thread_data_.push_back(
+                analyzer_shard_data_t(static_cast<int>(thread_data_.size()),
+                                      std::move(reader), path, get_file_size(path)));
             VPRINT(this, 2, "Opened reader for %s\n", path.c_str());
         }
-        // Like raw2trace, we use a simple round-robin static work assigment.  This
-        // could be improved later with dynamic work queue for better load balancing.
         if (worker_count_ <= 0)
             worker_count_ = std::thread::hardware_concurrency();
-        worker_tasks_.resize(worker_count_);
-        int worker = 0;
-        for (size_t i = 0; i < thread_data_.size(); ++i) {
-            VPRINT(this, 2, "Worker %d assigned trace shard %zd\n", worker, i);
-            worker_tasks_[worker].push_back(&thread_data_[i]);
-            thread_data_[i].worker = worker;
-            worker = (worker + 1) % worker_count_;
-        }
+        if (!split_shards())
+            return false;
+        assign_shards();
     } else {
         parallel_ = false;
-        serial_trace_iter_ = get_reader(trace_path, verbosity);
+        serial_trace_iter_ =
+            get_reader(trace_path, verbosity, reader_prefetch_chunks_);
         if (!serial_trace_iter_) {
             return false;
         }
@@ -220,6 +245,147 @@ analyzer_t::get_error_string()
     return error_string_;
 }
 
+bool
+analyzer_t::split_shards()
+{
+    // Idle workers are the only reason to split.
+    if (thread_data_.size() >= static_cast<size_t>(worker_count_))
+        return true;
+    for (int i = 0; i < num_tools_; ++i) {
+        if (!tools_[i]->parallel_shard_range_supported())
+            return true;
+    }
+    uint64_t total_size = 0;
+    for (const auto &tdata : thread_data_)
+        total_size += tdata.file_size;
+    if (total_size == 0)
+        return true;
+    const size_t num_shards = thread_data_.size();
+    for (size_t shard = 0; shard < num_shards; ++shard) {
+        // We give each shard a number of ranges proportional to its share of the
+        // work.  We index thread_data_ rather than holding a reference as we
+        // append to it.
+        const std::string path = thread_data_[shard].trace_file;
+        const uint64_t file_size = thread_data_[shard].file_size;
+        uint64_t num_ranges = worker_count_ * file_size / total_size;
+        if (num_ranges < 2)
+            continue;
+        std::vector<trace_chunk_t> chunks;
+        if (!trace_chunk_read_index(path, &chunks) || chunks.empty())
+            continue;
+        // The chunk starts divide the file into chunks.size() + 1 pieces, which we
+        // group into ranges of roughly equal numbers of pieces.
+        num_ranges = std::min<uint64_t>(num_ranges, chunks.size() + 1);
+        std::vector<const trace_chunk_t *> starts;
+        for (uint64_t range = 1; range < num_ranges; ++range)
+            starts.push_back(&chunks[range * (chunks.size() + 1) / num_ranges - 1]);
+        VPRINT(this, 1, "Splitting trace shard %zu into %zu ranges\n", shard,
+               starts.size() + 1);
+        thread_data_[shard].range_end = starts[0]->memref_ordinal;
+        thread_data_[shard].file_size = starts[0]->offset;
+        for (size_t i = 0; i < starts.size(); ++i) {
+            std::unique_ptr<reader_t> reader =
+                get_reader(path, verbosity_, reader_prefetch_chunks_);
+            if (!reader)
+                return false;
+            const bool last = i + 1 == starts.size();
+            const uint64_t end_offset = last ? file_size : starts[i + 1]->offset;
+            thread_data_.push_back(analyzer_shard_data_t(
+                static_cast<int>(thread_data_.size()), std::move(reader), path,
+                end_offset > starts[i]->offset ? end_offset - starts[i]->offset : 0));
+            thread_data_.back().range_start = starts[i]->memref_ordinal;
+            thread_data_.back().range_end = last ? 0 : starts[i + 1]->memref_ordinal;
+            thread_data_.back().first_range = static_cast<int>(shard);
+        }
+    }
+    return true;
+}
+
+void
+analyzer_t::assign_shards()
+{
+    // We use the file size as the work estimate and hand out shards largest-first
+    // to whichever worker has the least work queued so far (the classic LPT
+    // heuristic).  A skewed trace can still leave workers idle, as file size is
+    // only an approximation (compression ratios vary), which get_next_shard()
+    // addresses by stealing.
+    worker_data_.clear();
+    if (worker_count_ <= 0)
+        return; // run() will report the error.
+    worker_data_.reserve(worker_count_);
+    for (int i = 0; i < worker_count_; ++i)
+        worker_data_.emplace_back(new analyzer_worker_data_t(i));
+    std::vector<analyzer_shard_data_t *> sorted;
+    sorted.reserve(thread_data_.size());
+    for (auto &tdata : thread_data_)
+        sorted.push_back(&tdata);
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const analyzer_shard_data_t *l, const analyzer_shard_data_t *r) {
+                         return l->file_size > r->file_size;
+                     });
+    std::vector<uint64_t> assigned(worker_count_, 0);
+    for (analyzer_shard_data_t *tdata : sorted) {
+        int worker = static_cast<int>(
+            std::min_element(assigned.begin(), assigned.end()) - assigned.begin());
+        VPRINT(this, 2, "Worker %d assigned trace shard %d (%s bytes)\n", worker,
+               tdata->index, std::to_string(tdata->file_size).c_str());
+        // Each queue ends up sorted largest-first since we walk "sorted" in order.
+        worker_data_[worker]->queue.push_back(tdata);
+        worker_data_[worker]->queued_bytes += tdata->file_size;
+        tdata->worker = worker;
+        // Count empty files as a minimal unit so they still spread across workers.
+        assigned[worker] += std::max<uint64_t>(tdata->file_size, 1);
+    }
+}
+
+analyzer_t::analyzer_shard_data_t *
+analyzer_t::get_next_shard(analyzer_worker_data_t *worker)
+{
+    {
+        std::lock_guard<std::mutex> guard(worker->queue_lock);
+        if (!worker->queue.empty()) {
+            analyzer_shard_data_t *tdata = worker->queue.front();
+            worker->queue.pop_front();
+            worker->queued_bytes -= tdata->file_size;
+            return tdata;
+        }
+    }
+    // Our own queue is drained: steal from the worker with the most remaining
+    // queued work.  We take from the tail (its smallest pending shard) to stay
+    // out of the owner's way at the head.  The victim choice is racy, so we
+    // retry until every queue is observed empty.
+    while (true) {
+        analyzer_worker_data_t *victim = nullptr;
+        uint64_t victim_bytes = 0;
+        bool any_queued = false;
+        for (auto &other : worker_data_) {
+            if (other.get() == worker)
+                continue;
+            std::lock_guard<std::mutex> guard(other->queue_lock);
+            if (other->queue.empty())
+                continue;
+            uint64_t bytes = other->queued_bytes;
+            any_queued = true;
+            if (victim == nullptr || bytes > victim_bytes) {
+                victim = other.get();
+                victim_bytes = bytes;
+            }
+        }
+        if (!any_queued)
+            return nullptr;
+        std::lock_guard<std::mutex> guard(victim->queue_lock);
+        if (victim->queue.empty())
+            continue;
+        analyzer_shard_data_t *tdata = victim->queue.back();
+        victim->queue.pop_back();
+        victim->queued_bytes -= tdata->file_size;
+        VPRINT(this, 2, "Worker %d stole trace shard %d from worker %d\n",
+               worker->index, tdata->index, victim->index);
+        ++worker->shards_stolen;
+        return tdata;
+    }
+}
+
 // Used only for serial iteration.
 bool
 analyzer_t::start_reading()
@@ -228,64 +394,176 @@ analyzer_t::start_reading()
         ERRMSG("Failed to read from trace\n");
         return false;
     }
+    if (skip_refs_ > 0)
+        serial_trace_iter_->skip_memrefs(skip_refs_);
+    return true;
+}
+
+bool
+analyzer_t::process_shard(analyzer_worker_data_t *worker, analyzer_shard_data_t *tdata,
+                          std::vector<void *> &worker_data)
+{
+    tdata->worker = worker->index;
+    VPRINT(this, 1, "Worker %d starting on trace shard %d\n", tdata->worker,
+           tdata->index);
+    if (!tdata->iter->init()) {
+        tdata->error = "Failed to read from trace" + tdata->trace_file;
+        return false;
+    }
+    if (tdata->range_start > 0 &&
+        tdata->iter->skip_memrefs(tdata->range_start) != tdata->range_start) {
+        tdata->error = "Failed to reach range start in trace " + tdata->trace_file;
+        return false;
+    }
+    const uint64_t limit = tdata->range_end == 0
+        ? std::numeric_limits<uint64_t>::max()
+        : tdata->range_end - tdata->range_start;
+    std::vector<void *> &shard_data = tdata->shard_data;
+    shard_data.resize(num_tools_);
+    for (int i = 0; i < num_tools_; ++i) {
+        shard_data[i] = tdata->first_range >= 0
+            ? tools_[i]->parallel_shard_range_init(tdata->index, worker_data[i])
+            : tools_[i]->parallel_shard_init(tdata->index, worker_data[i]);
+    }
+    VPRINT(this, 1, "shard_data[0] is %p\n", shard_data[0]);
+    uint64_t records = 0;
+    if (use_memref_batch_) {
+        std::vector<memref_t> batch(memref_batch_size_);
+        size_t count = 0;
+        for (; *tdata->iter != *trace_end_ && records + count < limit;
+             ++(*tdata->iter)) {
+            const memref_t &memref = **tdata->iter;
+            // Tools that did not opt in still see each entry as it is read.
+            if (!process_shard_memref(tdata, shard_data, memref, false /*batched*/))
+                return false;
+            // The iterator's entry is overwritten on each increment so we must copy.
+            batch[count++] = memref;
+            if (count == memref_batch_size_) {
+                if (!process_shard_batch(tdata, shard_data, batch.data(), count))
+                    return false;
+                records += count;
+                count = 0;
+            }
+        }
+        if (count > 0) {
+            if (!process_shard_batch(tdata, shard_data, batch.data(), count))
+                return false;
+            records += count;
+        }
+    } else {
+        for (; *tdata->iter != *trace_end_ && records < limit; ++(*tdata->iter)) {
+            ++records;
+            if (!process_shard_memref(tdata, shard_data, **tdata->iter,
+                                      false /*batched*/))
+                return false;
+        }
+    }
+    VPRINT(this, 1, "Worker %d finished trace shard %d\n", tdata->worker, tdata->index);
+    for (int i = 0; i < num_tools_; ++i) {
+        if (!tools_[i]->parallel_shard_exit(shard_data[i])) {
+            tdata->error = tools_[i]->parallel_shard_error(shard_data[i]);
+            VPRINT(this, 1, "Worker %d hit shard exit error %s on trace shard %d\n",
+                   tdata->worker, tdata->error.c_str(), tdata->index);
+            return false;
+        }
+    }
+    ++worker->shards_processed;
+    worker->bytes_processed += tdata->file_size;
+    worker->records_processed += records;
+    return true;
+}
+
+bool
+analyzer_t::process_shard_memref(analyzer_shard_data_t *tdata,
+                                 std::vector<void *> &shard_data, const memref_t &memref,
+                                 bool batched)
+{
+    for (int i = 0; i < num_tools_; ++i) {
+        if (batch_tool_[i] != batched)
+            continue;
+        if (!tools_[i]->parallel_shard_memref(shard_data[i], memref)) {
+            tdata->error = tools_[i]->parallel_shard_error(shard_data[i]);
+            VPRINT(this, 1, "Worker %d hit shard memref error %s on trace shard %d\n",
+                   tdata->worker, tdata->error.c_str(), tdata->index);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+analyzer_t::process_shard_batch(analyzer_shard_data_t *tdata,
+                                std::vector<void *> &shard_data, const memref_t *batch,
+                                size_t count)
+{
+    for (int i = 0; i < num_tools_; ++i) {
+        if (!batch_tool_[i])
+            continue;
+        if (!tools_[i]->parallel_shard_memref_batch(shard_data[i], batch, count)) {
+            tdata->error = tools_[i]->parallel_shard_error(shard_data[i]);
+            VPRINT(this, 1, "Worker %d hit shard memref error %s on trace shard %d\n",
+                   tdata->worker, tdata->error.c_str(), tdata->index);
+            return false;
+        }
+    }
     return true;
 }
 
 void
-analyzer_t::process_tasks(std::vector<analyzer_shard_data_t *> *tasks)
+analyzer_t::process_tasks(analyzer_worker_data_t *worker)
 {
-    if (tasks->empty()) {
-        VPRINT(this, 1, "Worker has no tasks\n");
+    analyzer_shard_data_t *tdata = get_next_shard(worker);
+    if (tdata == nullptr) {
+        VPRINT(this, 1, "Worker %d has no tasks\n", worker->index);
         return;
     }
-    VPRINT(this, 1, "Worker %d assigned %zd task(s)\n", (*tasks)[0]->worker,
-           tasks->size());
+    auto start = std::chrono::steady_clock::now();
     std::vector<void *> worker_data(num_tools_);
     for (int i = 0; i < num_tools_; ++i)
-        worker_data[i] = tools_[i]->parallel_worker_init((*tasks)[0]->worker);
-    for (analyzer_shard_data_t *tdata : *tasks) {
-        VPRINT(this, 1, "Worker %d starting on trace shard %d\n", tdata->worker,
-               tdata->index);
-        if (!tdata->iter->init()) {
-            tdata->error = "Failed to read from trace" + tdata->trace_file;
+        worker_data[i] = tools_[i]->parallel_worker_init(worker->index);
+    for (; tdata != nullptr; tdata = get_next_shard(worker)) {
+        if (!process_shard(worker, tdata, worker_data)) {
+            worker->busy_seconds = std::chrono::duration<double>(
+                                       std::chrono::steady_clock::now() - start)
+                                       .count();
             return;
         }
-        std::vector<void *> shard_data(num_tools_);
-        for (int i = 0; i < num_tools_; ++i)
-            shard_data[i] = tools_[i]->parallel_shard_init(tdata->index, worker_data[i]);
-        VPRINT(this, 1, "shard_data[0] is %p\n", shard_data[0]);
-        for (; *tdata->iter != *trace_end_; ++(*tdata->iter)) {
-            for (int i = 0; i < num_tools_; ++i) {
-                const memref_t &memref = **tdata->iter;
-                if (!tools_[i]->parallel_shard_memref(shard_data[i], memref)) {
-                    tdata->error = tools_[i]->parallel_shard_error(shard_data[i]);
-                    VPRINT(this, 1,
-                           "Worker %d hit shard memref error %s on trace shard %d\n",
-                           tdata->worker, tdata->error.c_str(), tdata->index);
-                    return;
-                }
-            }
-        }
-        VPRINT(this, 1, "Worker %d finished trace shard %d\n", tdata->worker,
-               tdata->index);
-        for (int i = 0; i < num_tools_; ++i) {
-            if (!tools_[i]->parallel_shard_exit(shard_data[i])) {
-                tdata->error = tools_[i]->parallel_shard_error(shard_data[i]);
-                VPRINT(this, 1, "Worker %d hit shard exit error %s on trace shard %d\n",
-                       tdata->worker, tdata->error.c_str(), tdata->index);
-                return;
-            }
-        }
     }
     for (int i = 0; i < num_tools_; ++i) {
         const std::string error = tools_[i]->parallel_worker_exit(worker_data[i]);
         if (!error.empty()) {
-            (*tasks)[0]->error = error;
-            VPRINT(this, 1, "Worker %d hit worker exit error %s\n", (*tasks)[0]->worker,
+            worker->error = error;
+            VPRINT(this, 1, "Worker %d hit worker exit error %s\n", worker->index,
                    error.c_str());
-            return;
+            break;
         }
     }
+    worker->busy_seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void
+analyzer_t::print_worker_stats(double wall_seconds)
+{
+    // Unlike VPRINT we want this in release builds too, as it is most
+    // useful for tuning -jobs on large traces.
+    if (verbosity_ < 1)
+        return;
+    std::cerr << output_prefix_ << " Worker utilization over " << std::fixed
+              << std::setprecision(3) << wall_seconds << "s:\n";
+    for (const auto &worker : worker_data_) {
+        std::cerr << output_prefix_ << "   Worker " << std::setw(3) << worker->index
+                  << ": " << std::setw(6) << worker->shards_processed << " shards ("
+                  << worker->shards_stolen << " stolen), " << std::setw(12)
+                  << worker->bytes_processed << " bytes, " << std::setw(14)
+                  << worker->records_processed << " records, busy "
+                  << std::setprecision(3) << worker->busy_seconds << "s ("
+                  << std::setprecision(1)
+                  << (wall_seconds > 0. ? 100. * worker->busy_seconds / wall_seconds : 0.)
+                  << "%)\n";
+    }
+    std::cerr.unsetf(std::ios::floatfield);
+    std::cerr << std::setprecision(6);
 }
 
 bool
@@ -314,19 +592,47 @@ analyzer_t::run()
     }
     std::vector<std::thread> threads;
     VPRINT(this, 1, "Creating %d worker threads\n", worker_count_);
+    auto start = std::chrono::steady_clock::now();
     threads.reserve(worker_count_);
     for (int i = 0; i < worker_count_; ++i) {
         threads.emplace_back(
-            std::thread(&analyzer_t::process_tasks, this, &worker_tasks_[i]));
+            std::thread(&analyzer_t::process_tasks, this, worker_data_[i].get()));
     }
     for (std::thread &thread : threads)
         thread.join();
+    print_worker_stats(
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
     for (auto &tdata : thread_data_) {
         if (!tdata.error.empty()) {
             error_string_ = tdata.error;
             return false;
         }
     }
+    for (auto &worker : worker_data_) {
+        if (!worker->error.empty()) {
+            error_string_ = worker->error;
+            return false;
+        }
+    }
+    return merge_ranges();
+}
+
+bool
+analyzer_t::merge_ranges()
+{
+    // The ranges of a shard were appended in trace order.
+    for (auto &tdata : thread_data_) {
+        if (tdata.first_range < 0)
+            continue;
+        analyzer_shard_data_t &first = thread_data_[tdata.first_range];
+        for (int i = 0; i < num_tools_; ++i) {
+            if (!tools_[i]->parallel_shard_merge(first.shard_data[i],
+                                                 tdata.shard_data[i])) {
+                error_string_ = tools_[i]->parallel_shard_error(first.shard_data[i]);
+                return false;
+            }
+        }
+    }
     return true;
 }
 
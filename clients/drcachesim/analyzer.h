@@ -43,8 +43,10 @@
  * @brief DrMemtrace top-level trace analysis driver.
  */
 
+#include <deque>
 #include <iterator>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include "analysis_tool.h"
@@ -113,11 +115,12 @@ protected:
     // analyzed by a single worker thread, eliminating the need for locks.
     struct analyzer_shard_data_t {
         analyzer_shard_data_t(int index, std::unique_ptr<reader_t> iter,
-                              const std::string &trace_file)
+                              const std::string &trace_file, uint64_t file_size)
             : index(index)
             , worker(0)
             , iter(std::move(iter))
             , trace_file(trace_file)
+            , file_size(file_size)
         {
         }
         analyzer_shard_data_t(analyzer_shard_data_t &&src)
@@ -126,14 +129,32 @@ protected:
             worker = src.worker;
             iter = std::move(src.iter);
             trace_file = std::move(src.trace_file);
+            file_size = src.file_size;
             error = std::move(src.error);
+            range_start = src.range_start;
+            range_end = src.range_end;
+            first_range = src.first_range;
+            shard_data = std::move(src.shard_data);
         }
 
         int index;
+        // The worker that actually processed the shard, which may differ from its
+        // initial assignment if it was stolen.
         int worker;
         std::unique_ptr<reader_t> iter;
         std::string trace_file;
+        // The on-disk size, used as a proxy for the amount of work in the shard.
+        uint64_t file_size;
         std::string error;
+        // For a shard split into ranges, this range covers the memrefs from ordinal
+        // range_start up to range_end, or to the end of the shard if range_end is 0.
+        uint64_t range_start = 0;
+        uint64_t range_end = 0;
+        // For a range other than the first of its shard, the index in thread_data_
+        // of the first range, into which this range's results are merged.
+        int first_range = -1;
+        // The parallel_shard_init() value for each tool.
+        std::vector<void *> shard_data;
 
     private:
         analyzer_shard_data_t(const analyzer_shard_data_t &) = delete;
@@ -141,16 +162,81 @@ protected:
         operator=(const analyzer_shard_data_t &) = delete;
     };
 
+    // Data for one worker thread.  Shards are handed out dynamically: each worker
+    // starts with a size-balanced queue of shards sorted largest-first, and when
+    // its queue drains it steals from the tail of the queue with the most
+    // remaining work.  Only the queue itself is shared; the statistics are
+    // written solely by the owning worker.
+    struct analyzer_worker_data_t {
+        explicit analyzer_worker_data_t(int index)
+            : index(index)
+        {
+        }
+
+        int index;
+        std::mutex queue_lock; // Protects "queue".
+        std::deque<analyzer_shard_data_t *> queue;
+        // The sum of file_size over "queue", used to pick a victim to steal from.
+        uint64_t queued_bytes = 0;
+        std::string error;
+
+        // Statistics on load balancing.
+        uint64_t shards_processed = 0;
+        uint64_t shards_stolen = 0;
+        uint64_t bytes_processed = 0;
+        uint64_t records_processed = 0;
+        double busy_seconds = 0.;
+    };
+
     bool
     init_file_reader(const std::string &trace_path, int verbosity = 0);
 
+    // Splits shards with a chunk index into ranges, if all tools support that,
+    // until there are about as many shards as workers.
+    bool
+    split_shards();
+
+    // Distributes thread_data_ across worker_data_.
+    void
+    assign_shards();
+
+    // Combines the results of the ranges of each split shard.
+    bool
+    merge_ranges();
+
+    // Returns the next shard for "worker" to process, stealing from another worker
+    // if its own queue is empty.  Returns nullptr when no work remains anywhere.
+    analyzer_shard_data_t *
+    get_next_shard(analyzer_worker_data_t *worker);
+
+    void
+    print_worker_stats(double wall_seconds);
+
     // This finalizes the trace_iter setup.  It can block and is meant to be
     // called at the top of run() or begin().
     bool
     start_reading();
 
+    // Returns whether the shard was processed successfully.  On failure, sets
+    // tdata->error.
+    bool
+    process_shard(analyzer_worker_data_t *worker, analyzer_shard_data_t *tdata,
+                  std::vector<void *> &worker_data);
+
+    // Passes "memref" to each tool that does (if "batched") or does not (if not
+    // "batched") take batches.  Returns false and sets tdata->error on failure.
+    bool
+    process_shard_memref(analyzer_shard_data_t *tdata, std::vector<void *> &shard_data,
+                         const memref_t &memref, bool batched);
+
+    // Passes "count" entries from "batch" to each tool that takes batches.
+    // Returns false and sets tdata->error on failure.
+    bool
+    process_shard_batch(analyzer_shard_data_t *tdata, std::vector<void *> &shard_data,
+                        const memref_t *batch, size_t count);
+
     void
-    process_tasks(std::vector<analyzer_shard_data_t *> *tasks);
+    process_tasks(analyzer_worker_data_t *worker);
 
     bool success_;
     std::string error_string_;
@@ -160,9 +246,20 @@ protected:
     int num_tools_;
     analysis_tool_t **tools_;
     bool parallel_;
+    // Whether any tool wants parallel_shard_memref_batch().
+    bool use_memref_batch_ = false;
+    // Whether each tool in tools_ wants parallel_shard_memref_batch().
+    std::vector<bool> batch_tool_;
+    // The number of entries per parallel_shard_memref_batch() call.  This is
+    // small enough for a batch of memref_t to stay in the L1 cache.
+    static const size_t memref_batch_size_ = 256;
     int worker_count_;
-    std::vector<std::vector<analyzer_shard_data_t *>> worker_tasks_;
+    std::vector<std::unique_ptr<analyzer_worker_data_t>> worker_data_;
     int verbosity_ = 0;
+    // Passed to file_reader_t::set_prefetch_chunks() for each reader we create.
+    int reader_prefetch_chunks_ = 0;
+    // The number of memrefs skipped by start_reading() before serial iteration.
+    uint64_t skip_refs_ = 0;
     const char *output_prefix_ = "[analyzer]";
 };
 
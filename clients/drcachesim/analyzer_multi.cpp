@@ -43,19 +43,37 @@
 #    include "reader/compressed_file_reader.h"
 #endif
 #include "reader/ipc_reader.h"
+#ifdef UNIX
+#    include "reader/shm_ring_reader.h"
+#endif
 #include "tools/invariant_checker.h"
 
 analyzer_multi_t::analyzer_multi_t()
 {
     worker_count_ = op_jobs.get_value();
+    reader_prefetch_chunks_ = op_reader_prefetch_chunks.get_value();
     // Initial measurements show it's sometimes faster to keep the parallel model
     // of using single-file readers but use them sequentially, as opposed to
     // the every-file interleaving reader, but the user can specify -jobs 1, so
     // we still keep the serial vs parallel split for 0.
     if (worker_count_ == 0)
         parallel_ = false;
-    if (!op_indir.get_value().empty() || !op_infile.get_value().empty())
+    if (!op_indir.get_value().empty() || !op_infile.get_value().empty()) {
         op_offline.set_value(true); // Some tools check this on post-proc runs.
+        // The simulators drop the first -skip_refs references they are handed,
+        // so for them we can skip in the reader instead, which can seek past
+        // most of the skipped references in an indexed trace.  Other tools
+        // either see every reference or (view) skip on their own terms, as does
+        // the -test_mode invariant checker, whose stream checks need the trace
+        // from its start.
+        const std::string &type = op_simulator_type.get_value();
+        if (!op_test_mode.get_value() &&
+            ((type == CPU_CACHE && op_config_file.get_value().empty()) ||
+             type == MISS_ANALYZER || type == CACHE_SWEEP || type == TLB)) {
+            skip_refs_ = op_skip_refs.get_value();
+            op_skip_refs.set_value(0);
+        }
+    }
     if (!create_analysis_tools()) {
         success_ = false;
         error_string_ = "Failed to create analysis tool: " + error_string_;
@@ -120,6 +138,21 @@ analyzer_multi_t::analyzer_multi_t()
     } else if (op_infile.get_value().empty()) {
         // XXX i#3323: Add parallel analysis support for online tools.
         parallel_ = false;
+#ifdef UNIX
+        if (op_ipc_ring_size.get_value() > 0) {
+            serial_trace_iter_ = std::unique_ptr<reader_t>(new shm_ring_reader_t(
+                op_ipc_name.get_value().c_str(), op_ipc_ring_size.get_value(),
+                op_verbose.get_value()));
+            trace_end_ = std::unique_ptr<reader_t>(new shm_ring_reader_t());
+            if (!*serial_trace_iter_) {
+                success_ = false;
+                error_string_ = "try removing stale ring file " +
+                    reinterpret_cast<shm_ring_reader_t *>(serial_trace_iter_.get())
+                        ->get_ring_path();
+            }
+            return;
+        }
+#endif
         serial_trace_iter_ = std::unique_ptr<reader_t>(
             new ipc_reader_t(op_ipc_name.get_value().c_str(), op_verbose.get_value()));
         trace_end_ = std::unique_ptr<reader_t>(new ipc_reader_t());
@@ -0,0 +1,252 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* chunked_gzip_ostream_t: writes a trace as a series of independently
+ * compressed gzip members followed by an index of them, as described in
+ * trace_chunk_index.h, so that readers can start decoding partway through.
+ * The stream must be written with whole trace_entry_t records, though a record
+ * may span separate writes.  Seeking is not supported.
+ */
+
+#ifndef _CHUNKED_GZIP_OSTREAM_H_
+#define _CHUNKED_GZIP_OSTREAM_H_ 1
+
+#ifndef HAS_ZLIB
+#    error HAS_ZLIB is required
+#endif
+#include <fstream>
+#include <vector>
+#include <zlib.h>
+#include "trace_chunk_index.h"
+
+class chunked_gzip_streambuf_t
+    : public std::basic_streambuf<char, std::char_traits<char>> {
+public:
+    chunked_gzip_streambuf_t(const std::string &path, uint64_t chunk_entries)
+        : file_(path, std::ofstream::binary)
+        , chunk_entries_(chunk_entries)
+    {
+        memset(&zstream_, 0, sizeof(zstream_));
+        if (!file_ ||
+            deflateInit2(&zstream_, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                         15 + 16 /*gzip wrapper*/, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            return;
+        zstream_ok_ = true;
+        buf_ = new char[buffer_size_];
+        out_.resize(out_size_);
+        // We leave an extra slot for extra_char on overflow.
+        setp(buf_, buf_ + buffer_size_ - 1);
+    }
+    virtual ~chunked_gzip_streambuf_t() override
+    {
+        sync();
+        if (zstream_ok_) {
+            finish();
+            deflateEnd(&zstream_);
+        }
+        delete[] buf_;
+    }
+    virtual int
+    overflow(int extra_char) override
+    {
+        if (!zstream_ok_)
+            return traits_type::eof();
+        if (extra_char != traits_type::eof()) {
+            // Put the extra char into the buffer.  We left an extra slot for it.
+            *pptr() = traits_type::to_char_type(extra_char);
+            pbump(1);
+        }
+        int res = traits_type::not_eof(extra_char);
+        if (pptr() > pbase() && !add_bytes(pbase(), pptr() - pbase()))
+            res = traits_type::eof();
+        setp(buf_, buf_ + buffer_size_ - 1);
+        return res;
+    }
+    virtual int
+    sync() override
+    {
+        return overflow(traits_type::eof());
+    }
+    bool
+    is_open() const
+    {
+        return zstream_ok_;
+    }
+
+private:
+    bool
+    add_bytes(const char *data, size_t size)
+    {
+        // Reassemble entries that span writes.
+        while (size > 0) {
+            size_t copy = sizeof(trace_entry_t) - partial_size_;
+            if (copy > size)
+                copy = size;
+            memcpy(reinterpret_cast<char *>(&partial_) + partial_size_, data, copy);
+            partial_size_ += copy;
+            data += copy;
+            size -= copy;
+            if (partial_size_ == sizeof(trace_entry_t)) {
+                partial_size_ = 0;
+                if (!add_entry(partial_))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    bool
+    add_entry(const trace_entry_t &entry)
+    {
+        if (entry.type == TRACE_TYPE_THREAD) {
+            // A file holding more than one thread cannot be entered partway
+            // through without the earlier thread switches, so we stop cutting
+            // chunks.
+            if (tid_ != 0 && tid_ != entry.addr)
+                can_cut_ = false;
+            tid_ = entry.addr;
+        }
+        if (entries_in_chunk_ >= chunk_entries_ && can_cut_ &&
+            trace_chunk_can_start(entry)) {
+            if (!compress(Z_FINISH) || deflateReset(&zstream_) != Z_OK)
+                return false;
+            chunks_.push_back(
+                { bytes_written_, entries_, memrefs_, instrs_, timestamp_ });
+            entries_in_chunk_ = 0;
+        }
+        const char *start = reinterpret_cast<const char *>(&entry);
+        pending_.insert(pending_.end(), start, start + sizeof(entry));
+        if (pending_.size() >= pending_size_ && !compress(Z_NO_FLUSH))
+            return false;
+        ++entries_;
+        ++entries_in_chunk_;
+        memrefs_ += trace_chunk_entry_memrefs(entry);
+        instrs_ += trace_chunk_entry_instrs(entry);
+        if (entry.type == TRACE_TYPE_MARKER && entry.size == TRACE_MARKER_TYPE_TIMESTAMP)
+            timestamp_ = entry.addr;
+        return true;
+    }
+
+    // Compresses pending_ into the current member, ending the member if "flush"
+    // is Z_FINISH.
+    bool
+    compress(int flush)
+    {
+        zstream_.next_in = reinterpret_cast<Bytef *>(pending_.data());
+        zstream_.avail_in = static_cast<uInt>(pending_.size());
+        int res;
+        do {
+            zstream_.next_out = reinterpret_cast<Bytef *>(out_.data());
+            zstream_.avail_out = static_cast<uInt>(out_.size());
+            res = deflate(&zstream_, flush);
+            if (res == Z_STREAM_ERROR)
+                return false;
+            size_t len = out_.size() - zstream_.avail_out;
+            if (len > 0) {
+                if (!file_.write(out_.data(), len))
+                    return false;
+                bytes_written_ += len;
+            }
+        } while (zstream_.avail_out == 0 || (flush == Z_FINISH && res != Z_STREAM_END));
+        pending_.clear();
+        return true;
+    }
+
+    void
+    finish()
+    {
+        if (!compress(Z_FINISH))
+            return;
+        // A file with a single chunk is left as a plain gzip file.
+        if (chunks_.empty())
+            return;
+        trace_chunk_footer_t footer = { bytes_written_,
+                                        static_cast<uint32_t>(chunks_.size()),
+                                        TRACE_CHUNK_INDEX_VERSION };
+        for (size_t i = 0; i < chunks_.size(); i += TRACE_CHUNK_RECORDS_PER_MEMBER) {
+            size_t count = chunks_.size() - i;
+            if (count > TRACE_CHUNK_RECORDS_PER_MEMBER)
+                count = TRACE_CHUNK_RECORDS_PER_MEMBER;
+            trace_chunk_write_member(file_, TRACE_CHUNK_SUBFIELD_INDEX, &chunks_[i],
+                                     static_cast<uint16_t>(count * sizeof(chunks_[i])));
+        }
+        trace_chunk_write_member(file_, TRACE_CHUNK_SUBFIELD_FOOTER, &footer,
+                                 sizeof(footer));
+    }
+
+    static const int buffer_size_ = 4096;
+    // The amount of raw data we accumulate before invoking deflate().
+    static const size_t pending_size_ = 64 * 1024;
+    static const size_t out_size_ = 64 * 1024;
+    std::ofstream file_;
+    z_stream zstream_;
+    bool zstream_ok_ = false;
+    char *buf_ = nullptr;
+    std::vector<char> pending_;
+    std::vector<char> out_;
+    trace_entry_t partial_;
+    size_t partial_size_ = 0;
+    uint64_t chunk_entries_;
+    uint64_t entries_in_chunk_ = 0;
+    uint64_t bytes_written_ = 0;
+    uint64_t entries_ = 0;
+    uint64_t memrefs_ = 0;
+    uint64_t instrs_ = 0;
+    uint64_t timestamp_ = 0;
+    addr_t tid_ = 0;
+    bool can_cut_ = true;
+    std::vector<trace_chunk_t> chunks_;
+};
+
+class chunked_gzip_ostream_t : public std::ostream {
+public:
+    // Starts a new chunk at the first instruction fetch after each
+    // "chunk_entries" entries.
+    explicit chunked_gzip_ostream_t(const std::string &path,
+                                    uint64_t chunk_entries = default_chunk_entries_)
+        : std::ostream(new chunked_gzip_streambuf_t(path, chunk_entries))
+    {
+        if (!static_cast<chunked_gzip_streambuf_t *>(rdbuf())->is_open())
+            setstate(std::ios::badbit);
+    }
+    virtual ~chunked_gzip_ostream_t() override
+    {
+        delete rdbuf();
+    }
+
+    // This balances the compression lost at each member boundary and the size
+    // of the index against the amount read to reach an arbitrary point.
+    static const uint64_t default_chunk_entries_ = 256 * 1024;
+};
+
+#endif /* _CHUNKED_GZIP_OSTREAM_H_ */
@@ -52,6 +52,17 @@ droption_t<std::string> op_ipc_name(
     "for each instance of the simulator being run at any one time.  On Windows, the name "
     "is limited to 247 characters.");
 
+droption_t<bytesize_t> op_ipc_ring_size(
+    DROPTION_SCOPE_ALL, "ipc_ring_size", 0, "Shared memory ring size for online traces",
+    "If non-zero, online traces are sent from the target application processes to the "
+    "simulator through a ring buffer of this size in shared memory, rather than "
+    "through the named pipe.  This avoids a system call and a copy into the kernel for "
+    "every few kilobytes of trace data, and sends each trace buffer whole rather than "
+    "in pipe-sized pieces.  The ring is backed by a file named by -ipc_name, placed "
+    "in /dev/shm unless an absolute path is given.  The size is rounded up to a power "
+    "of 2 and must be at least twice the size of a trace buffer.  This is not "
+    "supported on Windows.");
+
 droption_t<std::string> op_outdir(
     DROPTION_SCOPE_ALL, "outdir", ".", "Target directory for offline trace files",
     "For the offline analysis mode (when -offline is requested), specifies the path "
@@ -87,6 +98,17 @@ droption_t<int> op_jobs(
     "negative value sets the job count to the number of hardware threads, "
     "with a cap of 16.");
 
+droption_t<int> op_reader_prefetch_chunks(
+    DROPTION_SCOPE_FRONTEND, "reader_prefetch_chunks", 0, 0, 64,
+    "Chunks of compressed trace input to decompress ahead",
+    "When reading gzip or snappy compressed offline trace files, decompression "
+    "normally runs inline on the analysis thread.  A non-zero value moves it to a "
+    "pool of helper threads which keep up to this many 64KB chunks of each input "
+    "file decompressed ahead of the analysis tools, overlapping decompression with "
+    "analysis.  A value of 2 provides double buffering.  This costs this many chunks "
+    "of memory per thread file, which can add up for traces with many threads when "
+    "not using parallel analysis.");
+
 droption_t<std::string> op_module_file(
     DROPTION_SCOPE_ALL, "module_file", "", "Path to modules.log for opcode_mix tool",
     "The opcode_mix tool needs the modules.log file (generated by the offline "
@@ -207,6 +229,41 @@ droption_t<bool> op_coherence(
     DROPTION_SCOPE_FRONTEND, "coherence", false, "Model coherence for private caches",
     "Writes to cache lines will invalidate other private caches that hold that line.");
 
+droption_t<unsigned int> op_core_sim_threads(
+    DROPTION_SCOPE_FRONTEND, "core_sim_threads", 0,
+    "Host threads simulating the private caches",
+    "If non-zero, the private L1 caches of the simulated cores are simulated on this "
+    "many host threads (at most one per core), with the shared LLC driven from the "
+    "analysis thread.  Requests to the LLC are buffered and applied in trace order, so "
+    "the results are identical to those of serial simulation.  With -coherence, writes "
+    "to lines held by other cores' caches serialize the simulation around them, and "
+    "with -warmup_fraction the simulation is serial until the LLC is warmed up.  This "
+    "is only supported for the default 2-level hierarchy, not with -config_file.");
+
+droption_t<std::string> op_sweep_L1D_sizes(
+    DROPTION_SCOPE_FRONTEND, "sweep_L1D_sizes", "", "L1D sizes for " CACHE_SWEEP,
+    "A comma-separated list of L1 data cache sizes, each accepting a K, M, or G suffix, "
+    "for the " CACHE_SWEEP " simulator.  Every size is simulated with every "
+    "associativity in -sweep_L1D_assocs.  If empty, only -L1D_size is simulated.");
+
+droption_t<std::string> op_sweep_L1D_assocs(
+    DROPTION_SCOPE_FRONTEND, "sweep_L1D_assocs", "",
+    "L1D associativities for " CACHE_SWEEP,
+    "A comma-separated list of L1 data cache associativities for the " CACHE_SWEEP
+    " simulator.  If empty, only -L1D_assoc is simulated.");
+
+droption_t<std::string> op_sweep_LL_sizes(
+    DROPTION_SCOPE_FRONTEND, "sweep_LL_sizes", "", "LL sizes for " CACHE_SWEEP,
+    "A comma-separated list of last-level cache sizes, each accepting a K, M, or G "
+    "suffix, for the " CACHE_SWEEP " simulator.  Every size is simulated with every "
+    "associativity in -sweep_LL_assocs, below every L1D geometry.  If empty, only "
+    "-LL_size is simulated.");
+
+droption_t<std::string> op_sweep_LL_assocs(
+    DROPTION_SCOPE_FRONTEND, "sweep_LL_assocs", "", "LL associativities for " CACHE_SWEEP,
+    "A comma-separated list of last-level cache associativities for the " CACHE_SWEEP
+    " simulator.  If empty, only -LL_assoc is simulated.");
+
 droption_t<bool> op_use_physical(
     DROPTION_SCOPE_CLIENT, "use_physical", false, "Use physical addresses if possible",
     "If available, the default virtual addresses will be translated to physical.  "
@@ -319,6 +376,25 @@ droption_t<std::string> op_raw_compress(
     "for an SSD, zlib and gzip typically add overhead and would only be used if space is "
     "at a premium; snappy_nocrc and lz4 are nearly always performance wins.");
 
+droption_t<unsigned int> op_writer_threads(
+    DROPTION_SCOPE_CLIENT, "writer_threads", 0,
+    "Threads compressing and writing offline trace buffers",
+    "If non-zero, a full trace buffer of an application thread is handed to one of this "
+    "many writer threads, which compresses it per -raw_compress and writes it to the "
+    "thread's file, while the application thread continues into a spare buffer.  Each "
+    "application thread's buffers are written in order by the same writer.  An "
+    "application thread with -writer_queue_depth buffers pending waits for its writer; "
+    "the count and duration of such stalls are reported at exit for -verbose 1 or "
+    "higher.  This only applies to -offline when no buffer handoff function has been "
+    "registered with drmemtrace_buffer_handoff().");
+
+droption_t<unsigned int> op_writer_queue_depth(
+    DROPTION_SCOPE_CLIENT, "writer_queue_depth", 4, 1, 1024,
+    "Pending buffers per thread for -writer_threads",
+    "The maximum number of full trace buffers of one application thread that may be "
+    "waiting for or undergoing compression and writing by -writer_threads.  Each "
+    "pending buffer holds memory of the size of a trace buffer.");
+
 droption_t<bool> op_online_instr_types(
     DROPTION_SCOPE_CLIENT, "online_instr_types", false,
     "Whether online traces should distinguish instr types",
@@ -379,11 +455,13 @@ droption_t<std::string>
 droption_t<std::string>
     op_simulator_type(DROPTION_SCOPE_FRONTEND, "simulator_type", CPU_CACHE,
                       "Simulator type (" CPU_CACHE ", " MISS_ANALYZER ", " TLB
-                      ", " REUSE_DIST ", " REUSE_TIME ", " HISTOGRAM ", " VIEW
-                      ", " FUNC_VIEW ", " BASIC_COUNTS ", or " INVARIANT_CHECKER ").",
+                      ", " CACHE_SWEEP ", " REUSE_DIST ", " REUSE_TIME
+                      ", " MISS_RATIO_CURVE ", " HISTOGRAM ", " VIEW ", " FUNC_VIEW
+                      ", " BASIC_COUNTS ", or " INVARIANT_CHECKER ").",
                       "Specifies the type of the simulator. "
                       "Supported types: " CPU_CACHE ", " MISS_ANALYZER ", " TLB
-                      ", " REUSE_DIST ", " REUSE_TIME ", " HISTOGRAM ", " BASIC_COUNTS
+                      ", " CACHE_SWEEP ", " REUSE_DIST ", " REUSE_TIME
+                      ", " MISS_RATIO_CURVE ", " HISTOGRAM ", " BASIC_COUNTS
                       ", or " INVARIANT_CHECKER ".");
 
 droption_t<unsigned int> op_verbose(DROPTION_SCOPE_ALL, "verbose", 0, 0, 64,
@@ -447,7 +525,12 @@ droption_t<bytesize_t>
                  "Number of memory references to skip",
                  "Specifies the number of references to skip "
                  "in the beginning of the application execution. "
-                 "These memory references are dropped instead of being simulated.");
+                 "These memory references are dropped instead of being simulated.  "
+                 "For an offline trace analyzed by a cache or TLB simulator, they "
+                 "are dropped by the trace reader, which for a single compressed "
+                 "thread file with a chunk index seeks past most of them without "
+                 "decompressing them, unless -test_mode also runs the invariant "
+                 "checker on the full trace.");
 
 droption_t<bytesize_t> op_warmup_refs(
     DROPTION_SCOPE_FRONTEND, "warmup_refs", 0,
@@ -515,9 +598,28 @@ droption_t<unsigned int> op_reuse_skip_dist(
 droption_t<bool> op_reuse_verify_skip(
     DROPTION_SCOPE_FRONTEND, "reuse_verify_skip", false,
     "Use full list walks to verify the skip list results.",
-    "Verifies every skip list-calculated reuse distance with a full list walk. "
+    "Verifies every reuse distance calculated by the skip list or by the tree "
+    "selected with -reuse_engine with a full list walk.  "
     "This incurs significant additional overhead.  This option is only available "
     "in debug builds.");
+droption_t<std::string> op_reuse_engine(
+    DROPTION_SCOPE_FRONTEND, "reuse_engine", REUSE_ENGINE_SKIP_LIST,
+    "Reuse distance computation method: " REUSE_ENGINE_SKIP_LIST " or "
+    REUSE_ENGINE_FENWICK ".",
+    "Selects how the reuse distance tool computes distances.  The default, "
+    "\"" REUSE_ENGINE_SKIP_LIST "\", walks a list of cache lines with a skip list "
+    "whose spacing is set by -reuse_skip_dist.  \"" REUSE_ENGINE_FENWICK "\" "
+    "instead counts more recently accessed lines with a Fenwick tree over access "
+    "times, whose cost grows only logarithmically with the distance and needs no "
+    "tuning.  Both produce identical results.");
+droption_t<double> op_mrc_sample_rate(
+    DROPTION_SCOPE_FRONTEND, "mrc_sample_rate", 0.01,
+    "Fraction of cache lines sampled by the miss_ratio_curve tool.",
+    "The " MISS_RATIO_CURVE " tool follows every reference to this fraction of the "
+    "cache lines, chosen by hashing their addresses, and scales their reuse distances "
+    "to estimate the miss ratio of every fully-associative LRU cache size at once.  "
+    "Lower rates reduce time and memory at the cost of accuracy.  A rate of 1 "
+    "produces the exact curve.");
 
 #define OP_RECORD_FUNC_ITEM_SEP "&"
 // XXX i#3048: replace function return address with function callstack
@@ -47,6 +47,10 @@
 #define HISTOGRAM "histogram"
 #define REUSE_DIST "reuse_distance"
 #define REUSE_TIME "reuse_time"
+#define MISS_RATIO_CURVE "miss_ratio_curve"
+#define CACHE_SWEEP "cache_sweep"
+#define REUSE_ENGINE_SKIP_LIST "skip_list"
+#define REUSE_ENGINE_FENWICK "fenwick"
 #define BASIC_COUNTS "basic_counts"
 #define OPCODE_MIX "opcode_mix"
 #define VIEW "view"
@@ -62,6 +66,7 @@
 
 extern droption_t<bool> op_offline;
 extern droption_t<std::string> op_ipc_name;
+extern droption_t<bytesize_t> op_ipc_ring_size;
 extern droption_t<std::string> op_outdir;
 extern droption_t<std::string> op_subdir_prefix;
 extern droption_t<std::string> op_infile;
@@ -85,6 +90,11 @@ extern droption_t<bool> op_L0D_filter;
 extern droption_t<bytesize_t> op_L0D_size;
 extern droption_t<bool> op_instr_only_trace;
 extern droption_t<bool> op_coherence;
+extern droption_t<unsigned int> op_core_sim_threads;
+extern droption_t<std::string> op_sweep_L1D_sizes;
+extern droption_t<std::string> op_sweep_L1D_assocs;
+extern droption_t<std::string> op_sweep_LL_sizes;
+extern droption_t<std::string> op_sweep_LL_assocs;
 extern droption_t<bool> op_use_physical;
 extern droption_t<unsigned int> op_virt2phys_freq;
 extern droption_t<bool> op_cpu_scheduling;
@@ -96,6 +106,8 @@ extern droption_t<bytesize_t> op_retrace_every_instrs;
 extern droption_t<bool> op_split_windows;
 extern droption_t<bytesize_t> op_exit_after_tracing;
 extern droption_t<std::string> op_raw_compress;
+extern droption_t<unsigned int> op_writer_threads;
+extern droption_t<unsigned int> op_writer_queue_depth;
 extern droption_t<bool> op_online_instr_types;
 extern droption_t<std::string> op_replace_policy;
 extern droption_t<std::string> op_data_prefetcher;
@@ -111,6 +123,7 @@ extern droption_t<std::string> op_simulator_type;
 extern droption_t<unsigned int> op_verbose;
 extern droption_t<bool> op_show_func_trace;
 extern droption_t<int> op_jobs;
+extern droption_t<int> op_reader_prefetch_chunks;
 extern droption_t<bool> op_test_mode;
 extern droption_t<std::string> op_test_mode_name;
 extern droption_t<bool> op_disable_optimizations;
@@ -131,6 +144,8 @@ extern droption_t<unsigned int> op_reuse_distance_threshold;
 extern droption_t<bool> op_reuse_distance_histogram;
 extern droption_t<unsigned int> op_reuse_skip_dist;
 extern droption_t<bool> op_reuse_verify_skip;
+extern droption_t<std::string> op_reuse_engine;
+extern droption_t<double> op_mrc_sample_rate;
 extern droption_t<std::string> op_view_syntax;
 extern droption_t<std::string> op_record_function;
 extern droption_t<bool> op_record_heap;
@@ -0,0 +1,333 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* shm_ring: a multi-producer single-consumer ring buffer of variable-sized
+ * records in memory shared between traced processes and the simulator.  This
+ * is an alternative to named_pipe_t for online traces.
+ *
+ * Producers reserve space by advancing a shared reservation position and then
+ * publish each record by storing its length into the record's header.  The
+ * consumer reads records in reservation order, waiting for each one to be
+ * published, and zeroes consumed space before handing it back, so the unused
+ * part of the ring is always zero.  A record that would straddle the end of
+ * the ring is preceded by a padding record covering the remainder.  Writer
+ * processes register their ids so the consumer can tell when the trace has
+ * ended, even if a writer died without unregistering.  Likewise the consumer
+ * records its id so a writer waiting for space can tell if it has gone away.
+ *
+ * This class only operates on a region mapped by its caller, which lets the
+ * tracer use DR's file mapping while the simulator uses the system's.
+ */
+
+#ifndef _SHM_RING_H_
+#define _SHM_RING_H_ 1
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+class shm_ring_t {
+public:
+    // The maximum number of simultaneously registered writer processes.
+    static const int MAX_WRITERS = 1024;
+
+    // Returns the path of the file backing the ring named "name", which follows
+    // the same conventions as the name of a named_pipe_t.
+    static std::string
+    get_path(const std::string &name)
+    {
+        if (!name.empty() && name[0] == '/')
+            return name;
+#ifdef LINUX
+        return "/dev/shm/" + name;
+#else
+        return "/tmp/" + name;
+#endif
+    }
+
+    // Returns the size of the region holding a ring with at least "capacity"
+    // bytes of record space.  The record space is rounded up to a power of two.
+    static size_t
+    get_region_size(size_t capacity)
+    {
+        return get_data_offset() + round_capacity(capacity);
+    }
+
+    // Sets up a new ring in "region", which must be zeroed and of
+    // get_region_size("capacity") bytes.  This is done once by the consumer,
+    // process "reader_pid".
+    static void
+    initialize(void *region, size_t capacity, int32_t reader_pid)
+    {
+        header_t *header = reinterpret_cast<header_t *>(region);
+        header->version = VERSION;
+        header->capacity = round_capacity(capacity);
+        header->reader.store(reader_pid, std::memory_order_relaxed);
+        header->magic.store(MAGIC, std::memory_order_release);
+    }
+
+    // Uses the ring in "region" of "size" bytes.  Returns false if the region
+    // does not hold an initialized ring.
+    bool
+    attach_region(void *region, size_t size)
+    {
+        header_t *header = reinterpret_cast<header_t *>(region);
+        if (size < get_data_offset() ||
+            header->magic.load(std::memory_order_acquire) != MAGIC ||
+            header->version != VERSION ||
+            get_data_offset() + header->capacity > size)
+            return false;
+        header_ = header;
+        data_ = reinterpret_cast<char *>(region) + get_data_offset();
+        capacity_ = header->capacity;
+        return true;
+    }
+
+    // The producer interface.
+
+    // Registers process "pid" as a writer.  A process re-registering under
+    // the same id, such as after an execve, reuses its prior slot.  Returns
+    // false if there are already MAX_WRITERS writers.
+    bool
+    add_writer(int32_t pid)
+    {
+        header_->had_writers.store(1, std::memory_order_release);
+        for (int i = 0; i < MAX_WRITERS; ++i) {
+            if (header_->writers[i].load(std::memory_order_acquire) == pid)
+                return true;
+        }
+        for (int i = 0; i < MAX_WRITERS; ++i) {
+            int32_t expected = 0;
+            if (header_->writers[i].compare_exchange_strong(expected, pid,
+                                                            std::memory_order_acq_rel))
+                return true;
+        }
+        return false;
+    }
+
+    // Unregisters process "pid".  All of its records must already be written.
+    void
+    remove_writer(int32_t pid)
+    {
+        for (int i = 0; i < MAX_WRITERS; ++i) {
+            int32_t expected = pid;
+            if (header_->writers[i].compare_exchange_strong(expected, 0,
+                                                            std::memory_order_acq_rel))
+                return;
+        }
+    }
+
+    // Returns the largest record payload that try_write() accepts.  Limiting
+    // records to half of the ring guarantees that any record fits once the
+    // consumer catches up, however the records before it were laid out.
+    size_t
+    get_max_record_size() const
+    {
+        return capacity_ / 2 - sizeof(record_header_t);
+    }
+
+    // Copies "size" bytes from "buf" into a new record.  Returns false if
+    // there is currently not enough free space.
+    bool
+    try_write(const void *buf, size_t size)
+    {
+        if (size == 0 || size > get_max_record_size())
+            return false;
+        uint64_t length = align_record(sizeof(record_header_t) + size);
+        uint64_t pos = header_->reserve_pos.load(std::memory_order_relaxed);
+        uint64_t pad;
+        do {
+            uint64_t offs = pos & (capacity_ - 1);
+            pad = offs + length > capacity_ ? capacity_ - offs : 0;
+            // The acquire pairs with the consumer's release of zeroed space.
+            if (pos + pad + length -
+                    header_->read_pos.load(std::memory_order_acquire) >
+                capacity_)
+                return false;
+        } while (!header_->reserve_pos.compare_exchange_weak(
+            pos, pos + pad + length, std::memory_order_relaxed));
+        if (pad > 0) {
+            record_header_t *padding = get_record(pos);
+            padding->payload = 0;
+            padding->length.store(static_cast<uint32_t>(pad), std::memory_order_release);
+            pos += pad;
+        }
+        record_header_t *record = get_record(pos);
+        record->payload = static_cast<uint32_t>(size);
+        memcpy(get_payload(record), buf, size);
+        record->length.store(static_cast<uint32_t>(length), std::memory_order_release);
+        return true;
+    }
+
+    // Returns the id of the consumer process, or 0 if it has closed the ring.
+    // A producer that cannot find space should check this periodically.
+    int32_t
+    get_reader() const
+    {
+        return header_->reader.load(std::memory_order_acquire);
+    }
+
+    // The consumer interface.
+
+    // Returns the next published record, with its size in "size", or nullptr
+    // if the next record has not been published yet.  The record stays valid
+    // until release() is called.
+    const void *
+    peek(size_t *size)
+    {
+        while (true) {
+            uint64_t pos = header_->read_pos.load(std::memory_order_relaxed);
+            record_header_t *record = get_record(pos);
+            uint32_t length = record->length.load(std::memory_order_acquire);
+            if (length == 0)
+                return nullptr;
+            if (record->payload != 0) {
+                *size = record->payload;
+                return get_payload(record);
+            }
+            // Padding: its body was zeroed when it last held records.
+            record->length.store(0, std::memory_order_relaxed);
+            header_->read_pos.store(pos + length, std::memory_order_release);
+        }
+    }
+
+    // Frees the record returned by the last peek().
+    void
+    release()
+    {
+        uint64_t pos = header_->read_pos.load(std::memory_order_relaxed);
+        record_header_t *record = get_record(pos);
+        uint32_t length = record->length.load(std::memory_order_relaxed);
+        memset(get_payload(record), 0, length - sizeof(*record));
+        record->payload = 0;
+        record->length.store(0, std::memory_order_relaxed);
+        header_->read_pos.store(pos + length, std::memory_order_release);
+    }
+
+    // Marks the ring as having no consumer.  No more records will be read.
+    void
+    remove_reader()
+    {
+        header_->reader.store(0, std::memory_order_release);
+    }
+
+    // Returns whether any writer has registered since the ring was initialized.
+    bool
+    had_writers() const
+    {
+        return header_->had_writers.load(std::memory_order_acquire) != 0;
+    }
+
+    // Returns the number of registered writers for which "is_alive" returns
+    // true, unregistering the rest.  Once this returns 0, a final peek() shows
+    // whether records remain, as they are published before their writer leaves.
+    template <typename alive_func_t>
+    int
+    count_live_writers(alive_func_t is_alive)
+    {
+        int count = 0;
+        for (int i = 0; i < MAX_WRITERS; ++i) {
+            int32_t pid = header_->writers[i].load(std::memory_order_acquire);
+            if (pid == 0)
+                continue;
+            if (is_alive(pid))
+                ++count;
+            else
+                header_->writers[i].compare_exchange_strong(pid, 0);
+        }
+        return count;
+    }
+
+private:
+    static const uint32_t MAGIC = 0x676e6972; // "ring"
+    static const uint32_t VERSION = 2;
+    static const size_t CACHE_LINE = 64;
+
+    struct header_t {
+        std::atomic<uint32_t> magic;
+        uint32_t version;
+        uint64_t capacity;
+        std::atomic<int32_t> reader;
+        alignas(CACHE_LINE) std::atomic<uint64_t> reserve_pos;
+        alignas(CACHE_LINE) std::atomic<uint64_t> read_pos;
+        alignas(CACHE_LINE) std::atomic<uint32_t> had_writers;
+        std::atomic<int32_t> writers[MAX_WRITERS];
+    };
+
+    // A length of 0 means not yet published; a payload of 0 means padding.
+    struct record_header_t {
+        std::atomic<uint32_t> length; // Including this header and alignment.
+        uint32_t payload;
+    };
+
+    static size_t
+    get_data_offset()
+    {
+        return (sizeof(header_t) + CACHE_LINE - 1) & ~(CACHE_LINE - 1);
+    }
+
+    static size_t
+    round_capacity(size_t capacity)
+    {
+        size_t rounded = 4096;
+        while (rounded < capacity)
+            rounded <<= 1;
+        return rounded;
+    }
+
+    static uint64_t
+    align_record(uint64_t size)
+    {
+        return (size + sizeof(record_header_t) - 1) & ~(sizeof(record_header_t) - 1);
+    }
+
+    record_header_t *
+    get_record(uint64_t pos)
+    {
+        return reinterpret_cast<record_header_t *>(data_ + (pos & (capacity_ - 1)));
+    }
+
+    static char *
+    get_payload(record_header_t *record)
+    {
+        return reinterpret_cast<char *>(record) + sizeof(*record);
+    }
+
+    header_t *header_ = nullptr;
+    char *data_ = nullptr;
+    uint64_t capacity_ = 0;
+};
+
+#endif /* _SHM_RING_H_ */
@@ -0,0 +1,220 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* trace_chunk_index: the random-access index that chunked_gzip_ostream_t appends
+ * to a final trace file, along with the routines its writer and readers share.
+ *
+ * An indexed file is a series of gzip members, each holding a chunk of whole
+ * trace entries that starts at an instruction fetch, where reader_t carries no
+ * state over from earlier entries of the thread.  gzip readers decompress
+ * concatenated members as a single stream, so an indexed file is still an
+ * ordinary compressed trace.  The index follows the last chunk as empty gzip
+ * members whose FEXTRA fields hold trace_chunk_t records, and the file ends
+ * with one more empty member of fixed size whose FEXTRA field holds a
+ * trace_chunk_footer_t locating the index.
+ */
+
+#ifndef _TRACE_CHUNK_INDEX_H_
+#define _TRACE_CHUNK_INDEX_H_ 1
+
+#include <stdint.h>
+#include <string.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "trace_entry.h"
+
+// The index record for one chunk.  The counts cover everything before the chunk.
+struct trace_chunk_t {
+    uint64_t offset;         // File offset of the chunk's gzip member.
+    uint64_t entry_ordinal;  // Count of trace entries.
+    uint64_t memref_ordinal; // Count of memrefs presented by reader_t.
+    uint64_t instr_count;    // Count of instructions.
+    uint64_t timestamp;      // The last timestamp value, or 0 if none.
+};
+
+struct trace_chunk_footer_t {
+    uint64_t index_offset; // File offset of the first index member.
+    uint32_t num_chunks;
+    uint32_t version;
+};
+
+#define TRACE_CHUNK_INDEX_VERSION 1
+
+// The FEXTRA subfield identifiers.  They share the first byte.
+#define TRACE_CHUNK_SUBFIELD_ID 'D'
+#define TRACE_CHUNK_SUBFIELD_INDEX 'I'
+#define TRACE_CHUNK_SUBFIELD_FOOTER 'F'
+
+// An empty gzip member with one FEXTRA subfield consists of the 10-byte member
+// header, the 2-byte FEXTRA length, the 4-byte subfield header, the subfield
+// data, a 2-byte empty final deflate block, and the 8-byte CRC and length.
+#define TRACE_CHUNK_MEMBER_OVERHEAD (10 + 2 + 4 + 2 + 8)
+#define TRACE_CHUNK_FOOTER_MEMBER_SIZE \
+    (TRACE_CHUNK_MEMBER_OVERHEAD + sizeof(trace_chunk_footer_t))
+// The FEXTRA length is 16 bits and includes the subfield header.
+#define TRACE_CHUNK_RECORDS_PER_MEMBER ((0xffff - 4) / sizeof(trace_chunk_t))
+
+// Returns the number of memrefs reader_t presents for "entry".
+static inline uint64_t
+trace_chunk_entry_memrefs(const trace_entry_t &entry)
+{
+    trace_type_t type = static_cast<trace_type_t>(entry.type);
+    if (type_is_instr(type) || type == TRACE_TYPE_INSTR_NO_FETCH ||
+        type == TRACE_TYPE_INSTR_MAYBE_FETCH)
+        return entry.size != 0 ? 1 : 0;
+    switch (type) {
+    case TRACE_TYPE_INSTR_BUNDLE: return entry.size;
+    case TRACE_TYPE_INSTR_FLUSH:
+    case TRACE_TYPE_DATA_FLUSH: return entry.size != 0 ? 1 : 0;
+    case TRACE_TYPE_HEADER:
+    case TRACE_TYPE_FOOTER:
+    case TRACE_TYPE_THREAD:
+    case TRACE_TYPE_PID: return 0;
+    default: return 1;
+    }
+}
+
+// Returns the number of instructions in "entry".
+static inline uint64_t
+trace_chunk_entry_instrs(const trace_entry_t &entry)
+{
+    trace_type_t type = static_cast<trace_type_t>(entry.type);
+    if (type_is_instr(type) || type == TRACE_TYPE_INSTR_NO_FETCH ||
+        type == TRACE_TYPE_INSTR_MAYBE_FETCH)
+        return entry.size != 0 ? 1 : 0;
+    if (type == TRACE_TYPE_INSTR_BUNDLE)
+        return entry.size;
+    return 0;
+}
+
+// Returns whether a chunk may start with "entry": reader_t derives nothing
+// for it or for the entries after it from anything earlier in the thread.
+static inline bool
+trace_chunk_can_start(const trace_entry_t &entry)
+{
+    trace_type_t type = static_cast<trace_type_t>(entry.type);
+    return (type_is_instr(type) || type == TRACE_TYPE_INSTR_NO_FETCH) && entry.size != 0;
+}
+
+// Writes an empty gzip member whose FEXTRA field holds a single subfield with
+// identifier "id" and contents "data".  Returns the number of bytes written.
+static inline size_t
+trace_chunk_write_member(std::ostream &out, char id, const void *data, uint16_t size)
+{
+    const uint16_t xlen = 4 + size;
+    const unsigned char header[] = {
+        0x1f, 0x8b, 8 /*deflate*/, 4 /*FEXTRA*/, 0, 0, 0, 0 /*mtime*/, 0, 0xff /*os*/,
+        static_cast<unsigned char>(xlen & 0xff), static_cast<unsigned char>(xlen >> 8),
+        TRACE_CHUNK_SUBFIELD_ID, static_cast<unsigned char>(id),
+        static_cast<unsigned char>(size & 0xff), static_cast<unsigned char>(size >> 8),
+    };
+    // An empty final fixed-Huffman block, then the zero CRC and length.
+    const unsigned char trailer[] = { 3, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    out.write(reinterpret_cast<const char *>(header), sizeof(header));
+    out.write(static_cast<const char *>(data), size);
+    out.write(reinterpret_cast<const char *>(trailer), sizeof(trailer));
+    return sizeof(header) + size + sizeof(trailer);
+}
+
+// Parses a member written by trace_chunk_write_member() with identifier "id"
+// from the "avail" bytes at "buf".  Returns the member's size, or 0 if "buf"
+// does not start with such a member.
+static inline size_t
+trace_chunk_parse_member(const unsigned char *buf, size_t avail, char id,
+                         const unsigned char **data, uint16_t *size)
+{
+    if (avail < TRACE_CHUNK_MEMBER_OVERHEAD || buf[0] != 0x1f || buf[1] != 0x8b ||
+        buf[2] != 8 || buf[3] != 4 || buf[12] != TRACE_CHUNK_SUBFIELD_ID ||
+        buf[13] != static_cast<unsigned char>(id))
+        return 0;
+    const uint16_t xlen = buf[10] | (buf[11] << 8);
+    *size = buf[14] | (buf[15] << 8);
+    const size_t member_size = TRACE_CHUNK_MEMBER_OVERHEAD + static_cast<size_t>(*size);
+    if (xlen != 4 + *size || avail < member_size)
+        return 0;
+    *data = buf + 16;
+    return member_size;
+}
+
+// Reads the index of the trace file at "path" into "chunks".  Returns false if
+// the file has no index.
+static inline bool
+trace_chunk_read_index(const std::string &path, std::vector<trace_chunk_t> *chunks)
+{
+    std::ifstream file(path, std::ifstream::binary);
+    if (!file || !file.seekg(0, std::ios::end))
+        return false;
+    const uint64_t file_size = static_cast<uint64_t>(file.tellg());
+    if (file_size < TRACE_CHUNK_FOOTER_MEMBER_SIZE)
+        return false;
+    unsigned char tail[TRACE_CHUNK_FOOTER_MEMBER_SIZE];
+    if (!file.seekg(file_size - sizeof(tail)) ||
+        !file.read(reinterpret_cast<char *>(tail), sizeof(tail)))
+        return false;
+    const unsigned char *data;
+    uint16_t size;
+    trace_chunk_footer_t footer;
+    if (trace_chunk_parse_member(tail, sizeof(tail), TRACE_CHUNK_SUBFIELD_FOOTER, &data,
+                                 &size) == 0 ||
+        size != sizeof(footer))
+        return false;
+    memcpy(&footer, data, sizeof(footer));
+    if (footer.version != TRACE_CHUNK_INDEX_VERSION ||
+        footer.index_offset > file_size - sizeof(tail))
+        return false;
+    std::vector<unsigned char> buf(
+        static_cast<size_t>(file_size - sizeof(tail) - footer.index_offset));
+    if (!file.seekg(footer.index_offset) ||
+        !file.read(reinterpret_cast<char *>(buf.data()), buf.size()))
+        return false;
+    chunks->clear();
+    chunks->reserve(footer.num_chunks);
+    size_t pos = 0;
+    while (pos < buf.size()) {
+        size_t member_size =
+            trace_chunk_parse_member(buf.data() + pos, buf.size() - pos,
+                                     TRACE_CHUNK_SUBFIELD_INDEX, &data, &size);
+        if (member_size == 0 || size % sizeof(trace_chunk_t) != 0)
+            return false;
+        for (size_t i = 0; i < size; i += sizeof(trace_chunk_t)) {
+            trace_chunk_t chunk;
+            memcpy(&chunk, data + i, sizeof(chunk));
+            chunks->push_back(chunk);
+        }
+        pos += member_size;
+    }
+    return chunks->size() == footer.num_chunks;
+}
+
+#endif /* _TRACE_CHUNK_INDEX_H_ */
@@ -30,13 +30,65 @@
  * DAMAGE.
  */
 
+#include <fcntl.h>
+#include <algorithm>
+#ifdef WINDOWS
+#    include <io.h>
+#else
+#    include <unistd.h>
+#endif
 #include "compressed_file_reader.h"
 
+static read_ahead_stream_t *
+create_read_ahead(gzFile file, int chunks)
+{
+    return new read_ahead_stream_t(
+        [file](char *buf, size_t size) {
+            return gzread(file, buf, static_cast<unsigned int>(size));
+        },
+        chunks);
+}
+
+// Opens "path" for reading starting at the gzip member at "offset".
+static gzFile
+open_at_member(const std::string &path, uint64_t offset)
+{
+#ifdef WINDOWS
+    int fd = _open(path.c_str(), _O_RDONLY | _O_BINARY);
+    if (fd < 0)
+        return nullptr;
+    if (_lseeki64(fd, offset, SEEK_SET) != static_cast<__int64>(offset)) {
+        _close(fd);
+        return nullptr;
+    }
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    if (lseek(fd, offset, SEEK_SET) != static_cast<off_t>(offset)) {
+        close(fd);
+        return nullptr;
+    }
+#endif
+    // zlib starts reading from the descriptor's current position.
+    gzFile file = gzdopen(fd, "rb");
+    if (file == nullptr) {
+#ifdef WINDOWS
+        _close(fd);
+#else
+        close(fd);
+#endif
+    }
+    return file;
+}
+
 /* clang-format off */ /* (make vera++ newline-after-type check happy) */
 template <>
 /* clang-format on */
 file_reader_t<gzFile>::~file_reader_t<gzFile>()
 {
+    // Stop any in-flight read-ahead before closing the files underneath it.
+    read_ahead_.clear();
     for (auto file : input_files_)
         gzclose(file);
     delete[] thread_eof_;
@@ -50,7 +102,11 @@ file_reader_t<gzFile>::open_single_file(const std::string &path)
     if (file == nullptr)
         return false;
     VPRINT(this, 1, "Opened input file %s\n", path.c_str());
+    if (input_files_.empty())
+        first_path_ = path;
     input_files_.push_back(file);
+    if (prefetch_chunks_ > 0)
+        read_ahead_.emplace_back(create_read_ahead(file, prefetch_chunks_));
     return true;
 }
 
@@ -59,11 +115,19 @@ bool
 file_reader_t<gzFile>::read_next_thread_entry(size_t thread_index,
                                               OUT trace_entry_t *entry, OUT bool *eof)
 {
-    int len = gzread(input_files_[thread_index], (char *)entry, sizeof(*entry));
-    // Returns less than asked-for for end of file, or –1 for error.
-    if (len < (int)sizeof(*entry)) {
-        *eof = (len >= 0);
-        return false;
+    if (!read_ahead_.empty()) {
+        int len = read_ahead_[thread_index]->read(sizeof(*entry), entry);
+        if (len < (int)sizeof(*entry)) {
+            *eof = read_ahead_[thread_index]->eof();
+            return false;
+        }
+    } else {
+        int len = gzread(input_files_[thread_index], (char *)entry, sizeof(*entry));
+        // Returns less than asked-for for end of file, or –1 for error.
+        if (len < (int)sizeof(*entry)) {
+            *eof = (len >= 0);
+            return false;
+        }
     }
     VPRINT(this, 4, "Read from thread #%zd file: type=%d, size=%d, addr=%zu\n",
            thread_index, entry->type, entry->size, entry->addr);
@@ -81,3 +145,46 @@ file_reader_t<gzFile>::is_complete()
     // XXX: Should we just remove this interface, then?
     return false;
 }
+
+template <>
+bool
+file_reader_t<gzFile>::seek_to_memref(uint64_t current, uint64_t target,
+                                      OUT uint64_t *ordinal)
+{
+    // With multiple inputs the interleaving depends on the timestamps in every
+    // input, and we must already be reading the input directly rather than its
+    // queued header entries.
+    if (input_files_.size() != 1 || index_ != 0 || !queues_[0].empty())
+        return false;
+    if (!chunks_loaded_) {
+        chunks_loaded_ = true;
+        if (!trace_chunk_read_index(first_path_, &chunks_)) {
+            VPRINT(this, 1, "No chunk index in %s\n", first_path_.c_str());
+            chunks_.clear();
+        }
+    }
+    // Find the last chunk that starts before "target".
+    auto it = std::upper_bound(chunks_.begin(), chunks_.end(), target - 1,
+                               [](uint64_t value, const trace_chunk_t &chunk) {
+                                   return value < chunk.memref_ordinal;
+                               });
+    if (it == chunks_.begin())
+        return false;
+    --it;
+    if (it->memref_ordinal <= current)
+        return false;
+    gzFile file = open_at_member(first_path_, it->offset);
+    if (file == nullptr)
+        return false;
+    VPRINT(this, 1, "Seeking to chunk at offset %llu of %s\n",
+           static_cast<unsigned long long>(it->offset), first_path_.c_str());
+    // Stop any in-flight read-ahead before closing the file underneath it.
+    if (!read_ahead_.empty())
+        read_ahead_[0].reset();
+    gzclose(input_files_[0]);
+    input_files_[0] = file;
+    if (!read_ahead_.empty())
+        read_ahead_[0].reset(create_read_ahead(file, prefetch_chunks_));
+    *ordinal = it->memref_ordinal;
+    return true;
+}
@@ -109,3 +109,12 @@ file_reader_t<std::ifstream *>::is_complete()
     }
     return res;
 }
+
+template <>
+bool
+file_reader_t<std::ifstream *>::seek_to_memref(uint64_t current, uint64_t target,
+                                               OUT uint64_t *ordinal)
+{
+    // Uncompressed files carry no chunk index.
+    return false;
+}
@@ -40,11 +40,16 @@
 
 #include <string.h>
 #include <fstream>
+#include <functional>
+#include <memory>
 #include <queue>
+#include <utility>
 #include <vector>
 #include "reader.h"
 #include "memref.h"
 #include "directory_iterator.h"
+#include "read_ahead.h"
+#include "trace_chunk_index.h"
 #include "trace_entry.h"
 
 #ifndef ZHEX64_FORMAT_STRING
@@ -99,11 +104,40 @@ public:
     virtual bool
     is_complete();
 
+    // Requests that decompression of each input file run ahead of the consumer
+    // on helper threads by up to "chunks" chunks of read_ahead_stream_t::chunk_size_
+    // bytes each.  Must be called before init().  This is only supported for
+    // compressed inputs and is ignored for other types.
+    void
+    set_prefetch_chunks(int chunks)
+    {
+        prefetch_chunks_ = chunks;
+    }
+
+    uint64_t
+    skip_memrefs(uint64_t count) override
+    {
+        // The entries queued by open_input_files() are presented normally, as
+        // they set up the thread state that a seek would otherwise bypass.
+        uint64_t skipped = 0;
+        while (skipped < count && !at_eof_ &&
+               (index_ >= input_files_.size() || !queues_[index_].empty())) {
+            ++*this;
+            ++skipped;
+        }
+        return skipped + reader_t::skip_memrefs(count - skipped);
+    }
+
 protected:
     bool
     read_next_thread_entry(size_t thread_index, OUT trace_entry_t *entry,
                            OUT bool *eof) override;
 
+    // Only inputs with a chunk index (see trace_chunk_index.h) support this, and
+    // only when there is a single input.
+    bool
+    seek_to_memref(uint64_t current, uint64_t target, OUT uint64_t *ordinal) override;
+
     virtual bool
     open_single_file(const std::string &path);
 
@@ -155,7 +189,8 @@ protected:
         queues_.resize(input_files_.size());
         tids_.resize(input_files_.size());
         timestamps_.resize(input_files_.size());
-        times_.resize(input_files_.size(), 0);
+        times_ = timestamp_heap_t();
+        need_initial_times_ = true;
         // We can't take the address of a vector<bool> element so we use a raw array.
         thread_eof_ = new bool[input_files_.size()];
         memset(thread_eof_, 0, input_files_.size() * sizeof(*thread_eof_));
@@ -212,15 +247,16 @@ protected:
     {
         // We read the thread files simultaneously in lockstep and merge them into
         // a single interleaved stream in timestamp order.
-        // When a thread file runs out we leave its times_[] entry as 0 and its file at
-        // eof.
+        // Each thread not currently being processed and not at eof has its next
+        // timestamp in the times_ min-heap, so picking the next thread costs
+        // O(log threads) rather than a scan over every thread.
         while (thread_count_ > 0) {
             if (index_ >= input_files_.size()) {
-                // Pick the next thread by looking for the smallest timestamp.
-                uint64_t min_time = 0xffffffffffffffff;
-                size_t next_index = 0;
-                for (size_t i = 0; i < times_.size(); ++i) {
-                    if (times_[i] == 0 && !thread_eof_[i]) {
+                if (need_initial_times_) {
+                    need_initial_times_ = false;
+                    for (size_t i = 0; i < input_files_.size(); ++i) {
+                        if (thread_eof_[i])
+                            continue;
                         if (!read_next_thread_entry(i, &timestamps_[i],
                                                     &thread_eof_[i])) {
                             ERRMSG("Failed to read from input file #%zu\n", i);
@@ -231,22 +267,24 @@ protected:
                             ERRMSG("Missing timestamp entry in input file #%zu\n", i);
                             return nullptr;
                         }
-                        times_[i] = timestamps_[i].addr;
                         VPRINT(this, 3,
                                "Thread #%zu timestamp is @0x" ZHEX64_FORMAT_STRING "\n",
-                               i, times_[i]);
-                    }
-                    if (times_[i] != 0 && times_[i] < min_time) {
-                        min_time = times_[i];
-                        next_index = i;
+                               i, (uint64_t)timestamps_[i].addr);
+                        times_.push(std::make_pair(
+                            static_cast<uint64_t>(timestamps_[i].addr), i));
                     }
                 }
+                if (times_.empty()) {
+                    ERRMSG("No thread has a pending timestamp\n");
+                    return nullptr;
+                }
+                // Ties go to the lowest thread index, via the pair ordering.
+                index_ = times_.top().second;
                 VPRINT(this, 2,
                        "Next thread in timestamp order is #%zu @0x" ZHEX64_FORMAT_STRING
                        "\n",
-                       next_index, times_[next_index]);
-                index_ = next_index;
-                times_[index_] = 0; // Read from file for this thread's next timestamp.
+                       index_, times_.top().first);
+                times_.pop();
                 // If the queue is not empty, it should contain the initial tid;pid.
                 if ((queues_[index_].empty() ||
                      queues_[index_].front().type != TRACE_TYPE_THREAD) &&
@@ -271,8 +309,7 @@ protected:
                         at_eof_ = true;
                         break;
                     }
-                    times_[index_] = 0;
-                    index_ = input_files_.size(); // Request thread scan.
+                    index_ = input_files_.size(); // Request thread selection.
                     continue;
                 } else {
                     ERRMSG("Failed to read from input file #%zu\n", index_);
@@ -283,9 +320,10 @@ protected:
                 entry_copy_.size == TRACE_MARKER_TYPE_TIMESTAMP) {
                 VPRINT(this, 3, "Thread #%zu timestamp 0x" ZHEX64_FORMAT_STRING "\n",
                        index_, (uint64_t)entry_copy_.addr);
-                times_[index_] = entry_copy_.addr;
+                times_.push(
+                    std::make_pair(static_cast<uint64_t>(entry_copy_.addr), index_));
                 timestamps_[index_] = entry_copy_;
-                index_ = input_files_.size(); // Request thread scan.
+                index_ = input_files_.size(); // Request thread selection.
                 continue;
             }
             return &entry_copy_;
@@ -294,6 +332,12 @@ protected:
     }
 
 private:
+    // A min-heap of (next timestamp, thread index).
+    typedef std::priority_queue<std::pair<uint64_t, size_t>,
+                                std::vector<std::pair<uint64_t, size_t>>,
+                                std::greater<std::pair<uint64_t, size_t>>>
+        timestamp_heap_t;
+
     std::string input_path_;
     std::vector<std::string> input_path_list_;
     std::vector<T> input_files_;
@@ -305,8 +349,18 @@ private:
     std::vector<std::queue<trace_entry_t>> queues_;
     std::vector<trace_entry_t> tids_;
     std::vector<trace_entry_t> timestamps_;
-    std::vector<uint64_t> times_;
+    timestamp_heap_t times_;
+    bool need_initial_times_ = true;
     bool *thread_eof_ = nullptr;
+    int prefetch_chunks_ = 0;
+    // If prefetch_chunks_ is non-zero, these parallel input_files_ for input types
+    // that support read-ahead.  They must be destroyed before input_files_.
+    std::vector<std::unique_ptr<read_ahead_stream_t>> read_ahead_;
+    // The path and, once seek_to_memref() first needs it, the chunk index of the
+    // first input file, for input types that support seeking.
+    std::string first_path_;
+    bool chunks_loaded_ = false;
+    std::vector<trace_chunk_t> chunks_;
 };
 
 #endif /* _FILE_READER_H_ */
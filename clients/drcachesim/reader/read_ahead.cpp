@@ -0,0 +1,204 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <string.h>
+#include <algorithm>
+#include "read_ahead.h"
+
+std::shared_ptr<read_ahead_pool_t>
+read_ahead_pool_t::acquire()
+{
+    static std::mutex pool_lock;
+    static std::weak_ptr<read_ahead_pool_t> shared_pool;
+    std::lock_guard<std::mutex> guard(pool_lock);
+    std::shared_ptr<read_ahead_pool_t> pool = shared_pool.lock();
+    if (!pool) {
+        // Decompression is CPU-bound so we match the hardware thread count.
+        int num_threads = static_cast<int>(std::thread::hardware_concurrency());
+        pool = std::make_shared<read_ahead_pool_t>(std::max(num_threads, 1));
+        shared_pool = pool;
+    }
+    return pool;
+}
+
+read_ahead_pool_t::read_ahead_pool_t(int num_threads)
+{
+    threads_.reserve(num_threads);
+    for (int i = 0; i < num_threads; ++i)
+        threads_.emplace_back(std::thread(&read_ahead_pool_t::worker, this));
+}
+
+read_ahead_pool_t::~read_ahead_pool_t()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        exiting_ = true;
+    }
+    cond_.notify_all();
+    for (std::thread &thread : threads_)
+        thread.join();
+}
+
+void
+read_ahead_pool_t::schedule(read_ahead_stream_t *stream)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        queue_.push_back(stream);
+    }
+    cond_.notify_one();
+}
+
+void
+read_ahead_pool_t::worker()
+{
+    while (true) {
+        read_ahead_stream_t *stream;
+        {
+            std::unique_lock<std::mutex> guard(lock_);
+            cond_.wait(guard, [this] { return exiting_ || !queue_.empty(); });
+            // Streams hold a reference to the pool, so once we are exiting there
+            // can be no queued work left.
+            if (queue_.empty())
+                return;
+            stream = queue_.front();
+            queue_.pop_front();
+        }
+        // We fill a single chunk and then requeue the stream at the back, so that
+        // one fast-draining input cannot starve the others.
+        stream->fill_next_chunk();
+    }
+}
+
+const size_t read_ahead_stream_t::chunk_size_;
+
+read_ahead_stream_t::read_ahead_stream_t(fill_func_t fill, int num_chunks)
+    : fill_(fill)
+    , pool_(read_ahead_pool_t::acquire())
+    , chunks_(std::max(num_chunks, 1))
+{
+    for (chunk_t &chunk : chunks_) {
+        chunk.data.resize(chunk_size_);
+        free_.push_back(&chunk);
+    }
+}
+
+read_ahead_stream_t::~read_ahead_stream_t()
+{
+    // Wait for any in-flight fill, which references our chunks and fill_.
+    std::unique_lock<std::mutex> guard(lock_);
+    closing_ = true;
+    cond_.wait(guard, [this] { return !fill_pending_; });
+}
+
+void
+read_ahead_stream_t::maybe_schedule()
+{
+    if (fill_pending_ || input_done_ || closing_ || free_.empty())
+        return;
+    fill_pending_ = true;
+    pool_->schedule(this);
+}
+
+void
+read_ahead_stream_t::fill_next_chunk()
+{
+    chunk_t *chunk;
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (closing_ || free_.empty()) {
+            fill_pending_ = false;
+            cond_.notify_all();
+            return;
+        }
+        chunk = free_.front();
+        free_.pop_front();
+    }
+    // The fill runs unlocked so the consumer can drain other chunks meanwhile.
+    chunk->length = fill_(chunk->data.data(), chunk_size_);
+    std::lock_guard<std::mutex> guard(lock_);
+    filled_.push_back(chunk);
+    if (chunk->length < static_cast<int>(chunk_size_))
+        input_done_ = true;
+    fill_pending_ = false;
+    maybe_schedule();
+    // We notify while holding the lock as the destructor may be waiting and we
+    // must not touch cond_ once it can proceed.
+    cond_.notify_all();
+}
+
+int
+read_ahead_stream_t::read(size_t size, void *to)
+{
+    char *to_buf = static_cast<char *>(to);
+    size_t to_read = size;
+    while (to_read > 0) {
+        if (cur_ != nullptr && cur_pos_ < cur_->length) {
+            size_t will_read = std::min(static_cast<size_t>(cur_->length - cur_pos_),
+                                        to_read);
+            memcpy(to_buf, cur_->data.data() + cur_pos_, will_read);
+            cur_pos_ += static_cast<int>(will_read);
+            to_buf += will_read;
+            to_read -= will_read;
+            continue;
+        }
+        if (at_eof_ || error_)
+            break;
+        std::unique_lock<std::mutex> guard(lock_);
+        if (cur_ != nullptr) {
+            // A short chunk marks the end of the input.
+            if (cur_->length < static_cast<int>(chunk_size_)) {
+                if (cur_->length < 0)
+                    error_ = true;
+                else
+                    at_eof_ = true;
+                break;
+            }
+            free_.push_back(cur_);
+            cur_ = nullptr;
+        }
+        maybe_schedule();
+        cond_.wait(guard, [this] { return !filled_.empty(); });
+        cur_ = filled_.front();
+        filled_.pop_front();
+        cur_pos_ = 0;
+        // Queue the next fill right away now that this chunk is ours.
+        maybe_schedule();
+    }
+    return static_cast<int>(size - to_read);
+}
+
+bool
+read_ahead_stream_t::eof()
+{
+    return at_eof_;
+}
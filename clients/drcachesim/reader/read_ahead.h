@@ -0,0 +1,138 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* read_ahead: moves decompression of trace input off of the analysis thread.
+ * A read_ahead_stream_t wraps a function that produces the next bytes of a
+ * decompressed input and keeps a small ring of chunks filled ahead of the
+ * consumer using a pool of helper threads shared by all streams in the process.
+ */
+
+#ifndef _READ_AHEAD_H_
+#define _READ_AHEAD_H_ 1
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class read_ahead_stream_t;
+
+// The helper threads that fill read_ahead_stream_t chunks.  A single pool is
+// shared by all live streams and is torn down when the last stream goes away.
+class read_ahead_pool_t {
+public:
+    static std::shared_ptr<read_ahead_pool_t>
+    acquire();
+
+    explicit read_ahead_pool_t(int num_threads);
+    ~read_ahead_pool_t();
+
+    // Queues "stream" for one chunk fill.
+    void
+    schedule(read_ahead_stream_t *stream);
+
+private:
+    void
+    worker();
+
+    std::mutex lock_; // Protects all fields below.
+    std::condition_variable cond_;
+    std::deque<read_ahead_stream_t *> queue_;
+    bool exiting_ = false;
+    std::vector<std::thread> threads_;
+};
+
+class read_ahead_stream_t {
+public:
+    // The fill function writes up to "size" bytes to "buf" and returns the count
+    // written.  A count below "size" indicates the end of the input, and a
+    // negative count indicates an error.  It is invoked on a helper thread, but
+    // never concurrently with itself for the same stream.
+    typedef std::function<int(char *buf, size_t size)> fill_func_t;
+
+    // Filling does not start until the first read(), so the fill function may
+    // refer to state that is still being set up when the stream is created.
+    read_ahead_stream_t(fill_func_t fill, int num_chunks);
+    ~read_ahead_stream_t();
+
+    // Copies up to "size" bytes into "to" and returns the number copied, which is
+    // below "size" only at the end of the input or on an error.
+    int
+    read(size_t size, void *to);
+
+    // Returns whether all input has been consumed without error.
+    bool
+    eof();
+
+    // The unit of decompression handed to the fill function.
+    static const size_t chunk_size_ = 64 * 1024;
+
+private:
+    friend class read_ahead_pool_t;
+
+    struct chunk_t {
+        std::vector<char> data;
+        int length = 0;
+    };
+
+    // Called by the pool to fill the next free chunk.
+    void
+    fill_next_chunk();
+
+    // Requests another fill if there is room and no fill is in flight.
+    // The caller must hold lock_.
+    void
+    maybe_schedule();
+
+    fill_func_t fill_;
+    std::shared_ptr<read_ahead_pool_t> pool_;
+    std::vector<chunk_t> chunks_;
+
+    std::mutex lock_; // Protects all fields below.
+    std::condition_variable cond_;
+    std::deque<chunk_t *> free_;
+    std::deque<chunk_t *> filled_;
+    bool fill_pending_ = false;
+    bool input_done_ = false;
+    bool closing_ = false;
+
+    // Only accessed by the consumer.
+    chunk_t *cur_ = nullptr;
+    int cur_pos_ = 0;
+    bool at_eof_ = false;
+    bool error_ = false;
+};
+
+#endif /* _READ_AHEAD_H_ */
@@ -226,9 +226,30 @@ reader_t::operator++()
             at_eof_ = true; // bail
             break;
         }
-        if (have_memref)
+        if (have_memref) {
+            ++memref_count_;
             break;
+        }
     }
 
     return *this;
 }
+
+uint64_t
+reader_t::skip_memrefs(uint64_t count)
+{
+    const uint64_t start = memref_count_;
+    const uint64_t target = start + count;
+    uint64_t ordinal;
+    // We cannot leave the middle of an instruction bundle.
+    if (count > 0 && !at_eof_ && bundle_idx_ == 0 &&
+        seek_to_memref(memref_count_, target, &ordinal)) {
+        VPRINT(this, 2, "Seeked from memref #%llu to #%llu\n",
+               static_cast<unsigned long long>(memref_count_),
+               static_cast<unsigned long long>(ordinal));
+        memref_count_ = ordinal;
+    }
+    while (memref_count_ < target && !at_eof_)
+        ++*this;
+    return memref_count_ - start;
+}
@@ -97,6 +97,12 @@ public:
     virtual reader_t &
     operator++();
 
+    // Advances past the next "count" memrefs, as though operator++ were invoked
+    // "count" times.  Returns the number skipped, which is less than "count" only
+    // if the end of the trace was reached.
+    virtual uint64_t
+    skip_memrefs(uint64_t count);
+
     // Supplied for subclasses that may fail in their constructors.
     virtual bool operator!()
     {
@@ -120,6 +126,16 @@ protected:
     virtual bool
     read_next_thread_entry(size_t thread_index, OUT trace_entry_t *entry,
                            OUT bool *eof) = 0;
+    // Repositions the input, without reading the entries in between, at a point
+    // past "current" and before "target" memrefs into the trace, where "current"
+    // is the number presented so far.  Returns false if the input
+    // cannot do so; else sets *ordinal to the number of memrefs that precede the
+    // new position.
+    virtual bool
+    seek_to_memref(uint64_t current, uint64_t target, OUT uint64_t *ordinal)
+    {
+        return false;
+    }
 
     // Following typical stream iterator convention, the default constructor
     // produces an EOF object.
@@ -140,6 +156,8 @@ private:
     addr_t next_pc_;
     addr_t prev_instr_addr_ = 0;
     int bundle_idx_ = 0;
+    // The number of memrefs presented, including cur_ref_.
+    uint64_t memref_count_ = 0;
     std::unordered_map<memref_tid_t, memref_pid_t> tid2pid_;
 };
 
@@ -0,0 +1,228 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include "shm_ring_reader.h"
+
+// How many times we poll an empty ring before we start yielding and then
+// sleeping.
+#define SPIN_COUNT 1024
+#define YIELD_COUNT 64
+#define MAX_SLEEP_US 1000
+// How long the ring must stay empty with no writers before we consider the
+// trace complete.  A forked child registers itself shortly after it starts, so
+// this covers a parent exiting before its child has done so.
+// XXX: Have the parent register the child instead to remove this window.
+#define FINAL_GRACE_US 200000
+
+shm_ring_reader_t::shm_ring_reader_t()
+{
+    /* Empty. */
+}
+
+shm_ring_reader_t::shm_ring_reader_t(const char *ipc_name, uint64_t capacity,
+                                     int verbosity)
+    : reader_t(verbosity, "SHM")
+    , path_(shm_ring_t::get_path(ipc_name))
+{
+    // As with ipc_reader_t, we create the ring here so the user can set up the
+    // writers *before* calling the blocking analyzer_t::run().
+    umask(0);
+    fd_ = open(path_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+    if (fd_ < 0)
+        return;
+    region_size_ = shm_ring_t::get_region_size(static_cast<size_t>(capacity));
+    if (ftruncate(fd_, region_size_) != 0)
+        return;
+    void *map = mmap(nullptr, region_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (map == MAP_FAILED)
+        return;
+    region_ = map;
+    shm_ring_t::initialize(region_, static_cast<size_t>(capacity), getpid());
+    creation_success_ = ring_.attach_region(region_, region_size_);
+}
+
+// Work around clang-format bug: no newline after return type for single-char operator.
+// clang-format off
+bool
+shm_ring_reader_t::operator!()
+// clang-format on
+{
+    return !creation_success_;
+}
+
+std::string
+shm_ring_reader_t::get_ring_path() const
+{
+    return path_;
+}
+
+bool
+shm_ring_reader_t::init()
+{
+    at_eof_ = false;
+    if (!creation_success_)
+        return false;
+    buf_.resize(1);
+    cur_buf_ = buf_.data();
+    end_buf_ = buf_.data();
+    ++*this;
+    return true;
+}
+
+shm_ring_reader_t::~shm_ring_reader_t()
+{
+    if (creation_success_) {
+        // Release any writer still waiting for space.
+        ring_.remove_reader();
+    }
+    if (region_ != nullptr)
+        munmap(region_, region_size_);
+    if (fd_ >= 0) {
+        close(fd_);
+        unlink(path_.c_str());
+    }
+}
+
+static bool
+is_process_alive(int32_t pid)
+{
+    if (kill(pid, 0) != 0 && errno != EPERM)
+        return false;
+#ifdef LINUX
+    // A writer that died without unregistering may linger as a zombie until our
+    // launcher reaps it, which is only after we are done.
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE *file = fopen(path, "r");
+    if (file == nullptr)
+        return true;
+    char stat[512];
+    size_t len = fread(stat, 1, sizeof(stat) - 1, file);
+    fclose(file);
+    stat[len] = '\0';
+    // The state follows the parenthesized command name.
+    const char *state = strrchr(stat, ')');
+    if (state != nullptr && state[1] == ' ' && (state[2] == 'Z' || state[2] == 'X'))
+        return false;
+#endif
+    return true;
+}
+
+bool
+shm_ring_reader_t::read_next_record()
+{
+    int polls = 0;
+    int sleep_us = 1;
+    int idle_us = 0;
+    while (true) {
+        size_t size;
+        const void *record = ring_.peek(&size);
+        if (record != nullptr) {
+            if (size % sizeof(trace_entry_t) != 0) {
+                ERRMSG("Shared memory ring record of %zu bytes is not a whole number "
+                       "of trace entries\n",
+                       size);
+                ring_.release();
+                corrupt_ = true;
+                return false;
+            }
+            size_t count = size / sizeof(trace_entry_t);
+            if (buf_.size() < count)
+                buf_.resize(count);
+            memcpy(buf_.data(), record, size);
+            ring_.release();
+            cur_buf_ = buf_.data();
+            end_buf_ = buf_.data() + count;
+            return true;
+        }
+        // Nothing is ready: spin briefly, as the next buffer is often only
+        // moments away, before backing off to avoid burning a core.
+        ++polls;
+        if (polls < SPIN_COUNT)
+            continue;
+        if (polls < SPIN_COUNT + YIELD_COUNT) {
+            sched_yield();
+            continue;
+        }
+        if (ring_.had_writers() && ring_.count_live_writers(is_process_alive) == 0) {
+            // Writers publish everything before they leave, so an empty ring is
+            // final once no new writer has shown up for a while.
+            if (idle_us >= FINAL_GRACE_US && ring_.peek(&size) == nullptr)
+                return false;
+        } else
+            idle_us = 0;
+        struct timespec sleep_time = { 0, sleep_us * 1000 };
+        nanosleep(&sleep_time, nullptr);
+        idle_us += sleep_us;
+        if (sleep_us < MAX_SLEEP_US)
+            sleep_us *= 2;
+    }
+}
+
+trace_entry_t *
+shm_ring_reader_t::read_next_entry()
+{
+    ++cur_buf_;
+    if (cur_buf_ >= end_buf_) {
+        if (!read_next_record()) {
+            // If called again at eof, do not return the footer: return an error.
+            // A corrupt ring is an error too, which our caller reports as long as
+            // we have not set at_eof_.
+            if (at_eof_ || corrupt_)
+                return nullptr;
+            // As with ipc_reader_t, we cannot easily distinguish truncation from
+            // a clean end.
+            cur_buf_ = buf_.data();
+            cur_buf_->type = TRACE_TYPE_FOOTER;
+            cur_buf_->size = 0;
+            cur_buf_->addr = 0;
+            end_buf_ = cur_buf_ + 1;
+            at_eof_ = true;
+            return cur_buf_;
+        }
+    }
+    if (cur_buf_->type == TRACE_TYPE_FOOTER)
+        at_eof_ = true;
+    return cur_buf_;
+}
@@ -0,0 +1,97 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* shm_ring_reader: obtains memory streams from DR clients running in
+ * application processes through a shm_ring_t and presents them via an
+ * iterator interface to the cache simulator.  This is the shared memory
+ * counterpart of ipc_reader_t.
+ */
+
+#ifndef _SHM_RING_READER_H_
+#define _SHM_RING_READER_H_ 1
+
+#include <string>
+#include <vector>
+#include "reader.h"
+#include "../common/memref.h"
+#include "../common/shm_ring.h"
+#include "../common/trace_entry.h"
+
+class shm_ring_reader_t : public reader_t {
+public:
+    shm_ring_reader_t();
+    // Creates a ring with "capacity" bytes of record space backed by the file
+    // for "ipc_name".
+    shm_ring_reader_t(const char *ipc_name, uint64_t capacity, int verbosity);
+    virtual ~shm_ring_reader_t();
+    bool operator!() override;
+    // This potentially blocks.
+    bool
+    init() override;
+    std::string
+    get_ring_path() const;
+
+protected:
+    trace_entry_t *
+    read_next_entry() override;
+
+    bool
+    read_next_thread_entry(size_t, trace_entry_t *, bool *) override
+    {
+        // Only an interleaved stream is supported.
+        return false;
+    }
+
+private:
+    // Copies the next record into buf_, waiting for one to be published.
+    // Returns false once every writer is gone and the ring is empty, or on a
+    // malformed record, for which it also sets corrupt_.
+    bool
+    read_next_record();
+
+    std::string path_;
+    int fd_ = -1;
+    void *region_ = nullptr;
+    size_t region_size_ = 0;
+    shm_ring_t ring_;
+    bool creation_success_ = false;
+    bool corrupt_ = false;
+
+    // Each record is one traced thread's buffer.  We copy it out so the
+    // writers can reuse its space while we process it.
+    std::vector<trace_entry_t> buf_;
+    trace_entry_t *cur_buf_ = nullptr;
+    trace_entry_t *end_buf_ = nullptr;
+};
+
+#endif /* _SHM_RING_READER_H_ */
@@ -207,7 +207,8 @@ template <>
 /* clang-format on */
 file_reader_t<snappy_reader_t>::~file_reader_t<snappy_reader_t>()
 {
-    // Empty.
+    // Stop any in-flight read-ahead before destroying the readers underneath it.
+    read_ahead_.clear();
 }
 
 template <>
@@ -219,6 +220,19 @@ file_reader_t<snappy_reader_t>::open_single_file(const std::string &path)
         return false;
     VPRINT(this, 1, "Opened snappy input file %s\n", path.c_str());
     input_files_.emplace_back(file);
+    if (prefetch_chunks_ > 0) {
+        // We refer to the reader by index as input_files_ may be reallocated
+        // while we open the rest of the files, before any reading starts.
+        size_t index = input_files_.size() - 1;
+        read_ahead_.emplace_back(new read_ahead_stream_t(
+            [this, index](char *buf, size_t size) {
+                int len = input_files_[index].read(size, buf);
+                if (len < static_cast<int>(size) && !input_files_[index].eof())
+                    return -1;
+                return len;
+            },
+            prefetch_chunks_));
+    }
     return true;
 }
 
@@ -228,11 +242,19 @@ file_reader_t<snappy_reader_t>::read_next_thread_entry(size_t thread_index,
                                                        OUT trace_entry_t *entry,
                                                        OUT bool *eof)
 {
-    int len = input_files_[thread_index].read(sizeof(*entry), entry);
-    // Returns less than asked-for for end of file, or –1 for error.
-    if (len < (int)sizeof(*entry)) {
-        *eof = input_files_[thread_index].eof();
-        return false;
+    if (!read_ahead_.empty()) {
+        int len = read_ahead_[thread_index]->read(sizeof(*entry), entry);
+        if (len < (int)sizeof(*entry)) {
+            *eof = read_ahead_[thread_index]->eof();
+            return false;
+        }
+    } else {
+        int len = input_files_[thread_index].read(sizeof(*entry), entry);
+        // Returns less than asked-for for end of file, or –1 for error.
+        if (len < (int)sizeof(*entry)) {
+            *eof = input_files_[thread_index].eof();
+            return false;
+        }
     }
     VPRINT(this, 4, "Read from thread #%zd file: type=%d, size=%d, addr=%zu\n",
            thread_index, entry->type, entry->size, entry->addr);
@@ -246,3 +268,12 @@ file_reader_t<snappy_reader_t>::is_complete()
     // Not supported, similar to gzip reader.
     return false;
 }
+
+template <>
+bool
+file_reader_t<snappy_reader_t>::seek_to_memref(uint64_t current, uint64_t target,
+                                               OUT uint64_t *ordinal)
+{
+    // The snappy writer does not produce a chunk index.
+    return false;
+}
@@ -51,6 +51,8 @@
 #include "../tracer/raw2trace.h"
 #include "../tracer/raw2trace_directory.h"
 #include <fstream>
+#include <stdlib.h>
+#include <vector>
 
 /* Get the path to an auxiliary file by examining
  * 1. The corresponding command line option
@@ -118,6 +120,7 @@ get_cache_simulator_knobs()
     knobs->LL_assoc = op_LL_assoc.get_value();
     knobs->LL_miss_file = op_LL_miss_file.get_value();
     knobs->model_coherence = op_coherence.get_value();
+    knobs->core_sim_threads = op_core_sim_threads.get_value();
     knobs->replace_policy = op_replace_policy.get_value();
     knobs->data_prefetcher = op_data_prefetcher.get_value();
     knobs->skip_refs = op_skip_refs.get_value();
@@ -129,12 +132,50 @@ get_cache_simulator_knobs()
     return knobs;
 }
 
+/* Parses a comma-separated list of sizes, each accepting the K, M, or G suffix
+ * of a bytesize_t option, into "values".  Returns false on a malformed entry.
+ */
+template <typename T>
+static bool
+parse_size_list(const std::string &list, std::vector<T> *values)
+{
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t end = list.find(',', pos);
+        if (end == std::string::npos)
+            end = list.size();
+        std::string entry = list.substr(pos, end - pos);
+        char *suffix;
+        uint64_t value = strtoull(entry.c_str(), &suffix, 10);
+        if (suffix == entry.c_str() || (suffix[0] != '\0' && suffix[1] != '\0'))
+            return false;
+        switch (*suffix) {
+        case '\0': break;
+        case 'K':
+        case 'k': value *= 1024; break;
+        case 'M':
+        case 'm': value *= 1024 * 1024; break;
+        case 'G':
+        case 'g': value *= 1024 * 1024 * 1024; break;
+        default: return false;
+        }
+        values->push_back(static_cast<T>(value));
+        pos = end + 1;
+    }
+    return true;
+}
+
 analysis_tool_t *
 drmemtrace_analysis_tool_create()
 {
     if (op_simulator_type.get_value() == CPU_CACHE) {
         const std::string &config_file = op_config_file.get_value();
         if (!config_file.empty()) {
+            if (op_core_sim_threads.get_value() > 0) {
+                ERRMSG("Usage error: -core_sim_threads is not supported with "
+                       "-config_file.\n");
+                return nullptr;
+            }
             return cache_simulator_create(config_file);
         } else {
             cache_simulator_knobs_t *knobs = get_cache_simulator_knobs();
@@ -145,6 +186,17 @@ drmemtrace_analysis_tool_create()
         return cache_miss_analyzer_create(*knobs, op_miss_count_threshold.get_value(),
                                           op_miss_frac_threshold.get_value(),
                                           op_confidence_threshold.get_value());
+    } else if (op_simulator_type.get_value() == CACHE_SWEEP) {
+        cache_simulator_knobs_t *knobs = get_cache_simulator_knobs();
+        cache_sweep_knobs_t sweep;
+        if (!parse_size_list(op_sweep_L1D_sizes.get_value(), &sweep.L1D_sizes) ||
+            !parse_size_list(op_sweep_L1D_assocs.get_value(), &sweep.L1D_assocs) ||
+            !parse_size_list(op_sweep_LL_sizes.get_value(), &sweep.LL_sizes) ||
+            !parse_size_list(op_sweep_LL_assocs.get_value(), &sweep.LL_assocs)) {
+            ERRMSG("Usage error: malformed -sweep_* list.\n");
+            return nullptr;
+        }
+        return cache_sweep_simulator_create(*knobs, sweep);
     } else if (op_simulator_type.get_value() == TLB) {
         tlb_simulator_knobs_t knobs;
         knobs.num_cores = op_num_cores.get_value();
@@ -174,8 +226,16 @@ drmemtrace_analysis_tool_create()
         knobs.report_top = op_report_top.get_value();
         knobs.skip_list_distance = op_reuse_skip_dist.get_value();
         knobs.verify_skip = op_reuse_verify_skip.get_value();
+        knobs.engine = op_reuse_engine.get_value();
         knobs.verbose = op_verbose.get_value();
         return reuse_distance_tool_create(knobs);
+    } else if (op_simulator_type.get_value() == MISS_RATIO_CURVE) {
+        reuse_distance_knobs_t knobs;
+        knobs.line_size = op_line_size.get_value();
+        knobs.verify_skip = op_reuse_verify_skip.get_value();
+        knobs.sample_rate = op_mrc_sample_rate.get_value();
+        knobs.verbose = op_verbose.get_value();
+        return miss_ratio_curve_tool_create(knobs);
     } else if (op_simulator_type.get_value() == REUSE_TIME) {
         return reuse_time_tool_create(op_line_size.get_value(), op_verbose.get_value());
     } else if (op_simulator_type.get_value() == BASIC_COUNTS) {
@@ -208,8 +268,8 @@ drmemtrace_analysis_tool_create()
         return invariant_checker_create(op_offline.get_value(), op_verbose.get_value());
     } else {
         ERRMSG("Usage error: unsupported analyzer type. "
-               "Please choose " CPU_CACHE ", " MISS_ANALYZER ", " TLB ", " HISTOGRAM
-               ", " REUSE_DIST ", " BASIC_COUNTS ", " OPCODE_MIX ", " VIEW
+               "Please choose " CPU_CACHE ", " MISS_ANALYZER ", " CACHE_SWEEP ", " TLB
+               ", " HISTOGRAM ", " REUSE_DIST ", " BASIC_COUNTS ", " OPCODE_MIX ", " VIEW
                " or " FUNC_VIEW ".\n");
         return nullptr;
     }
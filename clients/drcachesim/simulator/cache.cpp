@@ -73,7 +73,7 @@ cache_t::flush(const memref_t &memref)
         auto block_way = find_caching_device_block(tag);
         if (block_way.first == nullptr)
             continue;
-        invalidate_caching_device_block(block_way.first);
+        invalidate_caching_device_block(compute_block_idx(tag), block_way.second);
     }
     // We flush parent_'s code cache here.
     // XXX: should L1 data cache be flushed when L1 instr cache is flushed?
@@ -174,12 +174,16 @@ cache_miss_analyzer_t::cache_miss_analyzer_t(const cache_simulator_knobs_t &knob
 std::vector<prefetching_recommendation_t *>
 cache_miss_analyzer_t::generate_recommendations()
 {
+    if (core_sim_pool_)
+        core_sim_pool_->sync();
     return ll_stats_->generate_recommendations();
 }
 
 bool
 cache_miss_analyzer_t::print_results()
 {
+    if (core_sim_pool_)
+        core_sim_pool_->sync();
     std::vector<prefetching_recommendation_t *> recommendations =
         ll_stats_->generate_recommendations();
 
@@ -123,7 +123,21 @@ cache_simulator_t::cache_simulator_t(const cache_simulator_knobs_t &knobs)
         snoop_filter_ = new snoop_filter_t;
     }
 
+    if (knobs_.core_sim_threads > 0) {
+        core_sim_pool_.reset(new core_sim_pool_t(knobs_.core_sim_threads,
+                                                 knobs_.num_cores, (int)knobs_.line_size,
+                                                 llc, snoop_filter_));
+        // Warming up to a fraction of the LLC needs the LLC to be current after
+        // each reference.
+        if (knobs_.warmup_fraction > 0.0)
+            core_sim_pool_->set_serial(true);
+    }
+
     for (unsigned int i = 0; i < knobs_.num_cores; i++) {
+        caching_device_t *l1_parent =
+            core_sim_pool_ ? core_sim_pool_->get_private_parent(i) : llc;
+        snoop_filter_t *l1_snoop_filter =
+            core_sim_pool_ ? core_sim_pool_->get_private_snoop_filter(i) : snoop_filter_;
         l1_icaches_[i] = create_cache(knobs_.replace_policy);
         if (l1_icaches_[i] == NULL) {
             error_string_ = "create_cache failed for an l1_icache";
@@ -140,20 +154,20 @@ cache_simulator_t::cache_simulator_t(const cache_simulator_knobs_t &knobs)
         snooped_caches_[(2 * i) + 1] = l1_dcaches_[i];
 
         if (!l1_icaches_[i]->init(
-                knobs_.L1I_assoc, (int)knobs_.line_size, (int)knobs_.L1I_size, llc,
+                knobs_.L1I_assoc, (int)knobs_.line_size, (int)knobs_.L1I_size, l1_parent,
                 new cache_stats_t((int)knobs_.line_size, "", warmup_enabled_,
                                   knobs_.model_coherence),
                 nullptr /*prefetcher*/, false /*inclusive*/, knobs_.model_coherence,
-                2 * i, snoop_filter_) ||
+                2 * i, l1_snoop_filter) ||
             !l1_dcaches_[i]->init(
-                knobs_.L1D_assoc, (int)knobs_.line_size, (int)knobs_.L1D_size, llc,
+                knobs_.L1D_assoc, (int)knobs_.line_size, (int)knobs_.L1D_size, l1_parent,
                 new cache_stats_t((int)knobs_.line_size, "", warmup_enabled_,
                                   knobs_.model_coherence),
                 knobs_.data_prefetcher == PREFETCH_POLICY_NEXTLINE
                     ? new prefetcher_t((int)knobs_.line_size)
                     : nullptr,
                 false /*inclusive*/, knobs_.model_coherence, (2 * i) + 1,
-                snoop_filter_)) {
+                l1_snoop_filter)) {
             error_string_ = "Usage error: failed to initialize L1 caches.  Ensure sizes "
                             "and associativity are powers of 2 "
                             "and that the total sizes are multiples of the line size.";
@@ -173,6 +187,9 @@ cache_simulator_t::cache_simulator_t(const cache_simulator_knobs_t &knobs)
         success_ = false;
         return;
     }
+
+    if (core_sim_pool_)
+        core_sim_pool_->start(l1_icaches_, l1_dcaches_);
 }
 
 cache_simulator_t::cache_simulator_t(std::istream *config_file)
@@ -379,6 +396,8 @@ cache_simulator_t::cache_simulator_t(std::istream *config_file)
 
 cache_simulator_t::~cache_simulator_t()
 {
+    // Stop the workers before the caches they simulate go away.
+    core_sim_pool_.reset();
     for (auto &caches_it : all_caches_) {
         cache_t *cache = caches_it.second;
         delete cache->get_stats();
@@ -459,7 +478,10 @@ cache_simulator_t::process_memref(const memref_t &memref)
                       << " @" << (void *)memref.instr.addr << " instr x"
                       << memref.instr.size << "\n";
         }
-        l1_icaches_[core]->request(memref);
+        if (core_sim_pool_)
+            core_sim_pool_->add(core, core_sim_pool_t::REQUEST_ICACHE, memref);
+        else
+            l1_icaches_[core]->request(memref);
     } else if (memref.data.type == TRACE_TYPE_READ ||
                memref.data.type == TRACE_TYPE_WRITE ||
                // We may potentially handle prefetches differently.
@@ -471,21 +493,30 @@ cache_simulator_t::process_memref(const memref_t &memref)
                       << trace_type_names[memref.data.type] << " "
                       << (void *)memref.data.addr << " x" << memref.data.size << "\n";
         }
-        l1_dcaches_[core]->request(memref);
+        if (core_sim_pool_)
+            core_sim_pool_->add(core, core_sim_pool_t::REQUEST_DCACHE, memref);
+        else
+            l1_dcaches_[core]->request(memref);
     } else if (memref.flush.type == TRACE_TYPE_INSTR_FLUSH) {
         if (knobs_.verbose >= 3) {
             std::cerr << "::" << memref.data.pid << "." << memref.data.tid << ":: "
                       << " @" << (void *)memref.data.pc << " iflush "
                       << (void *)memref.data.addr << " x" << memref.data.size << "\n";
         }
-        l1_icaches_[core]->flush(memref);
+        if (core_sim_pool_)
+            core_sim_pool_->add(core, core_sim_pool_t::FLUSH_ICACHE, memref);
+        else
+            l1_icaches_[core]->flush(memref);
     } else if (memref.flush.type == TRACE_TYPE_DATA_FLUSH) {
         if (knobs_.verbose >= 3) {
             std::cerr << "::" << memref.data.pid << "." << memref.data.tid << ":: "
                       << " @" << (void *)memref.data.pc << " dflush "
                       << (void *)memref.data.addr << " x" << memref.data.size << "\n";
         }
-        l1_dcaches_[core]->flush(memref);
+        if (core_sim_pool_)
+            core_sim_pool_->add(core, core_sim_pool_t::FLUSH_DCACHE, memref);
+        else
+            l1_dcaches_[core]->flush(memref);
     } else if (memref.exit.type == TRACE_TYPE_THREAD_EXIT) {
         handle_thread_exit(memref.exit.tid);
         last_thread_ = 0;
@@ -503,6 +534,9 @@ cache_simulator_t::process_memref(const memref_t &memref)
 
     // reset cache stats when warming up is completed
     if (!is_warmed_up_ && check_warmed_up()) {
+        // The caches must reflect every warmup reference before the reset.
+        if (core_sim_pool_)
+            core_sim_pool_->set_serial(false);
         for (auto &cache_it : all_caches_) {
             cache_t *cache = cache_it.second;
             cache->get_stats()->reset();
@@ -561,6 +595,8 @@ cache_simulator_t::check_warmed_up()
 bool
 cache_simulator_t::print_results()
 {
+    if (core_sim_pool_)
+        core_sim_pool_->sync();
     std::cerr << "Cache simulation results:\n";
     // Print core and associated L1 cache stats first.
     for (unsigned int i = 0; i < knobs_.num_cores; i++) {
@@ -608,6 +644,8 @@ cache_simulator_t::get_cache_metric(metric_name_t metric, unsigned level, unsign
     if (core >= knobs_.num_cores) {
         return STATS_ERROR_WRONG_CORE_NUMBER;
     }
+    if (core_sim_pool_)
+        core_sim_pool_->sync();
 
     if (split == cache_split_t::DATA) {
         curr_cache = l1_dcaches_[core];
@@ -617,6 +655,10 @@ cache_simulator_t::get_cache_metric(metric_name_t metric, unsigned level, unsign
 
     for (size_t i = 1; i < level; i++) {
         caching_device_t *parent = curr_cache->get_parent();
+        // The L1 caches reach the LLC through a stand-in when simulated by
+        // core_sim_pool_.
+        if (i == 1 && core_sim_pool_)
+            parent = core_sim_pool_->get_shared();
 
         if (parent == NULL) {
             return STATS_ERROR_WRONG_CACHE_LEVEL;
@@ -42,7 +42,9 @@
 #include "cache_stats.h"
 #include "cache.h"
 #include "snoop_filter.h"
+#include "core_sim_pool.h"
 #include <limits.h>
+#include <memory>
 
 enum class cache_split_t { DATA, INSTRUCTION };
 
@@ -112,6 +114,9 @@ protected:
     // Snoop filter tracks ownership of cache lines across private caches.
     snoop_filter_t *snoop_filter_ = nullptr;
 
+    // Simulates the L1 caches on worker threads when knobs_.core_sim_threads is set.
+    std::unique_ptr<core_sim_pool_t> core_sim_pool_;
+
 private:
     bool is_warmed_up_;
 };
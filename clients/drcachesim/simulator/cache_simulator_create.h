@@ -36,6 +36,7 @@
 #define _CACHE_SIMULATOR_CREATE_H_ 1
 
 #include <string>
+#include <vector>
 #include "analysis_tool.h"
 
 /**
@@ -60,6 +61,7 @@ struct cache_simulator_knobs_t {
         , LL_assoc(16)
         , LL_miss_file("")
         , model_coherence(false)
+        , core_sim_threads(0)
         , replace_policy("LRU")
         , data_prefetcher("nextline")
         , skip_refs(0)
@@ -80,6 +82,7 @@ struct cache_simulator_knobs_t {
     unsigned int LL_assoc;
     std::string LL_miss_file;
     bool model_coherence;
+    unsigned int core_sim_threads;
     std::string replace_policy;
     std::string data_prefetcher;
     uint64_t skip_refs;
@@ -101,6 +104,30 @@ cache_simulator_create(const cache_simulator_knobs_t &knobs);
 analysis_tool_t *
 cache_simulator_create(const std::string &config_file);
 
+/**
+ * The geometries evaluated by cache_sweep_simulator_create().  Every size in a
+ * list is paired with every associativity in the same list.  An empty list
+ * stands for the single value in #cache_simulator_knobs_t.
+ */
+struct cache_sweep_knobs_t {
+    std::vector<uint64_t> L1D_sizes;
+    std::vector<unsigned int> L1D_assocs;
+    std::vector<uint64_t> LL_sizes;
+    std::vector<unsigned int> LL_assocs;
+};
+
+/**
+ * Creates an instance of a cache simulator that evaluates the 2-level hierarchy
+ * of cache_simulator_create() for every combination of the L1D and LL geometries
+ * in \p sweep in a single pass over the trace.  This requires LRU replacement
+ * and no data prefetcher, and does not support coherence, warmup, flushes, or
+ * a miss file.  Each combination reports the same statistics as a separate
+ * cache simulator run.
+ */
+analysis_tool_t *
+cache_sweep_simulator_create(const cache_simulator_knobs_t &knobs,
+                             const cache_sweep_knobs_t &sweep);
+
 /** Creates an instance of a cache miss analyzer. */
 analysis_tool_t *
 cache_miss_analyzer_create(const cache_simulator_knobs_t &knobs,
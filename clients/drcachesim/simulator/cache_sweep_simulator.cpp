@@ -0,0 +1,374 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+#include <iostream>
+#include <string>
+#include <string.h>
+#include "../common/memref.h"
+#include "../common/options.h"
+#include "../common/utils.h"
+#include "cache_sweep_simulator.h"
+
+analysis_tool_t *
+cache_sweep_simulator_create(const cache_simulator_knobs_t &knobs,
+                             const cache_sweep_knobs_t &sweep)
+{
+    return new cache_sweep_simulator_t(knobs, sweep);
+}
+
+bool
+cache_sweep_simulator_t::lru_stacks_t::init(const std::vector<geometry_t> &geometries,
+                                            unsigned int line_size)
+{
+    for (const geometry_t &geom : geometries) {
+        // The same constraints as caching_device_t::init().
+        if (!IS_POWER_OF_2(geom.assoc) || !IS_POWER_OF_2(line_size) || line_size < 4 ||
+            geom.size % line_size != 0 || !IS_POWER_OF_2(geom.size / line_size) ||
+            geom.size / line_size < geom.assoc)
+            return false;
+        addr_t set_mask = geom.size / line_size / geom.assoc - 1;
+        size_t group;
+        for (group = 0; group < groups_.size(); group++) {
+            if (groups_[group].set_mask == set_mask)
+                break;
+        }
+        if (group == groups_.size())
+            groups_.push_back({ set_mask, 0, 0, {} });
+        if (geom.assoc > groups_[group].ways)
+            groups_[group].ways = geom.assoc;
+        group_of_.push_back(group);
+        assoc_.push_back(geom.assoc);
+    }
+    for (set_group_t &group : groups_)
+        group.tags.resize((group.set_mask + 1) * group.ways, TAG_INVALID);
+    return true;
+}
+
+void
+cache_sweep_simulator_t::lru_stacks_t::access(addr_t tag)
+{
+    for (set_group_t &group : groups_) {
+        addr_t *stack = &group.tags[(tag & group.set_mask) * group.ways];
+        unsigned int depth = 0;
+        while (depth < group.ways && stack[depth] != tag)
+            depth++;
+        group.depth = depth;
+        // Push everything above the line, or the whole stack on a miss, down one
+        // entry, dropping the least recently used line on a miss.
+        unsigned int shift = depth < group.ways ? depth : group.ways - 1;
+        if (shift > 0)
+            memmove(stack + 1, stack, shift * sizeof(*stack));
+        stack[0] = tag;
+    }
+}
+
+cache_sweep_simulator_t::cache_sweep_simulator_t(const cache_simulator_knobs_t &knobs,
+                                                 const cache_sweep_knobs_t &sweep)
+    : simulator_t(knobs.num_cores, knobs.skip_refs, knobs.warmup_refs,
+                  knobs.warmup_fraction, knobs.sim_refs, knobs.cpu_scheduling,
+                  knobs.verbose)
+    , knobs_(knobs)
+    , line_bits_(compute_log2((int)knobs.line_size))
+{
+    if (!success_)
+        return;
+    if ((knobs_.replace_policy != REPLACE_POLICY_NON_SPECIFIED &&
+         knobs_.replace_policy != REPLACE_POLICY_LRU) ||
+        knobs_.data_prefetcher != PREFETCH_POLICY_NONE || knobs_.model_coherence ||
+        knobs_.warmup_refs > 0 || knobs_.warmup_fraction > 0.0 ||
+        !knobs_.LL_miss_file.empty()) {
+        error_string_ = "Usage error: a cache sweep requires LRU replacement and "
+                        "-data_prefetcher " PREFETCH_POLICY_NONE ", and does not support "
+                        "coherence, warmup, or a miss file.";
+        success_ = false;
+        return;
+    }
+    // An empty list sweeps just the single value from the knobs.
+    std::vector<uint64_t> L1D_sizes = sweep.L1D_sizes;
+    if (L1D_sizes.empty())
+        L1D_sizes.push_back(knobs_.L1D_size);
+    std::vector<unsigned int> L1D_assocs = sweep.L1D_assocs;
+    if (L1D_assocs.empty())
+        L1D_assocs.push_back(knobs_.L1D_assoc);
+    std::vector<uint64_t> LL_sizes = sweep.LL_sizes;
+    if (LL_sizes.empty())
+        LL_sizes.push_back(knobs_.LL_size);
+    std::vector<unsigned int> LL_assocs = sweep.LL_assocs;
+    if (LL_assocs.empty())
+        LL_assocs.push_back(knobs_.LL_assoc);
+    for (uint64_t size : L1D_sizes) {
+        for (unsigned int assoc : L1D_assocs)
+            L1D_geometries_.push_back({ size, assoc });
+    }
+    for (uint64_t size : LL_sizes) {
+        for (unsigned int assoc : LL_assocs)
+            LL_geometries_.push_back({ size, assoc });
+    }
+
+    icaches_.resize(knobs_.num_cores);
+    dcaches_.resize(knobs_.num_cores);
+    for (unsigned int i = 0; i < knobs_.num_cores; i++) {
+        if (!init_level(&icaches_[i], { { knobs_.L1I_size, knobs_.L1I_assoc } },
+                        "L1I") ||
+            !init_level(&dcaches_[i], L1D_geometries_, "L1D"))
+            return;
+    }
+    llcaches_.resize(L1D_geometries_.size());
+    for (level_t &llc : llcaches_) {
+        if (!init_level(&llc, LL_geometries_, "LL"))
+            return;
+    }
+    dcache_child_hits_.resize(L1D_geometries_.size(), 0);
+}
+
+cache_sweep_simulator_t::~cache_sweep_simulator_t()
+{
+}
+
+bool
+cache_sweep_simulator_t::init_level(level_t *level,
+                                    const std::vector<geometry_t> &geometries,
+                                    const std::string &name)
+{
+    if (!level->stacks.init(geometries, knobs_.line_size)) {
+        error_string_ = "Usage error: failed to initialize " + name +
+            " caches.  Ensure sizes and associativity are powers of 2 "
+            "and that the total sizes are multiples of the line size.";
+        success_ = false;
+        return false;
+    }
+    for (size_t i = 0; i < geometries.size(); i++) {
+        level->stats.emplace_back(new cache_stats_t((int)knobs_.line_size));
+    }
+    return true;
+}
+
+size_t
+cache_sweep_simulator_t::get_config_count() const
+{
+    return L1D_geometries_.size() * LL_geometries_.size();
+}
+
+void
+cache_sweep_simulator_t::get_config(size_t config, uint64_t *L1D_size,
+                                    unsigned int *L1D_assoc, uint64_t *LL_size,
+                                    unsigned int *LL_assoc) const
+{
+    const geometry_t &l1d = L1D_geometries_[config / LL_geometries_.size()];
+    const geometry_t &llc = LL_geometries_[config % LL_geometries_.size()];
+    *L1D_size = l1d.size;
+    *L1D_assoc = l1d.assoc;
+    *LL_size = llc.size;
+    *LL_assoc = llc.assoc;
+}
+
+// Calls "func" with the piece of "memref" in each line it touches, as
+// caching_device_t::request() splits it.
+template <typename func_t>
+static inline void
+for_each_line(const memref_t &memref_in, int line_bits, func_t func)
+{
+    addr_t final_addr = memref_in.data.addr + memref_in.data.size - 1 /*avoid overflow*/;
+    addr_t final_tag = final_addr >> line_bits;
+    addr_t tag = memref_in.data.addr >> line_bits;
+    if (tag == final_tag) {
+        func(tag, memref_in);
+        return;
+    }
+    memref_t memref = memref_in;
+    for (; tag <= final_tag; ++tag) {
+        if (tag + 1 <= final_tag)
+            memref.data.size = ((tag + 1) << line_bits) - memref.data.addr;
+        func(tag, memref);
+        if (tag + 1 <= final_tag) {
+            addr_t next_addr = (tag + 1) << line_bits;
+            memref.data.addr = next_addr;
+            memref.data.size = final_addr - next_addr + 1 /*undo the -1*/;
+        }
+    }
+}
+
+void
+cache_sweep_simulator_t::request_llc(level_t *llc, const memref_t &memref)
+{
+    // An L1 miss is a single line and the LL has the same line size.
+    llc->stacks.access(memref.data.addr >> line_bits_);
+    for (size_t i = 0; i < llc->stats.size(); i++)
+        llc->stats[i]->access(memref, llc->stacks.hit(i), nullptr);
+}
+
+void
+cache_sweep_simulator_t::request_icache(int core, const memref_t &memref)
+{
+    level_t &icache = icaches_[core];
+    for_each_line(memref, line_bits_, [&](addr_t tag, const memref_t &line_ref) {
+        icache.stacks.access(tag);
+        bool hit = icache.stacks.hit(0);
+        icache.stats[0]->access(line_ref, hit, nullptr);
+        if (hit)
+            icache_child_hits_++;
+        else {
+            for (level_t &llc : llcaches_)
+                request_llc(&llc, line_ref);
+        }
+    });
+}
+
+void
+cache_sweep_simulator_t::request_dcache(int core, const memref_t &memref)
+{
+    level_t &dcache = dcaches_[core];
+    for_each_line(memref, line_bits_, [&](addr_t tag, const memref_t &line_ref) {
+        dcache.stacks.access(tag);
+        for (size_t i = 0; i < dcache.stats.size(); i++) {
+            bool hit = dcache.stacks.hit(i);
+            dcache.stats[i]->access(line_ref, hit, nullptr);
+            if (hit)
+                dcache_child_hits_[i]++;
+            else
+                request_llc(&llcaches_[i], line_ref);
+        }
+    });
+}
+
+bool
+cache_sweep_simulator_t::process_memref(const memref_t &memref)
+{
+    // This follows cache_simulator_t::process_memref() with warmup disabled.
+    if (knobs_.skip_refs > 0) {
+        knobs_.skip_refs--;
+        return true;
+    }
+    if (knobs_.sim_refs == 0)
+        return true;
+
+    if (!simulator_t::process_memref(memref))
+        return false;
+
+    if (memref.marker.type == TRACE_TYPE_MARKER)
+        return true;
+
+    int core;
+    if (memref.data.tid == last_thread_)
+        core = last_core_;
+    else {
+        core = core_for_thread(memref.data.tid);
+        last_thread_ = memref.data.tid;
+        last_core_ = core;
+    }
+
+    if (type_is_instr(memref.instr.type) ||
+        memref.instr.type == TRACE_TYPE_PREFETCH_INSTR) {
+        request_icache(core, memref);
+    } else if (memref.data.type == TRACE_TYPE_READ ||
+               memref.data.type == TRACE_TYPE_WRITE ||
+               type_is_prefetch(memref.data.type)) {
+        request_dcache(core, memref);
+    } else if (memref.flush.type == TRACE_TYPE_INSTR_FLUSH ||
+               memref.flush.type == TRACE_TYPE_DATA_FLUSH) {
+        // A flush leaves a hole that a smaller cache may refill with a line a
+        // larger one never lost, breaking the stack property.
+        error_string_ = "Cache flushes are not supported by a cache sweep";
+        return false;
+    } else if (memref.exit.type == TRACE_TYPE_THREAD_EXIT) {
+        handle_thread_exit(memref.exit.tid);
+        last_thread_ = 0;
+    } else if (memref.marker.type != TRACE_TYPE_INSTR_NO_FETCH) {
+        error_string_ = "Unhandled memref type " + std::to_string(memref.data.type);
+        return false;
+    }
+
+    knobs_.sim_refs--;
+    return true;
+}
+
+void
+cache_sweep_simulator_t::apply_child_hits()
+{
+    for (size_t i = 0; i < llcaches_.size(); i++) {
+        for (auto &stats : llcaches_[i].stats)
+            stats->add_child_hits(icache_child_hits_ + dcache_child_hits_[i]);
+        dcache_child_hits_[i] = 0;
+    }
+    icache_child_hits_ = 0;
+}
+
+bool
+cache_sweep_simulator_t::print_results()
+{
+    apply_child_hits();
+    for (size_t config = 0; config < get_config_count(); config++) {
+        size_t l1d = config / LL_geometries_.size();
+        size_t llc = config % LL_geometries_.size();
+        std::cerr << "Configuration #" << config << ": -L1D_size "
+                  << L1D_geometries_[l1d].size << " -L1D_assoc "
+                  << L1D_geometries_[l1d].assoc << " -LL_size "
+                  << LL_geometries_[llc].size << " -LL_assoc "
+                  << LL_geometries_[llc].assoc << "\n";
+        // The rest matches cache_simulator_t::print_results().
+        std::cerr << "Cache simulation results:\n";
+        for (unsigned int i = 0; i < knobs_.num_cores; i++) {
+            print_core(i);
+            if (thread_ever_counts_[i] > 0) {
+                std::cerr << "  L1I stats:" << std::endl;
+                icaches_[i].stats[0]->print_stats("    ");
+                std::cerr << "  L1D stats:" << std::endl;
+                dcaches_[i].stats[l1d]->print_stats("    ");
+            }
+        }
+        std::cerr << "LL stats:" << std::endl;
+        llcaches_[l1d].stats[llc]->print_stats("    ");
+    }
+    return true;
+}
+
+int_least64_t
+cache_sweep_simulator_t::get_cache_metric(size_t config, metric_name_t metric,
+                                          unsigned level, unsigned core,
+                                          cache_split_t split)
+{
+    if (core >= knobs_.num_cores)
+        return STATS_ERROR_WRONG_CORE_NUMBER;
+    if (config >= get_config_count())
+        return STATS_ERROR_NO_CACHE_STATS;
+    apply_child_hits();
+    size_t l1d = config / LL_geometries_.size();
+    if (level == 1) {
+        if (split == cache_split_t::DATA)
+            return dcaches_[core].stats[l1d]->get_metric(metric);
+        return icaches_[core].stats[0]->get_metric(metric);
+    }
+    if (level == 2)
+        return llcaches_[l1d].stats[config % LL_geometries_.size()]->get_metric(metric);
+    return STATS_ERROR_WRONG_CACHE_LEVEL;
+}
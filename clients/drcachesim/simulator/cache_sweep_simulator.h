@@ -0,0 +1,156 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* cache_sweep_simulator: simulates the default 2-level hierarchy of
+ * cache_simulator_t for many L1D and LL geometries in a single pass.
+ *
+ * With LRU replacement, a set of an N-way cache holds exactly the N most
+ * recently used lines that map to it.  Keeping each set as an LRU stack
+ * deeper than N ways thus yields the hits of every smaller associativity with
+ * the same number of sets: a reference hits in an N-way cache when its depth in
+ * the stack is below N.  One stack array is kept per distinct set count, so a
+ * sweep over associativities costs little more than its largest member.  An LL
+ * is fed by the misses of its L1D, so one group of LL stacks is kept per L1D
+ * geometry.  The per-cache statistics are those cache_simulator_t would report
+ * for each hierarchy on its own.
+ */
+
+#ifndef _CACHE_SWEEP_SIMULATOR_H_
+#define _CACHE_SWEEP_SIMULATOR_H_ 1
+
+#include <memory>
+#include <vector>
+#include "simulator.h"
+#include "cache_simulator.h"
+#include "cache_simulator_create.h"
+#include "cache_stats.h"
+
+class cache_sweep_simulator_t : public simulator_t {
+public:
+    cache_sweep_simulator_t(const cache_simulator_knobs_t &knobs,
+                            const cache_sweep_knobs_t &sweep);
+    virtual ~cache_sweep_simulator_t();
+    bool
+    process_memref(const memref_t &memref) override;
+    bool
+    print_results() override;
+
+    // Returns the number of simulated hierarchies: every L1D geometry paired
+    // with every LL geometry, numbered with the LL geometry varying fastest.
+    size_t
+    get_config_count() const;
+
+    // Returns the L1D and LL geometry of hierarchy "config".
+    void
+    get_config(size_t config, uint64_t *L1D_size, unsigned int *L1D_assoc,
+               uint64_t *LL_size, unsigned int *LL_assoc) const;
+
+    // Returns the same values as cache_simulator_t::get_cache_metric() would for
+    // hierarchy "config" simulated on its own.
+    int_least64_t
+    get_cache_metric(size_t config, metric_name_t metric, unsigned level,
+                     unsigned core = 0, cache_split_t split = cache_split_t::DATA);
+
+private:
+    struct geometry_t {
+        uint64_t size;
+        unsigned int assoc;
+    };
+
+    // Simulates a list of LRU caches with a common line size that all see the
+    // same sequence of lines.
+    class lru_stacks_t {
+    public:
+        bool
+        init(const std::vector<geometry_t> &geometries, unsigned int line_size);
+
+        // Looks up "tag" in every cache and makes it the most recently used line.
+        void
+        access(addr_t tag);
+
+        // Returns whether the last access() hit in cache "index".
+        bool
+        hit(size_t index) const
+        {
+            return groups_[group_of_[index]].depth < assoc_[index];
+        }
+
+    private:
+        // The stacks of all caches with "set_mask" + 1 sets, each "ways" deep.
+        struct set_group_t {
+            addr_t set_mask;
+            unsigned int ways;
+            unsigned int depth; // Of the last access; "ways" if absent.
+            std::vector<addr_t> tags;
+        };
+        std::vector<set_group_t> groups_;
+        std::vector<size_t> group_of_;
+        std::vector<unsigned int> assoc_;
+    };
+
+    // All geometries of one cache: their stacks and statistics.
+    struct level_t {
+        lru_stacks_t stacks;
+        std::vector<std::unique_ptr<cache_stats_t>> stats;
+    };
+
+    bool
+    init_level(level_t *level, const std::vector<geometry_t> &geometries,
+               const std::string &name);
+
+    void
+    request_icache(int core, const memref_t &memref);
+    void
+    request_dcache(int core, const memref_t &memref);
+    void
+    request_llc(level_t *llc, const memref_t &memref);
+
+    // Credits the L1 hits counted so far to the LL statistics.  cache_simulator_t
+    // does this per hit; here it would cost a call per LL geometry.
+    void
+    apply_child_hits();
+
+    cache_simulator_knobs_t knobs_;
+    int line_bits_;
+    std::vector<geometry_t> L1D_geometries_;
+    std::vector<geometry_t> LL_geometries_;
+    std::vector<level_t> icaches_; // Per core, with the single L1I geometry.
+    std::vector<level_t> dcaches_; // Per core.
+    std::vector<level_t> llcaches_; // Per L1D geometry.
+
+    // L1 hits not yet credited to the LL statistics.
+    int_least64_t icache_child_hits_ = 0;
+    std::vector<int_least64_t> dcache_child_hits_; // Per L1D geometry.
+};
+
+#endif /* _CACHE_SWEEP_SIMULATOR_H_ */
@@ -37,6 +37,65 @@
 #include "snoop_filter.h"
 #include "../common/utils.h"
 #include <assert.h>
+#include <stdint.h>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    include <emmintrin.h>
+#    define HAS_SSE2_TAG_MATCH 1
+#endif
+#ifdef _MSC_VER
+#    include <intrin.h>
+#endif
+
+namespace {
+
+// The number of tags compared per step when scanning a set's tag array.
+static const int kTagMatchWidth = 8;
+
+// Returns a bitmask with bit i set if set_tags[i] == tag, for i < count, where
+// count is at most kTagMatchWidth.
+inline uint32_t
+match_tags(const addr_t *set_tags, addr_t tag, int count)
+{
+    uint32_t match = 0;
+#ifdef HAS_SSE2_TAG_MATCH
+    const int per_vector = static_cast<int>(sizeof(__m128i) / sizeof(addr_t));
+    if (count % per_vector == 0) {
+        for (int i = 0; i < count; i += per_vector) {
+            __m128i tags =
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(set_tags + i));
+#    if defined(__x86_64__) || defined(_M_X64)
+            // SSE2 has no 64-bit compare, so we require both 32-bit halves to match.
+            __m128i eq =
+                _mm_cmpeq_epi32(tags, _mm_set1_epi64x(static_cast<long long>(tag)));
+            eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+            match |= static_cast<uint32_t>(_mm_movemask_pd(_mm_castsi128_pd(eq))) << i;
+#    else
+            __m128i eq = _mm_cmpeq_epi32(tags, _mm_set1_epi32(static_cast<int>(tag)));
+            match |= static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(eq))) << i;
+#    endif
+        }
+        return match;
+    }
+#endif
+    // This branch-free form is also amenable to auto-vectorization.
+    for (int i = 0; i < count; ++i)
+        match |= static_cast<uint32_t>(set_tags[i] == tag) << i;
+    return match;
+}
+
+inline int
+lowest_set_bit(uint32_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+} // namespace
 
 caching_device_t::caching_device_t()
     : blocks_(NULL)
@@ -93,6 +152,10 @@ caching_device_t::init(int associativity, int block_size, int num_blocks,
 
     blocks_ = new caching_device_block_t *[num_blocks_];
     init_blocks();
+    tags_.assign(num_blocks_, TAG_INVALID);
+    counters_.assign(num_blocks_, 0);
+    // Scanning the tag array pays off once a set spans several vector compares.
+    use_tag_array_ = associativity_ >= kTagMatchWidth;
 
     last_tag_ = TAG_INVALID; // sentinel
 
@@ -109,18 +172,36 @@ caching_device_t::find_caching_device_block(addr_t tag)
         auto it = tag2block.find(tag);
         if (it == tag2block.end())
             return std::make_pair(nullptr, 0);
-        assert(it->second.first->tag_ == tag);
+        assert(get_block_tag(compute_block_idx(tag), it->second.second) == tag);
         return it->second;
     }
     int block_idx = compute_block_idx(tag);
+    if (use_tag_array_) {
+        int way = find_way_in_tag_array(block_idx, tag);
+        if (way < 0)
+            return std::make_pair(nullptr, 0);
+        return std::make_pair(&get_caching_device_block(block_idx, way), way);
+    }
     for (int way = 0; way < associativity_; ++way) {
-        caching_device_block_t &block = get_caching_device_block(block_idx, way);
-        if (block.tag_ == tag)
-            return std::make_pair(&block, way);
+        if (get_block_tag(block_idx, way) == tag)
+            return std::make_pair(&get_caching_device_block(block_idx, way), way);
     }
     return std::make_pair(nullptr, 0);
 }
 
+int
+caching_device_t::find_way_in_tag_array(int block_idx, addr_t tag) const
+{
+    const addr_t *set_tags = &tags_[block_idx];
+    int width = associativity_ < kTagMatchWidth ? associativity_ : kTagMatchWidth;
+    for (int base = 0; base < associativity_; base += width) {
+        uint32_t match = match_tags(set_tags + base, tag, width);
+        if (match != 0)
+            return base + lowest_set_bit(match);
+    }
+    return -1;
+}
+
 void
 caching_device_t::request(const memref_t &memref_in)
 {
@@ -139,7 +220,7 @@ caching_device_t::request(const memref_t &memref_in)
         // Make sure last_tag_ is properly in sync.
         caching_device_block_t *cache_block =
             &get_caching_device_block(last_block_idx_, last_way_);
-        assert(tag != TAG_INVALID && tag == cache_block->tag_);
+        assert(tag != TAG_INVALID && tag == get_block_tag(last_block_idx_, last_way_));
         record_access_stats(memref_in, true /*hit*/, cache_block);
         access_update(last_block_idx_, last_way_);
         return;
@@ -187,7 +268,7 @@ caching_device_t::request(const memref_t &memref_in)
                 snoop_filter_->snoop(tag, id_, (memref.data.type == TRACE_TYPE_WRITE));
             }
 
-            addr_t victim_tag = cache_block->tag_;
+            addr_t victim_tag = get_block_tag(block_idx, way);
             // Check if we are inserting a new block, if we are then increment
             // the block loaded count.
             if (victim_tag == TAG_INVALID) {
@@ -224,7 +305,7 @@ caching_device_t::request(const memref_t &memref_in)
                     }
                 }
             }
-            update_tag(cache_block, way, tag);
+            update_tag(block_idx, way, tag);
         }
 
         access_update(block_idx, way);
@@ -251,7 +332,7 @@ void
 caching_device_t::access_update(int block_idx, int way)
 {
     // We just inc the counter for LFU.  We live with any blip on overflow.
-    get_caching_device_block(block_idx, way).counter_++;
+    get_block_counter(block_idx, way)++;
 }
 
 int
@@ -259,7 +340,7 @@ caching_device_t::replace_which_way(int block_idx)
 {
     int min_way = get_next_way_to_replace(block_idx);
     // Clear the counter for LFU.
-    get_caching_device_block(block_idx, min_way).counter_ = 0;
+    get_block_counter(block_idx, min_way) = 0;
     return min_way;
 }
 
@@ -272,12 +353,12 @@ caching_device_t::get_next_way_to_replace(const int block_idx) const
     int min_counter = 0; /* avoid "may be used uninitialized" with GCC 4.4.7 */
     int min_way = 0;
     for (int way = 0; way < associativity_; ++way) {
-        if (get_caching_device_block(block_idx, way).tag_ == TAG_INVALID) {
+        if (get_block_tag(block_idx, way) == TAG_INVALID) {
             min_way = way;
             break;
         }
-        if (way == 0 || get_caching_device_block(block_idx, way).counter_ < min_counter) {
-            min_counter = get_caching_device_block(block_idx, way).counter_;
+        if (way == 0 || get_block_counter(block_idx, way) < min_counter) {
+            min_counter = get_block_counter(block_idx, way);
             min_way = way;
         }
     }
@@ -289,7 +370,7 @@ caching_device_t::invalidate(addr_t tag, invalidation_type_t invalidation_type)
 {
     auto block_way = find_caching_device_block(tag);
     if (block_way.first != nullptr) {
-        invalidate_caching_device_block(block_way.first);
+        invalidate_caching_device_block(compute_block_idx(tag), block_way.second);
         stats_->invalidate(invalidation_type);
         // Invalidate last_tag_ if it was this tag.
         if (last_tag_ == tag) {
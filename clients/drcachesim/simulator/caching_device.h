@@ -96,6 +96,11 @@ public:
     {
         return parent_;
     }
+    int
+    get_num_blocks() const
+    {
+        return num_blocks_;
+    }
     inline double
     get_loaded_fraction() const
     {
@@ -115,6 +120,15 @@ public:
         }
         use_tag2block_table_ = use_hashtable;
     }
+    // Selects whether lookups compare the tags of a set several ways at a time
+    // rather than one by one.  init() enables this for devices with an
+    // associativity of 8 or more.  Must be called after init() and prior to
+    // any call to request().
+    void
+    set_tag_array_use(bool use_tag_array)
+    {
+        use_tag_array_ = use_tag_array;
+    }
     int
     get_block_index(const addr_t addr) const
     {
@@ -149,26 +163,42 @@ protected:
     {
         return *(blocks_[block_idx + way]);
     }
+    inline int &
+    get_block_counter(int block_idx, int way)
+    {
+        return counters_[block_idx + way];
+    }
+    inline int
+    get_block_counter(int block_idx, int way) const
+    {
+        return counters_[block_idx + way];
+    }
+    inline addr_t
+    get_block_tag(int block_idx, int way) const
+    {
+        return tags_[block_idx + way];
+    }
 
     inline void
-    invalidate_caching_device_block(caching_device_block_t *block)
+    invalidate_caching_device_block(int block_idx, int way)
     {
         if (use_tag2block_table_)
-            tag2block.erase(block->tag_);
-        block->tag_ = TAG_INVALID;
-        // Xref cache_block_t constructor about why we set counter to 0.
-        block->counter_ = 0;
+            tag2block.erase(tags_[block_idx + way]);
+        tags_[block_idx + way] = TAG_INVALID;
+        // Xref counters_ about why we set the counter to 0.
+        counters_[block_idx + way] = 0;
     }
 
     inline void
-    update_tag(caching_device_block_t *block, int way, addr_t new_tag)
+    update_tag(int block_idx, int way, addr_t new_tag)
     {
         if (use_tag2block_table_) {
-            if (block->tag_ != TAG_INVALID)
-                tag2block.erase(block->tag_);
-            tag2block[new_tag] = std::make_pair(block, way);
+            if (tags_[block_idx + way] != TAG_INVALID)
+                tag2block.erase(tags_[block_idx + way]);
+            tag2block[new_tag] =
+                std::make_pair(&get_caching_device_block(block_idx, way), way);
         }
-        block->tag_ = new_tag;
+        tags_[block_idx + way] = new_tag;
     }
 
     // Returns the block (and its way) whose tag equals `tag`.
@@ -176,6 +206,11 @@ protected:
     std::pair<caching_device_block_t *, int>
     find_caching_device_block(addr_t tag);
 
+    // Returns the way in the set starting at block_idx whose tags_ entry equals
+    // `tag`, or -1 if there is none.
+    int
+    find_way_in_tag_array(int block_idx, addr_t tag) const;
+
     // a pure virtual function for subclasses to initialize their own block array
     virtual void
     init_blocks() = 0;
@@ -204,6 +239,21 @@ protected:
     // correctly by base class pointers.
     caching_device_block_t **blocks_;
     int blocks_per_set_;
+    // The tag of each block, laid out contiguously in the same order as blocks_
+    // so that the ways of a set can be compared without dereferencing each
+    // block.  Tags must be changed only through update_tag() and
+    // invalidate_caching_device_block() to keep tag2block in sync.
+    std::vector<addr_t> tags_;
+    bool use_tag_array_ = false;
+    // The per-block counters for use by replacement policies, indexed like blocks_
+    // so that a policy can update a whole set without dereferencing each block.
+    // Initializing counters to 0 is just to be safe and to make it easier to write
+    // new replacement algorithms without errors, as we expect any use of a counter
+    // to only occur *after* a valid tag is put in place, where for the current
+    // replacement code we also set the counter at that time.
+    // XXX: using int_least64_t here results in a ~4% slowdown for 32-bit apps.
+    // A 32-bit counter should be sufficient but we may want to revisit.
+    std::vector<int> counters_;
     // Optimization fields for fast bit operations
     int blocks_per_set_mask_;
     int assoc_bits_;
@@ -166,6 +166,14 @@ public:
     virtual void
     child_access(const memref_t &memref, bool hit, caching_device_block_t *cache_block);
 
+    // Accounts for "count" child hits that were not reported individually
+    // through child_access().
+    void
+    add_child_hits(int_least64_t count)
+    {
+        num_child_hits_ += count;
+    }
+
     virtual void
     print_stats(std::string prefix);
 
@@ -0,0 +1,316 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include "core_sim_pool.h"
+#include <assert.h>
+
+core_sim_pool_t::core_sim_pool_t(unsigned int num_threads, unsigned int num_cores,
+                                 int line_size, cache_t *shared,
+                                 snoop_filter_t *snoop_filter)
+    : shared_(shared)
+    , snoop_filter_(snoop_filter)
+    , num_cores_(num_cores)
+{
+    while ((1 << line_bits_) < line_size)
+        ++line_bits_;
+    if (num_threads > num_cores)
+        num_threads = num_cores;
+    for (unsigned int i = 0; i < num_threads; ++i) {
+        workers_.emplace_back(new worker_t(line_size));
+        worker_t *worker = workers_.back().get();
+        // The stand-in is never looked up: it only needs a parent and stats.
+        worker->parent.init(1, line_size, line_size, nullptr, &worker->stats);
+        worker->parent.out = &worker->output[0];
+    }
+}
+
+core_sim_pool_t::~core_sim_pool_t()
+{
+    if (in_flight_)
+        wait_for_workers();
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        exiting_ = true;
+    }
+    start_cond_.notify_all();
+    for (auto &worker : workers_) {
+        if (worker->thread.joinable())
+            worker->thread.join();
+    }
+}
+
+caching_device_t *
+core_sim_pool_t::get_private_parent(unsigned int core)
+{
+    return &workers_[core % workers_.size()]->parent;
+}
+
+snoop_filter_t *
+core_sim_pool_t::get_private_snoop_filter(unsigned int core)
+{
+    if (snoop_filter_ == nullptr)
+        return nullptr;
+    return &workers_[core % workers_.size()]->snoop_filter;
+}
+
+void
+core_sim_pool_t::start(cache_t **icaches, cache_t **dcaches)
+{
+    icaches_ = icaches;
+    dcaches_ = dcaches;
+    for (unsigned int core = 0; core < num_cores_; ++core) {
+        prune_threshold_ +=
+            4 * (icaches[core]->get_num_blocks() + dcaches[core]->get_num_blocks());
+    }
+    for (auto &worker : workers_)
+        worker->thread = std::thread(&core_sim_pool_t::worker_main, this, worker.get());
+}
+
+void
+core_sim_pool_t::add(unsigned int core, request_kind_t kind, const memref_t &memref)
+{
+    if (snoop_filter_ != nullptr && line_owner_.size() >= prune_threshold_)
+        prune_line_owners();
+    worker_t *worker = workers_[core % workers_.size()].get();
+    worker->input[fill_buf_].push_back({ fill_count_, core, kind, memref });
+    bool end_epoch = ++fill_count_ == epoch_size_;
+    if (snoop_filter_ != nullptr && may_invalidate(core, kind, memref))
+        end_epoch = true;
+    if (serial_) {
+        // The workers are idle, so we can drive the private caches ourselves.
+        simulate(worker, fill_buf_);
+        replay(fill_buf_);
+        fill_count_ = 0;
+    } else if (end_epoch)
+        advance_epoch();
+}
+
+bool
+core_sim_pool_t::may_invalidate(unsigned int core, request_kind_t kind,
+                                const memref_t &memref)
+{
+    if (kind != REQUEST_ICACHE && kind != REQUEST_DCACHE)
+        return false;
+    int cache = 2 * core + (kind == REQUEST_DCACHE ? 1 : 0);
+    addr_t end = memref.data.addr + (memref.data.size == 0 ? 0 : memref.data.size - 1);
+    addr_t first = memref.data.addr >> line_bits_;
+    addr_t last = end >> line_bits_;
+    bool shared = false;
+    for (addr_t line = first; line <= last; ++line) {
+        auto it = line_owner_.emplace(line, cache).first;
+        if (it->second != cache)
+            it->second = LINE_SHARED;
+        if (it->second == LINE_SHARED)
+            shared = true;
+    }
+    // A next-line prefetcher may bring in the line after each one accessed.
+    if (kind == REQUEST_DCACHE && dcaches_[core]->get_prefetcher() != nullptr) {
+        auto it = line_owner_.emplace(last + 1, cache).first;
+        if (it->second != cache)
+            it->second = LINE_SHARED;
+    }
+    return shared && memref.data.type == TRACE_TYPE_WRITE;
+}
+
+void
+core_sim_pool_t::prune_line_owners()
+{
+    sync();
+    // The private caches are idle and current, so whichever of them does not
+    // hold a line now can only get it through a later reference, which
+    // may_invalidate() will record.
+    auto holds = [this](int cache, addr_t line) {
+        cache_t *device = (cache % 2 == 0 ? icaches_ : dcaches_)[cache / 2];
+        return device->contains_tag(line);
+    };
+    for (auto it = line_owner_.begin(); it != line_owner_.end();) {
+        int owner = it->second;
+        if (owner == LINE_SHARED) {
+            int holders = 0;
+            for (int cache = 0; cache < 2 * (int)num_cores_ && holders < 2; ++cache) {
+                if (holds(cache, it->first)) {
+                    owner = cache;
+                    ++holders;
+                }
+            }
+            if (holders == 0)
+                it = line_owner_.erase(it);
+            else {
+                it->second = holders == 1 ? owner : LINE_SHARED;
+                ++it;
+            }
+        } else if (!holds(owner, it->first))
+            it = line_owner_.erase(it);
+        else
+            ++it;
+    }
+}
+
+void
+core_sim_pool_t::set_serial(bool serial)
+{
+    sync();
+    serial_ = serial;
+}
+
+void
+core_sim_pool_t::sync()
+{
+    if (fill_count_ > 0)
+        advance_epoch();
+    if (in_flight_) {
+        wait_for_workers();
+        in_flight_ = false;
+        replay(run_buf_);
+    }
+}
+
+void
+core_sim_pool_t::worker_main(worker_t *worker)
+{
+    uint64_t seen_epoch = 0;
+    while (true) {
+        int buf;
+        {
+            std::unique_lock<std::mutex> guard(lock_);
+            start_cond_.wait(guard, [&] { return exiting_ || epoch_ != seen_epoch; });
+            if (exiting_)
+                return;
+            seen_epoch = epoch_;
+            buf = run_buf_;
+        }
+        simulate(worker, buf);
+        std::lock_guard<std::mutex> guard(lock_);
+        if (--running_workers_ == 0)
+            done_cond_.notify_one();
+    }
+}
+
+void
+core_sim_pool_t::simulate(worker_t *worker, int buf)
+{
+    worker->parent.out = &worker->output[buf];
+    for (const input_t &input : worker->input[buf]) {
+        worker->parent.seq = input.seq;
+        switch (input.kind) {
+        case REQUEST_ICACHE: icaches_[input.core]->request(input.memref); break;
+        case REQUEST_DCACHE: dcaches_[input.core]->request(input.memref); break;
+        case FLUSH_ICACHE: icaches_[input.core]->flush(input.memref); break;
+        case FLUSH_DCACHE: dcaches_[input.core]->flush(input.memref); break;
+        }
+    }
+    worker->child_hits[buf] = worker->stats.child_hits;
+    worker->stats.child_hits = 0;
+}
+
+void
+core_sim_pool_t::advance_epoch()
+{
+    bool drain_prior = in_flight_;
+    if (in_flight_)
+        wait_for_workers();
+    int prior_buf = 1 - fill_buf_;
+    // The snoop filter invalidates lines in the private caches, so with
+    // coherence we must drain before the workers resume.
+    if (drain_prior && snoop_filter_ != nullptr) {
+        replay(prior_buf);
+        drain_prior = false;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        run_buf_ = fill_buf_;
+        running_workers_ = static_cast<unsigned int>(workers_.size());
+        ++epoch_;
+    }
+    start_cond_.notify_all();
+    in_flight_ = true;
+    fill_buf_ = prior_buf;
+    fill_count_ = 0;
+    // The workers never touch the shared cache, so without coherence we can
+    // apply the prior epoch's requests to it while they run.
+    if (drain_prior)
+        replay(prior_buf);
+}
+
+void
+core_sim_pool_t::wait_for_workers()
+{
+    std::unique_lock<std::mutex> guard(lock_);
+    done_cond_.wait(guard, [&] { return running_workers_ == 0; });
+}
+
+void
+core_sim_pool_t::replay(int buf)
+{
+    // Each worker's output is already in trace order, and all the requests
+    // caused by one reference come from a single worker, so a merge on the
+    // trace position reproduces the serial order.
+    std::vector<size_t> pos(workers_.size(), 0);
+    while (true) {
+        worker_t *next = nullptr;
+        size_t next_idx = 0;
+        for (size_t i = 0; i < workers_.size(); ++i) {
+            const std::vector<output_t> &output = workers_[i]->output[buf];
+            if (pos[i] < output.size() &&
+                (next == nullptr ||
+                 output[pos[i]].seq < next->output[buf][pos[next_idx]].seq)) {
+                next = workers_[i].get();
+                next_idx = i;
+            }
+        }
+        if (next == nullptr)
+            break;
+        uint32_t seq = next->output[buf][pos[next_idx]].seq;
+        for (; pos[next_idx] < next->output[buf].size() &&
+             next->output[buf][pos[next_idx]].seq == seq;
+             ++pos[next_idx]) {
+            const output_t &output = next->output[buf][pos[next_idx]];
+            switch (output.kind) {
+            case OUTPUT_REQUEST: shared_->request(output.memref); break;
+            case OUTPUT_FLUSH: shared_->flush(output.memref); break;
+            case OUTPUT_SNOOP: snoop_filter_->snoop(output.tag, output.id, false); break;
+            case OUTPUT_SNOOP_WRITE:
+                snoop_filter_->snoop(output.tag, output.id, true);
+                break;
+            case OUTPUT_SNOOP_EVICTION:
+                snoop_filter_->snoop_eviction(output.tag, output.id);
+                break;
+            }
+        }
+    }
+    for (auto &worker : workers_) {
+        shared_->get_stats()->add_child_hits(worker->child_hits[buf]);
+        worker->child_hits[buf] = 0;
+        worker->input[buf].clear();
+        worker->output[buf].clear();
+    }
+}
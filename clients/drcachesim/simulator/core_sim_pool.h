@@ -0,0 +1,300 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* core_sim_pool: simulates the private caches of each core on host worker
+ * threads for cache_simulator_t.
+ *
+ * The trace is cut into epochs.  During an epoch each worker runs the
+ * references for its cores through their private caches, and every request
+ * those caches would have sent to the shared cache is instead recorded along
+ * with the trace position of the reference that caused it.  At the end of the
+ * epoch the recorded requests of all workers are merged by trace position and
+ * applied to the shared cache on the calling thread, overlapped with the
+ * workers' processing of the next epoch.  The shared cache thus sees exactly
+ * the request sequence of serial simulation.  This requires that nothing flows
+ * back down from the shared cache into the private caches, so the shared cache
+ * must not be inclusive.
+ *
+ * With coherence, the private caches' calls to the snoop filter are recorded
+ * alongside their shared cache requests and replayed with them while the
+ * workers are idle, so the invalidations the snoop filter issues reach the
+ * private caches in trace order.  To keep an invalidation from arriving after
+ * a later reference to the cache it targets, an epoch ends at any write to a
+ * line that another private cache may hold.  Writes to shared lines thus
+ * shorten epochs and reduce parallelism, but not accuracy.
+ */
+
+#ifndef _CORE_SIM_POOL_H_
+#define _CORE_SIM_POOL_H_ 1
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "../common/memref.h"
+#include "cache.h"
+#include "caching_device_stats.h"
+#include "snoop_filter.h"
+
+class core_sim_pool_t {
+public:
+    // The private cache operation requested for a reference.
+    enum request_kind_t {
+        REQUEST_ICACHE,
+        REQUEST_DCACHE,
+        FLUSH_ICACHE,
+        FLUSH_DCACHE,
+    };
+
+    // Creates "num_threads" workers, capped at "num_cores", whose private caches
+    // will send their misses and flushes to "shared" and, if non-null, their
+    // coherence traffic to "snoop_filter".
+    core_sim_pool_t(unsigned int num_threads, unsigned int num_cores, int line_size,
+                    cache_t *shared, snoop_filter_t *snoop_filter);
+    ~core_sim_pool_t();
+
+    // Returns the device to pass as the parent when initializing the private
+    // caches of "core".
+    caching_device_t *
+    get_private_parent(unsigned int core);
+
+    // Returns the snoop filter to pass when initializing the private caches of
+    // "core", or nullptr without coherence.
+    snoop_filter_t *
+    get_private_snoop_filter(unsigned int core);
+
+    cache_t *
+    get_shared() const
+    {
+        return shared_;
+    }
+
+    // Starts the workers.  Must be called once all private caches are initialized
+    // and before any call to add().
+    void
+    start(cache_t **icaches, cache_t **dcaches);
+
+    // Queues one reference for the private caches of "core".
+    void
+    add(unsigned int core, request_kind_t kind, const memref_t &memref);
+
+    // Finishes simulating every queued reference in both the private caches and
+    // the shared cache.
+    void
+    sync();
+
+    // While "serial" is set, each reference is fully simulated on the calling
+    // thread by add(), so the shared cache is current after every reference.
+    void
+    set_serial(bool serial);
+
+private:
+    // A reference queued for a worker, tagged with its position in the epoch.
+    struct input_t {
+        uint32_t seq;
+        unsigned int core;
+        request_kind_t kind;
+        memref_t memref;
+    };
+
+    // What a private cache sent to its parent or to the snoop filter.
+    enum output_kind_t {
+        OUTPUT_REQUEST,
+        OUTPUT_FLUSH,
+        OUTPUT_SNOOP,
+        OUTPUT_SNOOP_WRITE,
+        OUTPUT_SNOOP_EVICTION,
+    };
+
+    // A request headed for the shared cache or the snoop filter, tagged with the
+    // position of the reference that caused it.  Requests and flushes use
+    // "memref"; snoops use "tag" and "id".
+    struct output_t {
+        uint32_t seq;
+        output_kind_t kind;
+        memref_t memref;
+        addr_t tag;
+        int id;
+    };
+
+    // Counts the hits that private caches report to their parent, which serial
+    // simulation records in the shared cache's statistics.
+    class deferred_stats_t : public caching_device_stats_t {
+    public:
+        explicit deferred_stats_t(int block_size)
+            : caching_device_stats_t("", block_size)
+        {
+        }
+        void
+        child_access(const memref_t &memref, bool hit,
+                     caching_device_block_t *cache_block) override
+        {
+            if (hit)
+                ++child_hits;
+        }
+        int_least64_t child_hits = 0;
+    };
+
+    // Stands in for the shared cache as the parent of one worker's private
+    // caches, recording what is sent to it.
+    class deferred_parent_t : public cache_t {
+    public:
+        void
+        request(const memref_t &memref) override
+        {
+            out->push_back({ seq, OUTPUT_REQUEST, memref, 0, 0 });
+        }
+        void
+        flush(const memref_t &memref) override
+        {
+            out->push_back({ seq, OUTPUT_FLUSH, memref, 0, 0 });
+        }
+        std::vector<output_t> *out = nullptr;
+        uint32_t seq = 0;
+    };
+
+    // Stands in for the snoop filter for one worker's private caches, recording
+    // their calls into the same output as "parent".
+    class deferred_snoop_filter_t : public snoop_filter_t {
+    public:
+        explicit deferred_snoop_filter_t(deferred_parent_t *parent)
+            : parent_(parent)
+        {
+        }
+        void
+        snoop(addr_t tag, int id, bool is_write) override
+        {
+            parent_->out->push_back({ parent_->seq,
+                                      is_write ? OUTPUT_SNOOP_WRITE : OUTPUT_SNOOP,
+                                      {},
+                                      tag,
+                                      id });
+        }
+        void
+        snoop_eviction(addr_t tag, int id) override
+        {
+            parent_->out->push_back(
+                { parent_->seq, OUTPUT_SNOOP_EVICTION, {}, tag, id });
+        }
+
+    private:
+        deferred_parent_t *parent_;
+    };
+
+    // The state of one worker.  The input and output vectors are double-buffered:
+    // the worker owns the pair for the epoch in flight while the calling thread
+    // fills the next epoch's input and drains the previous epoch's output.
+    struct worker_t {
+        explicit worker_t(int line_size)
+            : stats(line_size)
+            , snoop_filter(&parent)
+        {
+        }
+        deferred_stats_t stats;
+        deferred_parent_t parent;
+        deferred_snoop_filter_t snoop_filter;
+        std::vector<input_t> input[2];
+        std::vector<output_t> output[2];
+        int_least64_t child_hits[2] = { 0, 0 };
+        std::thread thread;
+    };
+
+    void
+    worker_main(worker_t *worker);
+
+    // Runs the references in "worker"'s input buffer "buf" through its private
+    // caches.
+    void
+    simulate(worker_t *worker, int buf);
+
+    // Records which private caches "memref" may bring lines into, and returns
+    // whether it is a write that may invalidate a line held by another one.
+    bool
+    may_invalidate(unsigned int core, request_kind_t kind, const memref_t &memref);
+
+    // Hands the filling buffer to the workers and drains the previous epoch.
+    void
+    advance_epoch();
+
+    // Waits for the epoch in flight to complete.
+    void
+    wait_for_workers();
+
+    // Applies the shared cache requests recorded in buffer "buf" in trace order.
+    void
+    replay(int buf);
+
+    // Drops from line_owner_ the lines that no private cache holds any longer,
+    // and narrows shared lines held by a single cache to that cache.  Finishes
+    // all queued references first so that the private caches are current.
+    void
+    prune_line_owners();
+
+    cache_t *shared_;
+    snoop_filter_t *snoop_filter_;
+    unsigned int num_cores_;
+    int line_bits_ = 0;
+    cache_t **icaches_ = nullptr;
+    cache_t **dcaches_ = nullptr;
+    std::vector<std::unique_ptr<worker_t>> workers_;
+
+    // Accessed only by the calling thread.
+    int fill_buf_ = 0;
+    uint32_t fill_count_ = 0;
+    bool in_flight_ = false;
+    bool serial_ = false;
+    // For coherence, maps each line that may be in a private cache to the one
+    // private cache that may hold it, identified as 2 * core plus 1 for data, or
+    // to LINE_SHARED if several may.
+    std::unordered_map<addr_t, int> line_owner_;
+    static const int LINE_SHARED = -1;
+    // line_owner_ is pruned once it reaches this size, a multiple of the number
+    // of lines the private caches can hold, so that pruning, which leaves at
+    // most that many, has an amortized constant cost per added line.
+    size_t prune_threshold_ = 0;
+
+    std::mutex lock_; // Protects all fields below.
+    std::condition_variable start_cond_;
+    std::condition_variable done_cond_;
+    uint64_t epoch_ = 0;
+    int run_buf_ = 0;
+    unsigned int running_workers_ = 0;
+    bool exiting_ = false;
+
+    // The number of references per epoch.  This balances the cost of the
+    // barrier against the memory held in the buffers.
+    static const uint32_t epoch_size_ = 16 * 1024;
+};
+
+#endif /* _CORE_SIM_POOL_H_ */
@@ -69,7 +69,7 @@ tlb_t::request(const memref_t &memref_in)
         // Make sure last_tag_ and pid are properly in sync.
         caching_device_block_t *tlb_entry =
             &get_caching_device_block(last_block_idx_, last_way_);
-        assert(tag != TAG_INVALID && tag == tlb_entry->tag_ &&
+        assert(tag != TAG_INVALID && tag == get_block_tag(last_block_idx_, last_way_) &&
                pid == ((tlb_entry_t *)tlb_entry)->pid_);
         record_access_stats(memref_in, true /*hit*/, tlb_entry);
         access_update(last_block_idx_, last_way_);
@@ -86,7 +86,8 @@ tlb_t::request(const memref_t &memref_in)
 
         for (way = 0; way < associativity_; ++way) {
             caching_device_block_t *tlb_entry = &get_caching_device_block(block_idx, way);
-            if (tlb_entry->tag_ == tag && ((tlb_entry_t *)tlb_entry)->pid_ == pid) {
+            if (get_block_tag(block_idx, way) == tag &&
+                ((tlb_entry_t *)tlb_entry)->pid_ == pid) {
                 record_access_stats(memref, true /*hit*/, tlb_entry);
                 break;
             }
@@ -103,7 +104,7 @@ tlb_t::request(const memref_t &memref_in)
 
             // XXX: do we need to handle TLB coherency?
 
-            tlb_entry->tag_ = tag;
+            update_tag(block_idx, way, tag);
             ((tlb_entry_t *)tlb_entry)->pid_ = pid;
         }
 
@@ -0,0 +1,144 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, LLC  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, LLC nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, LLC OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* Microbenchmark for the set lookup performed by caching_device_t::request().
+ * We drive L1-like and LLC-like LRU caches with a synthetic stream that mixes
+ * sequential and random lines, once scanning each set's blocks and once scanning
+ * its contiguous tag array, and report simulated references/second for each.
+ * We also check that both lookups produce the same hit and miss counts so this
+ * doubles as a regression test.
+ *
+ * Usage: cache_lookup_benchmark [num_refs]
+ */
+
+#include <stdint.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../simulator/cache_lru.h"
+#include "../simulator/cache_stats.h"
+#include "../common/memref.h"
+
+namespace {
+
+struct cache_config_t {
+    const char *name;
+    int associativity;
+    int line_size;
+    int total_size;
+};
+
+static std::vector<addr_t>
+make_addresses(const cache_config_t &config, int num_refs)
+{
+    // We touch four times the cache capacity so there is a steady stream of
+    // misses and evictions alongside the hits.
+    const uint64_t num_lines = 4ULL * config.total_size / config.line_size;
+    std::vector<addr_t> addrs;
+    addrs.reserve(num_refs);
+    uint64_t rand_state = 42;
+    addr_t addr = 0;
+    for (int i = 0; i < num_refs; ++i) {
+        // A simple LCG keeps the stream reproducible across platforms.
+        rand_state = rand_state * 6364136223846793005ULL + 1442695040888963407ULL;
+        if ((rand_state >> 60) < 4) {
+            addr = static_cast<addr_t>(((rand_state >> 16) % num_lines) *
+                                       config.line_size);
+        } else
+            addr += 16;
+        addrs.push_back(addr);
+    }
+    return addrs;
+}
+
+static bool
+run_config(const cache_config_t &config, bool use_tag_array,
+           const std::vector<addr_t> &addrs, int64_t *hits, int64_t *misses)
+{
+    cache_stats_t stats(config.line_size);
+    cache_lru_t cache;
+    if (!cache.init(config.associativity, config.line_size, config.total_size, nullptr,
+                    &stats, nullptr)) {
+        std::cerr << "Failed to initialize " << config.name << "\n";
+        return false;
+    }
+    cache.set_tag_array_use(use_tag_array);
+    memref_t ref = {};
+    ref.data.type = TRACE_TYPE_READ;
+    ref.data.size = 4;
+    auto start = std::chrono::steady_clock::now();
+    for (addr_t addr : addrs) {
+        ref.data.addr = addr;
+        cache.request(ref);
+    }
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+    *hits = stats.get_metric(metric_name_t::HITS);
+    *misses = stats.get_metric(metric_name_t::MISSES);
+    std::cerr << config.name << " " << config.associativity << "-way "
+              << (use_tag_array ? "tag array" : "block scan") << ": " << addrs.size()
+              << " refs in " << secs.count() << "s = "
+              << (secs.count() > 0 ? addrs.size() / secs.count() : 0.) << " refs/s\n";
+    return true;
+}
+
+} // namespace
+
+int
+main(int argc, const char *argv[])
+{
+    int num_refs = argc > 1 ? std::stoi(argv[1]) : 10000000;
+    const cache_config_t configs[] = {
+        { "L1", 8, 64, 32 * 1024 },
+        { "LLC", 16, 64, 8 * 1024 * 1024 },
+    };
+    for (const cache_config_t &config : configs) {
+        std::vector<addr_t> addrs = make_addresses(config, num_refs);
+        int64_t scan_hits, scan_misses, array_hits, array_misses;
+        if (!run_config(config, false, addrs, &scan_hits, &scan_misses) ||
+            !run_config(config, true, addrs, &array_hits, &array_misses)) {
+            std::cerr << "cache_lookup_benchmark FAILED\n";
+            return 1;
+        }
+        if (scan_hits != array_hits || scan_misses != array_misses) {
+            std::cerr << config.name << " mismatch: block scan " << scan_hits << "/"
+                      << scan_misses << " vs tag array " << array_hits << "/"
+                      << array_misses << " hits/misses\n";
+            std::cerr << "cache_lookup_benchmark FAILED\n";
+            return 1;
+        }
+    }
+    std::cerr << "cache_lookup_benchmark passed\n";
+    return 0;
+}
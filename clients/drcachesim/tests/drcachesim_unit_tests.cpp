@@ -32,12 +32,33 @@
 
 // Unit tests for drcachesim
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string.h>
+#include <thread>
+#include <vector>
 #undef NDEBUG
 #include <assert.h>
 #include "cache_replacement_policy_unit_test.h"
 #include "simulator/cache_simulator.h"
+#include "simulator/cache_sweep_simulator.h"
 #include "../common/memref.h"
+#include "../common/shm_ring.h"
+#include "reader/read_ahead.h"
+#ifdef HAS_ZLIB
+#    include "../common/chunked_gzip_ostream.h"
+#    include "reader/compressed_file_reader.h"
+#    include "analyzer.h"
+#endif
+#ifdef UNIX
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
 
 static cache_simulator_knobs_t
 make_test_knobs()
@@ -306,6 +327,793 @@ LLC {
            num_accesses - 1);
 }
 
+static void
+run_core_sim_threads_trace(cache_simulator_t &cache_sim)
+{
+    // Eight threads spread over four cores, each with private code and data plus
+    // a shared data region, long enough to span several core_sim_pool_t epochs.
+    const int num_threads = 8;
+    const int num_refs = 200000;
+    uint32_t rand_state = 1;
+    for (int i = 0; i < num_refs; i++) {
+        rand_state = rand_state * 1103515245 + 12345;
+        uint32_t rnd = rand_state >> 8;
+        memref_t ref = {};
+        ref.data.pid = 1;
+        ref.data.tid = 1 + (i / 64 + rnd % 2) % num_threads;
+        addr_t base = static_cast<addr_t>(ref.data.tid) << 24;
+        if (i % 3 == 0) {
+            ref.instr.type = TRACE_TYPE_INSTR;
+            ref.instr.addr = base + (rnd % 4096) * 4;
+            ref.instr.size = 4;
+        } else if (i % 4099 == 0) {
+            ref.flush.type = TRACE_TYPE_DATA_FLUSH;
+            ref.flush.addr = base + 0x100000 + (rnd % 1024) * 64;
+            ref.flush.size = 256;
+        } else {
+            ref.data.type = (rnd & 0x10) != 0 ? TRACE_TYPE_WRITE : TRACE_TYPE_READ;
+            ref.data.addr = ((rnd & 0x20) != 0 ? 0x7f000000 : base + 0x100000) +
+                (rnd % 8192) * 8;
+            ref.data.size = 8;
+        }
+        if (!cache_sim.process_memref(ref)) {
+            std::cerr << "drcachesim unit_test_core_sim_threads failed: "
+                      << cache_sim.get_error_string() << "\n";
+            exit(1);
+        }
+    }
+}
+
+static void
+check_core_sim_threads(cache_simulator_knobs_t knobs, const char *config)
+{
+    // Simulating the L1 caches on worker threads must not change any result.
+    knobs.core_sim_threads = 0;
+    cache_simulator_t serial_sim(knobs);
+    run_core_sim_threads_trace(serial_sim);
+    if ((knobs.warmup_refs > 0 || knobs.warmup_fraction > 0.0) &&
+        serial_sim.get_cache_metric(metric_name_t::MISSES_AT_RESET, 2, 0) == 0) {
+        std::cerr << "drcachesim unit_test_core_sim_threads failed: " << config
+                  << " never warmed up\n";
+        exit(1);
+    }
+    const metric_name_t metrics[] = { metric_name_t::HITS,
+                                      metric_name_t::MISSES,
+                                      metric_name_t::HITS_AT_RESET,
+                                      metric_name_t::MISSES_AT_RESET,
+                                      metric_name_t::COMPULSORY_MISSES,
+                                      metric_name_t::CHILD_HITS,
+                                      metric_name_t::COHERENCE_INVALIDATES,
+                                      metric_name_t::PREFETCH_HITS,
+                                      metric_name_t::PREFETCH_MISSES,
+                                      metric_name_t::FLUSHES };
+    // Try both one thread per core and cores sharing a thread.
+    for (unsigned int threads = 2; threads <= knobs.num_cores; threads += 2) {
+        knobs.core_sim_threads = threads;
+        cache_simulator_t parallel_sim(knobs);
+        if (!parallel_sim) {
+            std::cerr << "drcachesim unit_test_core_sim_threads failed: "
+                      << parallel_sim.get_error_string() << "\n";
+            exit(1);
+        }
+        run_core_sim_threads_trace(parallel_sim);
+        for (metric_name_t metric : metrics) {
+            for (unsigned int core = 0; core < knobs.num_cores; core++) {
+                for (unsigned int level = 1; level <= 2; level++) {
+                    for (cache_split_t split :
+                         { cache_split_t::DATA, cache_split_t::INSTRUCTION }) {
+                        if (serial_sim.get_cache_metric(metric, level, core, split) !=
+                            parallel_sim.get_cache_metric(metric, level, core, split)) {
+                            std::cerr << "drcachesim unit_test_core_sim_threads failed: "
+                                      << config << " mismatch for metric "
+                                      << (int)metric << " level " << level << " core "
+                                      << core << " with " << threads << " threads\n";
+                            exit(1);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void
+unit_test_core_sim_threads()
+{
+    cache_simulator_knobs_t knobs;
+    knobs.L1I_size = 4 * 1024;
+    knobs.L1D_size = 8 * 1024;
+    knobs.LL_size = 64 * 1024;
+    check_core_sim_threads(knobs, "default");
+    knobs.model_coherence = true;
+    check_core_sim_threads(knobs, "coherence");
+    knobs.model_coherence = false;
+    knobs.warmup_refs = 50000;
+    check_core_sim_threads(knobs, "warmup_refs");
+    knobs.warmup_refs = 0;
+    knobs.warmup_fraction = 0.5;
+    check_core_sim_threads(knobs, "warmup_fraction");
+    knobs.model_coherence = true;
+    check_core_sim_threads(knobs, "coherence with warmup_fraction");
+}
+
+static std::vector<memref_t>
+make_cache_sweep_trace()
+{
+    // Six threads over two cores with unaligned accesses that span lines,
+    // software prefetches, and thread exits that reshuffle the cores.
+    const int num_threads = 6;
+    const int num_refs = 100000;
+    std::vector<memref_t> trace;
+    uint32_t rand_state = 7;
+    for (int i = 0; i < num_refs; i++) {
+        rand_state = rand_state * 1103515245 + 12345;
+        uint32_t rnd = rand_state >> 8;
+        memref_t ref = {};
+        ref.data.pid = 1;
+        ref.data.tid = 1 + (i / 128 + rnd % 2) % num_threads;
+        addr_t base = static_cast<addr_t>(ref.data.tid) << 24;
+        if (i % 20011 == 20010) {
+            ref.exit.type = TRACE_TYPE_THREAD_EXIT;
+            ref.exit.tid = ref.data.tid;
+        } else if (i % 3 == 0) {
+            ref.instr.type = TRACE_TYPE_INSTR;
+            ref.instr.addr = base + (rnd % 2048) * 3;
+            ref.instr.size = 5;
+        } else {
+            if ((rnd & 0x40) != 0)
+                ref.data.type = TRACE_TYPE_PREFETCH;
+            else
+                ref.data.type = (rnd & 0x10) != 0 ? TRACE_TYPE_WRITE : TRACE_TYPE_READ;
+            ref.data.addr = ((rnd & 0x20) != 0 ? 0x7f000000 : base + 0x100000) +
+                (rnd % 6000) * 12;
+            ref.data.size = 8 << (rnd % 4);
+        }
+        trace.push_back(ref);
+    }
+    return trace;
+}
+
+void
+unit_test_cache_sweep()
+{
+    // Each hierarchy of a sweep must match a separate cache_simulator_t run.
+    cache_simulator_knobs_t knobs;
+    knobs.num_cores = 2;
+    knobs.L1I_size = 2 * 1024;
+    knobs.L1I_assoc = 2;
+    knobs.data_prefetcher = "none";
+    knobs.skip_refs = 1000;
+    knobs.sim_refs = 90000;
+    cache_sweep_knobs_t sweep;
+    sweep.L1D_sizes = { 1024, 4 * 1024, 16 * 1024 };
+    sweep.L1D_assocs = { 1, 4, 16 };
+    sweep.LL_sizes = { 32 * 1024, 128 * 1024 };
+    sweep.LL_assocs = { 2, 8 };
+    std::vector<memref_t> trace = make_cache_sweep_trace();
+    cache_sweep_simulator_t sweep_sim(knobs, sweep);
+    for (const memref_t &ref : trace) {
+        if (!sweep_sim.process_memref(ref)) {
+            std::cerr << "drcachesim unit_test_cache_sweep failed: "
+                      << sweep_sim.get_error_string() << "\n";
+            exit(1);
+        }
+    }
+    assert(sweep_sim.get_config_count() == 36);
+    const metric_name_t metrics[] = { metric_name_t::HITS,
+                                      metric_name_t::MISSES,
+                                      metric_name_t::COMPULSORY_MISSES,
+                                      metric_name_t::CHILD_HITS,
+                                      metric_name_t::PREFETCH_HITS,
+                                      metric_name_t::PREFETCH_MISSES };
+    for (size_t config = 0; config < sweep_sim.get_config_count(); config++) {
+        sweep_sim.get_config(config, &knobs.L1D_size, &knobs.L1D_assoc, &knobs.LL_size,
+                             &knobs.LL_assoc);
+        cache_simulator_t cache_sim(knobs);
+        for (const memref_t &ref : trace)
+            cache_sim.process_memref(ref);
+        for (metric_name_t metric : metrics) {
+            for (unsigned int core = 0; core < knobs.num_cores; core++) {
+                for (unsigned int level = 1; level <= 2; level++) {
+                    for (cache_split_t split :
+                         { cache_split_t::DATA, cache_split_t::INSTRUCTION }) {
+                        if (cache_sim.get_cache_metric(metric, level, core, split) !=
+                            sweep_sim.get_cache_metric(config, metric, level, core,
+                                                       split)) {
+                            std::cerr << "drcachesim unit_test_cache_sweep failed: "
+                                      << "mismatch for metric " << (int)metric
+                                      << " level " << level << " core " << core
+                                      << " config " << config << "\n";
+                            exit(1);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    knobs.data_prefetcher = "nextline";
+    cache_sweep_simulator_t prefetch_sim(knobs, sweep);
+    bool rejected = !prefetch_sim;
+    if (!rejected) {
+        std::cerr << "drcachesim unit_test_cache_sweep failed: "
+                  << "a prefetcher should be rejected\n";
+        exit(1);
+    }
+}
+
+void
+unit_test_shm_ring()
+{
+    // A small ring forces wraparound, padding, and writers waiting for space.
+    const size_t capacity = 4096;
+    const int num_writers = 4;
+    const int records_per_writer = 5000;
+    size_t region_size = shm_ring_t::get_region_size(capacity);
+    void *region = calloc(1, region_size);
+    assert(region != nullptr);
+    shm_ring_t::initialize(region, capacity, 7);
+    shm_ring_t reader;
+    assert(reader.attach_region(region, region_size));
+    assert(!reader.had_writers());
+    assert(reader.get_reader() == 7);
+    // Each record holds its writer, its sequence number, and a size-dependent
+    // number of filler bytes derived from both.
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_writers; ++i) {
+        assert(reader.add_writer(100 + i));
+        threads.emplace_back([region, region_size, i]() {
+            shm_ring_t writer;
+            assert(writer.attach_region(region, region_size));
+            std::vector<unsigned char> buf(writer.get_max_record_size());
+            for (int seq = 0; seq < records_per_writer; ++seq) {
+                size_t size = 2 + (seq * 37 + i * 11) % (buf.size() - 2);
+                buf[0] = static_cast<unsigned char>(i);
+                buf[1] = static_cast<unsigned char>(seq);
+                for (size_t j = 2; j < size; ++j)
+                    buf[j] = static_cast<unsigned char>(seq + i + j);
+                while (!writer.try_write(buf.data(), size))
+                    std::this_thread::yield();
+            }
+            writer.remove_writer(100 + i);
+        });
+    }
+    assert(reader.had_writers());
+    std::vector<int> next_seq(num_writers, 0);
+    for (int received = 0; received < num_writers * records_per_writer;) {
+        size_t size;
+        const unsigned char *record =
+            reinterpret_cast<const unsigned char *>(reader.peek(&size));
+        if (record == nullptr) {
+            std::this_thread::yield();
+            continue;
+        }
+        int i = record[0];
+        assert(i < num_writers);
+        int seq = next_seq[i]++;
+        assert(record[1] == static_cast<unsigned char>(seq));
+        assert(size == 2 + (seq * 37 + i * 11) % (reader.get_max_record_size() - 2));
+        for (size_t j = 2; j < size; ++j)
+            assert(record[j] == static_cast<unsigned char>(seq + i + j));
+        reader.release();
+        ++received;
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+    size_t size;
+    assert(reader.peek(&size) == nullptr);
+    assert(reader.count_live_writers([](int32_t pid) { return true; }) == 0);
+    // Writers that are gone without unregistering are removed.
+    assert(reader.add_writer(42) && reader.add_writer(43));
+    assert(reader.count_live_writers([](int32_t pid) { return pid == 43; }) == 1);
+    assert(reader.count_live_writers([](int32_t pid) { return true; }) == 1);
+    reader.remove_reader();
+    assert(reader.get_reader() == 0);
+    free(region);
+}
+
+// Reads all of "stream" in pieces of "read_size" and checks it against "input".
+// Returns the number of bytes read.
+static size_t
+read_ahead_check(read_ahead_stream_t &stream, const std::vector<char> &input,
+                 size_t read_size)
+{
+    std::vector<char> buf(read_size);
+    size_t total = 0;
+    while (true) {
+        int len = stream.read(read_size, buf.data());
+        assert(len >= 0 && static_cast<size_t>(len) <= read_size);
+        assert(total + len <= input.size());
+        assert(memcmp(buf.data(), input.data() + total, len) == 0);
+        total += len;
+        if (static_cast<size_t>(len) < read_size)
+            break;
+    }
+    // Further reads stay at the end.
+    assert(stream.read(read_size, buf.data()) == 0);
+    return total;
+}
+
+void
+unit_test_read_ahead()
+{
+    const size_t chunk = read_ahead_stream_t::chunk_size_;
+    // Inputs ending exactly on a chunk boundary end with an empty fill.
+    const size_t lengths[] = { 0, 1, chunk - 1, chunk, chunk + 1, 3 * chunk };
+    // Reads smaller than, straddling, and larger than chunks.
+    const size_t read_sizes[] = { 24, 1000, chunk, 2 * chunk + 7 };
+    for (size_t length : lengths) {
+        std::vector<char> input(length);
+        for (size_t i = 0; i < length; ++i)
+            input[i] = static_cast<char>(i * 7 + i / chunk);
+        for (int num_chunks = 1; num_chunks <= 3; ++num_chunks) {
+            for (size_t read_size : read_sizes) {
+                size_t pos = 0;
+                std::atomic<int> in_fill(0);
+                read_ahead_stream_t stream(
+                    [&](char *buf, size_t size) {
+                        // Fills for one stream must not overlap.
+                        assert(in_fill.fetch_add(1) == 0);
+                        size_t count = std::min(size, input.size() - pos);
+                        memcpy(buf, input.data() + pos, count);
+                        pos += count;
+                        in_fill.fetch_sub(1);
+                        return static_cast<int>(count);
+                    },
+                    num_chunks);
+                assert(read_ahead_check(stream, input, read_size) == length);
+                assert(stream.eof());
+            }
+        }
+    }
+
+    // An error after some input delivers the input before it and then stops
+    // without reaching eof.
+    for (int good_fills = 0; good_fills <= 2; ++good_fills) {
+        std::vector<char> input(good_fills * chunk, 'x');
+        int fills = 0;
+        read_ahead_stream_t stream(
+            [&](char *buf, size_t size) {
+                if (fills++ == good_fills)
+                    return -1;
+                memset(buf, 'x', size);
+                return static_cast<int>(size);
+            },
+            2);
+        assert(read_ahead_check(stream, input, 1000) == input.size());
+        assert(!stream.eof());
+        assert(fills == good_fills + 1);
+    }
+
+    // Destroying a stream while one of its fills is running must wait for the
+    // fill and must not start another.
+    std::atomic<int> fills(0);
+    std::atomic<bool> filling(false);
+    std::atomic<bool> release(false);
+    std::atomic<bool> fill_done(false);
+    auto stream = std::unique_ptr<read_ahead_stream_t>(new read_ahead_stream_t(
+        [&](char *buf, size_t size) {
+            if (fills++ > 0) {
+                filling = true;
+                while (!release)
+                    std::this_thread::yield();
+                fill_done = true;
+            }
+            memset(buf, 'y', size);
+            return static_cast<int>(size);
+        },
+        2));
+    char byte;
+    // The first fill is ours and the second is queued right behind it.
+    assert(stream->read(1, &byte) == 1 && byte == 'y');
+    while (!filling)
+        std::this_thread::yield();
+    std::thread releaser([&release]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        release = true;
+    });
+    stream.reset();
+    assert(fill_done);
+    releaser.join();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    assert(fills == 2);
+}
+
+#ifdef HAS_ZLIB
+static bool
+memrefs_match(const memref_t &a, const memref_t &b)
+{
+    if (a.data.type != b.data.type || a.data.pid != b.data.pid ||
+        a.data.tid != b.data.tid)
+        return false;
+    if (a.data.type == TRACE_TYPE_MARKER) {
+        return a.marker.marker_type == b.marker.marker_type &&
+            a.marker.marker_value == b.marker.marker_value;
+    }
+    if (a.data.type == TRACE_TYPE_THREAD_EXIT)
+        return true;
+    if (type_is_instr(a.instr.type))
+        return a.instr.addr == b.instr.addr && a.instr.size == b.instr.size;
+    return a.data.addr == b.data.addr && a.data.size == b.data.size &&
+        a.data.pc == b.data.pc;
+}
+
+// Writes a single-thread trace of thread "tid" to "path" with a chunk index.
+static void
+write_chunked_trace(const char *path, uint64_t chunk_entries, int tid = 7,
+                    int instrs = 2000)
+{
+    chunked_gzip_ostream_t out(path, chunk_entries);
+    assert(out);
+    auto write = [&out](unsigned short type, unsigned short size, addr_t addr) {
+        trace_entry_t entry;
+        entry.type = type;
+        entry.size = size;
+        entry.addr = addr;
+        out.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+    };
+    write(TRACE_TYPE_HEADER, 0, TRACE_ENTRY_VERSION);
+    write(TRACE_TYPE_MARKER, TRACE_MARKER_TYPE_VERSION, TRACE_ENTRY_VERSION);
+    write(TRACE_TYPE_MARKER, TRACE_MARKER_TYPE_FILETYPE, 0);
+    write(TRACE_TYPE_THREAD, sizeof(int), tid);
+    write(TRACE_TYPE_PID, sizeof(int), 3);
+    write(TRACE_TYPE_MARKER, TRACE_MARKER_TYPE_TIMESTAMP, 100);
+    for (int i = 0; i < instrs; ++i) {
+        write(TRACE_TYPE_INSTR, 4, 0x1000 + 16 * i);
+        if (i % 7 == 0) {
+            trace_entry_t bundle;
+            bundle.type = TRACE_TYPE_INSTR_BUNDLE;
+            bundle.size = 2;
+            bundle.length[0] = 4;
+            bundle.length[1] = 8;
+            // Split the entry across writes.
+            out.write(reinterpret_cast<const char *>(&bundle), 5);
+            out.write(reinterpret_cast<const char *>(&bundle) + 5, sizeof(bundle) - 5);
+        }
+        if (i % 3 == 0)
+            write(TRACE_TYPE_READ, 8, 0x80000 + 8 * i);
+        if (i % 500 == 499) {
+            write(TRACE_TYPE_MARKER, TRACE_MARKER_TYPE_TIMESTAMP, 100 + i);
+            write(TRACE_TYPE_MARKER, TRACE_MARKER_TYPE_CPU_ID, i % 4);
+        }
+    }
+    write(TRACE_TYPE_THREAD_EXIT, sizeof(int), tid);
+    write(TRACE_TYPE_FOOTER, 0, 0);
+}
+
+void
+unit_test_chunked_gzip()
+{
+    const char *path = "drcachesim_unit_tests_chunked.gz";
+    write_chunked_trace(path, 64);
+
+    std::vector<memref_t> refs;
+    compressed_file_reader_t end;
+    {
+        compressed_file_reader_t reader(path);
+        assert(reader.init());
+        for (; reader != end; ++reader)
+            refs.push_back(*reader);
+    }
+    assert(refs.size() > 2000 && refs.back().exit.type == TRACE_TYPE_THREAD_EXIT);
+
+    // Each chunk starts with an instruction fetch and records the counts before it.
+    std::vector<trace_chunk_t> chunks;
+    assert(trace_chunk_read_index(path, &chunks));
+    assert(chunks.size() > 10);
+    std::vector<uint64_t> skips = { 0, 1, 4, 5, 6, 777, refs.size() - 1, refs.size(),
+                                    refs.size() + 10 };
+    for (const trace_chunk_t &chunk : chunks) {
+        assert(chunk.memref_ordinal < refs.size());
+        const memref_t &first = refs[chunk.memref_ordinal];
+        assert(first.instr.type == TRACE_TYPE_INSTR);
+        uint64_t instrs = 0;
+        for (uint64_t i = 0; i < chunk.memref_ordinal; ++i) {
+            if (type_is_instr(refs[i].instr.type))
+                ++instrs;
+        }
+        assert(chunk.instr_count == instrs);
+        assert(chunk.timestamp >= 100);
+        skips.push_back(chunk.memref_ordinal - 1);
+        skips.push_back(chunk.memref_ordinal);
+        skips.push_back(chunk.memref_ordinal + 1);
+    }
+
+    // Skipping must present the same references as walking, with or without
+    // read-ahead.
+    for (int prefetch = 0; prefetch < 2; ++prefetch) {
+        for (uint64_t skip : skips) {
+            compressed_file_reader_t reader(path);
+            reader.set_prefetch_chunks(prefetch * 2);
+            assert(reader.init());
+            uint64_t skipped = reader.skip_memrefs(skip);
+            if (skip >= refs.size()) {
+                assert(skipped == refs.size() - 1);
+                assert(reader == end);
+                continue;
+            }
+            assert(skipped == skip);
+            for (uint64_t i = skip; i < refs.size(); ++i, ++reader) {
+                assert(reader != end);
+                assert(memrefs_match(*reader, refs[i]));
+            }
+            assert(reader == end);
+        }
+    }
+    remove(path);
+}
+
+#    ifdef UNIX
+// Records the memrefs of each shard, supporting shard ranges.
+class range_recorder_t : public analysis_tool_t {
+public:
+    bool
+    process_memref(const memref_t &memref) override
+    {
+        return true;
+    }
+    bool
+    print_results() override
+    {
+        return true;
+    }
+    bool
+    parallel_shard_supported() override
+    {
+        return true;
+    }
+    void *
+    parallel_shard_init(int shard_index, void *worker_data) override
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        shards_.emplace_back(new std::vector<memref_t>);
+        return shards_.back().get();
+    }
+    void *
+    parallel_shard_range_init(int shard_index, void *worker_data) override
+    {
+        ++range_inits_;
+        return parallel_shard_init(shard_index, worker_data);
+    }
+    bool
+    parallel_shard_memref(void *shard_data, const memref_t &memref) override
+    {
+        reinterpret_cast<std::vector<memref_t> *>(shard_data)->push_back(memref);
+        return true;
+    }
+    bool
+    parallel_shard_range_supported() override
+    {
+        return true;
+    }
+    bool
+    parallel_shard_merge(void *dst_shard_data, void *src_shard_data) override
+    {
+        auto dst = reinterpret_cast<std::vector<memref_t> *>(dst_shard_data);
+        auto src = reinterpret_cast<std::vector<memref_t> *>(src_shard_data);
+        dst->insert(dst->end(), src->begin(), src->end());
+        for (auto iter = shards_.begin(); iter != shards_.end(); ++iter) {
+            if (iter->get() == src) {
+                shards_.erase(iter);
+                break;
+            }
+        }
+        return true;
+    }
+    std::mutex lock_;
+    std::vector<std::unique_ptr<std::vector<memref_t>>> shards_;
+    std::atomic<int> range_inits_ { 0 };
+};
+
+void
+unit_test_shard_ranges()
+{
+    const std::string dir = "drcachesim_unit_tests_ranges";
+    const std::string path = dir + "/drmemtrace.threadsig.7.trace.gz";
+    mkdir(dir.c_str(), 0755);
+    write_chunked_trace(path.c_str(), 64);
+    std::vector<memref_t> refs;
+    {
+        compressed_file_reader_t reader(path);
+        compressed_file_reader_t end;
+        assert(reader.init());
+        for (; reader != end; ++reader)
+            refs.push_back(*reader);
+    }
+    // With one worker nothing is split; with four the single shard is split in
+    // four ranges that must together present the whole shard in order.
+    for (int workers = 1; workers <= 4; workers += 3) {
+        range_recorder_t recorder;
+        analysis_tool_t *tools[] = { &recorder };
+        analyzer_t analyzer(dir, tools, 1, workers);
+        assert(!!analyzer);
+        assert(analyzer.run());
+        assert(recorder.range_inits_ == workers - 1);
+        assert(recorder.shards_.size() == 1);
+        const std::vector<memref_t> &shard = *recorder.shards_[0];
+        assert(shard.size() == refs.size());
+        for (size_t i = 0; i < refs.size(); ++i)
+            assert(memrefs_match(shard[i], refs[i]));
+    }
+    remove(path.c_str());
+    rmdir(dir.c_str());
+}
+
+// Records the memrefs of each shard while counting which interface delivered them.
+class batch_recorder_t : public range_recorder_t {
+public:
+    explicit batch_recorder_t(bool batch)
+        : batch_(batch)
+    {
+    }
+    bool
+    parallel_shard_memref_batch_supported() override
+    {
+        return batch_;
+    }
+    bool
+    parallel_shard_memref(void *shard_data, const memref_t &memref) override
+    {
+        ++single_calls_;
+        return range_recorder_t::parallel_shard_memref(shard_data, memref);
+    }
+    bool
+    parallel_shard_memref_batch(void *shard_data, const memref_t *memrefs,
+                                size_t count) override
+    {
+        ++batch_calls_;
+        auto shard = reinterpret_cast<std::vector<memref_t> *>(shard_data);
+        shard->insert(shard->end(), memrefs, memrefs + count);
+        return true;
+    }
+    bool batch_;
+    std::atomic<int> single_calls_ { 0 };
+    std::atomic<int> batch_calls_ { 0 };
+};
+
+void
+unit_test_memref_batch()
+{
+    const std::string dir = "drcachesim_unit_tests_batch";
+    const std::string path = dir + "/drmemtrace.threadsig.7.trace.gz";
+    mkdir(dir.c_str(), 0755);
+    write_chunked_trace(path.c_str(), 64);
+    std::vector<memref_t> refs;
+    {
+        compressed_file_reader_t reader(path);
+        compressed_file_reader_t end;
+        assert(reader.init());
+        for (; reader != end; ++reader)
+            refs.push_back(*reader);
+    }
+    // A tool that takes batches must not push a tool that does not onto the
+    // batch interface, and both must see the whole shard in order.
+    batch_recorder_t batched(true);
+    batch_recorder_t single(false);
+    analysis_tool_t *tools[] = { &batched, &single };
+    analyzer_t analyzer(dir, tools, 2, 1);
+    assert(!!analyzer);
+    assert(analyzer.run());
+    assert(batched.single_calls_ == 0 && batched.batch_calls_ > 1);
+    assert(single.batch_calls_ == 0 && single.single_calls_ == (int)refs.size());
+    for (batch_recorder_t *recorder : { &batched, &single }) {
+        assert(recorder->shards_.size() == 1);
+        const std::vector<memref_t> &shard = *recorder->shards_[0];
+        assert(shard.size() == refs.size());
+        for (size_t i = 0; i < refs.size(); ++i)
+            assert(memrefs_match(shard[i], refs[i]));
+    }
+    remove(path.c_str());
+    rmdir(dir.c_str());
+}
+
+// Records the memrefs and the init and exit calls of each shard, without range
+// support so that every shard is handed out whole.
+class shard_recorder_t : public analysis_tool_t {
+public:
+    struct shard_t {
+        int index;
+        int exits = 0;
+        std::vector<memref_t> refs;
+    };
+    bool
+    process_memref(const memref_t &memref) override
+    {
+        return true;
+    }
+    bool
+    print_results() override
+    {
+        return true;
+    }
+    bool
+    parallel_shard_supported() override
+    {
+        return true;
+    }
+    void *
+    parallel_shard_init(int shard_index, void *worker_data) override
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        shards_.emplace_back(new shard_t);
+        shards_.back()->index = shard_index;
+        return shards_.back().get();
+    }
+    bool
+    parallel_shard_exit(void *shard_data) override
+    {
+        ++reinterpret_cast<shard_t *>(shard_data)->exits;
+        return true;
+    }
+    bool
+    parallel_shard_memref(void *shard_data, const memref_t &memref) override
+    {
+        reinterpret_cast<shard_t *>(shard_data)->refs.push_back(memref);
+        return true;
+    }
+    std::mutex lock_;
+    std::vector<std::unique_ptr<shard_t>> shards_;
+};
+
+// Runs "workers" workers over one trace file per entry of "instrs" and checks
+// that each shard is processed exactly once, in order.
+static void
+check_shard_assignment(const std::string &dir, const std::vector<int> &instrs,
+                       int workers)
+{
+    mkdir(dir.c_str(), 0755);
+    std::vector<std::string> paths;
+    std::vector<std::vector<memref_t>> expected;
+    for (size_t i = 0; i < instrs.size(); ++i) {
+        const int tid = 100 + static_cast<int>(i);
+        paths.push_back(dir + "/drmemtrace.threadsig." + std::to_string(tid) +
+                        ".trace.gz");
+        write_chunked_trace(paths.back().c_str(), 64, tid, instrs[i]);
+        expected.emplace_back();
+        compressed_file_reader_t reader(paths.back());
+        compressed_file_reader_t end;
+        assert(reader.init());
+        for (; reader != end; ++reader)
+            expected.back().push_back(*reader);
+    }
+    shard_recorder_t recorder;
+    analysis_tool_t *tools[] = { &recorder };
+    analyzer_t analyzer(dir, tools, 1, workers);
+    assert(!!analyzer);
+    assert(analyzer.run());
+    assert(recorder.shards_.size() == instrs.size());
+    std::vector<bool> seen_index(instrs.size(), false);
+    std::vector<bool> seen_thread(instrs.size(), false);
+    for (const auto &shard : recorder.shards_) {
+        assert(shard->index >= 0 && shard->index < (int)instrs.size());
+        assert(!seen_index[shard->index]);
+        seen_index[shard->index] = true;
+        assert(shard->exits == 1);
+        // The shard index follows directory order, so we match on the thread.
+        assert(!shard->refs.empty());
+        const size_t which = shard->refs.back().exit.tid - 100;
+        assert(which < instrs.size() && !seen_thread[which]);
+        seen_thread[which] = true;
+        assert(shard->refs.size() == expected[which].size());
+        for (size_t i = 0; i < shard->refs.size(); ++i)
+            assert(memrefs_match(shard->refs[i], expected[which][i]));
+    }
+    for (const std::string &path : paths)
+        remove(path.c_str());
+    rmdir(dir.c_str());
+}
+
+void
+unit_test_shard_assignment()
+{
+    // Idle workers must find nothing to steal once every shard is taken.
+    check_shard_assignment("drcachesim_unit_tests_assign_idle", { 1500, 300 }, 6);
+    // Uneven sizes leave the workers with the small shards free to steal.
+    check_shard_assignment("drcachesim_unit_tests_assign_uneven",
+                           { 6000, 40, 2500, 0, 800, 120, 3000 }, 3);
+}
+#    endif
+#endif
+
 int
 main(int argc, const char *argv[])
 {
@@ -316,5 +1124,17 @@ main(int argc, const char *argv[])
     unit_test_sim_refs();
     unit_test_child_hits();
     unit_test_cache_replacement_policy();
+    unit_test_core_sim_threads();
+    unit_test_cache_sweep();
+    unit_test_shm_ring();
+    unit_test_read_ahead();
+#ifdef HAS_ZLIB
+    unit_test_chunked_gzip();
+#    ifdef UNIX
+    unit_test_shard_ranges();
+    unit_test_memref_batch();
+    unit_test_shard_assignment();
+#    endif
+#endif
     return 0;
 }
@@ -0,0 +1,170 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, LLC  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, LLC nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, LLC OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Microbenchmark for the timestamp-ordered interleaving performed by
+ * file_reader_t::read_next_entry() when reading a set of thread files serially.
+ * We synthesize thread files whose timestamps alternate between threads so that
+ * every buffer is a thread switch, then report entries/second for a range of
+ * thread counts.  We also check that the merged stream is in timestamp order so
+ * this doubles as a regression test.
+ *
+ * Usage: file_reader_benchmark [file_prefix] [max_threads] [total_entries]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../reader/file_reader.h"
+#include "../common/memref.h"
+#include "../common/trace_entry.h"
+
+namespace {
+
+// Instructions per timestamp-delimited buffer.  We keep this small so that
+// thread selection dominates.
+static constexpr int kEntriesPerBuffer = 4;
+
+static void
+write_entry(std::ofstream &out, unsigned short type, unsigned short size, addr_t addr)
+{
+    trace_entry_t entry;
+    entry.type = type;
+    entry.size = size;
+    entry.addr = addr;
+    out.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+}
+
+static bool
+write_thread_files(const std::string &prefix, int num_threads, int buffers_per_thread,
+                   std::vector<std::string> *paths)
+{
+    for (int t = 0; t < num_threads; ++t) {
+        std::string path = prefix + "." + std::to_string(t) + ".trace";
+        std::ofstream out(path, std::ofstream::binary);
+        if (!out) {
+            std::cerr << "Failed to create " << path << "\n";
+            return false;
+        }
+        paths->push_back(path);
+        const addr_t tid = 100 + t;
+        write_entry(out, TRACE_TYPE_HEADER, 0, TRACE_ENTRY_VERSION);
+        write_entry(out, TRACE_TYPE_THREAD, sizeof(addr_t), tid);
+        write_entry(out, TRACE_TYPE_PID, sizeof(addr_t), 1);
+        for (int b = 0; b < buffers_per_thread; ++b) {
+            // Round-robin timestamps force a thread switch at every buffer.
+            write_entry(out, TRACE_TYPE_MARKER, TRACE_MARKER_TYPE_TIMESTAMP,
+                        1 + static_cast<addr_t>(b) * num_threads + t);
+            for (int i = 0; i < kEntriesPerBuffer; ++i)
+                write_entry(out, TRACE_TYPE_INSTR, 4, 0x1000 + 4 * i);
+        }
+        write_entry(out, TRACE_TYPE_THREAD_EXIT, sizeof(addr_t), tid);
+        write_entry(out, TRACE_TYPE_FOOTER, 0, 0);
+        if (!out)
+            return false;
+    }
+    return true;
+}
+
+static bool
+run_benchmark(const std::string &prefix, int num_threads, int total_entries)
+{
+    int buffers_per_thread = total_entries / (num_threads * (kEntriesPerBuffer + 1));
+    if (buffers_per_thread < 1)
+        buffers_per_thread = 1;
+    std::vector<std::string> paths;
+    bool res = write_thread_files(prefix, num_threads, buffers_per_thread, &paths);
+    if (res) {
+        file_reader_t<std::ifstream *> reader(paths);
+        file_reader_t<std::ifstream *> end;
+        uint64_t count = 0;
+        uint64_t last_timestamp = 0;
+        auto start = std::chrono::steady_clock::now();
+        if (!reader.init()) {
+            std::cerr << "Failed to initialize reader\n";
+            res = false;
+        }
+        for (; res && reader != end; ++reader) {
+            const memref_t &memref = *reader;
+            ++count;
+            if (memref.marker.type == TRACE_TYPE_MARKER &&
+                memref.marker.marker_type == TRACE_MARKER_TYPE_TIMESTAMP) {
+                if (memref.marker.marker_value < last_timestamp) {
+                    std::cerr << "Timestamp " << memref.marker.marker_value
+                              << " out of order after " << last_timestamp << "\n";
+                    res = false;
+                }
+                last_timestamp = memref.marker.marker_value;
+            }
+        }
+        std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+        // Each buffer yields its timestamp and instrs, plus one thread exit per
+        // thread.
+        const uint64_t expected = static_cast<uint64_t>(num_threads) *
+            (buffers_per_thread * (kEntriesPerBuffer + 1) + 1);
+        if (res && count != expected) {
+            std::cerr << "Expected " << expected << " entries but saw " << count << "\n";
+            res = false;
+        }
+        if (res) {
+            std::cerr << "threads " << num_threads << ": " << count << " entries in "
+                      << secs.count() << "s = "
+                      << (secs.count() > 0 ? count / secs.count() : 0.)
+                      << " entries/s\n";
+        }
+    }
+    for (const std::string &path : paths)
+        std::remove(path.c_str());
+    return res;
+}
+
+} // namespace
+
+int
+main(int argc, const char *argv[])
+{
+    std::string prefix = argc > 1 ? argv[1] : "file_reader_benchmark";
+    // We stay under the common 1024 open-file limit by default.
+    int max_threads = argc > 2 ? std::stoi(argv[2]) : 512;
+    int total_entries = argc > 3 ? std::stoi(argv[3]) : 1 << 20;
+    for (int threads = 1; threads <= max_threads; threads *= 4) {
+        if (!run_benchmark(prefix, threads, total_entries)) {
+            std::cerr << "file_reader_benchmark FAILED\n";
+            return 1;
+        }
+    }
+    std::cerr << "file_reader_benchmark passed\n";
+    return 0;
+}
@@ -0,0 +1,150 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Tests the sampled miss ratio curve tool against exact reuse distances. */
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../tools/miss_ratio_curve.h"
+#include "../tools/reuse_distance.h"
+#include "../common/memref.h"
+#include "memref_gen.h"
+
+namespace {
+
+static constexpr unsigned int LINE_SIZE = 64;
+
+// Exposes the exact reuse distance histogram computed by reuse_distance_t.
+class exact_reuse_distance_t : public reuse_distance_t {
+public:
+    explicit exact_reuse_distance_t(const reuse_distance_knobs_t &knobs)
+        : reuse_distance_t(knobs)
+    {
+    }
+    double
+    get_miss_ratio(uint64_t num_lines)
+    {
+        int_least64_t total = 0, misses = 0;
+        for (const auto &shard : shard_map_) {
+            int_least64_t reuses = 0;
+            for (const auto &entry : shard.second->dist_map) {
+                reuses += entry.second;
+                if (static_cast<uint64_t>(entry.first) >= num_lines)
+                    misses += entry.second;
+            }
+            misses += shard.second->total_refs - reuses;
+            total += shard.second->total_refs;
+        }
+        return static_cast<double>(misses) / total;
+    }
+};
+
+// Returns a trace mixing a hot loop, a medium and a large working set, and
+// streaming accesses, so the curve has several steps.
+std::vector<memref_t>
+generate_trace()
+{
+    std::vector<memref_t> memrefs;
+    std::mt19937 rng(42);
+    for (int i = 0; i < 2000000; i++) {
+        addr_t line;
+        uint32_t pick = rng() % 100;
+        if (pick < 40)
+            line = rng() % 2048;
+        else if (pick < 70)
+            line = 0x10000 + rng() % 16384;
+        else if (pick < 95)
+            line = 0x100000 + rng() % 131072;
+        else
+            line = 0x1000000 + i;
+        memrefs.push_back(gen_data(1, /*load=*/true, line * LINE_SIZE, 8));
+    }
+    return memrefs;
+}
+
+bool
+check_curve(const std::vector<memref_t> &memrefs, exact_reuse_distance_t &exact,
+            double rate, double max_error)
+{
+    reuse_distance_knobs_t knobs;
+    knobs.line_size = LINE_SIZE;
+    knobs.sample_rate = rate;
+    miss_ratio_curve_t sampled(knobs);
+    for (const auto &memref : memrefs)
+        sampled.process_memref(memref);
+    double worst = 0.;
+    // Distances among sampled lines are scaled by 1/rate, so the curve has no
+    // resolution below that many lines.
+    for (uint64_t lines = static_cast<uint64_t>(1 / rate); lines <= 1 << 20;
+         lines *= 2) {
+        double expect = exact.get_miss_ratio(lines);
+        double actual = sampled.get_miss_ratio(lines);
+        double error = std::fabs(expect - actual);
+        if (error > worst)
+            worst = error;
+        if (error > max_error) {
+            std::cerr << "rate " << rate << ": miss ratio for " << lines
+                      << " lines is " << actual << " but should be " << expect
+                      << "\n";
+            return false;
+        }
+    }
+    std::cerr << "rate " << rate << ": maximum absolute error " << worst << "\n";
+    return true;
+}
+
+} // namespace
+
+int
+main(int argc, const char *argv[])
+{
+    std::vector<memref_t> memrefs = generate_trace();
+    reuse_distance_knobs_t knobs;
+    knobs.line_size = LINE_SIZE;
+    knobs.engine = "fenwick";
+    exact_reuse_distance_t exact(knobs);
+    for (const auto &memref : memrefs)
+        exact.process_memref(memref);
+    // Sampling every line must reproduce the exact curve, while sparser sampling
+    // should stay within a few percent.
+    if (check_curve(memrefs, exact, 1.0, 1e-9) &&
+        check_curve(memrefs, exact, 0.1, 0.02) &&
+        check_curve(memrefs, exact, 0.01, 0.05)) {
+        std::cerr << "miss_ratio_curve_test passed\n";
+        return 0;
+    }
+    std::cerr << "miss_ratio_curve_test FAILED\n";
+    exit(1);
+}
@@ -81,6 +81,47 @@ basic_counts_t::parallel_shard_exit(void *shard_data)
     return true;
 }
 
+bool
+basic_counts_t::parallel_shard_range_supported()
+{
+    return true;
+}
+
+void *
+basic_counts_t::parallel_shard_range_init(int shard_index, void *worker_data)
+{
+    per_shard_t *per_shard =
+        reinterpret_cast<per_shard_t *>(parallel_shard_init(shard_index, worker_data));
+    per_shard->mid_shard = true;
+    return reinterpret_cast<void *>(per_shard);
+}
+
+bool
+basic_counts_t::parallel_shard_merge(void *dst_shard_data, void *src_shard_data)
+{
+    per_shard_t *dst = reinterpret_cast<per_shard_t *>(dst_shard_data);
+    per_shard_t *src = reinterpret_cast<per_shard_t *>(src_shard_data);
+    // The counts before the range's first window marker continue the window
+    // that the earlier ranges ended in.
+    dst->counters.back() += src->counters[0];
+    for (size_t i = 1; i < src->counters.size(); ++i) {
+        if (!enter_window(dst, src->first_window + i - 1))
+            return false;
+        dst->counters.back() += src->counters[i];
+    }
+    if (src->tid != 0)
+        dst->tid = src->tid;
+    // We are single-threaded here.
+    for (auto iter = shard_map_.begin(); iter != shard_map_.end(); ++iter) {
+        if (iter->second == src) {
+            shard_map_.erase(iter);
+            break;
+        }
+    }
+    delete src;
+    return true;
+}
+
 std::string
 basic_counts_t::parallel_shard_error(void *shard_data)
 {
@@ -90,8 +131,31 @@ basic_counts_t::parallel_shard_error(void *shard_data)
 
 bool
 basic_counts_t::parallel_shard_memref(void *shard_data, const memref_t &memref)
+{
+    return process_shard_memref(reinterpret_cast<per_shard_t *>(shard_data), memref);
+}
+
+bool
+basic_counts_t::parallel_shard_memref_batch_supported()
+{
+    return true;
+}
+
+bool
+basic_counts_t::parallel_shard_memref_batch(void *shard_data, const memref_t *memrefs,
+                                            size_t count)
 {
     per_shard_t *per_shard = reinterpret_cast<per_shard_t *>(shard_data);
+    for (size_t i = 0; i < count; ++i) {
+        if (!process_shard_memref(per_shard, memrefs[i]))
+            return false;
+    }
+    return true;
+}
+
+bool
+basic_counts_t::process_shard_memref(per_shard_t *per_shard, const memref_t &memref)
+{
     counters_t *counters = &per_shard->counters[per_shard->counters.size() - 1];
     if (type_is_instr(memref.instr.type)) {
         ++counters->instrs;
@@ -112,24 +176,10 @@ basic_counts_t::parallel_shard_memref(void *shard_data, const memref_t &memref)
                    memref.marker.marker_type == TRACE_MARKER_TYPE_KERNEL_XFER) {
             ++counters->xfer_markers;
         } else {
-            if (memref.marker.marker_type == TRACE_MARKER_TYPE_WINDOW_ID &&
-                static_cast<intptr_t>(memref.marker.marker_value) !=
-                    per_shard->last_window) {
-                if (per_shard->last_window == -1 && memref.marker.marker_value != 0) {
-                    // We assume that a single file with multiple windows always
-                    // starts at 0, which is how we distinguish it from a split
-                    // file starting at a high window number.  We check this below.
-                    per_shard->last_window = memref.marker.marker_value;
-                } else if (per_shard->last_window != -1 &&
-                           per_shard->counters.size() !=
-                               static_cast<size_t>(per_shard->last_window + 1)) {
-                    per_shard->error = "Multi-window file must start at 0";
+            if (memref.marker.marker_type == TRACE_MARKER_TYPE_WINDOW_ID) {
+                if (!enter_window(per_shard, memref.marker.marker_value))
                     return false;
-                } else {
-                    per_shard->last_window = memref.marker.marker_value;
-                    per_shard->counters.resize(per_shard->last_window + 1 /*0-based*/);
-                    counters = &per_shard->counters[per_shard->counters.size() - 1];
-                }
+                counters = &per_shard->counters[per_shard->counters.size() - 1];
             }
             switch (memref.marker.marker_type) {
             case TRACE_MARKER_TYPE_FUNC_ID: ++counters->func_id_markers; break;
@@ -156,6 +206,37 @@ basic_counts_t::parallel_shard_memref(void *shard_data, const memref_t &memref)
     return true;
 }
 
+bool
+basic_counts_t::enter_window(per_shard_t *per_shard, intptr_t window)
+{
+    if (window == per_shard->last_window)
+        return true;
+    if (per_shard->mid_shard) {
+        if (per_shard->first_window == -1)
+            per_shard->first_window = window;
+        if (window < per_shard->last_window) {
+            per_shard->error = "Window ids must increase";
+            return false;
+        }
+        per_shard->last_window = window;
+        per_shard->counters.resize(window - per_shard->first_window + 2);
+    } else if (per_shard->last_window == -1 && window != 0) {
+        // We assume that a single file with multiple windows always
+        // starts at 0, which is how we distinguish it from a split
+        // file starting at a high window number.  We check this below.
+        per_shard->last_window = window;
+    } else if (per_shard->last_window != -1 &&
+               per_shard->counters.size() !=
+                   static_cast<size_t>(per_shard->last_window + 1)) {
+        per_shard->error = "Multi-window file must start at 0";
+        return false;
+    } else {
+        per_shard->last_window = window;
+        per_shard->counters.resize(per_shard->last_window + 1 /*0-based*/);
+    }
+    return true;
+}
+
 bool
 basic_counts_t::process_memref(const memref_t &memref)
 {
@@ -166,7 +247,7 @@ basic_counts_t::process_memref(const memref_t &memref)
         shard_map_[memref.data.tid] = per_shard;
     } else
         per_shard = lookup->second;
-    if (!parallel_shard_memref(reinterpret_cast<void *>(per_shard), memref)) {
+    if (!process_shard_memref(per_shard, memref)) {
         error_string_ = per_shard->error;
         return false;
     }
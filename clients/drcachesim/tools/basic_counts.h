@@ -56,6 +56,17 @@ public:
     parallel_shard_exit(void *shard_data) override;
     bool
     parallel_shard_memref(void *shard_data, const memref_t &memref) override;
+    bool
+    parallel_shard_memref_batch_supported() override;
+    bool
+    parallel_shard_memref_batch(void *shard_data, const memref_t *memrefs,
+                                size_t count) override;
+    bool
+    parallel_shard_range_supported() override;
+    void *
+    parallel_shard_range_init(int shard_index, void *worker_data) override;
+    bool
+    parallel_shard_merge(void *dst_shard_data, void *src_shard_data) override;
     std::string
     parallel_shard_error(void *shard_data) override;
 
@@ -116,8 +127,22 @@ protected:
         std::vector<counters_t> counters;
         std::string error;
         intptr_t last_window = -1;
+        // For a range that starts partway through its shard, counters[0] holds the
+        // counts before the range's first window marker and counters[i] those of
+        // window first_window + i - 1.
+        bool mid_shard = false;
+        intptr_t first_window = -1;
     };
 
+    // Switches "per_shard" to counting into "window".  Returns false on an error.
+    bool
+    enter_window(per_shard_t *per_shard, intptr_t window);
+
+    // The non-virtual worker for parallel_shard_memref() and
+    // parallel_shard_memref_batch().
+    bool
+    process_shard_memref(per_shard_t *per_shard, const memref_t &memref);
+
     static bool
     cmp_threads(const std::pair<memref_tid_t, per_shard_t *> &l,
                 const std::pair<memref_tid_t, per_shard_t *> &r);
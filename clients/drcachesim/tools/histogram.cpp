@@ -131,6 +131,32 @@ histogram_t::parallel_shard_memref(void *shard_data, const memref_t &memref)
     return true;
 }
 
+bool
+histogram_t::parallel_shard_range_supported()
+{
+    return true;
+}
+
+bool
+histogram_t::parallel_shard_merge(void *dst_shard_data, void *src_shard_data)
+{
+    shard_data_t *dst = reinterpret_cast<shard_data_t *>(dst_shard_data);
+    shard_data_t *src = reinterpret_cast<shard_data_t *>(src_shard_data);
+    for (const auto &keyvals : src->icache_map)
+        dst->icache_map[keyvals.first] += keyvals.second;
+    for (const auto &keyvals : src->dcache_map)
+        dst->dcache_map[keyvals.first] += keyvals.second;
+    // We are single-threaded here.
+    for (auto iter = shard_map_.begin(); iter != shard_map_.end(); ++iter) {
+        if (iter->second == src) {
+            shard_map_.erase(iter);
+            break;
+        }
+    }
+    delete src;
+    return true;
+}
+
 std::string
 histogram_t::parallel_shard_error(void *shard_data)
 {
@@ -63,6 +63,10 @@ public:
     parallel_shard_exit(void *shard_data) override;
     bool
     parallel_shard_memref(void *shard_data, const memref_t &memref) override;
+    bool
+    parallel_shard_range_supported() override;
+    bool
+    parallel_shard_merge(void *dst_shard_data, void *src_shard_data) override;
     std::string
     parallel_shard_error(void *shard_data) override;
 
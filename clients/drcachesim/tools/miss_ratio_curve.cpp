@@ -0,0 +1,246 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include "miss_ratio_curve.h"
+#include "../common/utils.h"
+
+const std::string miss_ratio_curve_t::TOOL_NAME = "Miss ratio curve tool";
+
+analysis_tool_t *
+miss_ratio_curve_tool_create(const reuse_distance_knobs_t &knobs)
+{
+    return new miss_ratio_curve_t(knobs);
+}
+
+miss_ratio_curve_t::miss_ratio_curve_t(const reuse_distance_knobs_t &knobs)
+    : knobs_(knobs)
+    , line_size_bits_(compute_log2((int)knobs_.line_size))
+{
+    if (knobs_.sample_rate <= 0. || knobs_.sample_rate > 1.) {
+        error_string_ = "The sample rate must be in (0,1]";
+        success_ = false;
+        return;
+    }
+    sample_threshold_ =
+        static_cast<uint64_t>(knobs_.sample_rate * static_cast<double>(1 << HASH_BITS));
+    if (sample_threshold_ == 0)
+        sample_threshold_ = 1;
+}
+
+miss_ratio_curve_t::~miss_ratio_curve_t()
+{
+    for (auto &shard : shard_map_) {
+        delete shard.second;
+    }
+}
+
+miss_ratio_curve_t::shard_data_t::shard_data_t(bool verify)
+    // The distance threshold only affects the distant reference counts, which
+    // we do not report.
+    : ref_list(0, verify)
+{
+}
+
+bool
+miss_ratio_curve_t::is_sampled(addr_t tag) const
+{
+    // A 64-bit finalizer (from splitmix64) spreads nearby lines across the hash
+    // space so that the sample is spatially uniform.
+    uint64_t hash = static_cast<uint64_t>(tag);
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return (hash & ((1ULL << HASH_BITS) - 1)) < sample_threshold_;
+}
+
+bool
+miss_ratio_curve_t::parallel_shard_supported()
+{
+    return true;
+}
+
+void *
+miss_ratio_curve_t::parallel_shard_init(int shard_index, void *worker_data)
+{
+    auto shard = new shard_data_t(knobs_.verify_skip);
+    std::lock_guard<std::mutex> guard(shard_map_mutex_);
+    shard_map_[shard_index] = shard;
+    return reinterpret_cast<void *>(shard);
+}
+
+bool
+miss_ratio_curve_t::parallel_shard_exit(void *shard_data)
+{
+    // Nothing (we read the shard data in print_results).
+    return true;
+}
+
+std::string
+miss_ratio_curve_t::parallel_shard_error(void *shard_data)
+{
+    shard_data_t *shard = reinterpret_cast<shard_data_t *>(shard_data);
+    return shard->error;
+}
+
+bool
+miss_ratio_curve_t::parallel_shard_memref(void *shard_data, const memref_t &memref)
+{
+    shard_data_t *shard = reinterpret_cast<shard_data_t *>(shard_data);
+    if (memref.data.type == TRACE_TYPE_THREAD_EXIT) {
+        shard->tid = memref.exit.tid;
+        return true;
+    }
+    if (type_is_instr(memref.instr.type) || memref.data.type == TRACE_TYPE_READ ||
+        memref.data.type == TRACE_TYPE_WRITE || type_is_prefetch(memref.data.type)) {
+        ++shard->total_refs;
+        addr_t tag = memref.data.addr >> line_size_bits_;
+        if (!is_sampled(tag))
+            return true;
+        ++shard->sampled_refs;
+        auto it = shard->cache_map.find(tag);
+        if (it == shard->cache_map.end()) {
+            line_ref_t *ref = new line_ref_t(tag);
+            shard->cache_map.insert(std::pair<addr_t, line_ref_t *>(tag, ref));
+            shard->ref_list.add_to_front(ref);
+        } else {
+            int_least64_t dist = shard->ref_list.move_to_front(it->second);
+            ++shard->dist_map[dist];
+        }
+    }
+    return true;
+}
+
+bool
+miss_ratio_curve_t::process_memref(const memref_t &memref)
+{
+    // For serial operation we index using the tid.
+    shard_data_t *shard;
+    const auto &lookup = shard_map_.find(memref.data.tid);
+    if (lookup == shard_map_.end()) {
+        shard = new shard_data_t(knobs_.verify_skip);
+        shard_map_[memref.data.tid] = shard;
+    } else
+        shard = lookup->second;
+    if (!parallel_shard_memref(reinterpret_cast<void *>(shard), memref)) {
+        error_string_ = shard->error;
+        return false;
+    }
+    return true;
+}
+
+void
+miss_ratio_curve_t::compute_curve(curve_t *curve)
+{
+    double rate = static_cast<double>(sample_threshold_) / (1 << HASH_BITS);
+    std::unordered_map<int_least64_t, int_least64_t> merged;
+    for (const auto &shard : shard_map_) {
+        int_least64_t reuses = 0;
+        for (const auto &entry : shard.second->dist_map) {
+            merged[entry.first] += entry.second;
+            reuses += entry.second;
+        }
+        curve->cold_misses += shard.second->sampled_refs - reuses;
+        curve->sampled_refs += shard.second->sampled_refs;
+    }
+    for (const auto &entry : merged)
+        curve->dists.emplace_back(entry.first / rate, entry.second);
+    std::sort(curve->dists.begin(), curve->dists.end());
+}
+
+double
+miss_ratio_curve_t::miss_ratio(const curve_t &curve, uint64_t num_lines) const
+{
+    if (curve.sampled_refs == 0)
+        return 0.;
+    // A reference hits in a cache of num_lines lines if fewer than num_lines
+    // distinct lines were referenced since the prior reference to its line.
+    int_least64_t misses = curve.cold_misses;
+    auto it = std::lower_bound(
+        curve.dists.begin(), curve.dists.end(), static_cast<double>(num_lines),
+        [](const std::pair<double, int_least64_t> &entry, double dist) {
+            return entry.first < dist;
+        });
+    for (; it != curve.dists.end(); ++it)
+        misses += it->second;
+    // Dividing by the sampled count rather than the expected one makes this a
+    // ratio estimator: a sample that over-represents some lines inflates both
+    // sides alike.
+    return static_cast<double>(misses) / curve.sampled_refs;
+}
+
+double
+miss_ratio_curve_t::get_miss_ratio(uint64_t num_lines)
+{
+    curve_t curve;
+    compute_curve(&curve);
+    return miss_ratio(curve, num_lines);
+}
+
+bool
+miss_ratio_curve_t::print_results()
+{
+    curve_t curve;
+    compute_curve(&curve);
+    int_least64_t total_refs = 0;
+    uint64_t sampled_lines = 0;
+    for (const auto &shard : shard_map_) {
+        total_refs += shard.second->total_refs;
+        sampled_lines += shard.second->cache_map.size();
+    }
+    std::cerr << TOOL_NAME << " results:\n";
+    std::cerr << "Total accesses: " << total_refs << "\n";
+    std::cerr << "Sampled accesses: " << curve.sampled_refs << "\n";
+    std::cerr << "Sampled cache lines: " << sampled_lines << "\n";
+    std::cerr << "Sample rate: "
+              << static_cast<double>(sample_threshold_) / (1 << HASH_BITS) << "\n";
+    std::cerr << "\n";
+    std::cerr << "Miss ratio curve for fully-associative LRU caches:\n";
+    std::cerr << std::setw(18) << "Size (bytes)" << std::setw(14) << "Lines"
+              << std::setw(12) << "Miss ratio\n";
+    std::cerr.precision(4);
+    std::cerr.setf(std::ios::fixed);
+    // We stop at the first size that holds every reuse.
+    double max_dist = curve.dists.empty() ? 0. : curve.dists.back().first;
+    for (uint64_t lines = 1;; lines *= 2) {
+        std::cerr << std::setw(18) << (lines << line_size_bits_) << std::setw(14)
+                  << lines << std::setw(11) << miss_ratio(curve, lines) << "\n";
+        if (static_cast<double>(lines) > max_dist || lines >= (1ULL << 62))
+            break;
+    }
+    // Reset the i/o format for subsequent tool invocations.
+    std::cerr.unsetf(std::ios::fixed);
+    std::cerr << std::dec;
+    return true;
+}
@@ -0,0 +1,123 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* miss_ratio_curve: estimates the miss ratio of fully-associative LRU caches of
+ * every size in a single pass using spatially-hashed sampling (SHARDS).
+ * A cache line is sampled if a hash of its address falls below a threshold, so
+ * every reference to a sampled line is seen and reuse distances among sampled
+ * lines can be computed exactly.  Scaling those distances by the inverse of the
+ * sampling rate estimates the reuse distances over the full trace.
+ */
+
+#ifndef _MISS_RATIO_CURVE_H_
+#define _MISS_RATIO_CURVE_H_ 1
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "analysis_tool.h"
+#include "reuse_distance.h"
+#include "reuse_distance_create.h"
+#include "memref.h"
+
+class miss_ratio_curve_t : public analysis_tool_t {
+public:
+    explicit miss_ratio_curve_t(const reuse_distance_knobs_t &knobs);
+    ~miss_ratio_curve_t() override;
+    bool
+    process_memref(const memref_t &memref) override;
+    bool
+    print_results() override;
+    bool
+    parallel_shard_supported() override;
+    void *
+    parallel_shard_init(int shard_index, void *worker_data) override;
+    bool
+    parallel_shard_exit(void *shard_data) override;
+    bool
+    parallel_shard_memref(void *shard_data, const memref_t &memref) override;
+    std::string
+    parallel_shard_error(void *shard_data) override;
+
+    // Returns the estimated miss ratio over all shards of a fully-associative LRU
+    // cache holding "num_lines" cache lines.
+    double
+    get_miss_ratio(uint64_t num_lines);
+
+protected:
+    // As in reuse_distance_t, the shard is the unit over which we measure
+    // distance, which is a traced thread for serial operation.
+    struct shard_data_t {
+        explicit shard_data_t(bool verify);
+        // The sampled lines.
+        std::unordered_map<addr_t, line_ref_t *> cache_map;
+        // Unscaled distances among sampled lines to their counts.
+        std::unordered_map<int_least64_t, int_least64_t> dist_map;
+        line_ref_tree_t ref_list;
+        int_least64_t total_refs = 0;
+        int_least64_t sampled_refs = 0;
+        memref_tid_t tid = 0;
+        std::string error;
+    };
+
+    // The sampled reuse distance histogram aggregated over all shards.
+    struct curve_t {
+        int_least64_t sampled_refs = 0;
+        int_least64_t cold_misses = 0;
+        // Distances scaled to the full trace and their sampled counts, sorted by
+        // distance.
+        std::vector<std::pair<double, int_least64_t>> dists;
+    };
+
+    bool
+    is_sampled(addr_t tag) const;
+
+    void
+    compute_curve(curve_t *curve);
+
+    double
+    miss_ratio(const curve_t &curve, uint64_t num_lines) const;
+
+    const reuse_distance_knobs_t knobs_;
+    const size_t line_size_bits_;
+    // A line is sampled if the low bits of its hash are below this.
+    uint64_t sample_threshold_;
+    static const int HASH_BITS = 24;
+    static const std::string TOOL_NAME;
+    std::unordered_map<memref_tid_t, shard_data_t *> shard_map_;
+    // This mutex is only needed in parallel_shard_init.
+    std::mutex shard_map_mutex_;
+};
+
+#endif /* _MISS_RATIO_CURVE_H_ */
@@ -128,8 +128,31 @@ opcode_mix_t::parallel_shard_exit(void *shard_data)
 
 bool
 opcode_mix_t::parallel_shard_memref(void *shard_data, const memref_t &memref)
+{
+    return process_shard_memref(reinterpret_cast<shard_data_t *>(shard_data), memref);
+}
+
+bool
+opcode_mix_t::parallel_shard_memref_batch_supported()
+{
+    return true;
+}
+
+bool
+opcode_mix_t::parallel_shard_memref_batch(void *shard_data, const memref_t *memrefs,
+                                          size_t count)
 {
     shard_data_t *shard = reinterpret_cast<shard_data_t *>(shard_data);
+    for (size_t i = 0; i < count; ++i) {
+        if (!process_shard_memref(shard, memrefs[i]))
+            return false;
+    }
+    return true;
+}
+
+bool
+opcode_mix_t::process_shard_memref(shard_data_t *shard, const memref_t &memref)
+{
     if (memref.marker.type == TRACE_TYPE_MARKER &&
         memref.marker.marker_type == TRACE_MARKER_TYPE_FILETYPE) {
         if (TESTANY(OFFLINE_FILE_TYPE_ARCH_ALL, memref.marker.marker_value) &&
@@ -201,7 +224,7 @@ opcode_mix_t::parallel_shard_error(void *shard_data)
 bool
 opcode_mix_t::process_memref(const memref_t &memref)
 {
-    if (!parallel_shard_memref(reinterpret_cast<void *>(&serial_shard_), memref)) {
+    if (!process_shard_memref(&serial_shard_, memref)) {
         error_string_ = serial_shard_.error;
         return false;
     }
@@ -64,6 +64,14 @@ public:
     parallel_shard_exit(void *shard_data) override;
     bool
     parallel_shard_memref(void *shard_data, const memref_t &memref) override;
+    bool
+    parallel_shard_memref_batch_supported() override;
+    bool
+    parallel_shard_memref_batch(void *shard_data, const memref_t *memrefs,
+                                size_t count) override;
+    // We do not override parallel_shard_range_supported(): a range starting
+    // mid-shard never sees the filetype marker at the start of the shard, which
+    // is where we check that we decode the trace for the right architecture.
     std::string
     parallel_shard_error(void *shard_data) override;
 
@@ -95,6 +103,11 @@ protected:
         app_pc last_mapped_module_start;
     };
 
+    // The non-virtual worker for parallel_shard_memref() and
+    // parallel_shard_memref_batch().
+    bool
+    process_shard_memref(shard_data_t *shard, const memref_t &memref);
+
     struct dcontext_cleanup_last_t {
     public:
         ~dcontext_cleanup_last_t()
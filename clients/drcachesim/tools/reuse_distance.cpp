@@ -36,6 +36,7 @@
 #include <iostream>
 #include <vector>
 #include "reuse_distance.h"
+#include "../common/options.h"
 #include "../common/utils.h"
 
 const std::string reuse_distance_t::TOOL_NAME = "Reuse distance tool";
@@ -51,7 +52,13 @@ reuse_distance_tool_create(const reuse_distance_knobs_t &knobs)
 reuse_distance_t::reuse_distance_t(const reuse_distance_knobs_t &knobs)
     : knobs_(knobs)
     , line_size_bits_(compute_log2((int)knobs_.line_size))
+    , use_tree_(knobs_.engine == REUSE_ENGINE_FENWICK)
 {
+    if (knobs_.engine != REUSE_ENGINE_SKIP_LIST && !use_tree_) {
+        error_string_ = "Unknown reuse distance engine: '" + knobs_.engine + "'";
+        success_ = false;
+        return;
+    }
     if (DEBUG_VERBOSE(2)) {
         std::cerr << "cache line size " << knobs_.line_size << ", "
                   << "reuse distance threshold " << knobs_.distance_threshold
@@ -67,10 +74,15 @@ reuse_distance_t::~reuse_distance_t()
 }
 
 reuse_distance_t::shard_data_t::shard_data_t(uint64_t reuse_threshold, uint64_t skip_dist,
-                                             bool verify)
+                                             bool verify, bool use_tree)
 {
-    ref_list = std::unique_ptr<line_ref_list_t>(
-        new line_ref_list_t(reuse_threshold, skip_dist, verify));
+    if (use_tree) {
+        ref_list = std::unique_ptr<line_ref_list_t>(
+            new line_ref_tree_t(reuse_threshold, verify));
+    } else {
+        ref_list = std::unique_ptr<line_ref_list_t>(
+            new line_ref_list_t(reuse_threshold, skip_dist, verify));
+    }
 }
 
 bool
@@ -83,7 +95,7 @@ void *
 reuse_distance_t::parallel_shard_init(int shard_index, void *worker_data)
 {
     auto shard = new shard_data_t(knobs_.distance_threshold, knobs_.skip_list_distance,
-                                  knobs_.verify_skip);
+                                  knobs_.verify_skip, use_tree_);
     std::lock_guard<std::mutex> guard(shard_map_mutex_);
     shard_map_[shard_index] = shard;
     return reinterpret_cast<void *>(shard);
@@ -161,7 +173,7 @@ reuse_distance_t::process_memref(const memref_t &memref)
     const auto &lookup = shard_map_.find(memref.data.tid);
     if (lookup == shard_map_.end()) {
         shard = new shard_data_t(knobs_.distance_threshold, knobs_.skip_list_distance,
-                                 knobs_.verify_skip);
+                                 knobs_.verify_skip, use_tree_);
         shard_map_[memref.data.tid] = shard;
     } else
         shard = lookup->second;
@@ -308,8 +320,9 @@ bool
 reuse_distance_t::print_results()
 {
     // First, aggregate the per-shard data into whole-trace data.
-    auto aggregate = std::unique_ptr<shard_data_t>(new shard_data_t(
-        knobs_.distance_threshold, knobs_.skip_list_distance, knobs_.verify_skip));
+    auto aggregate = std::unique_ptr<shard_data_t>(
+        new shard_data_t(knobs_.distance_threshold, knobs_.skip_list_distance,
+                         knobs_.verify_skip, use_tree_));
     for (const auto &shard : shard_map_) {
         aggregate->total_refs += shard.second->total_refs;
         // We simply sum the unique accesses.
@@ -40,6 +40,7 @@
 #include <mutex>
 #include <unordered_map>
 #include <string>
+#include <vector>
 #include <assert.h>
 #include <iostream>
 #include "analysis_tool.h"
@@ -88,7 +89,8 @@ protected:
     // the shards we're given.  This is for simplicity and to give the user a method
     // for computing over different units if for some reason that was desired.
     struct shard_data_t {
-        shard_data_t(uint64_t reuse_threshold, uint64_t skip_dist, bool verify);
+        shard_data_t(uint64_t reuse_threshold, uint64_t skip_dist, bool verify,
+                     bool use_tree);
         std::unordered_map<addr_t, line_ref_t *> cache_map;
         // This is our reuse distance histogram.
         std::unordered_map<int_least64_t, int_least64_t> dist_map;
@@ -105,6 +107,8 @@ protected:
 
     const reuse_distance_knobs_t knobs_;
     const size_t line_size_bits_;
+    // Whether to use line_ref_tree_t rather than the skip list.
+    const bool use_tree_;
     static const std::string TOOL_NAME;
     // In parallel operation the keys are "shard indices": just ints.
     std::unordered_map<memref_tid_t, shard_data_t *> shard_map_;
@@ -234,7 +238,7 @@ struct line_ref_list_t {
     // than the threshold so that the gate points to the earliest
     // referenced cache line within the threshold.
     void
-    add_to_front(line_ref_t *ref)
+    link_new_front(line_ref_t *ref)
     {
         if (DEBUG_VERBOSE(3))
             std::cerr << "Add tag 0x" << std::hex << ref->tag << "\n";
@@ -249,6 +253,64 @@ struct line_ref_list_t {
         if (unique_lines_ > threshold_)
             gate_ = gate_->prev;
         unique_lines_++;
+    }
+
+    // Counts ref's distant references and keeps gate_ pointing at the same depth
+    // for a move of ref to the front.  ref must not be head_.
+    void
+    update_gate_for_move(line_ref_t *ref)
+    {
+        if (ref_is_distant(ref)) {
+            ref->distant_refs++;
+            gate_ = gate_->prev;
+        } else if (ref == gate_) {
+            // move gate_ if ref is the gate_.
+            gate_ = gate_->prev;
+        }
+    }
+
+    // Compares dist against a full list walk when -reuse_verify_skip is set.
+    void
+    verify_distance(line_ref_t *ref, int_least64_t dist)
+    {
+        if (DEBUG_VERBOSE(0) && verify_skip_) {
+            // Compute reuse distance with a full list walk as a sanity check.
+            // This is a debug-only option, so we guard with DEBUG_VERBOSE(0).
+            // Yes, the option check branch shows noticeable overhead without it.
+            int_least64_t brute_dist = 0;
+            for (line_ref_t *prev = head_; prev != ref; prev = prev->next)
+                ++brute_dist;
+            if (brute_dist != dist) {
+                std::cerr << "Mismatch!  Brute=" << brute_dist << " vs computed=" << dist
+                          << "\n";
+                print_list();
+                assert(false);
+            }
+        }
+    }
+
+    // Removes ref, which must not be head_, from its place in the list and
+    // makes it the new head_.
+    void
+    unlink_to_front(line_ref_t *ref)
+    {
+        line_ref_t *prev = ref->prev;
+        line_ref_t *next = ref->next;
+        prev->next = next;
+        // ref could be the last
+        if (next != NULL)
+            next->prev = prev;
+        // move ref to the front
+        ref->prev = NULL;
+        ref->next = head_;
+        head_->prev = ref;
+        head_ = ref;
+    }
+
+    virtual void
+    add_to_front(line_ref_t *ref)
+    {
+        link_new_front(ref);
         head_->time_stamp = cur_time_++;
 
         // Add a new skip node if necessary.
@@ -283,24 +345,17 @@ struct line_ref_list_t {
     // We need to move the gate_ pointer forward if the referenced cache
     // line is the gate_ cache line or any cache line after.
     // Returns the reuse distance of ref.
-    int_least64_t
+    virtual int_least64_t
     move_to_front(line_ref_t *ref)
     {
         if (DEBUG_VERBOSE(3))
             std::cerr << "Move tag 0x" << std::hex << ref->tag << " to front\n";
-        line_ref_t *prev;
         line_ref_t *next;
 
         ref->total_refs++;
         if (ref == head_)
             return 0;
-        if (ref_is_distant(ref)) {
-            ref->distant_refs++;
-            gate_ = gate_->prev;
-        } else if (ref == gate_) {
-            // move gate_ if ref is the gate_.
-            gate_ = gate_->prev;
-        }
+        update_gate_for_move(ref);
 
         // Compute reuse distance.
         int_least64_t dist = 0;
@@ -312,20 +367,7 @@ struct line_ref_list_t {
         else
             --dist; // Don't count self.
 
-        if (DEBUG_VERBOSE(0) && verify_skip_) {
-            // Compute reuse distance with a full list walk as a sanity check.
-            // This is a debug-only option, so we guard with DEBUG_VERBOSE(0).
-            // Yes, the option check branch shows noticeable overhead without it.
-            int_least64_t brute_dist = 0;
-            for (prev = head_; prev != ref; prev = prev->next)
-                ++brute_dist;
-            if (brute_dist != dist) {
-                std::cerr << "Mismatch!  Brute=" << brute_dist << " vs skip=" << dist
-                          << "\n";
-                print_list();
-                assert(false);
-            }
-        }
+        verify_distance(ref, dist);
 
         // Shift skip nodes between where ref was and head one earlier to
         // maintain spacing.  This means their depths remain the same.
@@ -338,18 +380,7 @@ struct line_ref_list_t {
         } else
             assert(ref->depth == -1);
 
-        // remove ref from the list
-        prev = ref->prev;
-        next = ref->next;
-        prev->next = next;
-        // ref could be the last
-        if (next != NULL)
-            next->prev = prev;
-        // move ref to the front
-        ref->prev = NULL;
-        ref->next = head_;
-        head_->prev = ref;
-        head_ = ref;
+        unlink_to_front(ref);
         head_->time_stamp = cur_time_++;
 
         if (DEBUG_VERBOSE(3))
@@ -360,4 +391,111 @@ struct line_ref_list_t {
     }
 };
 
+// An alternative to the skip list whose depth computation costs O(log n)
+// regardless of the distance or of any tuning.  Each line's time_stamp is a
+// slot number that increases with each access, and a Fenwick tree over the
+// slots marks the slot holding each line's latest access.  The depth of a line
+// is then the number of marked slots after its own.  When the slots run out
+// we renumber the lines compactly in list order, so the tree stays proportional
+// to the number of unique lines.  We still maintain the list and gate_, which
+// are cheap and give the distant reference counts and the verification walk.
+struct line_ref_tree_t : public line_ref_list_t {
+    line_ref_tree_t(uint64_t reuse_threshold, bool verify)
+        : line_ref_list_t(reuse_threshold, 0, verify)
+        , live_lines_(0)
+        , next_slot_(0)
+    {
+        tree_.assign(INITIAL_SLOTS + 1, 0);
+    }
+
+    void
+    add_to_front(line_ref_t *ref) override
+    {
+        link_new_front(ref);
+        ++cur_time_;
+        take_slot(ref);
+    }
+
+    int_least64_t
+    move_to_front(line_ref_t *ref) override
+    {
+        if (DEBUG_VERBOSE(3))
+            std::cerr << "Move tag 0x" << std::hex << ref->tag << " to front\n";
+        ref->total_refs++;
+        if (ref == head_)
+            return 0;
+        update_gate_for_move(ref);
+        int_least64_t dist =
+            static_cast<int_least64_t>(live_lines_) - count_through(ref->time_stamp);
+        verify_distance(ref, dist);
+        tree_add(ref->time_stamp, -1);
+        --live_lines_;
+        unlink_to_front(ref);
+        ++cur_time_;
+        take_slot(ref);
+        return dist;
+    }
+
+private:
+    static const uint64_t INITIAL_SLOTS = 1 << 16;
+
+    // Gives head_, which must be ref, the next slot.
+    void
+    take_slot(line_ref_t *ref)
+    {
+        assert(ref == head_);
+        if (next_slot_ == tree_.size() - 1)
+            renumber();
+        ref->time_stamp = next_slot_++;
+        tree_add(ref->time_stamp, 1);
+        ++live_lines_;
+    }
+
+    // Assigns slots 0..live_lines_-1 to every line but head_ in access order and
+    // rebuilds the tree, growing it if that leaves less than half of it free.
+    void
+    renumber()
+    {
+        uint64_t slots = tree_.size() - 1;
+        while (live_lines_ * 2 > slots)
+            slots *= 2;
+        uint64_t slot = live_lines_;
+        for (line_ref_t *node = head_->next; node != NULL; node = node->next)
+            node->time_stamp = --slot;
+        assert(slot == 0);
+        // Build the tree over the first live_lines_ slots in linear time.
+        tree_.assign(slots + 1, 0);
+        for (uint64_t i = 1; i <= slots; ++i) {
+            if (i <= live_lines_)
+                ++tree_[i];
+            uint64_t parent = i + (i & (~i + 1));
+            if (parent <= slots)
+                tree_[parent] += tree_[i];
+        }
+        next_slot_ = live_lines_;
+    }
+
+    void
+    tree_add(uint64_t slot, int_least64_t delta)
+    {
+        for (uint64_t i = slot + 1; i < tree_.size(); i += i & (~i + 1))
+            tree_[i] += delta;
+    }
+
+    // Returns the number of lines in slots 0 through "slot".
+    int_least64_t
+    count_through(uint64_t slot)
+    {
+        int_least64_t count = 0;
+        for (uint64_t i = slot + 1; i > 0; i -= i & (~i + 1))
+            count += tree_[i];
+        return count;
+    }
+
+    // A 1-based Fenwick tree: tree_[0] is unused.
+    std::vector<int_least64_t> tree_;
+    uint64_t live_lines_;
+    uint64_t next_slot_;
+};
+
 #endif /* _REUSE_DISTANCE_H_ */
@@ -55,6 +55,8 @@ struct reuse_distance_knobs_t {
         , report_top(10)
         , skip_list_distance(500)
         , verify_skip(false)
+        , engine("skip_list")
+        , sample_rate(0.01)
         , verbose(0)
     {
     }
@@ -64,6 +66,8 @@ struct reuse_distance_knobs_t {
     unsigned int report_top;
     unsigned int skip_list_distance;
     bool verify_skip;
+    std::string engine;
+    double sample_rate;
     unsigned int verbose;
 };
 
@@ -71,4 +75,12 @@ struct reuse_distance_knobs_t {
 analysis_tool_t *
 reuse_distance_tool_create(const reuse_distance_knobs_t &knobs);
 
+/**
+ * Creates an analysis tool which estimates the miss ratio curve of
+ * fully-associative LRU caches from the reuse distances of a sample of the
+ * cache lines, selected by hashing with the rate given by knobs.sample_rate.
+ */
+analysis_tool_t *
+miss_ratio_curve_tool_create(const reuse_distance_knobs_t &knobs);
+
 #endif /* _REUSE_DISTANCE_CREATE_H_ */
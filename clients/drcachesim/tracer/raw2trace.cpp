@@ -41,6 +41,7 @@
 #include "../common/memref.h"
 #include "../common/trace_entry.h"
 #include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <fstream>
 #include <sstream>
@@ -681,6 +682,7 @@ raw2trace_t::process_tasks(std::vector<raw2trace_thread_data_t *> *tasks)
     for (raw2trace_thread_data_t *tdata : *tasks) {
         VPRINT(1, "Worker %d starting on trace thread %d\n", tdata->worker, tdata->index);
         std::string error = process_thread_file(tdata);
+        publish_pending_block(tdata);
         if (!error.empty()) {
             VPRINT(1, "Worker %d hit error %s on trace thread %d\n", tdata->worker,
                    error.c_str(), tdata->index);
@@ -693,18 +695,23 @@ raw2trace_t::process_tasks(std::vector<raw2trace_thread_data_t *> *tasks)
 std::string
 raw2trace_t::do_conversion()
 {
+    auto start_time = std::chrono::steady_clock::now();
     std::string error = read_and_map_modules();
     if (!error.empty())
         return error;
     if (thread_data_.empty())
         return "No thread files found.";
+    auto convert_time = std::chrono::steady_clock::now();
+    module_map_usec_ = std::chrono::duration_cast<std::chrono::microseconds>(
+                           convert_time - start_time)
+                           .count();
     // XXX i#3286: Add a %-completed progress message by looking at the file sizes.
     if (worker_count_ == 0) {
         for (size_t i = 0; i < thread_data_.size(); ++i) {
             error = process_thread_file(&thread_data_[i]);
+            publish_pending_block(&thread_data_[i]);
             if (!error.empty())
                 return error;
-            count_elided_ += thread_data_[i].count_elided;
         }
     } else {
         // The files can be converted concurrently.
@@ -720,11 +727,22 @@ raw2trace_t::do_conversion()
         for (auto &tdata : thread_data_) {
             if (!tdata.error.empty())
                 return tdata.error;
-            count_elided_ += tdata.count_elided;
         }
     }
+    conversion_usec_ = std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::steady_clock::now() - convert_time)
+                           .count();
+    for (auto &tdata : thread_data_) {
+        count_elided_ += tdata.count_elided;
+        blocks_decoded_ += tdata.blocks_decoded;
+        blocks_decoded_twice_ += tdata.blocks_decoded_twice;
+    }
     VPRINT(1, "Reconstructed " UINT64_FORMAT_STRING " elided addresses.\n",
            count_elided_);
+    VPRINT(1,
+           "Decoded " UINT64_FORMAT_STRING " blocks (" UINT64_FORMAT_STRING
+           " redundantly).\n",
+           blocks_decoded_, blocks_decoded_twice_);
     VPRINT(1, "Successfully converted %zu thread files\n", thread_data_.size());
     return "";
 }
@@ -738,8 +756,9 @@ raw2trace_t::lookup_block_summary(void *tls, app_pc block_start)
                tdata->last_block_summary, tdata->last_decode_block_start);
         return tdata->last_block_summary;
     }
-    block_summary_t *ret = static_cast<block_summary_t *>(
-        hashtable_lookup(&decode_cache_[tdata->worker], block_start));
+    // We are done with the prior block, so other workers may now use it.
+    publish_pending_block(tdata);
+    block_summary_t *ret = decode_cache_.lookup(block_start);
     if (ret != nullptr) {
         DEBUG_ASSERT(ret->start_pc == block_start);
         tdata->last_decode_block_start = block_start;
@@ -750,6 +769,29 @@ raw2trace_t::lookup_block_summary(void *tls, app_pc block_start)
     return ret;
 }
 
+void
+raw2trace_t::publish_pending_block(raw2trace_thread_data_t *tdata)
+{
+    block_summary_t *block = tdata->pending_block;
+    if (block == nullptr)
+        return;
+    tdata->pending_block = nullptr;
+    if (tdata->pending_block_replaces) {
+        tdata->pending_block_replaces = false;
+        decode_cache_.replace(block);
+        return;
+    }
+    block_summary_t *shared = decode_cache_.insert(block);
+    if (shared == block)
+        ++tdata->blocks_decoded;
+    else {
+        // Another worker added the same block first and ours has been freed.
+        ++tdata->blocks_decoded_twice;
+        if (tdata->last_block_summary == block)
+            tdata->last_block_summary = shared;
+    }
+}
+
 instr_summary_t *
 raw2trace_t::lookup_instr_summary(void *tls, uint64 modidx, uint64 modoffs,
                                   app_pc block_start, int index, app_pc pc,
@@ -782,15 +824,36 @@ raw2trace_t::create_instr_summary(void *tls, uint64 modidx, uint64 modoffs,
                                   app_pc orig)
 {
     auto tdata = reinterpret_cast<raw2trace_thread_data_t *>(tls);
+    instr_summary_t *desc;
     if (block == nullptr) {
+        // The new block stays private to this thread until it is complete, so we can
+        // fill it in and set its flags without synchronization.
+        publish_pending_block(tdata);
         block = new block_summary_t(block_start, instr_count);
         DEBUG_ASSERT(index >= 0 && index < static_cast<int>(block->instrs.size()));
-        hashtable_add(&decode_cache_[tdata->worker], block_start, block);
         VPRINT(5, "Created new block summary " PFX " for " PFX "\n", block, block_start);
+        tdata->pending_block = block;
         tdata->last_decode_block_start = block_start;
         tdata->last_block_summary = block;
     }
-    instr_summary_t *desc = &block->instrs[index];
+    if (block != tdata->pending_block) {
+        // A shared block is missing this entry because the visit that built it was
+        // cut short before reaching it.  We fill in a private copy, which replaces
+        // the shared block once we move on, so the entry is only decoded once.
+        publish_pending_block(tdata);
+        block_summary_t *copy =
+            new block_summary_t(block->start_pc, static_cast<int>(block->instrs.size()));
+        for (size_t i = 0; i < block->instrs.size(); ++i)
+            copy->instrs[i].copy_from(block->instrs[i]);
+        VPRINT(5, "Copied block summary " PFX " to " PFX " for " PFX "\n", block, copy,
+               block_start);
+        tdata->pending_block = copy;
+        tdata->pending_block_replaces = true;
+        tdata->last_decode_block_start = block_start;
+        tdata->last_block_summary = copy;
+        block = copy;
+    }
+    desc = &block->instrs[index];
     if (!instr_summary_t::construct(dcontext_, block_start, pc, orig, desc, verbosity_)) {
         WARN("Encountered invalid/undecodable instr @ %s+" PIFX,
              modvec_()[static_cast<size_t>(modidx)].path, IF_NOT_X64((uint)) modoffs);
@@ -828,12 +891,17 @@ raw2trace_t::set_instr_summary_flags(void *tls, uint64 modidx, uint64 modoffs,
     instr_summary_t *desc =
         lookup_instr_summary(tls, modidx, modoffs, block_start, index, pc, &block);
     if (desc == nullptr) {
+        // A new entry is always in this thread's pending block.
         app_pc pc_copy = pc;
         desc = create_instr_summary(tls, modidx, modoffs, block, block_start, instr_count,
                                     index, &pc_copy, orig);
+        if (desc == nullptr)
+            return false;
+    } else if (block != reinterpret_cast<raw2trace_thread_data_t *>(tls)->pending_block) {
+        // A shared block already had its flags set by the worker that built it, and
+        // it must not be modified now that other workers may be reading it.
+        return true;
     }
-    if (desc == nullptr)
-        return false;
     if (write)
         desc->set_mem_dest_flags(memop_index, use_remembered_base, remember_base);
     else
@@ -1148,7 +1216,6 @@ raw2trace_t::raw2trace_t(const char *module_map,
         if (worker_count_ > kDefaultJobMax)
             worker_count_ = kDefaultJobMax;
     }
-    int cache_count = worker_count_;
     if (worker_count_ > 0) {
         worker_tasks_.resize(worker_count_);
         int worker = 0;
@@ -1158,37 +1225,133 @@ raw2trace_t::raw2trace_t(const char *module_map,
             thread_data_[i].worker = worker;
             worker = (worker + 1) % worker_count_;
         }
-    } else
-        cache_count = 1;
-    decode_cache_.resize(cache_count);
-    for (int i = 0; i < cache_count; ++i) {
-        // We go ahead and start with a reasonably large capacity.
-        // We do not want the built-in mutex: this is per-worker so it can be lockless.
-        hashtable_init_ex(&decode_cache_[i], 16, HASH_INTPTR, false, false, nullptr,
-                          nullptr, nullptr);
-        // We pay a little memory to get a lower load factor, unless we have
-        // many duplicated tables.
-        hashtable_config_t config = { sizeof(config), true,
-                                      worker_count_ <= 8
-                                          ? 40U
-                                          : (worker_count_ <= 16 ? 50U : 60U) };
-        hashtable_configure(&decode_cache_[i], &config);
     }
 }
 
 raw2trace_t::~raw2trace_t()
 {
     module_mapper_.reset();
-    for (size_t i = 0; i < decode_cache_.size(); ++i) {
-        // XXX: We can't use a free-payload function b/c we can't get the dcontext there,
-        // so we have to explicitly free the payloads.
-        for (uint j = 0; j < HASHTABLE_SIZE(decode_cache_[i].table_bits); j++) {
-            for (hash_entry_t *e = decode_cache_[i].table[j]; e != NULL; e = e->next) {
-                delete (static_cast<block_summary_t *>(e->payload));
+    // Blocks are normally published at the end of each thread, but a caller may
+    // have stopped early.
+    for (auto &tdata : thread_data_)
+        delete tdata.pending_block;
+}
+
+// We used to keep a separate hashtable_t per worker, as it was the fastest option
+// when we looked up every instruction pc (i#2056).  Now that we only look up each
+// block, lookup speed matters much less than avoiding decoding the same block once
+// per worker.
+raw2trace_t::block_cache_t::block_cache_t()
+{
+    for (shard_t &shard : shards_) {
+        shard.tables.emplace_back(new table_t(kInitialCapacity));
+        shard.table.store(shard.tables.back().get(), std::memory_order_relaxed);
+    }
+}
+
+raw2trace_t::block_cache_t::~block_cache_t()
+{
+    for (shard_t &shard : shards_) {
+        table_t *table = shard.table.load(std::memory_order_relaxed);
+        for (size_t i = 0; i <= table->mask; ++i)
+            delete table->slots[i].load(std::memory_order_relaxed);
+    }
+}
+
+uint64
+raw2trace_t::block_cache_t::hash(app_pc start)
+{
+    // The splitmix64 finalizer, to spread nearby block addresses across shards
+    // and slots.
+    uint64 key = static_cast<uint64>(reinterpret_cast<ptr_uint_t>(start));
+    key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+    return key ^ (key >> 31);
+}
+
+raw2trace_t::block_summary_t *
+raw2trace_t::block_cache_t::lookup(app_pc start) const
+{
+    uint64 key = hash(start);
+    const shard_t &shard = shards_[key & ((1 << kShardBits) - 1)];
+    const table_t *table = shard.table.load(std::memory_order_acquire);
+    for (size_t i = static_cast<size_t>(key >> kShardBits);; ++i) {
+        block_summary_t *block =
+            table->slots[i & table->mask].load(std::memory_order_acquire);
+        if (block == nullptr || block->start_pc == start)
+            return block;
+    }
+}
+
+raw2trace_t::block_summary_t *
+raw2trace_t::block_cache_t::insert(block_summary_t *block)
+{
+    uint64 key = hash(block->start_pc);
+    shard_t &shard = shards_[key & ((1 << kShardBits) - 1)];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    table_t *table = shard.table.load(std::memory_order_relaxed);
+    size_t i = static_cast<size_t>(key >> kShardBits);
+    for (;; ++i) {
+        block_summary_t *existing =
+            table->slots[i & table->mask].load(std::memory_order_relaxed);
+        if (existing == nullptr)
+            break;
+        if (existing->start_pc == block->start_pc) {
+            delete block;
+            return existing;
+        }
+    }
+    // We keep the load factor at or below one half so probe sequences stay short.
+    if ((shard.count + 1) * 2 > table->mask + 1) {
+        table_t *grown = new table_t((table->mask + 1) * 2);
+        for (size_t j = 0; j <= table->mask; ++j) {
+            block_summary_t *entry = table->slots[j].load(std::memory_order_relaxed);
+            if (entry == nullptr)
+                continue;
+            size_t k = static_cast<size_t>(hash(entry->start_pc) >> kShardBits);
+            while (grown->slots[k & grown->mask].load(std::memory_order_relaxed) !=
+                   nullptr)
+                ++k;
+            grown->slots[k & grown->mask].store(entry, std::memory_order_relaxed);
+        }
+        shard.tables.emplace_back(grown);
+        // Publish the fully built table to readers.
+        shard.table.store(grown, std::memory_order_release);
+        table = grown;
+        for (i = static_cast<size_t>(key >> kShardBits);
+             table->slots[i & table->mask].load(std::memory_order_relaxed) != nullptr;
+             ++i) {
+        }
+    }
+    // The release store publishes the block's contents along with its pointer.
+    table->slots[i & table->mask].store(block, std::memory_order_release);
+    ++shard.count;
+    return block;
+}
+
+void
+raw2trace_t::block_cache_t::replace(block_summary_t *block)
+{
+    uint64 key = hash(block->start_pc);
+    shard_t &shard = shards_[key & ((1 << kShardBits) - 1)];
+    {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        table_t *table = shard.table.load(std::memory_order_relaxed);
+        for (size_t i = static_cast<size_t>(key >> kShardBits);; ++i) {
+            block_summary_t *existing =
+                table->slots[i & table->mask].load(std::memory_order_relaxed);
+            if (existing == nullptr)
+                break;
+            if (existing->start_pc == block->start_pc) {
+                shard.replaced.emplace_back(existing);
+                table->slots[i & table->mask].store(block, std::memory_order_release);
+                return;
             }
         }
-        hashtable_delete(&decode_cache_[i]);
     }
+    // The block we copied can only be missing if the caller is confused.
+    DEBUG_ASSERT(false);
+    insert(block);
 }
 
 bool
@@ -1307,6 +1470,10 @@ raw2trace_t::get_statistic(raw2trace_statistic_t stat)
 {
     switch (stat) {
     case RAW2TRACE_STAT_COUNT_ELIDED: return count_elided_;
+    case RAW2TRACE_STAT_BLOCKS_DECODED: return blocks_decoded_;
+    case RAW2TRACE_STAT_BLOCKS_DECODED_TWICE: return blocks_decoded_twice_;
+    case RAW2TRACE_STAT_MODULE_MAP_USEC: return module_map_usec_;
+    case RAW2TRACE_STAT_CONVERSION_USEC: return conversion_usec_;
     default: DR_ASSERT(false); return 0;
     }
 }
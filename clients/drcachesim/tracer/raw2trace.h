@@ -47,11 +47,11 @@
 #include <array>
 #include <atomic>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include "trace_entry.h"
 #include "instru.h"
 #include <fstream>
-#include "hashtable.h"
 #include <vector>
 
 #ifdef DEBUG
@@ -84,6 +84,15 @@
 
 typedef enum {
     RAW2TRACE_STAT_COUNT_ELIDED,
+    // The number of distinct blocks decoded into the shared decode cache.
+    RAW2TRACE_STAT_BLOCKS_DECODED,
+    // The number of blocks decoded redundantly because two workers raced to add
+    // the same block to the shared decode cache.
+    RAW2TRACE_STAT_BLOCKS_DECODED_TWICE,
+    // Wall-clock microseconds spent loading and mapping modules.
+    RAW2TRACE_STAT_MODULE_MAP_USEC,
+    // Wall-clock microseconds spent converting the thread files.
+    RAW2TRACE_STAT_CONVERSION_USEC,
 } raw2trace_statistic_t;
 
 struct module_t {
@@ -112,6 +121,8 @@ struct module_t {
     bool is_external; // If true, the data is embedded in drmodtrack custom fields.
 };
 
+class raw2trace_t;
+
 /**
  * instr_summary_t is a compact encapsulation of the information needed by trace
  * conversion from decoded instructions.
@@ -205,6 +216,23 @@ struct instr_summary_t final {
 
 private:
     template <typename T> friend class trace_converter_t;
+    friend class raw2trace_t;
+
+    // Copies all of "other", so raw2trace_t can extend a block other threads may
+    // be reading without modifying it.
+    void
+    copy_from(const instr_summary_t &other)
+    {
+        pc_ = other.pc_;
+        type_ = other.type_;
+        prefetch_type_ = other.prefetch_type_;
+        flush_type_ = other.flush_type_;
+        length_ = other.length_;
+        next_pc_ = other.next_pc_;
+        mem_srcs_and_dests_ = other.mem_srcs_and_dests_;
+        num_mem_srcs_ = other.num_mem_srcs_;
+        packed_ = other.packed_;
+    }
 
     byte
     length() const
@@ -1650,6 +1678,7 @@ protected:
             , prev_instr_was_rep_string(false)
             , last_decode_block_start(nullptr)
             , last_block_summary(nullptr)
+            , pending_block(nullptr)
         {
         }
 
@@ -1677,10 +1706,18 @@ protected:
         bool prev_instr_was_rep_string;
         app_pc last_decode_block_start;
         block_summary_t *last_block_summary;
+        // A block this thread is still filling in, which is added to the shared
+        // decode cache once the thread moves on to another block.
+        block_summary_t *pending_block;
+        // Whether pending_block is a more complete copy of a block already in the
+        // shared decode cache, which it is to replace there.
+        bool pending_block_replaces = false;
         uint64 last_window = 0;
 
         // Statistics on the processing.
         uint64 count_elided = 0;
+        uint64 blocks_decoded = 0;
+        uint64 blocks_decoded_twice = 0;
     };
 
     virtual std::string
@@ -1697,6 +1734,10 @@ protected:
     write_footer(void *tls);
 
     uint64 count_elided_ = 0;
+    uint64 blocks_decoded_ = 0;
+    uint64 blocks_decoded_twice_ = 0;
+    uint64 module_map_usec_ = 0;
+    uint64 conversion_usec_ = 0;
 
 private:
     friend class trace_converter_t<raw2trace_t>;
@@ -1722,6 +1763,9 @@ private:
                          int index, app_pc pc);
     block_summary_t *
     lookup_block_summary(void *tls, app_pc block_start);
+    // Adds tdata->pending_block, if any, to the shared decode cache.
+    void
+    publish_pending_block(raw2trace_thread_data_t *tdata);
     instr_summary_t *
     lookup_instr_summary(void *tls, uint64 modidx, uint64 modoffs, app_pc block_start,
                          int index, app_pc pc, OUT block_summary_t **block_summary);
@@ -1771,15 +1815,62 @@ private:
     int worker_count_;
     std::vector<std::vector<raw2trace_thread_data_t *>> worker_tasks_;
 
-    // We use a hashtable to cache decodings.  We compared the performance of
-    // hashtable_t to std::map.find, std::map.lower_bound, std::tr1::unordered_map,
-    // and c++11 std::unordered_map (including tuning its load factor, initial size,
-    // and hash function), and hashtable_t outperformed the others (i#2056).
-    // Update: that measurement was when we did a hashtable lookup on every
-    // instruction pc.  Now that we use block_summary_t and only look up each block,
-    // the hashtable performance matters much less.
-    // We use a per-worker cache to avoid locks.
-    std::vector<hashtable_t> decode_cache_;
+    // A cache of decoded blocks shared by all workers, so that code common to many
+    // traced threads is decoded only once.  Lookups take no locks: each shard is an
+    // open-addressed table of block pointers published with release stores, and a
+    // full table is replaced by a larger copy rather than resized in place.  Inserts
+    // take the owning shard's lock.  Blocks are never modified once added, so callers
+    // may read them without locks.  A block whose first visit was cut short is
+    // missing entries; it is replaced by a filled-in copy and kept until
+    // destruction.
+    class block_cache_t {
+    public:
+        block_cache_t();
+        ~block_cache_t();
+
+        // Returns the block starting at "start", or nullptr if there is none.
+        block_summary_t *
+        lookup(app_pc start) const;
+
+        // Adds "block" and returns it, unless a block with the same start was added
+        // first, in which case "block" is deleted and the existing one is returned.
+        block_summary_t *
+        insert(block_summary_t *block);
+
+        // Adds "block" in place of the block with the same start, which must exist.
+        void
+        replace(block_summary_t *block);
+
+    private:
+        struct table_t {
+            explicit table_t(size_t capacity)
+                : mask(capacity - 1)
+                , slots(new std::atomic<block_summary_t *>[capacity])
+            {
+                for (size_t i = 0; i < capacity; ++i)
+                    slots[i].store(nullptr, std::memory_order_relaxed);
+            }
+            size_t mask;
+            std::unique_ptr<std::atomic<block_summary_t *>[]> slots;
+        };
+        struct shard_t {
+            std::mutex lock; // Protects all fields but "table" for readers.
+            std::atomic<table_t *> table;
+            size_t count = 0;
+            // Replaced tables and blocks are kept until destruction as readers may
+            // still be using them.
+            std::vector<std::unique_ptr<table_t>> tables;
+            std::vector<std::unique_ptr<block_summary_t>> replaced;
+        };
+
+        static uint64
+        hash(app_pc start);
+
+        static const int kShardBits = 6;
+        static const size_t kInitialCapacity = 256;
+        shard_t shards_[1 << kShardBits];
+    };
+    block_cache_t decode_cache_;
 
     // Store optional parameters for the module_mapper_t until we need to construct it.
     const char *(*user_parse_)(const char *src, OUT void **data) = nullptr;
@@ -1795,8 +1886,8 @@ private:
 
     std::string alt_module_dir_;
 
-    // Our decode_cache duplication will not scale forever on very large code
-    // footprint traces, so we set a cap for the default.
+    // Each worker holds a thread file open for reading and writing along with its
+    // buffers, so we set a cap for the default.
     static const int kDefaultJobMax = 16;
 };
 
@@ -57,7 +57,7 @@
 #include "utils.h"
 #ifdef HAS_ZLIB
 #    include "common/gzip_istream.h"
-#    include "common/gzip_ostream.h"
+#    include "common/chunked_gzip_ostream.h"
 #    include "common/zlib_istream.h"
 #endif
 #ifdef HAS_SNAPPY
@@ -209,7 +209,7 @@ raw2trace_directory_t::open_thread_log_file(const char *basename)
     }
     std::ostream *ofile;
 #ifdef HAS_ZLIB
-    ofile = new gzip_ostream_t(path);
+    ofile = new chunked_gzip_ostream_t(path);
 #else
     ofile = new std::ofstream(path, std::ofstream::binary);
 #endif
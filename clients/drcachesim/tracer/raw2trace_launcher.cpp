@@ -39,6 +39,7 @@
 #    include <windows.h>
 #endif
 
+#include <chrono>
 #include "droption.h"
 #include "dr_frontend.h"
 #include "raw2trace.h"
@@ -94,10 +95,13 @@ _tmain(int argc, const TCHAR *targv[])
                     droption_parser_t::usage_short(DROPTION_SCOPE_ALL).c_str());
     }
 
+    auto start_time = std::chrono::steady_clock::now();
     raw2trace_directory_t dir(op_verbose.get_value());
     std::string dir_err = dir.initialize(op_indir.get_value(), op_outdir.get_value());
     if (!dir_err.empty())
         FATAL_ERROR("Directory parsing failed: %s", dir_err.c_str());
+    std::chrono::duration<double> open_secs =
+        std::chrono::steady_clock::now() - start_time;
     raw2trace_t raw2trace(dir.modfile_bytes_, dir.in_files_, dir.out_files_, NULL,
                           op_verbose.get_value(), op_jobs.get_value(),
                           op_alt_module_dir.get_value());
@@ -105,5 +109,19 @@ _tmain(int argc, const TCHAR *targv[])
     if (!error.empty())
         FATAL_ERROR("Conversion failed: %s", error.c_str());
 
+    if (op_verbose.get_value() >= 1) {
+        fprintf(stderr, "Phase timing:\n");
+        fprintf(stderr, "  %-24s %10.3fs\n", "Opening files", open_secs.count());
+        fprintf(stderr, "  %-24s %10.3fs\n", "Mapping modules",
+                raw2trace.get_statistic(RAW2TRACE_STAT_MODULE_MAP_USEC) / 1000000.);
+        fprintf(stderr, "  %-24s %10.3fs\n", "Converting threads",
+                raw2trace.get_statistic(RAW2TRACE_STAT_CONVERSION_USEC) / 1000000.);
+        fprintf(stderr, "Decoded %llu blocks for %zu threads (%llu decoded twice)\n",
+                static_cast<unsigned long long>(
+                    raw2trace.get_statistic(RAW2TRACE_STAT_BLOCKS_DECODED)),
+                dir.in_files_.size(),
+                static_cast<unsigned long long>(
+                    raw2trace.get_statistic(RAW2TRACE_STAT_BLOCKS_DECODED_TWICE)));
+    }
     return 0;
 }
@@ -59,6 +59,7 @@
 #include "func_trace.h"
 #include "../common/trace_entry.h"
 #include "../common/named_pipe.h"
+#include "../common/shm_ring.h"
 #include "../common/options.h"
 #include "../common/utils.h"
 #ifdef HAS_SNAPPY
@@ -121,6 +122,10 @@ static size_t max_buf_size;
 
 static drvector_t scratch_reserve_vec;
 
+/* For -writer_threads: see "Asynchronous buffer writing" below. */
+struct writer_t;
+struct write_request_t;
+
 /* Thread private data.  This is all set to 0 at thread init. */
 typedef struct {
     byte *seg_base;
@@ -135,6 +140,13 @@ typedef struct {
     /* For file_ops_func.handoff_buf */
     uint num_buffers;
     byte *reserve_buf;
+    /* For -writer_threads */
+    writer_t *writer;
+    void *write_done; /* Signaled by the writer as each buffer completes. */
+    uint pending_writes; /* Protected by writer->lock, as is spare_writes. */
+    write_request_t *spare_writes; /* Written buffers, zeroed for reuse. */
+    uint64 num_writer_stalls;
+    uint64 writer_stall_us;
     /* For level 0 filters */
     byte *l0_dcache;
     byte *l0_icache;
@@ -182,6 +194,12 @@ typedef struct {
 
 /* For online simulation, we write to a single global pipe */
 static named_pipe_t ipc_pipe;
+/* ...or, for -ipc_ring_size, to a ring in memory shared with the simulator. */
+static shm_ring_t ipc_ring;
+static void *ipc_ring_map;
+static size_t ipc_ring_map_size;
+/* How often a writer waiting for space in ipc_ring checks that the reader is alive. */
+#define RING_READER_CHECK_MS 1000
 
 #define MAX_INSTRU_SIZE 128 /* the max obj size of instr_t or its children */
 static instru_t *instru;
@@ -322,6 +340,9 @@ redirect_free(void *drcontext, void *ptr)
  * Buffer writing to disk.
  */
 
+static void
+wait_for_writes(per_thread_t *data, uint max_pending, bool is_stall);
+
 #ifdef HAS_LZ4
 static const LZ4F_preferences_t lz4_ops = {
     { LZ4F_max256KB, LZ4F_blockLinked, LZ4F_noContentChecksum, LZ4F_frame,
@@ -501,6 +522,7 @@ static void
 close_thread_file(void *drcontext)
 {
     per_thread_t *data = (per_thread_t *)drmgr_get_tls_field(drcontext, tls_idx);
+    wait_for_writes(data, 0, false);
 #ifdef HAS_SNAPPY
     if (op_offline.get_value() && snappy_enabled()) {
         data->snappy_writer->~snappy_file_writer_t();
@@ -692,6 +714,145 @@ atomic_pipe_write(void *drcontext, byte *pipe_start, byte *pipe_end, ptr_int_t w
     return pipe_start;
 }
 
+// Returns whether the simulator reading ipc_ring is still running.
+static bool
+ring_reader_alive()
+{
+    int32_t pid = ipc_ring.get_reader();
+    if (pid == 0)
+        return false;
+#ifdef LINUX
+    // Unlike a pipe, the ring gives no error once the reader is gone, so we
+    // look for it.  A reader that has exited may linger as a zombie.
+    char path[64];
+    dr_snprintf(path, BUFFER_SIZE_ELEMENTS(path), "/proc/%d/stat", pid);
+    NULL_TERMINATE_BUFFER(path);
+    file_t fd = dr_open_file(path, DR_FILE_READ);
+    if (fd == INVALID_FILE)
+        return false;
+    char stat[512];
+    ssize_t len = dr_read_file(fd, stat, sizeof(stat) - 1);
+    dr_close_file(fd);
+    if (len <= 0)
+        return true;
+    stat[len] = '\0';
+    // The state follows the parenthesized command name.
+    const char *state = strrchr(stat, ')');
+    if (state != NULL && state[1] == ' ' && (state[2] == 'Z' || state[2] == 'X'))
+        return false;
+#endif
+    return true;
+}
+
+static void
+ring_write(byte *start, byte *end)
+{
+    DR_ASSERT(end - start <= (ssize_t)ipc_ring.get_max_record_size());
+    uint64 next_check = 0;
+    while (!ipc_ring.try_write(start, end - start)) {
+        // The simulator is behind: wait for it to free up space, unless it has
+        // exited, where we give up as a failed pipe write does.
+        uint64 now = dr_get_milliseconds();
+        if (now >= next_check) {
+            if (next_check != 0 && !ring_reader_alive())
+                FATAL("Fatal error: simulator exited while writing to ring\n");
+            next_check = now + RING_READER_CHECK_MS;
+        }
+        dr_thread_yield();
+    }
+}
+
+static void
+open_ipc_ring()
+{
+#ifdef UNIX
+    // The simulator creates and initializes the ring before launching the
+    // application.  We check for the file as opening it would otherwise create it.
+    std::string path = shm_ring_t::get_path(op_ipc_name.get_value());
+    if (!dr_file_exists(path.c_str()))
+        FATAL("Fatal error: failed to find ring file %s\n", path.c_str());
+    file_t fd = dr_open_file(path.c_str(), DR_FILE_READ | DR_FILE_WRITE_APPEND);
+    uint64 size;
+    if (fd == INVALID_FILE || !dr_file_size(fd, &size))
+        FATAL("Fatal error: failed to open ring file %s\n", path.c_str());
+    ipc_ring_map_size = (size_t)size;
+    ipc_ring_map = dr_map_file(fd, &ipc_ring_map_size, 0, NULL,
+                               DR_MEMPROT_READ | DR_MEMPROT_WRITE, 0);
+    dr_close_file(fd);
+    if (ipc_ring_map == NULL || !ipc_ring.attach_region(ipc_ring_map, ipc_ring_map_size))
+        FATAL("Fatal error: failed to map ring file %s\n", path.c_str());
+    if (!ipc_ring.add_writer((int32_t)dr_get_process_id()))
+        FATAL("Fatal error: too many processes writing to ring %s\n", path.c_str());
+#else
+    FATAL("Fatal error: -ipc_ring_size is not supported on Windows\n");
+#endif
+}
+
+static void
+close_ipc_ring()
+{
+    ipc_ring.remove_writer((int32_t)dr_get_process_id());
+    dr_unmap_file(ipc_ring_map, ipc_ring_map_size);
+    ipc_ring_map = NULL;
+    ipc_ring_map_size = 0;
+}
+
+// Compresses and writes [towrite_start, towrite_end) to the offline file of the
+// thread owning "data".  This is called by a writer thread for -writer_threads.
+static void
+write_offline_data(per_thread_t *data, thread_id_t tid, ptr_int_t window,
+                   byte *towrite_start, byte *towrite_end)
+{
+    ssize_t size = towrite_end - towrite_start;
+    ssize_t wrote;
+#ifdef HAS_SNAPPY
+    if (op_offline.get_value() && snappy_enabled())
+        wrote = data->snappy_writer->compress_and_write(towrite_start, size);
+    else
+#endif
+#ifdef HAS_ZLIB
+        if (op_offline.get_value() &&
+            (op_raw_compress.get_value() == "zlib" ||
+             op_raw_compress.get_value() == "gzip")) {
+        data->zstream.next_in = (Bytef *)towrite_start;
+        data->zstream.avail_in = size;
+        int res;
+        do {
+            data->zstream.next_out = (Bytef *)data->buf_compressed;
+            data->zstream.avail_out = max_buf_size;
+            res = deflate(&data->zstream, Z_NO_FLUSH);
+            NOTIFY(3, "deflate => %d in=%d out=%d => in=%d, out=%d, write=%d\n",
+                   res, size, size, data->zstream.avail_in,
+                   data->zstream.avail_out,
+                   max_buf_size - data->zstream.avail_out);
+            DR_ASSERT(res != Z_STREAM_ERROR);
+            wrote =
+                file_ops_func.write_file(data->file, data->buf_compressed,
+                                         max_buf_size - data->zstream.avail_out);
+        } while (data->zstream.avail_out == 0);
+        DR_ASSERT(data->zstream.avail_in == 0);
+        wrote = size;
+    } else
+#endif
+#ifdef HAS_LZ4
+        if (op_offline.get_value() && op_raw_compress.get_value() == "lz4") {
+        size_t res =
+            LZ4F_compressUpdate(data->lzcxt, data->buf_lz4, data->buf_lz4_size,
+                                towrite_start, size, nullptr);
+        DR_ASSERT(!LZ4F_isError(res));
+        wrote = file_ops_func.write_file(data->file, data->buf_lz4, res);
+        DR_ASSERT(static_cast<size_t>(wrote) == res);
+        wrote = size;
+    } else
+#endif
+        wrote = file_ops_func.write_file(data->file, towrite_start, size);
+    if (wrote < size) {
+        FATAL("Fatal error: failed to write trace for T%d window %zd: wrote %zd "
+              "of %zd\n",
+              tid, window, wrote, size);
+    }
+}
+
 static inline byte *
 write_trace_data(void *drcontext, byte *towrite_start, byte *towrite_end,
                  ptr_int_t window)
@@ -706,53 +867,10 @@ write_trace_data(void *drcontext, byte *towrite_start, byte *towrite_end,
                 FATAL("Fatal error: failed to hand off trace\n");
             }
         } else {
-            ssize_t wrote;
-#ifdef HAS_SNAPPY
-            if (op_offline.get_value() && snappy_enabled())
-                wrote = data->snappy_writer->compress_and_write(towrite_start, size);
-            else
-#endif
-#ifdef HAS_ZLIB
-                if (op_offline.get_value() &&
-                    (op_raw_compress.get_value() == "zlib" ||
-                     op_raw_compress.get_value() == "gzip")) {
-                data->zstream.next_in = (Bytef *)towrite_start;
-                data->zstream.avail_in = size;
-                int res;
-                do {
-                    data->zstream.next_out = (Bytef *)data->buf_compressed;
-                    data->zstream.avail_out = max_buf_size;
-                    res = deflate(&data->zstream, Z_NO_FLUSH);
-                    NOTIFY(3, "deflate => %d in=%d out=%d => in=%d, out=%d, write=%d\n",
-                           res, size, size, data->zstream.avail_in,
-                           data->zstream.avail_out,
-                           max_buf_size - data->zstream.avail_out);
-                    DR_ASSERT(res != Z_STREAM_ERROR);
-                    wrote =
-                        file_ops_func.write_file(data->file, data->buf_compressed,
-                                                 max_buf_size - data->zstream.avail_out);
-                } while (data->zstream.avail_out == 0);
-                DR_ASSERT(data->zstream.avail_in == 0);
-                wrote = size;
-            } else
-#endif
-#ifdef HAS_LZ4
-                if (op_offline.get_value() && op_raw_compress.get_value() == "lz4") {
-                size_t res =
-                    LZ4F_compressUpdate(data->lzcxt, data->buf_lz4, data->buf_lz4_size,
-                                        towrite_start, size, nullptr);
-                DR_ASSERT(!LZ4F_isError(res));
-                wrote = file_ops_func.write_file(data->file, data->buf_lz4, res);
-                DR_ASSERT(static_cast<size_t>(wrote) == res);
-                wrote = size;
-            } else
-#endif
-                wrote = file_ops_func.write_file(data->file, towrite_start, size);
-            if (wrote < size) {
-                FATAL("Fatal error: failed to write trace for T%d window %zd: wrote %zd "
-                      "of %zd\n",
-                      dr_get_thread_id(drcontext), get_local_window(data), wrote, size);
-            }
+            // Earlier buffers of this thread may still be queued for its writer.
+            wait_for_writes(data, 0, false);
+            write_offline_data(data, dr_get_thread_id(drcontext), get_local_window(data),
+                               towrite_start, towrite_end);
         }
         return towrite_start;
     } else {
@@ -760,6 +878,10 @@ write_trace_data(void *drcontext, byte *towrite_start, byte *towrite_end,
         // XXX i#5427: Use snappy compression for pipe data as well.  We need to
         // create a reader on the other end first.
 #endif
+        if (ipc_ring_map != NULL) {
+            ring_write(towrite_start, towrite_end);
+            return towrite_start;
+        }
         return atomic_pipe_write(drcontext, towrite_start, towrite_end, window);
     }
 }
@@ -880,6 +1002,208 @@ create_v2p_buffer(per_thread_t *data)
     }
 }
 
+/***************************************************************************
+ * Asynchronous buffer writing for -writer_threads.
+ *
+ * A full offline buffer is queued for a writer thread, which compresses and
+ * writes it while the application thread continues on a spare buffer.  Each
+ * traced thread is assigned to a single writer so that its buffers are written
+ * in order by one thread, which also lets the writer use the per-thread
+ * compression state without further synchronization.  Written buffers are
+ * zeroed with a fresh redzone by the writer and handed back to their thread
+ * for reuse.  A thread with -writer_queue_depth buffers in flight waits for
+ * its writer: we count these stalls to show when more writers are needed.
+ */
+
+struct write_request_t {
+    write_request_t *next;
+    per_thread_t *data;
+    thread_id_t tid;
+    ptr_int_t window;
+    byte *buf; // The allocation base.
+    byte *start;
+    byte *end;
+    bool is_v2p;
+};
+
+struct writer_t {
+    void *lock; // Protects the queue and each of its threads' pending_writes.
+    void *work_event;
+    void *exited_event;
+    write_request_t *head;
+    write_request_t *tail;
+    bool exiting;
+};
+
+static writer_t *writers;
+static uint num_writers;
+static uint64 num_writer_stalls;
+static uint64 writer_stall_us;
+
+// Waits until at most "max_pending" of the buffers of "data" are queued or
+// being written.
+static void
+wait_for_writes(per_thread_t *data, uint max_pending, bool is_stall)
+{
+    if (data->writer == NULL)
+        return;
+    uint64 start_us = 0;
+    while (true) {
+        dr_mutex_lock(data->writer->lock);
+        uint pending = data->pending_writes;
+        dr_mutex_unlock(data->writer->lock);
+        if (pending <= max_pending)
+            break;
+        if (is_stall && start_us == 0) {
+            start_us = dr_get_microseconds();
+            ++data->num_writer_stalls;
+        }
+        // The event is auto-reset and only this thread waits on it, so a
+        // signal sent since we read "pending" is not lost.
+        dr_event_wait(data->write_done);
+    }
+    if (start_us != 0)
+        data->writer_stall_us += dr_get_microseconds() - start_us;
+}
+
+static void
+writer_thread_main(void *arg)
+{
+    writer_t *writer = (writer_t *)arg;
+    while (true) {
+        dr_mutex_lock(writer->lock);
+        write_request_t *req = writer->head;
+        if (req == NULL) {
+            bool exiting = writer->exiting;
+            dr_mutex_unlock(writer->lock);
+            if (exiting)
+                break;
+            dr_event_wait(writer->work_event);
+            continue;
+        }
+        writer->head = req->next;
+        if (writer->head == NULL)
+            writer->tail = NULL;
+        dr_mutex_unlock(writer->lock);
+
+        per_thread_t *data = req->data;
+        write_offline_data(data, req->tid, req->window, req->start, req->end);
+        if (req->is_v2p) {
+            dr_raw_mem_free(req->buf, get_v2p_buffer_size());
+            dr_global_free(req, sizeof(*req));
+            req = NULL;
+        } else {
+            // Prepare the buffer for reuse just like memtrace() does.
+            memset(req->buf, 0, trace_buf_size);
+            memset(req->buf + trace_buf_size, -1, redzone_size);
+        }
+        dr_mutex_lock(writer->lock);
+        if (req != NULL) {
+            req->next = data->spare_writes;
+            data->spare_writes = req;
+        }
+        --data->pending_writes;
+        // We signal while holding the lock so that the thread cannot observe
+        // zero pending writes and free "data" before we are done with it.
+        dr_event_signal(data->write_done);
+        dr_mutex_unlock(writer->lock);
+    }
+    dr_event_signal(writer->exited_event);
+}
+
+static void
+create_writer_threads()
+{
+    num_writers = op_writer_threads.get_value();
+    writers = (writer_t *)dr_global_alloc(num_writers * sizeof(*writers));
+    for (uint i = 0; i < num_writers; ++i) {
+        writers[i] = {};
+        writers[i].lock = dr_mutex_create();
+        writers[i].work_event = dr_event_create();
+        writers[i].exited_event = dr_event_create();
+        if (!dr_create_client_thread(writer_thread_main, &writers[i]))
+            FATAL("Fatal error: failed to create writer thread\n");
+    }
+}
+
+static void
+destroy_writer_threads()
+{
+    if (writers == NULL)
+        return;
+    for (uint i = 0; i < num_writers; ++i) {
+        dr_mutex_lock(writers[i].lock);
+        writers[i].exiting = true;
+        dr_mutex_unlock(writers[i].lock);
+        dr_event_signal(writers[i].work_event);
+        dr_event_wait(writers[i].exited_event);
+        DR_ASSERT(writers[i].head == NULL);
+        dr_event_destroy(writers[i].exited_event);
+        dr_event_destroy(writers[i].work_event);
+        dr_mutex_destroy(writers[i].lock);
+    }
+    dr_global_free(writers, num_writers * sizeof(*writers));
+    writers = NULL;
+    num_writers = 0;
+}
+
+// Hands [start, end) inside the buffer allocated at "buf" to the writer for
+// "data" and gives the thread a replacement buffer.
+static void
+queue_buffer_write(void *drcontext, per_thread_t *data, byte *buf, bool is_v2p,
+                   byte *start, byte *end)
+{
+    wait_for_writes(data, op_writer_queue_depth.get_value() - 1, true);
+    write_request_t *req = NULL;
+    if (!is_v2p) {
+        dr_mutex_lock(data->writer->lock);
+        req = data->spare_writes;
+        if (req != NULL)
+            data->spare_writes = req->next;
+        dr_mutex_unlock(data->writer->lock);
+    }
+    byte *spare_buf = NULL;
+    if (req != NULL)
+        spare_buf = req->buf;
+    else
+        req = (write_request_t *)dr_global_alloc(sizeof(*req));
+    req->next = NULL;
+    req->data = data;
+    req->tid = dr_get_thread_id(drcontext);
+    req->window = get_local_window(data);
+    req->buf = buf;
+    req->start = start;
+    req->end = end;
+    req->is_v2p = is_v2p;
+    dr_mutex_lock(data->writer->lock);
+    if (data->writer->tail == NULL)
+        data->writer->head = req;
+    else
+        data->writer->tail->next = req;
+    data->writer->tail = req;
+    ++data->pending_writes;
+    dr_mutex_unlock(data->writer->lock);
+    dr_event_signal(data->writer->work_event);
+
+    if (is_v2p)
+        create_v2p_buffer(data);
+    else if (spare_buf != NULL)
+        data->buf_base = spare_buf;
+    else
+        create_buffer(data);
+}
+
+static void
+free_spare_writes(per_thread_t *data)
+{
+    while (data->spare_writes != NULL) {
+        write_request_t *req = data->spare_writes;
+        data->spare_writes = req->next;
+        dr_raw_mem_free(req->buf, max_buf_size);
+        dr_global_free(req, sizeof(*req));
+    }
+}
+
 static bool
 is_ok_to_split_before(trace_type_t type)
 {
@@ -924,7 +1248,14 @@ output_buffer(void *drcontext, per_thread_t *data, byte *buf_base, byte *buf_ptr
 {
     byte *pipe_start = buf_base;
     byte *pipe_end = pipe_start;
-    if (!op_offline.get_value()) {
+    bool is_v2p = false;
+    if (buf_base >= data->v2p_buf && buf_base < data->v2p_buf + get_v2p_buffer_size())
+        is_v2p = true;
+    if (!op_offline.get_value() && ipc_ring_map != NULL) {
+        // A ring record holds the whole buffer, so unlike a pipe write we need
+        // not split it.
+        ring_write(pipe_start, buf_ptr);
+    } else if (!op_offline.get_value()) {
         for (byte *mem_ref = buf_base + header_size; mem_ref < buf_ptr;
              mem_ref += instru->sizeof_entry()) {
             // Split up the buffer into multiple writes to ensure atomic pipe writes.
@@ -964,6 +1295,10 @@ output_buffer(void *drcontext, per_thread_t *data, byte *buf_base, byte *buf_ptr
                 is_ok_to_split_before(instru->get_entry_type(pipe_start + header_size)));
             atomic_pipe_write(drcontext, pipe_start, buf_ptr, get_local_window(data));
         }
+    } else if (data->writer != NULL && file_ops_func.handoff_buf == NULL &&
+               data->buf_base != data->reserve_buf) {
+        queue_buffer_write(drcontext, data, is_v2p ? data->v2p_buf : data->buf_base,
+                           is_v2p, pipe_start, buf_ptr);
     } else {
         write_trace_data(drcontext, pipe_start, buf_ptr, get_local_window(data));
     }
@@ -972,9 +1307,6 @@ output_buffer(void *drcontext, per_thread_t *data, byte *buf_base, byte *buf_ptr
     uint current_num_refs = (uint)(span / instru->sizeof_entry());
     data->num_refs += current_num_refs;
     data->bytes_written += buf_ptr - pipe_start;
-    bool is_v2p = false;
-    if (buf_base >= data->v2p_buf && buf_base < data->v2p_buf + get_v2p_buffer_size())
-        is_v2p = true;
     if (is_v2p)
         ++data->num_v2p_writeouts;
     else
@@ -1168,6 +1500,8 @@ memtrace(void *drcontext, bool skip_size_cap)
     }
 
     header_size = add_buffer_header(drcontext, data, data->buf_base);
+    // A writer thread may swap in a new buffer, which is already prepared.
+    byte *full_buf = data->buf_base;
 
     bool window_changed = false;
     if (has_tracing_windows() &&
@@ -1247,7 +1581,7 @@ memtrace(void *drcontext, bool skip_size_cap)
             output_buffer(drcontext, data, data->buf_base + skip, buf_ptr, header_size);
     }
 
-    if (file_ops_func.handoff_buf == NULL) {
+    if (file_ops_func.handoff_buf == NULL && data->buf_base == full_buf) {
         // Our instrumentation reads from buffer and skips the clean call if the
         // content is 0, so we need set zero in the trace buffer and set non-zero
         // in redzone.
@@ -2899,6 +3233,10 @@ event_thread_init(void *drcontext)
         if (op_use_physical.get_value() && op_offline.get_value()) {
             create_v2p_buffer(data);
         }
+        if (num_writers > 0) {
+            data->writer = &writers[dr_get_thread_id(drcontext) % num_writers];
+            data->write_done = dr_event_create();
+        }
         init_thread_in_process(drcontext);
         // XXX i#1729: gather and store an initial callstack for the thread.
     }
@@ -2966,6 +3304,11 @@ event_thread_exit(void *drcontext)
 
         if (op_offline.get_value() && data->file != INVALID_FILE)
             close_thread_file(drcontext);
+        if (data->writer != NULL) {
+            wait_for_writes(data, 0, false);
+            free_spare_writes(data);
+            dr_event_destroy(data->write_done);
+        }
 
 #ifdef HAS_ZLIB
         if (op_offline.get_value() &&
@@ -2985,6 +3328,8 @@ event_thread_exit(void *drcontext)
         num_writeouts += data->num_writeouts;
         num_v2p_writeouts += data->num_v2p_writeouts;
         num_phys_markers += data->num_phys_markers;
+        num_writer_stalls += data->num_writer_stalls;
+        writer_stall_us += data->writer_stall_us;
         dr_mutex_unlock(mutex);
         dr_raw_mem_free(data->buf_base, max_buf_size);
         if (data->reserve_buf != NULL)
@@ -3013,6 +3358,14 @@ event_exit(void)
                " physical address markers in " UINT64_FORMAT_STRING " writeouts.\n",
                num_phys_markers, num_v2p_writeouts);
     }
+    if (num_writers > 0) {
+        NOTIFY(1,
+               "drmemtrace writer threads stalled the application " UINT64_FORMAT_STRING
+               " times for " UINT64_FORMAT_STRING " us.\n",
+               num_writer_stalls, writer_stall_us);
+    }
+    // Every thread exit has already waited for its queued buffers.
+    destroy_writer_threads();
     /* we use placement new for better isolation */
     instru->~instru_t();
     dr_global_free(instru, MAX_INSTRU_SIZE);
@@ -3021,7 +3374,9 @@ event_exit(void)
         file_ops_func.close_file(module_file);
         if (funclist_file != INVALID_FILE)
             file_ops_func.close_file(funclist_file);
-    } else
+    } else if (ipc_ring_map != NULL)
+        close_ipc_ring();
+    else
         ipc_pipe.close();
 
     if (file_ops_func.exit_cb != NULL)
@@ -3056,6 +3411,8 @@ event_exit(void)
     num_refs = 0;
     num_refs_racy = 0;
     notify_beyond_global_max_once = 0;
+    num_writer_stalls = 0;
+    writer_stall_us = 0;
 
     dr_mutex_destroy(mutex);
     drutil_exit();
@@ -3155,6 +3512,25 @@ fork_init(void *drcontext)
             FATAL("Failed to create a subdir in %s\n", op_outdir.get_value().c_str());
         }
     }
+    /* The ring mapping is shared with the parent, but we need our own registration
+     * so the simulator waits for us.
+     */
+    if (ipc_ring_map != NULL && !ipc_ring.add_writer((int32_t)dr_get_process_id()))
+        FATAL("Fatal error: too many processes writing to the ring\n");
+    if (num_writers > 0) {
+        /* The writer threads do not exist in the child and their locks may have
+         * been held at the fork, so we start over, leaking the parent's copies.
+         * Buffers still queued belong to the parent's files.
+         */
+        writers = NULL;
+        create_writer_threads();
+        if (data->writer != NULL) {
+            data->writer = &writers[dr_get_thread_id(drcontext) % num_writers];
+            data->write_done = dr_event_create();
+            data->pending_writes = 0;
+            data->spare_writes = NULL;
+        }
+    }
     init_thread_in_process(drcontext);
 }
 #endif
@@ -3254,28 +3630,32 @@ drmemtrace_client_main(client_id_t id, int argc, const char *argv[])
         instru = new (placement)
             online_instru_t(insert_load_buf_ptr, insert_update_buf_ptr,
                             op_L0I_filter.get_value(), &scratch_reserve_vec);
-        if (!ipc_pipe.set_name(op_ipc_name.get_value().c_str()))
-            DR_ASSERT(false);
+        if (op_ipc_ring_size.get_value() > 0)
+            open_ipc_ring();
+        else {
+            if (!ipc_pipe.set_name(op_ipc_name.get_value().c_str()))
+                DR_ASSERT(false);
 #ifdef UNIX
-        /* we want an isolated fd so we don't use ipc_pipe.open_for_write() */
-        int fd = dr_open_file(ipc_pipe.get_pipe_path().c_str(), DR_FILE_WRITE_ONLY);
-        DR_ASSERT(fd != INVALID_FILE);
-        if (!ipc_pipe.set_fd(fd))
-            DR_ASSERT(false);
+            /* we want an isolated fd so we don't use ipc_pipe.open_for_write() */
+            int fd = dr_open_file(ipc_pipe.get_pipe_path().c_str(), DR_FILE_WRITE_ONLY);
+            DR_ASSERT(fd != INVALID_FILE);
+            if (!ipc_pipe.set_fd(fd))
+                DR_ASSERT(false);
 #else
-        if (!ipc_pipe.open_for_write()) {
-            if (GetLastError() == ERROR_PIPE_BUSY) {
-                // FIXME i#1727: add multi-process support to Windows named_pipe_t.
-                FATAL("Fatal error: multi-process applications not yet supported "
-                      "for drcachesim on Windows\n");
-            } else {
-                FATAL("Fatal error: Failed to open pipe %s.\n",
-                      op_ipc_name.get_value().c_str());
+            if (!ipc_pipe.open_for_write()) {
+                if (GetLastError() == ERROR_PIPE_BUSY) {
+                    // FIXME i#1727: add multi-process support to Windows named_pipe_t.
+                    FATAL("Fatal error: multi-process applications not yet supported "
+                          "for drcachesim on Windows\n");
+                } else {
+                    FATAL("Fatal error: Failed to open pipe %s.\n",
+                          op_ipc_name.get_value().c_str());
+                }
             }
-        }
 #endif
-        if (!ipc_pipe.maximize_buffer())
-            NOTIFY(1, "Failed to maximize pipe buffer: performance may suffer.\n");
+            if (!ipc_pipe.maximize_buffer())
+                NOTIFY(1, "Failed to maximize pipe buffer: performance may suffer.\n");
+        }
     }
 
     if (op_offline.get_value() &&
@@ -3388,6 +3768,16 @@ drmemtrace_client_main(client_id_t id, int argc, const char *argv[])
 
     if (op_use_physical.get_value() && !physaddr_t::global_init())
         FATAL("Unable to open pagemap for physical addresses: check privileges.\n");
+
+    if (op_offline.get_value() && op_writer_threads.get_value() > 0 &&
+        file_ops_func.handoff_buf == NULL)
+        create_writer_threads();
+
+    if (ipc_ring_map != NULL && ipc_ring.get_max_record_size() < max_buf_size) {
+        FATAL("Fatal error: -ipc_ring_size must be at least %zu for this trace "
+              "buffer size\n",
+              2 * (max_buf_size + 8));
+    }
 }
 
 /* To support statically linked multiple clients, we add drmemtrace_client_main
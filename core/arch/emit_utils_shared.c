@@ -811,6 +811,8 @@ patch_coarse_branch(dcontext_t *dcontext, cache_pc stub, cache_pc tgt, bool hot_
 {
     bool stubs_readonly = false;
     bool stubs_restore = false;
+    /* stub jmp can't cross page boundary (can't cross cache line in fact) */
+    byte *stub_page = (byte *)PAGE_START(entrance_stub_jmp(stub));
     if (DYNAMO_OPTION(persist_protect_stubs)) {
         if (info == NULL)
             info = get_stub_coarse_info(stub);
@@ -818,13 +820,20 @@ patch_coarse_branch(dcontext_t *dcontext, cache_pc stub, cache_pc tgt, bool hot_
         if (info->stubs_readonly) {
             stubs_readonly = true;
             stubs_restore = true;
+#ifdef UNIX
+            /* We restore the protection coarse_unit_load() gave the stubs
+             * ourselves: make_writable() would query the OS for it, which for our
+             * pcache mappings means parsing the maps file on every link.
+             */
+            DEBUG_DECLARE(bool ok =)
+            set_protection(stub_page, PAGE_SIZE, info->stubs_prot | MEMPROT_WRITE);
+            ASSERT(ok);
+#else
             /* if we don't preserve mapped-in COW state the protection change
              * will fail (case 10570)
              */
-            make_copy_on_writable((byte *)PAGE_START(entrance_stub_jmp(stub)),
-                                  /* stub jmp can't cross page boundary (can't
-                                   * cross cache line in fact) */
-                                  PAGE_SIZE);
+            make_copy_on_writable(stub_page, PAGE_SIZE);
+#endif
             if (DYNAMO_OPTION(persist_protect_stubs_limit) > 0) {
                 info->stubs_write_count++;
                 if (info->stubs_write_count >
@@ -839,8 +848,15 @@ patch_coarse_branch(dcontext_t *dcontext, cache_pc stub, cache_pc tgt, bool hot_
     }
     /* FIXME i#1551: for proper ARM support we'll need the ISA mode of the coarse unit */
     patch_branch(dr_get_isa_mode(dcontext), entrance_stub_jmp(stub), tgt, HOT_PATCHABLE);
-    if (stubs_restore)
-        make_unwritable((byte *)PAGE_START(entrance_stub_jmp(stub)), PAGE_SIZE);
+    if (stubs_restore) {
+#ifdef UNIX
+        DEBUG_DECLARE(bool ok =)
+        set_protection(stub_page, PAGE_SIZE, info->stubs_prot);
+        ASSERT(ok);
+#else
+        make_unwritable(stub_page, PAGE_SIZE);
+#endif
+    }
     return stubs_readonly;
 }
 
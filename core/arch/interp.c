@@ -226,6 +226,7 @@ typedef struct {
 #ifdef ARM
     dr_pred_type_t svc_pred; /* predicate for conditional svc */
 #endif
+    bool ir_arena; /* in an IR arena session for this build */
     DEBUG_DECLARE(bool initialized;)
 } build_bb_t;
 
@@ -4390,6 +4391,10 @@ bb_build_abort(dcontext_t *dcontext, bool clean_vmarea, bool unlock)
             instrlist_clear_and_destroy(dcontext, bb->ilist);
             DODEBUG({ bb->ilist = NULL; });
         }
+        if (bb->ir_arena) {
+            bb->ir_arena = false;
+            ir_arena_end(dcontext);
+        }
         if (clean_vmarea) {
             /* Free the vmlist and any locks held (we could have been in
              * the middle of check_thread_vm_area and had a decode fault
@@ -5047,6 +5052,13 @@ init_interp_build_bb(dcontext_t *dcontext, build_bb_t *bb, app_pc start,
     }
     /* we need to clone the ilist pre-mangling */
     bb->unmangled_ilist = unmangled_ilist;
+    /* The ilist is freed before exit_interp_build_bb() or bb_build_abort() end the
+     * session, except for the clone in *unmangled_ilist, which the trace outlives.
+     */
+    if (DYNAMO_OPTION(ir_arena) && unmangled_ilist == NULL) {
+        ir_arena_begin(dcontext);
+        bb->ir_arena = true;
+    }
 }
 
 static inline void
@@ -5058,6 +5070,10 @@ exit_interp_build_bb(dcontext_t *dcontext, build_bb_t *bb)
 
     /* free the instrlist_t elements */
     instrlist_clear_and_destroy(dcontext, bb->ilist);
+    if (bb->ir_arena) {
+        bb->ir_arena = false;
+        ir_arena_end(dcontext);
+    }
 }
 
 /* Interprets the application's instructions until the end of a basic
@@ -5106,6 +5122,8 @@ build_basic_block_fragment(dcontext_t *dcontext, app_pc start, uint initial_flag
             instrlist_clear_and_destroy(dcontext, bb.ilist);
             vm_area_destroy_list(dcontext, bb.vmlist);
             dcontext->bb_build_info = NULL;
+            if (bb.ir_arena)
+                ir_arena_end(dcontext);
             init_interp_build_bb(dcontext, &bb, start, initial_flags, for_trace,
                                  unmangled_ilist);
             /* PR 232617 - build_native_exec_bb doesn't support setting
@@ -100,7 +100,17 @@ insert_relative_target(byte *pc, cache_pc target, bool hot_patch)
      */
     int value = (int)(ptr_int_t)(target - pc - 4);
     IF_X64(ASSERT(CHECK_TRUNCATE_TYPE_int(target - pc - 4)));
-    ATOMIC_4BYTE_WRITE(vmcode_get_writable_addr(pc), value, hot_patch);
+    if (!hot_patch && CROSSES_ALIGNMENT(pc, 4, proc_get_cache_line_size())) {
+        /* No thread can be executing this code, and a locked write that crosses a
+         * cache line is a split lock, which recent Linux kernels trap and throttle.
+         * Unpadded coarse-grain exits hit this on nearly every link.  A hot patch
+         * keeps the locked write: a split lock is slow but still atomic, while a
+         * plain store could tear under a thread executing a live link, as can
+         * happen with -no_pad_jmps.
+         */
+        *(int *)(vmcode_get_writable_addr(pc)) = value;
+    } else
+        ATOMIC_4BYTE_WRITE(vmcode_get_writable_addr(pc), value, hot_patch);
     pc += 4;
     return pc;
 }
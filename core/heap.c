@@ -253,6 +253,48 @@ typedef struct _thread_units_t {
 
 #define REACHABLE_HEAP() (IF_X64_ELSE(DYNAMO_OPTION(reachable_heap), true))
 
+/* Each thread has a magazine for each fixed-size bucket of the global heap: a small
+ * list of free blocks, linked through their first words like the free lists, that
+ * serves that thread's global allocations and frees without global_alloc_lock.
+ * An empty magazine is refilled from the global free list, and a full one is
+ * drained back to it, half of -global_heap_magazine_size blocks at a time.
+ */
+typedef struct _heap_magazine_t {
+    heap_pc list;
+    uint count;
+} heap_magazine_t;
+
+typedef struct _heap_magazines_t {
+    heap_magazine_t bucket[BLOCK_TYPES - 1];
+    /* Set while the owning thread updates the magazines, so that a signal handler
+     * interrupting it goes to the global units instead.
+     */
+    volatile bool in_use;
+#ifdef HEAP_ACCOUNTING
+    /* Usage through the magazines, added to the global units' at thread exit.
+     * A thread that frees more than it allocates will have negative usage here.
+     */
+    heap_acct_t acct;
+#endif
+} heap_magazines_t;
+
+/* An IR arena hands out IR memory by bumping a pointer through chunks of reachable
+ * heap for the duration of an ir_arena_begin()/ir_arena_end() session.  Frees of
+ * arena memory are no-ops, and the outermost ir_arena_end() releases all but the
+ * oldest chunk, which is kept for the next session.
+ */
+typedef struct _ir_arena_chunk_t {
+    struct _ir_arena_chunk_t *next;
+} ir_arena_chunk_t;
+
+typedef struct _ir_arena_t {
+    ir_arena_chunk_t *chunks; /* Newest first. */
+    uint num_chunks;
+    byte *cur;
+    byte *end;
+    uint depth; /* Nesting depth of ir_arena_begin(). */
+} ir_arena_t;
+
 /* per-thread structure: */
 typedef struct _thread_heap_t {
     thread_units_t *local_heap;
@@ -265,6 +307,12 @@ typedef struct _thread_heap_t {
      */
     thread_units_t *nonpersistent_heap;
     thread_units_t *reachable_heap; /* Only used if !REACHABLE_HEAP() */
+    /* Points at magazines once they are set up, and is NULL if they are disabled. */
+    heap_magazines_t *global_magazines;
+    heap_magazines_t magazines;
+    /* Next in magazine_threads. */
+    struct _thread_heap_t *next_with_magazines;
+    ir_arena_t ir_arena;
 #ifdef UNIX
     /* Used for -satisfy_w_xor_x. */
     heap_pc fork_copy_start;
@@ -558,8 +606,20 @@ static void
 threadunits_exit(thread_units_t *tu, dcontext_t *dcontext);
 static void *
 common_heap_alloc(thread_units_t *tu, size_t size HEAPACCT(which_heap_t which));
+static void
+heap_alloc_bookkeeping(dcontext_t *dcontext, heap_pc p, int bucket, size_t size,
+                       size_t aligned_size, size_t alloc_size,
+                       bool special_unit HEAPACCT(which_heap_t which));
+static void
+heap_free_bookkeeping(thread_units_t *tu, heap_pc p, int bucket, size_t size,
+                      size_t aligned_size,
+                      size_t alloc_size HEAPACCT(which_heap_t which));
 static bool
 common_heap_free(thread_units_t *tu, void *p, size_t size HEAPACCT(which_heap_t which));
+#ifdef DEBUG_MEMORY
+static heap_unit_t *
+find_heap_unit(thread_units_t *tu, heap_pc p, size_t size);
+#endif
 static void
 release_real_memory(void *p, size_t size, bool remove_vm, which_vmm_t which);
 static void
@@ -609,6 +669,13 @@ report_low_on_memory(which_vmm_t which, oom_source_t source,
 /* minimum will be used only if an invalid option is set */
 #define MIN_VMM_HEAP_UNIT_SIZE DYNAMO_OPTION(vmm_block_size)
 
+/* We keep per-size caches of recently freed runs of up to VMM_CACHE_CLASSES blocks
+ * so that the common reserve-free-reserve pattern of same-sized units and stacks
+ * does not have to search the bitmap.
+ */
+#define VMM_CACHE_CLASSES 8
+#define VMM_CACHE_DEPTH 16
+
 typedef struct {
     vm_addr_t start_addr;  /* base virtual address */
     vm_addr_t end_addr;    /* noninclusive virtual memory range [start,end) */
@@ -627,9 +694,17 @@ typedef struct {
     const char *name;
     /* We dynamically allocate the bitmap to allow for different sizes for
      * vmcode and vmheap and to allow for large vmheap sizes.
-     * We place it at start_addr, or the writable equivalent for vmcode.
+     * We place it at start_addr, or the writable equivalent for vmcode,
+     * followed by its summary bitmap.
      */
     bitmap_element_t *blocks;
+    bitmap_element_t *summary;
+    /* The first block of each cached free run of (class + 1) blocks.  Cached blocks
+     * stay clear in the bitmap but are counted in num_free_blocks.
+     */
+    uint cache[VMM_CACHE_CLASSES][VMM_CACHE_DEPTH];
+    uint cache_count[VMM_CACHE_CLASSES];
+    uint num_cached_blocks;
 } vm_heap_t;
 
 /* We keep our heap management structs on the heap for selfprot (case 8074).
@@ -673,6 +748,16 @@ typedef struct _heap_management_t {
  */
 static heap_management_t temp_heapmgt;
 static heap_management_t *heapmgt = &temp_heapmgt; /* initial value until alloced */
+/* The threads whose magazines are in use, so that d_r_heap_exit() can drain those
+ * of threads that never reach heap_thread_exit().  Protected by global_alloc_lock.
+ */
+static thread_heap_t *magazine_threads;
+
+static void
+heap_flush_all_magazines(void);
+
+static void
+ir_arena_release(dcontext_t *dcontext, ir_arena_t *arena, bool keep_one);
 
 static bool vmm_heap_exited = false; /* FIXME: used only to thwart stack_free from trying,
                                         should change the interface for the last stack
@@ -708,6 +793,54 @@ vmm_in_same_block(vm_heap_t *vmh, vm_addr_t p1, vm_addr_t p2)
     return vmm_addr_to_block(vmh, p1) == vmm_addr_to_block(vmh, p2);
 }
 
+/* Returns the size of the space holding the bitmap and its summary. */
+static size_t
+vmm_bitmap_size(vm_heap_t *vmh)
+{
+    size_t elements =
+        BITMAP_INDEX(vmh->num_blocks) + BITMAP_SUMMARY_ELEMENTS(vmh->num_blocks);
+    return ALIGN_FORWARD(elements * sizeof(bitmap_element_t),
+                         DYNAMO_OPTION(vmm_block_size));
+}
+
+/* Returns all cached free runs to the bitmap.  Caller must hold vmh->lock, or be
+ * the only thread left.
+ */
+static void
+vmm_heap_flush_cache(vm_heap_t *vmh)
+{
+    uint cls, i;
+    for (cls = 0; cls < VMM_CACHE_CLASSES; cls++) {
+        for (i = 0; i < vmh->cache_count[cls]; i++) {
+            bitmap_free_blocks(vmh->blocks, vmh->summary, vmh->num_blocks,
+                               vmh->cache[cls][i], cls + 1);
+        }
+        vmh->cache_count[cls] = 0;
+    }
+    vmh->num_cached_blocks = 0;
+}
+
+#if defined(DEBUG) || defined(STANDALONE_UNIT_TEST)
+/* Returns whether any of the num_blocks blocks starting at first_block is in a
+ * cached free run.  Cached blocks look reserved in the bitmap, so asserts that a
+ * range is reserved must also check this.  Like those bitmap reads this takes no
+ * lock: a caller asking about its own blocks cannot race with their caching.
+ */
+static bool
+vmm_blocks_are_cached(vm_heap_t *vmh, uint first_block, uint num_blocks)
+{
+    uint cls, i;
+    for (cls = 0; cls < VMM_CACHE_CLASSES; cls++) {
+        for (i = 0; i < vmh->cache_count[cls]; i++) {
+            uint cached = vmh->cache[cls][i];
+            if (cached < first_block + num_blocks && first_block < cached + cls + 1)
+                return true;
+        }
+    }
+    return false;
+}
+#endif
+
 #if defined(DEBUG) && defined(INTERNAL)
 static void
 vmm_dump_map(vm_heap_t *vmh)
@@ -1014,13 +1147,15 @@ vmm_heap_unit_init(vm_heap_t *vmh, size_t size, bool is_vmcode, const char *name
     vmh->end_addr = vmh->start_addr + size;
     ASSERT_TRUNCATE(vmh->num_blocks, uint, size / DYNAMO_OPTION(vmm_block_size));
     vmh->num_blocks = (uint)(size / DYNAMO_OPTION(vmm_block_size));
-    size_t blocks_sz_bytes = BITMAP_INDEX(vmh->num_blocks) * sizeof(bitmap_element_t);
-    blocks_sz_bytes = ALIGN_FORWARD(blocks_sz_bytes, DYNAMO_OPTION(vmm_block_size));
+    size_t blocks_sz_bytes = vmm_bitmap_size(vmh);
     /* We place the bitmap at the start of the (writable) vmm region. */
     vmh->blocks = (bitmap_element_t *)vmh->start_addr;
     if (is_vmcode)
         vmh->blocks = (bitmap_element_t *)vmcode_get_writable_addr((byte *)vmh->blocks);
+    vmh->summary = vmh->blocks + BITMAP_INDEX(vmh->num_blocks);
     vmh->num_free_blocks = vmh->num_blocks;
+    memset(vmh->cache_count, 0, sizeof(vmh->cache_count));
+    vmh->num_cached_blocks = 0;
     LOG(GLOBAL, LOG_HEAP, 1,
         "vmm_heap_unit_init %s reservation: [" PFX "," PFX ") total=%d free=%d\n", name,
         vmh->start_addr, vmh->end_addr, vmh->num_blocks, vmh->num_free_blocks);
@@ -1038,10 +1173,11 @@ vmm_heap_unit_init(vm_heap_t *vmh, size_t size, bool is_vmcode, const char *name
         vmm_heap_unit_init_failed(vmh, error_code, name);
         ASSERT_NOT_REACHED();
     }
-    bitmap_initialize_free(vmh->blocks, vmh->num_blocks);
+    bitmap_initialize_free(vmh->blocks, vmh->summary, vmh->num_blocks);
     vmm_heap_reserve_blocks(vmh, blocks_sz_bytes, vmh->start_addr, which);
     DOLOG(1, LOG_HEAP, { vmm_dump_map(vmh); });
-    ASSERT(bitmap_check_consistency(vmh->blocks, vmh->num_blocks, vmh->num_free_blocks));
+    ASSERT(bitmap_check_consistency(vmh->blocks, vmh->summary, vmh->num_blocks,
+                                    vmh->num_free_blocks));
 }
 
 static void
@@ -1055,8 +1191,10 @@ vmm_heap_unit_exit(vm_heap_t *vmh)
     if (vmh->start_addr == NULL)
         return;
 
+    vmm_heap_flush_cache(vmh);
     DOLOG(1, LOG_HEAP, { vmm_dump_map(vmh); });
-    ASSERT(bitmap_check_consistency(vmh->blocks, vmh->num_blocks, vmh->num_free_blocks));
+    ASSERT(bitmap_check_consistency(vmh->blocks, vmh->summary, vmh->num_blocks,
+                                    vmh->num_free_blocks));
     ASSERT(vmh->num_blocks * DYNAMO_OPTION(vmm_block_size) ==
            (ptr_uint_t)(vmh->end_addr - vmh->start_addr));
 
@@ -1111,6 +1249,8 @@ vmm_is_reserved_unit(vm_heap_t *vmh, vm_addr_t p, size_t size)
     ASSERT(bitmap_are_reserved_blocks(vmh->blocks, vmh->num_blocks,
                                       vmm_addr_to_block(vmh, p),
                                       (uint)(size / DYNAMO_OPTION(vmm_block_size))));
+    ASSERT(!vmm_blocks_are_cached(vmh, vmm_addr_to_block(vmh, p),
+                                  (uint)(size / DYNAMO_OPTION(vmm_block_size))));
     return true;
 }
 
@@ -1422,8 +1562,21 @@ vmm_heap_reserve_blocks(vm_heap_t *vmh, size_t size_in, byte *base, which_vmm_t
         d_r_mutex_unlock(&vmh->lock);
         return NULL;
     }
-    first_block =
-        bitmap_allocate_blocks(vmh->blocks, vmh->num_blocks, request, must_start);
+    if (must_start == UINT_MAX && request <= VMM_CACHE_CLASSES &&
+        vmh->cache_count[request - 1] > 0) {
+        first_block = vmh->cache[request - 1][--vmh->cache_count[request - 1]];
+        vmh->num_cached_blocks -= request;
+        STATS_INC(vmm_block_cache_hits);
+    } else {
+        first_block = bitmap_allocate_blocks(vmh->blocks, vmh->summary, vmh->num_blocks,
+                                             request, must_start);
+        if (first_block == BITMAP_NOT_FOUND && vmh->num_cached_blocks > 0) {
+            /* The cached runs may be what is in the way. */
+            vmm_heap_flush_cache(vmh);
+            first_block = bitmap_allocate_blocks(vmh->blocks, vmh->summary,
+                                                 vmh->num_blocks, request, must_start);
+        }
+    }
     if (first_block != BITMAP_NOT_FOUND) {
         vmh->num_free_blocks -= request;
     }
@@ -1469,7 +1622,18 @@ vmm_heap_free_blocks(vm_heap_t *vmh, vm_addr_t p, size_t size_in, which_vmm_t wh
         vmh->name, size, request, p);
 
     d_r_mutex_lock(&vmh->lock);
-    bitmap_free_blocks(vmh->blocks, vmh->num_blocks, first_block, request);
+    /* A double free would otherwise go unnoticed if either free is cached. */
+    ASSERT(bitmap_are_reserved_blocks(vmh->blocks, vmh->num_blocks, first_block,
+                                      request));
+    ASSERT(!vmm_blocks_are_cached(vmh, first_block, request));
+    if (request <= VMM_CACHE_CLASSES &&
+        vmh->cache_count[request - 1] < VMM_CACHE_DEPTH) {
+        vmh->cache[request - 1][vmh->cache_count[request - 1]++] = first_block;
+        vmh->num_cached_blocks += request;
+    } else {
+        bitmap_free_blocks(vmh->blocks, vmh->summary, vmh->num_blocks, first_block,
+                           request);
+    }
     vmh->num_free_blocks += request;
     d_r_mutex_unlock(&vmh->lock);
 
@@ -1952,9 +2116,7 @@ vmh_exit(vm_heap_t *vmh, bool contains_stacks)
                 perstack * ((doing_detach IF_APP_EXPORTS(|| dr_api_exit)) ? 0 : 1);
         }
         /* Our bitmap does not get freed. */
-        size_t blocks_sz_bytes =
-            ALIGN_FORWARD_UINT(BITMAP_INDEX(vmh->num_blocks) * sizeof(bitmap_element_t),
-                               DYNAMO_OPTION(vmm_block_size));
+        size_t blocks_sz_bytes = vmm_bitmap_size(vmh);
         unfreed_blocks += (uint)(blocks_sz_bytes / DYNAMO_OPTION(vmm_block_size));
         /* XXX: On detach, arch_thread_exit should explicitly mark as
          * left behind all TPCs needed so then we can assert even for
@@ -2360,6 +2522,7 @@ d_r_heap_exit()
     heap_unit_t *u, *next_u;
     heap_management_t *temp;
 
+    heap_flush_all_magazines();
     heap_exiting = true;
     /* FIXME: we shouldn't need either lock if executed last */
     dynamo_vm_areas_lock();
@@ -3539,6 +3702,174 @@ common_global_heap_free(thread_units_t *tu, void *p,
     ASSERT(ok);
 }
 
+/* Returns the calling thread's global heap magazines, or NULL if it has none. */
+static inline heap_magazines_t *
+heap_get_magazines(void)
+{
+    dcontext_t *dcontext = get_thread_private_dcontext();
+    thread_heap_t *th;
+    if (dcontext == NULL || dcontext == GLOBAL_DCONTEXT)
+        return NULL;
+    th = (thread_heap_t *)dcontext->heap_field;
+    if (th == NULL)
+        return NULL;
+    return th->global_magazines;
+}
+
+/* Keeps the compiler from moving magazine updates across the setting and clearing
+ * of in_use.  A signal handler runs on the interrupted thread, so we need no fence.
+ */
+#ifdef WINDOWS
+#    define MAGAZINE_COMPILER_BARRIER() MemoryBarrier()
+#else
+#    define MAGAZINE_COMPILER_BARRIER() __asm__ __volatile__("" : : : "memory")
+#endif
+
+/* Marks mags as being updated, unless we interrupted an update of them, in which
+ * case we return false and the caller must go to the global units.
+ */
+static inline bool
+heap_magazines_enter(heap_magazines_t *mags)
+{
+    if (mags->in_use)
+        return false;
+    mags->in_use = true;
+    MAGAZINE_COMPILER_BARRIER();
+    return true;
+}
+
+static inline void
+heap_magazines_exit(heap_magazines_t *mags)
+{
+    MAGAZINE_COMPILER_BARRIER();
+    mags->in_use = false;
+}
+
+/* Returns the fixed-size bucket for an aligned_size request, or -1 if it needs
+ * a variable-length block.
+ */
+static inline int
+heap_fixed_bucket(size_t aligned_size)
+{
+    int bucket = 0;
+    if (aligned_size > BLOCK_SIZES[BLOCK_TYPES - 2])
+        return -1;
+    while (aligned_size > BLOCK_SIZES[bucket])
+        bucket++;
+    return bucket;
+}
+
+/* Moves up to num blocks from the global free list for bucket into mag. */
+static void
+heap_magazine_refill(heap_magazine_t *mag, int bucket, uint num)
+{
+    thread_units_t *tu = &heapmgt->global_units;
+    acquire_recursive_lock(&global_alloc_lock);
+    while (num > 0 && tu->free_list[bucket] != NULL) {
+        heap_pc p = tu->free_list[bucket];
+        tu->free_list[bucket] = *((heap_pc *)p);
+        *((heap_pc *)p) = mag->list;
+        mag->list = p;
+        mag->count++;
+        num--;
+    }
+    release_recursive_lock(&global_alloc_lock);
+}
+
+/* Moves up to num blocks from mag to the global free list for bucket. */
+static void
+heap_magazine_drain(heap_magazine_t *mag, int bucket, uint num)
+{
+    thread_units_t *tu = &heapmgt->global_units;
+    STATS_ADD(heap_magazine_returns, MIN(num, mag->count));
+    acquire_recursive_lock(&global_alloc_lock);
+    while (num > 0 && mag->list != NULL) {
+        heap_pc p = mag->list;
+        mag->list = *((heap_pc *)p);
+        mag->count--;
+        *((heap_pc *)p) = tu->free_list[bucket];
+        tu->free_list[bucket] = p;
+        num--;
+    }
+    release_recursive_lock(&global_alloc_lock);
+}
+
+/* Returns a block from the calling thread's magazine, or NULL if the caller should
+ * go to the global units.
+ */
+static void *
+heap_magazine_alloc(size_t size HEAPACCT(which_heap_t which))
+{
+    heap_magazines_t *mags = heap_get_magazines();
+    heap_magazine_t *mag;
+    size_t aligned_size = ALIGN_FORWARD(size, HEAP_ALIGNMENT);
+    int bucket;
+    heap_pc p;
+    if (mags == NULL || size == 0)
+        return NULL;
+    bucket = heap_fixed_bucket(aligned_size);
+    if (bucket < 0 || !heap_magazines_enter(mags))
+        return NULL;
+    mag = &mags->bucket[bucket];
+    if (mag->count > 0)
+        STATS_INC(heap_magazine_hits);
+    else {
+        heap_magazine_refill(mag, bucket, INTERNAL_OPTION(global_heap_magazine_size) / 2);
+        if (mag->count == 0) {
+            heap_magazines_exit(mags);
+            return NULL;
+        }
+    }
+    p = mag->list;
+    mag->list = *((heap_pc *)p);
+    mag->count--;
+    ACCOUNT_FOR_ALLOC(alloc_reuse, mags, which, BLOCK_SIZES[bucket], aligned_size);
+    heap_magazines_exit(mags);
+    heap_alloc_bookkeeping(GLOBAL_DCONTEXT, p, bucket, size, aligned_size,
+                           BLOCK_SIZES[bucket], false /*!special*/ HEAPACCT(which));
+    return (void *)p;
+}
+
+/* Puts p into the calling thread's magazine.  Returns false if the caller should
+ * free it to the global units instead.
+ */
+static bool
+heap_magazine_free(void *p_void, size_t size HEAPACCT(which_heap_t which))
+{
+    heap_magazines_t *mags = heap_get_magazines();
+    heap_magazine_t *mag;
+    heap_pc p = (heap_pc)p_void;
+    size_t aligned_size = ALIGN_FORWARD(size, HEAP_ALIGNMENT);
+    int bucket;
+    if (mags == NULL || p == NULL || size == 0)
+        return false;
+    bucket = heap_fixed_bucket(aligned_size);
+    if (bucket < 0 || !heap_magazines_enter(mags))
+        return false;
+    mag = &mags->bucket[bucket];
+#ifdef DEBUG_MEMORY
+    /* ensure we are freeing memory in a proper unit, as common_heap_free() does */
+    DOCHECK(CHKLVL_DEFAULT, { /* expensive check */
+        acquire_recursive_lock(&global_alloc_lock);
+        ASSERT(find_heap_unit(&heapmgt->global_units, p, BLOCK_SIZES[bucket]) != NULL);
+        release_recursive_lock(&global_alloc_lock);
+    });
+#endif
+    heap_free_bookkeeping(NULL, p, bucket, size, aligned_size,
+                          BLOCK_SIZES[bucket] HEAPACCT(which));
+    ACCOUNT_FOR_FREE(mags, which, BLOCK_SIZES[bucket]);
+    if (mag->count >= INTERNAL_OPTION(global_heap_magazine_size)) {
+        heap_magazine_drain(mag, bucket,
+                            INTERNAL_OPTION(global_heap_magazine_size) / 2);
+    } else
+        STATS_INC(heap_magazine_hits);
+    *((heap_pc *)p) = mag->list;
+    mag->list = p;
+    mag->count++;
+    heap_magazines_exit(mags);
+    return true;
+}
+
 /* these functions use the global heap instead of a thread's heap: */
 void *
 global_heap_alloc(size_t size HEAPACCT(which_heap_t which))
@@ -3554,7 +3885,9 @@ global_heap_alloc(size_t size HEAPACCT(which_heap_t which))
         /* XXX: We have no control point to call standalone_exit(). */
         standalone_init();
     }
-    p = common_global_heap_alloc(&heapmgt->global_units, size HEAPACCT(which));
+    p = heap_magazine_alloc(size HEAPACCT(which));
+    if (p == NULL)
+        p = common_global_heap_alloc(&heapmgt->global_units, size HEAPACCT(which));
     ASSERT(p != NULL);
     LOG(GLOBAL, LOG_HEAP, 6, "\nglobal alloc: " PFX " (%d bytes)\n", p, size);
     return p;
@@ -3563,7 +3896,8 @@ global_heap_alloc(size_t size HEAPACCT(which_heap_t which))
 void
 global_heap_free(void *p, size_t size HEAPACCT(which_heap_t which))
 {
-    common_global_heap_free(&heapmgt->global_units, p, size HEAPACCT(which));
+    if (!heap_magazine_free(p, size HEAPACCT(which)))
+        common_global_heap_free(&heapmgt->global_units, p, size HEAPACCT(which));
     LOG(GLOBAL, LOG_HEAP, 6, "\nglobal free: " PFX " (%d bytes)\n", p, size);
 }
 
@@ -4033,6 +4367,7 @@ heap_thread_init(dcontext_t *dcontext)
 {
     thread_heap_t *th =
         (thread_heap_t *)global_heap_alloc(sizeof(thread_heap_t) HEAPACCT(ACCT_MEM_MGT));
+    th->global_magazines = NULL;
     dcontext->heap_field = (void *)th;
     th->local_heap = (thread_units_t *)global_heap_alloc(sizeof(thread_units_t)
                                                              HEAPACCT(ACCT_MEM_MGT));
@@ -4050,6 +4385,18 @@ heap_thread_init(dcontext_t *dcontext)
     th->fork_copy_start = NULL;
     th->fork_copy_size = 0;
 #endif
+    memset(&th->magazines, 0, sizeof(th->magazines));
+    memset(&th->ir_arena, 0, sizeof(th->ir_arena));
+    /* The magazines' blocks are global heap blocks, which with the malloc-based
+     * global heap of a standalone static library are not ours to manage.
+     */
+    if (INTERNAL_OPTION(global_heap_magazine_size) >= 2 && !standalone_library) {
+        acquire_recursive_lock(&global_alloc_lock);
+        th->next_with_magazines = magazine_threads;
+        magazine_threads = th;
+        release_recursive_lock(&global_alloc_lock);
+        th->global_magazines = &th->magazines;
+    }
 }
 
 void
@@ -4065,10 +4412,62 @@ heap_thread_reset_free(dcontext_t *dcontext)
     threadunits_exit(th->nonpersistent_heap, dcontext);
 }
 
+/* Returns all of a thread's magazine blocks to the global free lists and stops it
+ * from using magazines.
+ */
+static void
+heap_thread_flush_magazines(thread_heap_t *th)
+{
+    uint i;
+    thread_heap_t **prev;
+    if (th->global_magazines == NULL)
+        return;
+    th->global_magazines = NULL;
+    acquire_recursive_lock(&global_alloc_lock);
+    for (prev = &magazine_threads; *prev != NULL; prev = &(*prev)->next_with_magazines) {
+        if (*prev == th) {
+            *prev = th->next_with_magazines;
+            break;
+        }
+    }
+    /* A thread interrupted while updating its magazines, which we can only see at
+     * exit, leaves lists we cannot trust: we strand its blocks instead.
+     */
+    if (!th->magazines.in_use) {
+        for (i = 0; i < BLOCK_TYPES - 1; i++) {
+            heap_magazine_drain(&th->magazines.bucket[i], i,
+                                th->magazines.bucket[i].count);
+        }
+    }
+    release_recursive_lock(&global_alloc_lock);
+#ifdef HEAP_ACCOUNTING
+    add_heapacct_to_global_stats(&th->magazines.acct);
+    memset(&th->magazines.acct, 0, sizeof(th->magazines.acct));
+#endif
+}
+
+/* Drains the magazines of every thread that still has them, such as threads that
+ * are not cleaned up at process exit.  The caller must ensure no other thread is
+ * running DR code.
+ */
+static void
+heap_flush_all_magazines(void)
+{
+    acquire_recursive_lock(&global_alloc_lock);
+    while (magazine_threads != NULL) {
+        thread_heap_t *th = magazine_threads;
+        magazine_threads = th->next_with_magazines;
+        heap_thread_flush_magazines(th);
+    }
+    release_recursive_lock(&global_alloc_lock);
+}
+
 void
 heap_thread_exit(dcontext_t *dcontext)
 {
     thread_heap_t *th = (thread_heap_t *)dcontext->heap_field;
+    heap_thread_flush_magazines(th);
+    ir_arena_release(dcontext, &th->ir_arena, false /*free all*/);
     threadunits_exit(th->local_heap, dcontext);
     heap_thread_reset_free(dcontext);
     global_heap_free(th->local_heap, sizeof(thread_units_t) HEAPACCT(ACCT_MEM_MGT));
@@ -4154,6 +4553,161 @@ heap_unit_extend_commitment(heap_unit_t *u, size_t size_need, uint prot)
                                                size_need, prot, u->which);
 }
 
+/* Updates the statistics for handing out the alloc_size bytes at p for a request
+ * of size bytes, and for DEBUG_MEMORY checks that the block was unused and fills
+ * it.  special_unit says whether p is an oversized allocation with its own unit.
+ */
+static void
+heap_alloc_bookkeeping(dcontext_t *dcontext, heap_pc p, int bucket, size_t size,
+                       size_t aligned_size, size_t alloc_size,
+                       bool special_unit HEAPACCT(which_heap_t which))
+{
+#if defined(DEBUG_MEMORY) && defined(DEBUG)
+    /* DrMem i#999: private libs can be heap-intensive and our checks here
+     * can have a prohibitive perf cost!
+     */
+    uint chklvl = CHKLVL_MEMFILL + (IF_HEAPACCT_ELSE(which == ACCT_LIBDUP ? 1 : 0, 0));
+#endif
+    /* we ignore special-unit allocs */
+    if (!special_unit) {
+        DOSTATS({
+            ATOMIC_ADD(int, block_count[bucket], 1);
+            ATOMIC_ADD(int, block_total_count[bucket], 1);
+            /* FIXME: should atomically store inc-ed val in temp to avoid races w/ max */
+            ATOMIC_MAX(int, block_peak_count[bucket], block_count[bucket]);
+            ASSERT(CHECK_TRUNCATE_TYPE_uint(alloc_size - aligned_size));
+            ATOMIC_ADD(int, block_wasted[bucket], (int)(alloc_size - aligned_size));
+            /* FIXME: should atomically store val in temp to avoid races w/ max */
+            ATOMIC_MAX(int, block_peak_wasted[bucket], block_wasted[bucket]);
+            if (aligned_size > size) {
+                ASSERT(CHECK_TRUNCATE_TYPE_uint(aligned_size - size));
+                ATOMIC_ADD(int, block_align_pad[bucket], (int)(aligned_size - size));
+                /* FIXME: should atomically store val in temp to avoid races w/ max */
+                ATOMIC_MAX(int, block_peak_align_pad[bucket], block_align_pad[bucket]);
+                STATS_ADD_PEAK(heap_align, aligned_size - size);
+                LOG(GLOBAL, LOG_STATS, 5,
+                    "alignment mismatch: %s ask %d, aligned is %d -> %d pad\n",
+                    IF_HEAPACCT_ELSE(whichheap_name[which], ""), size, aligned_size,
+                    aligned_size - size);
+            }
+            if (bucket == BLOCK_TYPES - 1) {
+                STATS_ADD(heap_headers, HEADER_SIZE);
+                STATS_INC(heap_allocs_variable);
+            } else {
+                STATS_INC(heap_allocs_buckets);
+                if (alloc_size > aligned_size) {
+                    STATS_ADD_PEAK(heap_bucket_pad, alloc_size - aligned_size);
+                    LOG(GLOBAL, LOG_STATS, 5,
+                        "bucket mismatch: %s ask (aligned) %d, got %d, -> %d\n",
+                        IF_HEAPACCT_ELSE(whichheap_name[which], ""), aligned_size,
+                        alloc_size, alloc_size - aligned_size);
+                }
+            }
+        });
+    }
+#ifdef DEBUG_MEMORY
+    if (bucket == BLOCK_TYPES - 1 && !special_unit) {
+        /* verify is unallocated memory, skip possible free list next pointer */
+        DOCHECK(chklvl, {
+            CLIENT_ASSERT(
+                is_region_memset_to_char(p + sizeof(heap_pc *),
+                                         (alloc_size - HEADER_SIZE) - sizeof(heap_pc *),
+                                         HEAP_UNALLOCATED_BYTE),
+                "memory corruption detected");
+        });
+        LOG(THREAD, LOG_HEAP, 6,
+            "\nalloc var " PFX "-" PFX " %d bytes, ret " PFX "-" PFX " %d bytes\n",
+            p - HEADER_SIZE, p - HEADER_SIZE + alloc_size, alloc_size, p, p + size, size);
+        /* there can only be extra padding if we took off of the free list */
+        DOCHECK(chklvl,
+                memset(p + size, HEAP_PAD_BYTE, (alloc_size - HEADER_SIZE) - size););
+    } else {
+        /* verify is unallocated memory, skip possible free list next pointer */
+        DOCHECK(chklvl, {
+            CLIENT_ASSERT(is_region_memset_to_char(p + sizeof(heap_pc *),
+                                                   alloc_size - sizeof(heap_pc *),
+                                                   HEAP_UNALLOCATED_BYTE),
+                          "memory corruption detected");
+        });
+        LOG(THREAD, LOG_HEAP, 6,
+            "\nalloc fix or oversize " PFX "-" PFX " %d bytes, ret " PFX "-" PFX
+            " %d bytes\n",
+            p, p + alloc_size, alloc_size, p, p + size, size);
+        DOCHECK(chklvl, memset(p + size, HEAP_PAD_BYTE, alloc_size - size););
+    }
+    DOCHECK(chklvl, memset(p, HEAP_ALLOCATED_BYTE, size););
+#    ifdef HEAP_ACCOUNTING
+    LOG(THREAD, LOG_HEAP, 6, "\t%s\n", whichheap_name[which]);
+#    endif
+#endif
+}
+
+/* Updates the statistics for freeing the alloc_size bytes at p that were handed
+ * out for a request of size bytes, and for DEBUG_MEMORY checks for overflows and
+ * fills the block.  We check that p is in one of tu's units unless tu is NULL.
+ * The caller is responsible for ACCOUNT_FOR_FREE.
+ */
+static void
+heap_free_bookkeeping(thread_units_t *tu, heap_pc p, int bucket, size_t size,
+                      size_t aligned_size, size_t alloc_size HEAPACCT(which_heap_t which))
+{
+#if defined(DEBUG) && (defined(DEBUG_MEMORY) || defined(HEAP_ACCOUNTING))
+    dcontext_t *dcontext = tu == NULL ? GLOBAL_DCONTEXT : tu->dcontext;
+    /* DrMem i#999: private libs can be heap-intensive and our checks here
+     * can have a prohibitive perf cost!
+     */
+    uint chklvl = CHKLVL_MEMFILL + (IF_HEAPACCT_ELSE(which == ACCT_LIBDUP ? 1 : 0, 0));
+#endif
+#if defined(DEBUG) || defined(DEBUG_MEMORY) || defined(HEAP_ACCOUNTING)
+    if (bucket == BLOCK_TYPES - 1) {
+#    ifdef DEBUG_MEMORY
+        LOG(THREAD, LOG_HEAP, 6,
+            "\nfree var " PFX "-" PFX " %d bytes, asked " PFX "-" PFX " %d bytes\n",
+            p - HEADER_SIZE, p - HEADER_SIZE + alloc_size, alloc_size, p, p + size, size);
+        ASSERT_MESSAGE(chklvl, "heap overflow",
+                       is_region_memset_to_char(
+                           p + size, (alloc_size - HEADER_SIZE) - size, HEAP_PAD_BYTE));
+        /* ensure we are freeing memory in a proper unit */
+        DOCHECK(CHKLVL_DEFAULT,
+                { /* expensive check */
+                  ASSERT(tu == NULL ||
+                         find_heap_unit(tu, p, alloc_size - HEADER_SIZE) != NULL);
+                });
+        /* set used and padding memory back to unallocated */
+        DOCHECK(CHKLVL_MEMFILL,
+                memset(p, HEAP_UNALLOCATED_BYTE, alloc_size - HEADER_SIZE););
+#    endif
+        STATS_SUB(heap_headers, HEADER_SIZE);
+    } else {
+#    ifdef DEBUG_MEMORY
+        LOG(THREAD, LOG_HEAP, 6,
+            "\nfree fix " PFX "-" PFX " %d bytes, asked " PFX "-" PFX " %d bytes\n", p,
+            p + alloc_size, alloc_size, p, p + size, size);
+        ASSERT_MESSAGE(
+            chklvl, "heap overflow",
+            is_region_memset_to_char(p + size, alloc_size - size, HEAP_PAD_BYTE));
+        /* ensure we are freeing memory in a proper unit */
+        DOCHECK(CHKLVL_DEFAULT, { /* expensive check */
+                                  ASSERT(tu == NULL ||
+                                         find_heap_unit(tu, p, alloc_size) != NULL);
+        });
+        /* set used and padding memory back to unallocated */
+        DOCHECK(CHKLVL_MEMFILL, memset(p, HEAP_UNALLOCATED_BYTE, alloc_size););
+#    endif
+        STATS_SUB(heap_bucket_pad, (alloc_size - aligned_size));
+    }
+    STATS_SUB(heap_align, (aligned_size - size));
+    DOSTATS({
+        ATOMIC_ADD(int, block_count[bucket], -1);
+        ATOMIC_ADD(int, block_wasted[bucket], -(int)(alloc_size - aligned_size));
+        ATOMIC_ADD(int, block_align_pad[bucket], -(int)(aligned_size - size));
+    });
+#    ifdef HEAP_ACCOUNTING
+    LOG(THREAD, LOG_HEAP, 6, "\t%s\n", whichheap_name[which]);
+#    endif
+#endif
+}
+
 /* allocate storage on the DR heap
  * returns NULL iff caller needs to grab dynamo_vm_areas_lock() and retry
  */
@@ -4165,12 +4719,7 @@ common_heap_alloc(thread_units_t *tu, size_t size HEAPACCT(which_heap_t which))
     int bucket = 0;
     size_t alloc_size, aligned_size;
 #if defined(DEBUG_MEMORY) && defined(DEBUG)
-    size_t check_alloc_size;
     dcontext_t *dcontext = tu->dcontext;
-    /* DrMem i#999: private libs can be heap-intensive and our checks here
-     * can have a prohibitive perf cost!
-     */
-    uint chklvl = CHKLVL_MEMFILL + (IF_HEAPACCT_ELSE(which == ACCT_LIBDUP ? 1 : 0, 0));
     ASSERT_CURIOSITY(which != ACCT_TOMBSTONE &&
                      "Do you really need to use ACCT_TOMBSTONE? (potentially dangerous)");
 #endif
@@ -4198,10 +4747,6 @@ common_heap_alloc(thread_units_t *tu, size_t size HEAPACCT(which_heap_t which))
     else
         alloc_size = BLOCK_SIZES[bucket];
     ASSERT(size <= alloc_size);
-#ifdef DEBUG_MEMORY
-    /* case 10292: use original calculated size for later check */
-    check_alloc_size = alloc_size;
-#endif
     if (alloc_size > MAXROOM) {
         /* too big for normal unit, build a special unit just for this allocation */
         /* don't need alloc_size or even aligned_size, just need size */
@@ -4247,7 +4792,9 @@ common_heap_alloc(thread_units_t *tu, size_t size HEAPACCT(which_heap_t which))
         p = new_unit->start_pc;
         new_unit->cur_pc += size;
         ACCOUNT_FOR_ALLOC(alloc_new, tu, which, size, size); /* use alloc_size? */
-        goto done_allocating;
+        heap_alloc_bookkeeping(tu->dcontext, p, bucket, size, aligned_size, alloc_size,
+                               true /*special*/ HEAPACCT(which));
+        return (void *)p;
     }
     if (tu->free_list[bucket] != NULL) {
         if (bucket == BLOCK_TYPES - 1) {
@@ -4390,77 +4937,8 @@ common_heap_alloc(thread_units_t *tu, size_t size HEAPACCT(which_heap_t which))
 
         ACCOUNT_FOR_ALLOC(alloc_new, tu, which, alloc_size, aligned_size);
     }
-    DOSTATS({
-        /* do this before done_allocating: want to ignore special-unit allocs */
-        ATOMIC_ADD(int, block_count[bucket], 1);
-        ATOMIC_ADD(int, block_total_count[bucket], 1);
-        /* FIXME: should atomically store inc-ed val in temp to avoid races w/ max */
-        ATOMIC_MAX(int, block_peak_count[bucket], block_count[bucket]);
-        ASSERT(CHECK_TRUNCATE_TYPE_uint(alloc_size - aligned_size));
-        ATOMIC_ADD(int, block_wasted[bucket], (int)(alloc_size - aligned_size));
-        /* FIXME: should atomically store val in temp to avoid races w/ max */
-        ATOMIC_MAX(int, block_peak_wasted[bucket], block_wasted[bucket]);
-        if (aligned_size > size) {
-            ASSERT(CHECK_TRUNCATE_TYPE_uint(aligned_size - size));
-            ATOMIC_ADD(int, block_align_pad[bucket], (int)(aligned_size - size));
-            /* FIXME: should atomically store val in temp to avoid races w/ max */
-            ATOMIC_MAX(int, block_peak_align_pad[bucket], block_align_pad[bucket]);
-            STATS_ADD_PEAK(heap_align, aligned_size - size);
-            LOG(GLOBAL, LOG_STATS, 5,
-                "alignment mismatch: %s ask %d, aligned is %d -> %d pad\n",
-                IF_HEAPACCT_ELSE(whichheap_name[which], ""), size, aligned_size,
-                aligned_size - size);
-        }
-        if (bucket == BLOCK_TYPES - 1) {
-            STATS_ADD(heap_headers, HEADER_SIZE);
-            STATS_INC(heap_allocs_variable);
-        } else {
-            STATS_INC(heap_allocs_buckets);
-            if (alloc_size > aligned_size) {
-                STATS_ADD_PEAK(heap_bucket_pad, alloc_size - aligned_size);
-                LOG(GLOBAL, LOG_STATS, 5,
-                    "bucket mismatch: %s ask (aligned) %d, got %d, -> %d\n",
-                    IF_HEAPACCT_ELSE(whichheap_name[which], ""), aligned_size, alloc_size,
-                    alloc_size - aligned_size);
-            }
-        }
-    });
-done_allocating:
-#ifdef DEBUG_MEMORY
-    if (bucket == BLOCK_TYPES - 1 && check_alloc_size <= MAXROOM) {
-        /* verify is unallocated memory, skip possible free list next pointer */
-        DOCHECK(chklvl, {
-            CLIENT_ASSERT(
-                is_region_memset_to_char(p + sizeof(heap_pc *),
-                                         (alloc_size - HEADER_SIZE) - sizeof(heap_pc *),
-                                         HEAP_UNALLOCATED_BYTE),
-                "memory corruption detected");
-        });
-        LOG(THREAD, LOG_HEAP, 6,
-            "\nalloc var " PFX "-" PFX " %d bytes, ret " PFX "-" PFX " %d bytes\n",
-            p - HEADER_SIZE, p - HEADER_SIZE + alloc_size, alloc_size, p, p + size, size);
-        /* there can only be extra padding if we took off of the free list */
-        DOCHECK(chklvl,
-                memset(p + size, HEAP_PAD_BYTE, (alloc_size - HEADER_SIZE) - size););
-    } else {
-        /* verify is unallocated memory, skip possible free list next pointer */
-        DOCHECK(chklvl, {
-            CLIENT_ASSERT(is_region_memset_to_char(p + sizeof(heap_pc *),
-                                                   alloc_size - sizeof(heap_pc *),
-                                                   HEAP_UNALLOCATED_BYTE),
-                          "memory corruption detected");
-        });
-        LOG(THREAD, LOG_HEAP, 6,
-            "\nalloc fix or oversize " PFX "-" PFX " %d bytes, ret " PFX "-" PFX
-            " %d bytes\n",
-            p, p + alloc_size, alloc_size, p, p + size, size);
-        DOCHECK(chklvl, memset(p + size, HEAP_PAD_BYTE, alloc_size - size););
-    }
-    DOCHECK(chklvl, memset(p, HEAP_ALLOCATED_BYTE, size););
-#    ifdef HEAP_ACCOUNTING
-    LOG(THREAD, LOG_HEAP, 6, "\t%s\n", whichheap_name[which]);
-#    endif
-#endif
+    heap_alloc_bookkeeping(tu->dcontext, p, bucket, size, aligned_size, alloc_size,
+                           false /*!special*/ HEAPACCT(which));
     return (void *)p;
 }
 
@@ -4587,53 +5065,8 @@ common_heap_free(thread_units_t *tu, void *p_void,
         ASSERT(alloc_size - HEADER_SIZE >= aligned_size);
     }
 
-#if defined(DEBUG) || defined(DEBUG_MEMORY) || defined(HEAP_ACCOUNTING)
-    if (bucket == BLOCK_TYPES - 1) {
-#    ifdef DEBUG_MEMORY
-        LOG(THREAD, LOG_HEAP, 6,
-            "\nfree var " PFX "-" PFX " %d bytes, asked " PFX "-" PFX " %d bytes\n",
-            p - HEADER_SIZE, p - HEADER_SIZE + alloc_size, alloc_size, p, p + size, size);
-        ASSERT_MESSAGE(chklvl, "heap overflow",
-                       is_region_memset_to_char(
-                           p + size, (alloc_size - HEADER_SIZE) - size, HEAP_PAD_BYTE));
-        /* ensure we are freeing memory in a proper unit */
-        DOCHECK(CHKLVL_DEFAULT,
-                { /* expensive check */
-                  ASSERT(find_heap_unit(tu, p, alloc_size - HEADER_SIZE) != NULL);
-                });
-        /* set used and padding memory back to unallocated */
-        DOCHECK(CHKLVL_MEMFILL,
-                memset(p, HEAP_UNALLOCATED_BYTE, alloc_size - HEADER_SIZE););
-#    endif
-        STATS_SUB(heap_headers, HEADER_SIZE);
-    } else {
-#    ifdef DEBUG_MEMORY
-        LOG(THREAD, LOG_HEAP, 6,
-            "\nfree fix " PFX "-" PFX " %d bytes, asked " PFX "-" PFX " %d bytes\n", p,
-            p + alloc_size, alloc_size, p, p + size, size);
-        ASSERT_MESSAGE(
-            chklvl, "heap overflow",
-            is_region_memset_to_char(p + size, alloc_size - size, HEAP_PAD_BYTE));
-        /* ensure we are freeing memory in a proper unit */
-        DOCHECK(CHKLVL_DEFAULT, { /* expensive check */
-                                  ASSERT(find_heap_unit(tu, p, alloc_size) != NULL);
-        });
-        /* set used and padding memory back to unallocated */
-        DOCHECK(CHKLVL_MEMFILL, memset(p, HEAP_UNALLOCATED_BYTE, alloc_size););
-#    endif
-        STATS_SUB(heap_bucket_pad, (alloc_size - aligned_size));
-    }
-    STATS_SUB(heap_align, (aligned_size - size));
-    DOSTATS({
-        ATOMIC_ADD(int, block_count[bucket], -1);
-        ATOMIC_ADD(int, block_wasted[bucket], -(int)(alloc_size - aligned_size));
-        ATOMIC_ADD(int, block_align_pad[bucket], -(int)(aligned_size - size));
-    });
-#    ifdef HEAP_ACCOUNTING
-    LOG(THREAD, LOG_HEAP, 6, "\t%s\n", whichheap_name[which]);
+    heap_free_bookkeeping(tu, p, bucket, size, aligned_size, alloc_size HEAPACCT(which));
     ACCOUNT_FOR_FREE(tu, which, alloc_size);
-#    endif
-#endif
 
     /* write next pointer */
     *((heap_pc *)p) = tu->free_list[bucket];
@@ -4848,6 +5281,146 @@ heap_reachable_free(dcontext_t *dcontext, void *p,
     }
 }
 
+/****************************************************************************
+ * IR ARENA
+ */
+
+/* Chunks are reachable heap, as instr raw bits must be reachable for
+ * re-relativization.
+ */
+#define IR_ARENA_CHUNK_SIZE (64 * 1024)
+/* Larger requests go to the regular heap. */
+#define IR_ARENA_MAX_ALLOC (IR_ARENA_CHUNK_SIZE / 16)
+/* Once a session has this many chunks further IR comes from the regular heap, which
+ * bounds the chunk walk in ir_arena_owns() on every IR free.  Even large traces fit.
+ */
+#define IR_ARENA_MAX_CHUNKS 4
+#define IR_ARENA_CHUNK_START(chunk) \
+    ((byte *)(chunk) + ALIGN_FORWARD(sizeof(ir_arena_chunk_t), HEAP_ALIGNMENT))
+#define IR_ARENA_CHUNK_END(chunk) ((byte *)(chunk) + IR_ARENA_CHUNK_SIZE)
+
+/* Returns NULL for GLOBAL_DCONTEXT, which has no arena: an arena is an unlocked
+ * bump allocator, and GLOBAL_DCONTEXT is shared by all threads.
+ */
+static inline ir_arena_t *
+ir_arena_for(dcontext_t *dcontext)
+{
+    if (dcontext == GLOBAL_DCONTEXT)
+        return NULL;
+    return &((thread_heap_t *)dcontext->heap_field)->ir_arena;
+}
+
+/* Frees the arena's chunks, keeping the oldest one if keep_one. */
+static void
+ir_arena_release(dcontext_t *dcontext, ir_arena_t *arena, bool keep_one)
+{
+    ir_arena_chunk_t *chunk = arena->chunks;
+#ifdef DEBUG_MEMORY
+    if (keep_one && chunk != NULL) {
+        /* Help catch IR that outlives its session. */
+        ir_arena_chunk_t *oldest = chunk;
+        while (oldest->next != NULL)
+            oldest = oldest->next;
+        DOCHECK(CHKLVL_MEMFILL,
+                memset(IR_ARENA_CHUNK_START(oldest), HEAP_UNALLOCATED_BYTE,
+                       (oldest == chunk ? arena->cur : IR_ARENA_CHUNK_END(oldest)) -
+                           IR_ARENA_CHUNK_START(oldest)););
+    }
+#endif
+    while (chunk != NULL && (!keep_one || chunk->next != NULL)) {
+        ir_arena_chunk_t *next = chunk->next;
+        heap_reachable_free(dcontext, chunk, IR_ARENA_CHUNK_SIZE HEAPACCT(ACCT_IR));
+        chunk = next;
+    }
+    arena->chunks = chunk;
+    arena->num_chunks = chunk == NULL ? 0 : 1;
+    arena->cur = chunk == NULL ? NULL : IR_ARENA_CHUNK_START(chunk);
+    arena->end = chunk == NULL ? NULL : IR_ARENA_CHUNK_END(chunk);
+}
+
+/* Takes at most IR_ARENA_MAX_CHUNKS steps. */
+static bool
+ir_arena_owns(ir_arena_t *arena, void *p)
+{
+    ir_arena_chunk_t *chunk;
+    ASSERT(arena->num_chunks <= IR_ARENA_MAX_CHUNKS);
+    for (chunk = arena->chunks; chunk != NULL; chunk = chunk->next) {
+        if ((byte *)p >= (byte *)chunk && (byte *)p < IR_ARENA_CHUNK_END(chunk))
+            return true;
+    }
+    return false;
+}
+
+/* Starts an IR arena session on dcontext.  Sessions nest: memory is only
+ * released by the outermost ir_arena_end().  All IR allocated with dcontext
+ * during the session must be destroyed before it ends.  A session on
+ * GLOBAL_DCONTEXT is a no-op.
+ */
+void
+ir_arena_begin(dcontext_t *dcontext)
+{
+    ir_arena_t *arena = ir_arena_for(dcontext);
+    if (arena != NULL)
+        arena->depth++;
+}
+
+void
+ir_arena_end(dcontext_t *dcontext)
+{
+    ir_arena_t *arena = ir_arena_for(dcontext);
+    if (arena == NULL)
+        return;
+    ASSERT(arena->depth > 0);
+    if (--arena->depth > 0)
+        return;
+    ir_arena_release(dcontext, arena, true /*keep one*/);
+}
+
+void *
+ir_heap_alloc(dcontext_t *dcontext, size_t size, bool reachable)
+{
+    ir_arena_t *arena = ir_arena_for(dcontext);
+    size_t aligned_size = ALIGN_FORWARD(size, HEAP_ALIGNMENT);
+    if (arena != NULL && arena->depth > 0 && size <= IR_ARENA_MAX_ALLOC &&
+        ((size_t)(arena->end - arena->cur) >= aligned_size ||
+         arena->num_chunks < IR_ARENA_MAX_CHUNKS)) {
+        void *p;
+        if ((size_t)(arena->end - arena->cur) < aligned_size) {
+            ir_arena_chunk_t *chunk = (ir_arena_chunk_t *)heap_reachable_alloc(
+                dcontext, IR_ARENA_CHUNK_SIZE HEAPACCT(ACCT_IR));
+            chunk->next = arena->chunks;
+            arena->chunks = chunk;
+            arena->num_chunks++;
+            arena->cur = IR_ARENA_CHUNK_START(chunk);
+            arena->end = IR_ARENA_CHUNK_END(chunk);
+        }
+        p = arena->cur;
+        arena->cur += aligned_size;
+        return p;
+    }
+    if (reachable)
+        return heap_reachable_alloc(dcontext, size HEAPACCT(ACCT_IR));
+    return heap_alloc(dcontext, size HEAPACCT(ACCT_IR));
+}
+
+void
+ir_heap_free(dcontext_t *dcontext, void *p, size_t size, bool reachable)
+{
+    ir_arena_t *arena = ir_arena_for(dcontext);
+    /* Arena memory is released as a whole by ir_arena_end().  Outside of a
+     * session nothing is arena memory: the kept chunk only holds the remains of
+     * the last session, which IR must not outlive.
+     */
+    if (arena != NULL && arena->depth > 0 && ir_arena_owns(arena, p))
+        return;
+    ASSERT_MESSAGE(CHKLVL_DEFAULT, "IR outlived its arena session",
+                   arena == NULL || arena->depth > 0 || !ir_arena_owns(arena, p));
+    if (reachable)
+        heap_reachable_free(dcontext, p, size HEAPACCT(ACCT_IR));
+    else
+        heap_free(dcontext, p, size HEAPACCT(ACCT_IR));
+}
+
 /****************************************************************************
  * SPECIAL SINGLE-ALLOC-SIZE HEAP SERVICE
  */
@@ -5995,3 +6568,283 @@ release_landing_pad_mem(void)
 }
 #endif /* WINDOWS */
 /*----------------------------------------------------------------------------*/
+
+#ifdef STANDALONE_UNIT_TEST
+
+#    define TEST_VMM_BLOCKS 16384
+#    define TEST_VMM_MAX_REQUEST 12
+#    define TEST_VMM_MAX_LIVE 2048
+#    define TEST_VMM_OPS 256
+
+static bitmap_element_t test_vmm_bitmap[BITMAP_INDEX(TEST_VMM_BLOCKS) +
+                                        BITMAP_SUMMARY_ELEMENTS(TEST_VMM_BLOCKS)];
+/* Which blocks we have been handed, to check the allocator against. */
+static bool test_vmm_used[TEST_VMM_BLOCKS];
+static uint test_vmm_seed;
+
+static uint
+test_vmm_rand(uint max)
+{
+    test_vmm_seed = test_vmm_seed * 1103515245 + 12345;
+    return (test_vmm_seed >> 8) % max;
+}
+
+/* Sets up a vm_heap_t whose blocks are never touched, so that we need no backing
+ * memory beyond the bitmap.
+ */
+static void
+test_vmm_init(vm_heap_t *vmh)
+{
+    memset(vmh, 0, sizeof(*vmh));
+    ASSIGN_INIT_LOCK_FREE(vmh->lock, vmh_lock);
+    vmh->name = "test";
+    vmh->num_blocks = TEST_VMM_BLOCKS;
+    vmh->num_free_blocks = TEST_VMM_BLOCKS;
+    vmh->start_addr = (vm_addr_t)ALIGN_FORWARD(0x10000000, DYNAMO_OPTION(vmm_block_size));
+    vmh->end_addr = vmh->start_addr + TEST_VMM_BLOCKS * DYNAMO_OPTION(vmm_block_size);
+    vmh->blocks = test_vmm_bitmap;
+    vmh->summary = test_vmm_bitmap + BITMAP_INDEX(TEST_VMM_BLOCKS);
+    bitmap_initialize_free(vmh->blocks, vmh->summary, vmh->num_blocks);
+    memset(test_vmm_used, 0, sizeof(test_vmm_used));
+}
+
+static uint
+test_vmm_reserve(vm_heap_t *vmh, uint num, uint must_start)
+{
+    byte *base = must_start == UINT_MAX ? NULL : vmm_block_to_addr(vmh, must_start);
+    vm_addr_t p =
+        vmm_heap_reserve_blocks(vmh, num * DYNAMO_OPTION(vmm_block_size), base, VMM_HEAP);
+    uint first, i;
+    if (p == NULL)
+        return BITMAP_NOT_FOUND;
+    first = vmm_addr_to_block(vmh, p);
+    EXPECT(must_start == UINT_MAX || first == must_start, true);
+    EXPECT(first + num <= TEST_VMM_BLOCKS, true);
+    for (i = first; i < first + num; i++) {
+        EXPECT(test_vmm_used[i], false);
+        test_vmm_used[i] = true;
+    }
+    return first;
+}
+
+static void
+test_vmm_free(vm_heap_t *vmh, uint first, uint num)
+{
+    uint i;
+    for (i = first; i < first + num; i++) {
+        EXPECT(test_vmm_used[i], true);
+        test_vmm_used[i] = false;
+    }
+    vmm_heap_free_blocks(vmh, vmm_block_to_addr(vmh, first),
+                         num * DYNAMO_OPTION(vmm_block_size), VMM_HEAP);
+}
+
+/* Returns whether there are num unused blocks starting at first. */
+static bool
+test_vmm_is_free_run(uint first, uint num)
+{
+    uint i;
+    if (first + num > TEST_VMM_BLOCKS)
+        return false;
+    for (i = first; i < first + num; i++) {
+        if (test_vmm_used[i])
+            return false;
+    }
+    return true;
+}
+
+/* Checks random reservations and frees against a simple model: we must never be
+ * handed a block twice, and must only fail when there is no room.
+ */
+static void
+test_vmm_random(void)
+{
+    vm_heap_t vmh;
+    uint live_first[TEST_VMM_MAX_LIVE], live_num[TEST_VMM_MAX_LIVE];
+    uint num_live = 0, used = 0, iter, i;
+    test_vmm_init(&vmh);
+    for (iter = 0; iter < 50000; iter++) {
+        if (num_live == 0 || (num_live < TEST_VMM_MAX_LIVE && test_vmm_rand(3) != 0)) {
+            uint num = 1 + test_vmm_rand(TEST_VMM_MAX_REQUEST);
+            uint must_start =
+                test_vmm_rand(16) == 0 ? test_vmm_rand(TEST_VMM_BLOCKS) : UINT_MAX;
+            uint first = test_vmm_reserve(&vmh, num, must_start);
+            if (first == BITMAP_NOT_FOUND) {
+                if (must_start != UINT_MAX)
+                    EXPECT(test_vmm_is_free_run(must_start, num), false);
+                else {
+                    for (i = 0; i < TEST_VMM_BLOCKS; i++)
+                        EXPECT(test_vmm_is_free_run(i, num), false);
+                }
+                continue;
+            }
+            live_first[num_live] = first;
+            live_num[num_live++] = num;
+            used += num;
+        } else {
+            uint which = test_vmm_rand(num_live);
+            test_vmm_free(&vmh, live_first[which], live_num[which]);
+            used -= live_num[which];
+            live_first[which] = live_first[--num_live];
+            live_num[which] = live_num[num_live];
+        }
+        EXPECT(vmh.num_free_blocks, TEST_VMM_BLOCKS - used);
+    }
+    while (num_live > 0) {
+        num_live--;
+        test_vmm_free(&vmh, live_first[num_live], live_num[num_live]);
+    }
+    vmm_heap_flush_cache(&vmh);
+    EXPECT(vmh.num_free_blocks, TEST_VMM_BLOCKS);
+    for (i = 0; i < BITMAP_INDEX(TEST_VMM_BLOCKS); i++)
+        EXPECT(vmh.blocks[i], ~(bitmap_element_t)0);
+    for (i = 0; i < BITMAP_SUMMARY_ELEMENTS(TEST_VMM_BLOCKS); i++)
+        EXPECT(vmh.summary[i], ~(bitmap_element_t)0);
+    DELETE_LOCK(vmh.lock);
+}
+
+/* Reserves from a heap where free_percent of the blocks, chosen at random, are
+ * free, both by searching the bitmap and by reusing recently freed blocks.  Every
+ * failed search must be for a size with no free run left, and cached blocks must
+ * be told apart from reserved ones.
+ */
+static void
+test_vmm_fragmented(uint free_percent)
+{
+    vm_heap_t vmh;
+    uint firsts[TEST_VMM_OPS];
+    uint num, i, j, freed;
+    test_vmm_init(&vmh);
+    for (i = 0; i < TEST_VMM_BLOCKS; i++)
+        EXPECT(test_vmm_reserve(&vmh, 1, UINT_MAX), i);
+    for (i = 0; i < TEST_VMM_BLOCKS; i++) {
+        if (test_vmm_rand(100) < free_percent)
+            test_vmm_free(&vmh, i, 1);
+    }
+    for (num = 1; num <= 4; num *= 4) {
+        vmm_heap_flush_cache(&vmh);
+        for (i = 0; i < TEST_VMM_OPS; i++) {
+            firsts[i] = test_vmm_reserve(&vmh, num, UINT_MAX);
+            if (firsts[i] == BITMAP_NOT_FOUND) {
+                for (j = 0; j < TEST_VMM_BLOCKS; j++)
+                    EXPECT(test_vmm_is_free_run(j, num), false);
+            }
+        }
+        for (i = 0, freed = 0; i < TEST_VMM_OPS; i++) {
+            if (firsts[i] != BITMAP_NOT_FOUND) {
+                bool expect_cached = freed < VMM_CACHE_DEPTH;
+                freed++;
+                test_vmm_free(&vmh, firsts[i], num);
+                EXPECT(vmm_blocks_are_cached(&vmh, firsts[i], num), expect_cached);
+            }
+        }
+    }
+    for (i = 0; i < TEST_VMM_OPS; i++) {
+        uint first = test_vmm_reserve(&vmh, 1, UINT_MAX);
+        if (first != BITMAP_NOT_FOUND) {
+            EXPECT(vmm_blocks_are_cached(&vmh, first, 1), false);
+            EXPECT(vmm_is_reserved_unit(&vmh, vmm_block_to_addr(&vmh, first),
+                                        DYNAMO_OPTION(vmm_block_size)),
+                   true);
+            test_vmm_free(&vmh, first, 1);
+            EXPECT(vmm_blocks_are_cached(&vmh, first, 1), true);
+        }
+    }
+    DELETE_LOCK(vmh.lock);
+}
+
+void
+unit_test_vmm_heap(void)
+{
+    print_file(STDERR, "testing vmm heap\n");
+    test_vmm_random();
+    test_vmm_fragmented(90);
+    test_vmm_fragmented(50);
+    test_vmm_fragmented(10);
+    test_vmm_fragmented(1);
+}
+
+#    define TEST_MAGAZINE_BUCKET 1
+#    define TEST_MAGAZINE_BLOCKS 64
+
+static uint
+test_global_free_list_length(int bucket)
+{
+    heap_pc p;
+    uint length = 0;
+    acquire_recursive_lock(&global_alloc_lock);
+    for (p = heapmgt->global_units.free_list[bucket]; p != NULL; p = *(heap_pc *)p)
+        length++;
+    release_recursive_lock(&global_alloc_lock);
+    return length;
+}
+
+/* Runs the calling thread's global allocations of one size through its magazine,
+ * checking that blocks only move between the magazine and the global free list,
+ * that the magazine never holds more than -global_heap_magazine_size blocks, and
+ * that flushing it at thread exit hands every block back.
+ */
+void
+unit_test_heap_magazines(void)
+{
+    dcontext_t *dcontext = get_thread_private_dcontext();
+    thread_heap_t *th = (thread_heap_t *)dcontext->heap_field;
+    heap_magazine_t *mag = &th->magazines.bucket[TEST_MAGAZINE_BUCKET];
+    uint mag_size = INTERNAL_OPTION(global_heap_magazine_size);
+    size_t size = BLOCK_SIZES[TEST_MAGAZINE_BUCKET];
+    void *blocks[TEST_MAGAZINE_BLOCKS];
+    uint i, free_blocks, count;
+    print_file(STDERR, "testing heap magazines\n");
+    EXPECT(mag_size >= 2 && 2 * mag_size <= TEST_MAGAZINE_BLOCKS, true);
+    /* Standalone mode has no magazines, so these go straight to the free list. */
+    EXPECT(th->global_magazines == NULL, true);
+    for (i = 0; i < TEST_MAGAZINE_BLOCKS; i++)
+        blocks[i] = global_heap_alloc(size HEAPACCT(ACCT_OTHER));
+    for (i = 0; i < TEST_MAGAZINE_BLOCKS; i++)
+        global_heap_free(blocks[i], size HEAPACCT(ACCT_OTHER));
+    free_blocks = test_global_free_list_length(TEST_MAGAZINE_BUCKET);
+    EXPECT(free_blocks >= TEST_MAGAZINE_BLOCKS, true);
+
+    th->global_magazines = &th->magazines;
+    /* An empty magazine is refilled with half a magazine's worth. */
+    blocks[0] = global_heap_alloc(size HEAPACCT(ACCT_OTHER));
+    EXPECT(mag->count, mag_size / 2 - 1);
+    EXPECT(test_global_free_list_length(TEST_MAGAZINE_BUCKET),
+           free_blocks - mag_size / 2);
+    for (i = 1; i < TEST_MAGAZINE_BLOCKS; i++) {
+        blocks[i] = global_heap_alloc(size HEAPACCT(ACCT_OTHER));
+        EXPECT(mag->count < mag_size, true);
+        EXPECT(mag->count + test_global_free_list_length(TEST_MAGAZINE_BUCKET),
+               free_blocks - i - 1);
+    }
+    /* A full magazine is drained by half before taking another block. */
+    for (i = 0; i < TEST_MAGAZINE_BLOCKS; i++) {
+        global_heap_free(blocks[i], size HEAPACCT(ACCT_OTHER));
+        EXPECT(mag->count <= mag_size, true);
+        EXPECT(mag->count + test_global_free_list_length(TEST_MAGAZINE_BUCKET),
+               free_blocks - TEST_MAGAZINE_BLOCKS + i + 1);
+    }
+    EXPECT(mag->count > mag_size / 2, true);
+
+    /* A signal handler that interrupted an update goes to the global units. */
+    count = mag->count;
+    th->magazines.in_use = true;
+    blocks[0] = global_heap_alloc(size HEAPACCT(ACCT_OTHER));
+    EXPECT(mag->count, count);
+    global_heap_free(blocks[0], size HEAPACCT(ACCT_OTHER));
+    EXPECT(mag->count, count);
+    th->magazines.in_use = false;
+
+    /* Exit drains the magazines of threads that did not, as if this were one. */
+    EXPECT(magazine_threads == NULL, true);
+    th->next_with_magazines = NULL;
+    magazine_threads = th;
+    heap_flush_all_magazines();
+    EXPECT(magazine_threads == NULL, true);
+    EXPECT(th->global_magazines == NULL, true);
+    for (i = 0; i < BLOCK_TYPES - 1; i++)
+        EXPECT(th->magazines.bucket[i].count, 0);
+    EXPECT(test_global_free_list_length(TEST_MAGAZINE_BUCKET), free_blocks);
+}
+
+#endif /* STANDALONE_UNIT_TEST */
@@ -300,6 +300,20 @@ void
 heap_reachable_free(dcontext_t *dcontext, void *p,
                     size_t size HEAPACCT(which_heap_t which));
 
+/* IR memory (instrlist_t, instr_t, operand arrays, and raw bits) comes from
+ * dcontext's IR arena during an ir_arena_begin()/ir_arena_end() session and from
+ * the regular heap otherwise.  Arena memory is always reachable.  GLOBAL_DCONTEXT
+ * has no arena and always uses the regular heap.
+ */
+void *
+ir_heap_alloc(dcontext_t *dcontext, size_t size, bool reachable);
+void
+ir_heap_free(dcontext_t *dcontext, void *p, size_t size, bool reachable);
+void
+ir_arena_begin(dcontext_t *dcontext);
+void
+ir_arena_end(dcontext_t *dcontext);
+
 bool
 local_heap_protected(dcontext_t *dcontext);
 void
@@ -126,6 +126,29 @@ heap_reachable_free(dcontext_t *dcontext, void *p,
     free(p);
 }
 
+/* There is no IR arena here: IR always comes from malloc. */
+void *
+ir_heap_alloc(dcontext_t *dcontext, size_t size, bool reachable)
+{
+    return malloc(size);
+}
+
+void
+ir_heap_free(dcontext_t *dcontext, void *p, size_t size, bool reachable)
+{
+    free(p);
+}
+
+void
+ir_arena_begin(dcontext_t *dcontext)
+{
+}
+
+void
+ir_arena_end(dcontext_t *dcontext)
+{
+}
+
 dcontext_t *
 get_thread_private_dcontext(void)
 {
@@ -85,7 +85,7 @@ instr_t *
 instr_create(void *drcontext)
 {
     dcontext_t *dcontext = (dcontext_t *)drcontext;
-    instr_t *instr = (instr_t *)heap_alloc(dcontext, sizeof(instr_t) HEAPACCT(ACCT_IR));
+    instr_t *instr = (instr_t *)ir_heap_alloc(dcontext, sizeof(instr_t), false);
     /* everything initializes to 0, even flags, to indicate
      * an uninitialized instruction */
     memset((void *)instr, 0, sizeof(instr_t));
@@ -112,7 +112,7 @@ instr_destroy(void *drcontext, instr_t *instr)
     instr_free(dcontext, instr);
 
     /* CAUTION: assumes that instr is not part of any instrlist */
-    heap_free(dcontext, instr, sizeof(instr_t) HEAPACCT(ACCT_IR));
+    ir_heap_free(dcontext, instr, sizeof(instr_t), false);
 }
 
 /* returns a clone of orig, but with next and prev fields set to NULL */
@@ -126,7 +126,7 @@ instr_clone(void *drcontext, instr_t *orig)
     CLIENT_ASSERT(!TEST(INSTR_IS_NOALLOC_STRUCT, orig->flags),
                   "Cloning an instr_noalloc_t is not supported.");
 
-    instr_t *instr = (instr_t *)heap_alloc(dcontext, sizeof(instr_t) HEAPACCT(ACCT_IR));
+    instr_t *instr = (instr_t *)ir_heap_alloc(dcontext, sizeof(instr_t), false);
     memcpy((void *)instr, (void *)orig, sizeof(instr_t));
     instr->next = NULL;
     instr->prev = NULL;
@@ -139,8 +139,7 @@ instr_clone(void *drcontext, instr_t *orig)
 
     if ((orig->flags & INSTR_RAW_BITS_ALLOCATED) != 0) {
         /* instr length already set from memcpy */
-        instr->bytes =
-            (byte *)heap_reachable_alloc(dcontext, instr->length HEAPACCT(ACCT_IR));
+        instr->bytes = (byte *)ir_heap_alloc(dcontext, instr->length, true);
         memcpy((void *)instr->bytes, (void *)orig->bytes, instr->length);
     } else if (instr_is_label(orig) && instr_get_label_callback(instr) != NULL) {
         /* We don't know what this callback does, we can't copy this. The caller that
@@ -149,13 +148,13 @@ instr_clone(void *drcontext, instr_t *orig)
         instr_clear_label_callback(instr);
     }
     if (orig->num_dsts > 0) { /* checking num_dsts, not dsts, b/c of label data */
-        instr->dsts = (opnd_t *)heap_alloc(
-            dcontext, instr->num_dsts * sizeof(opnd_t) HEAPACCT(ACCT_IR));
+        instr->dsts =
+            (opnd_t *)ir_heap_alloc(dcontext, instr->num_dsts * sizeof(opnd_t), false);
         memcpy((void *)instr->dsts, (void *)orig->dsts, instr->num_dsts * sizeof(opnd_t));
     }
     if (orig->num_srcs > 1) { /* checking num_src, not srcs, b/c of label data */
-        instr->srcs = (opnd_t *)heap_alloc(
-            dcontext, (instr->num_srcs - 1) * sizeof(opnd_t) HEAPACCT(ACCT_IR));
+        instr->srcs = (opnd_t *)ir_heap_alloc(
+            dcontext, (instr->num_srcs - 1) * sizeof(opnd_t), false);
         memcpy((void *)instr->srcs, (void *)orig->srcs,
                (instr->num_srcs - 1) * sizeof(opnd_t));
     }
@@ -200,15 +199,14 @@ instr_free(void *drcontext, instr_t *instr)
         instr_free_raw_bits(dcontext, instr);
     }
     if (instr->num_dsts > 0) { /* checking num_dsts, not dsts, b/c of label data */
-        heap_free(dcontext, instr->dsts,
-                  instr->num_dsts * sizeof(opnd_t) HEAPACCT(ACCT_IR));
+        ir_heap_free(dcontext, instr->dsts, instr->num_dsts * sizeof(opnd_t), false);
         instr->dsts = NULL;
         instr->num_dsts = 0;
     }
     if (instr->num_srcs > 1) { /* checking num_src, not src, b/c of label data */
         /* remember one src is static, rest are dynamic */
-        heap_free(dcontext, instr->srcs,
-                  (instr->num_srcs - 1) * sizeof(opnd_t) HEAPACCT(ACCT_IR));
+        ir_heap_free(dcontext, instr->srcs, (instr->num_srcs - 1) * sizeof(opnd_t),
+                     false);
         instr->srcs = NULL;
         instr->num_srcs = 0;
     }
@@ -350,7 +348,7 @@ private_instr_encode(dcontext_t *dcontext, instr_t *instr, bool always_cache)
          * Otherwise we can't keep the encoding around since re-relativization won't
          * work.
          */
-        buf = heap_reachable_alloc(dcontext, MAX_INSTR_LENGTH HEAPACCT(ACCT_IR));
+        buf = ir_heap_alloc(dcontext, MAX_INSTR_LENGTH, true);
     }
     uint len;
     /* Do not cache instr opnds as they are pc-relative to final encoding location.
@@ -370,7 +368,7 @@ private_instr_encode(dcontext_t *dcontext, instr_t *instr, bool always_cache)
                                                                 _IF_ARM(false))
                                         ->name);
             if (!TEST(INSTR_IS_NOALLOC_STRUCT, instr->flags))
-                heap_reachable_free(dcontext, buf, MAX_INSTR_LENGTH HEAPACCT(ACCT_IR));
+                ir_heap_free(dcontext, buf, MAX_INSTR_LENGTH, true);
             return 0;
         }
         /* if unreachable, we can't cache, since re-relativization won't work */
@@ -419,7 +417,7 @@ private_instr_encode(dcontext_t *dcontext, instr_t *instr, bool always_cache)
         instr_set_operands_valid(instr, valid);
     }
     if (!TEST(INSTR_IS_NOALLOC_STRUCT, instr->flags))
-        heap_reachable_free(dcontext, buf, MAX_INSTR_LENGTH HEAPACCT(ACCT_IR));
+        ir_heap_free(dcontext, buf, MAX_INSTR_LENGTH, true);
     return len;
 }
 
@@ -563,8 +561,8 @@ instr_set_num_opnds(void *drcontext, instr_t *instr, int instr_num_dsts,
             instr_noalloc_t *noalloc = (instr_noalloc_t *)instr;
             noalloc->instr.dsts = noalloc->dsts;
         } else {
-            instr->dsts = (opnd_t *)heap_alloc(
-                dcontext, instr_num_dsts * sizeof(opnd_t) HEAPACCT(ACCT_IR));
+            instr->dsts =
+                (opnd_t *)ir_heap_alloc(dcontext, instr_num_dsts * sizeof(opnd_t), false);
         }
     }
     if (instr_num_srcs > 0) {
@@ -576,8 +574,8 @@ instr_set_num_opnds(void *drcontext, instr_t *instr, int instr_num_dsts,
                 instr_noalloc_t *noalloc = (instr_noalloc_t *)instr;
                 noalloc->instr.srcs = noalloc->srcs;
             } else {
-                instr->srcs = (opnd_t *)heap_alloc(
-                    dcontext, (instr_num_srcs - 1) * sizeof(opnd_t) HEAPACCT(ACCT_IR));
+                instr->srcs = (opnd_t *)ir_heap_alloc(
+                    dcontext, (instr_num_srcs - 1) * sizeof(opnd_t), false);
             }
         }
         CLIENT_ASSERT_TRUNCATE(instr->num_srcs, byte, instr_num_srcs,
@@ -629,9 +627,8 @@ instr_remove_srcs(void *drcontext, instr_t *instr, uint start, uint end)
     CLIENT_ASSERT(start >= 0 && end <= instr->num_srcs && start < end,
                   "instr_remove_srcs: ordinals invalid");
     if (instr->num_srcs - 1 > (byte)(end - start)) {
-        new_srcs = (opnd_t *)heap_alloc(dcontext,
-                                        (instr->num_srcs - 1 - (end - start)) *
-                                            sizeof(opnd_t) HEAPACCT(ACCT_IR));
+        new_srcs = (opnd_t *)ir_heap_alloc(
+            dcontext, (instr->num_srcs - 1 - (end - start)) * sizeof(opnd_t), false);
         if (start > 1)
             memcpy(new_srcs, instr->srcs, (start - 1) * sizeof(opnd_t));
         if ((byte)end < instr->num_srcs - 1) {
@@ -642,8 +639,7 @@ instr_remove_srcs(void *drcontext, instr_t *instr, uint start, uint end)
         new_srcs = NULL;
     if (start == 0 && end < instr->num_srcs)
         instr->src0 = instr->srcs[end - 1];
-    heap_free(dcontext, instr->srcs,
-              (instr->num_srcs - 1) * sizeof(opnd_t) HEAPACCT(ACCT_IR));
+    ir_heap_free(dcontext, instr->srcs, (instr->num_srcs - 1) * sizeof(opnd_t), false);
     instr->num_srcs -= (byte)(end - start);
     instr->srcs = new_srcs;
     instr_being_modified(instr, false /*raw bits invalid*/);
@@ -662,9 +658,8 @@ instr_remove_dsts(void *drcontext, instr_t *instr, uint start, uint end)
     CLIENT_ASSERT(start >= 0 && end <= instr->num_dsts && start < end,
                   "instr_remove_dsts: ordinals invalid");
     if (instr->num_dsts > (byte)(end - start)) {
-        new_dsts = (opnd_t *)heap_alloc(dcontext,
-                                        (instr->num_dsts - (end - start)) *
-                                            sizeof(opnd_t) HEAPACCT(ACCT_IR));
+        new_dsts = (opnd_t *)ir_heap_alloc(
+            dcontext, (instr->num_dsts - (end - start)) * sizeof(opnd_t), false);
         if (start > 0)
             memcpy(new_dsts, instr->dsts, start * sizeof(opnd_t));
         if (end < instr->num_dsts) {
@@ -673,7 +668,7 @@ instr_remove_dsts(void *drcontext, instr_t *instr, uint start, uint end)
         }
     } else
         new_dsts = NULL;
-    heap_free(dcontext, instr->dsts, instr->num_dsts * sizeof(opnd_t) HEAPACCT(ACCT_IR));
+    ir_heap_free(dcontext, instr->dsts, instr->num_dsts * sizeof(opnd_t), false);
     instr->num_dsts -= (byte)(end - start);
     instr->dsts = new_dsts;
     instr_being_modified(instr, false /*raw bits invalid*/);
@@ -1047,7 +1042,7 @@ instr_free_raw_bits(void *drcontext, instr_t *instr)
     if ((instr->flags & INSTR_RAW_BITS_ALLOCATED) == 0)
         return;
     if (!TEST(INSTR_IS_NOALLOC_STRUCT, instr->flags))
-        heap_reachable_free(dcontext, instr->bytes, instr->length HEAPACCT(ACCT_IR));
+        ir_heap_free(dcontext, instr->bytes, instr->length, true);
     instr->bytes = NULL;
     instr->flags &= ~INSTR_RAW_BITS_VALID;
     instr->flags &= ~INSTR_RAW_BITS_ALLOCATED;
@@ -1074,8 +1069,7 @@ instr_allocate_raw_bits(void *drcontext, instr_t *instr, uint num_bytes)
             new_bits = noalloc->encode_buf;
         } else {
             /* We need reachable heap for rip-rel re-relativization. */
-            new_bits =
-                (byte *)heap_reachable_alloc(dcontext, num_bytes HEAPACCT(ACCT_IR));
+            new_bits = (byte *)ir_heap_alloc(dcontext, num_bytes, true);
         }
         if (original_bits != NULL) {
             /* copy original bits into modified bits so can just modify
@@ -61,7 +61,7 @@ instrlist_create(void *drcontext)
 {
     dcontext_t *dcontext = (dcontext_t *)drcontext;
     instrlist_t *ilist =
-        (instrlist_t *)heap_alloc(dcontext, sizeof(instrlist_t) HEAPACCT(ACCT_IR));
+        (instrlist_t *)ir_heap_alloc(dcontext, sizeof(instrlist_t), false);
     CLIENT_ASSERT(ilist != NULL, "instrlist_create: allocation error");
     instrlist_init(ilist);
     return ilist;
@@ -88,7 +88,7 @@ instrlist_destroy(void *drcontext, instrlist_t *ilist)
     dcontext_t *dcontext = (dcontext_t *)drcontext;
     CLIENT_ASSERT(ilist->first == NULL && ilist->last == NULL,
                   "instrlist_destroy: list not empty");
-    heap_free(dcontext, ilist, sizeof(instrlist_t) HEAPACCT(ACCT_IR));
+    ir_heap_free(dcontext, ilist, sizeof(instrlist_t), false);
 }
 
 /* frees the Instrs in the instrlist_t */
@@ -118,6 +118,18 @@ instrlist_clear_and_destroy(void *drcontext, instrlist_t *ilist)
     instrlist_destroy(dcontext, ilist);
 }
 
+void
+dr_ir_arena_begin(void *drcontext)
+{
+    ir_arena_begin((dcontext_t *)drcontext);
+}
+
+void
+dr_ir_arena_end(void *drcontext)
+{
+    ir_arena_end((dcontext_t *)drcontext);
+}
+
 /* Specifies the fall-through target of a basic block if its last
  * instruction is a conditional branch instruction.
  * It can only be called in basic block building event callbacks
@@ -67,6 +67,30 @@ DR_API
 void
 instrlist_clear_and_destroy(void *drcontext, instrlist_t *ilist);
 
+DR_API
+/**
+ * Starts an IR arena session on \p drcontext.  Until the matching
+ * dr_ir_arena_end(), the instrlist_t, instr_t, operand, and raw bits memory
+ * allocated with \p drcontext is carved out of a per-context arena instead of
+ * being taken from the heap one object at a time, and freeing it, including via
+ * instrlist_clear_and_destroy(), costs next to nothing.  This suits a tool that
+ * decodes or builds many short-lived instruction lists.
+ *
+ * Sessions nest, and the arena's memory is released when the outermost session
+ * ends.  All IR allocated with \p drcontext during a session must be destroyed
+ * before it ends, or abandoned: it must not be used or destroyed afterward.
+ * For GLOBAL_DCONTEXT, as in standalone mode, there is a single arena shared by
+ * all threads, so no other thread may use IR with GLOBAL_DCONTEXT during the
+ * session.
+ */
+void
+dr_ir_arena_begin(void *drcontext);
+
+DR_API
+/** Ends an IR arena session started by dr_ir_arena_begin(). */
+void
+dr_ir_arena_end(void *drcontext);
+
 DR_API
 /**
  * All future instructions inserted into \p ilist that do not have raw bits
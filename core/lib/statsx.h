@@ -899,6 +899,9 @@ STATS_DEF("Heap bucket pad space (bytes)", heap_bucket_pad)
 STATS_DEF("Peak heap bucket pad space (bytes)", peak_heap_bucket_pad)
 STATS_DEF("Heap allocs in buckets", heap_allocs_buckets)
 STATS_DEF("Heap allocs variable-sized", heap_allocs_variable)
+STATS_DEF("Global heap allocs and frees using only a thread magazine",
+          heap_magazine_hits)
+STATS_DEF("Global heap blocks returned from thread magazines", heap_magazine_returns)
 STATS_DEF("Total reserved memory", reserved_memory_capacity)
 STATS_DEF("Peak total reserved memory", peak_reserved_memory_capacity)
 STATS_DEF("Guard pages, reserved virtual pages", guard_pages)
@@ -998,6 +1001,7 @@ STATS_DEF("Wasted vmm space due to alignment", vmm_vsize_wasted)
 STATS_DEF("Peak wasted vmm space due to alignment", peak_vmm_vsize_wasted)
 STATS_DEF("Allocations using multiple vmm blocks", vmm_multi_block_allocs)
 STATS_DEF("Blocks used for multi-block allocs", vmm_multi_blocks)
+STATS_DEF("Vmm block reservations from the free cache", vmm_block_cache_hits)
 RSTATS_DEF("Current vmm virtual memory in use (bytes)", vmm_vsize_used)
 RSTATS_DEF("Peak vmm virtual memory in use (bytes)", peak_vmm_vsize_used)
 STATS_DEF("Number of landing pad areas allocated", num_landing_pad_areas)
@@ -1152,6 +1152,12 @@ end_and_emit_trace(dcontext_t *dcontext, fragment_t *cur_f)
      * to a trace b/c traces have prefixes that basic blocks don't!
      */
 
+    /* Every path below frees the trace's IR, so what instrumenting and mangling add
+     * to it can come from the IR arena.
+     */
+    if (DYNAMO_OPTION(ir_arena))
+        ir_arena_begin(dcontext);
+
     DOSTATS({
         /* static count last_exit statistics case 4817 */
         if (LINKSTUB_INDIRECT(dcontext->last_exit->flags)) {
@@ -1556,6 +1562,8 @@ end_and_emit_trace(dcontext_t *dcontext, fragment_t *cur_f)
 #endif
 
 end_and_emit_trace_return:
+    if (DYNAMO_OPTION(ir_arena))
+        ir_arena_end(dcontext);
     if (cur_f == NULL && cur_f_tag == tag)
         return trace_f;
     else {
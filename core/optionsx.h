@@ -1327,6 +1327,17 @@ OPTION_DEFAULT(uint_size, initial_global_heap_unit_size, 24 * 1024,
  */
 OPTION_DEFAULT_INTERNAL(uint_size, max_heap_unit_size, 256 * 1024,
                         "maximum heap unit size")
+/* Each thread caches up to this many free global heap blocks of each fixed size,
+ * moving half this many at a time to and from the shared free lists.
+ */
+OPTION_DEFAULT_INTERNAL(uint, global_heap_magazine_size, 16,
+                        "per-thread global heap blocks cached per size (0 disables)")
+/* Allocates the IR of each block and trace we build from a per-thread arena that is
+ * released as a whole once the fragment is emitted.  Off by default, as a client that
+ * keeps instrs created with an event's drcontext past a bb or trace event would be
+ * left with dangling pointers.
+ */
+OPTION_DEFAULT(bool, ir_arena, false, "allocate block and trace IR from an arena")
 /* heap_commit_increment may be adjusted by adjust_defaults_for_page_size(). */
 OPTION_DEFAULT(uint_size, heap_commit_increment, 4 * 1024, "heap commit increment")
 /* cache_commit_increment may be adjusted by adjust_defaults_for_page_size(). */
@@ -2487,8 +2498,7 @@ OPTION_DEFAULT(bool, persist_map_rw_separate, true,
 OPTION_DEFAULT(bool, persist_lock_file, true,
                "keep persisted file handle open to prevent writes/deletes")
 /* FIXME: could make PC_ to coexist for separate values */
-/* PR 215036: linux does not support PERSCACHE_MODULE_MD5_AT_LOAD */
-OPTION_DEFAULT(uint, persist_gen_validation, IF_WINDOWS_ELSE(0x1d, 0xd),
+OPTION_DEFAULT(uint, persist_gen_validation, 0x1d,
                /* PERSCACHE_MODULE_MD5_SHORT | PERSCACHE_MODULE_MD5_AT_LOAD |
                   PERSCACHE_GENFILE_MD5_{SHORT,COMPLETE} */
                "controls md5 values that we store when we persist")
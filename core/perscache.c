@@ -189,14 +189,14 @@ coarse_unit_create(app_pc base_pc, app_pc end_pc, module_digest_t *digest,
          * Should have consistent injection points in steady state usage.
          * FIXME PR 215036: for 4.4 we'll want to not record the at-mmap md5, but
          * rather the 1st-execution-time post-rebase md5.
+         * On Linux we are called as the text segment is mapped, before later
+         * segments are set up, but the digest only covers executable segments
+         * and queries the OS for their readability, just like coarse_unit_load()
+         * does at this same point.
          */
         app_pc modbase = get_module_base(info->base_pc);
         size_t modsize;
         os_get_module_info_lock();
-        /* For linux we can't do module segment walking at initial mmap time
-         * b/c the segments are not set up: we hit SIGBUS!
-         */
-        IF_UNIX(ASSERT_BUG_NUM(215036, true));
         if (os_get_module_info(modbase, NULL, NULL, &modsize, NULL, NULL, NULL)) {
             os_get_module_info_unlock();
             persist_calculate_module_digest(&info->module_md5, modbase, modsize,
@@ -3875,7 +3875,7 @@ coarse_unit_load(dcontext_t *dcontext, app_pc start, app_pc end, bool for_execut
                                       DYNAMO_OPTION(persist_load_validation));
         DOLOG(1, LOG_CACHE, {
             print_module_digest(THREAD, &footer->self_md5, "md5 stored in file: ");
-            print_module_digest(THREAD, &footer->self_md5, "md5 calculated:     ");
+            print_module_digest(THREAD, &self_md5, "md5 calculated:     ");
         });
         if ((TEST(PERSCACHE_GENFILE_MD5_SHORT, DYNAMO_OPTION(persist_load_validation)) &&
              !md5_digests_equal(self_md5.short_MD5, footer->self_md5.short_MD5)) ||
@@ -4118,9 +4118,10 @@ coarse_unit_load(dcontext_t *dcontext, app_pc start, app_pc end, bool for_execut
                 STATS_INC(pcache_stub_touched);
             }
         }
+        info->stubs_prot = MEMPROT_READ | MEMPROT_EXEC;
         DEBUG_DECLARE(ok =)
         set_protection(rwx_pc, map + pers->header_len + pers->data_len - rwx_pc,
-                       MEMPROT_READ | MEMPROT_EXEC);
+                       info->stubs_prot);
         ASSERT(ok);
         info->stubs_readonly = true;
     } else {
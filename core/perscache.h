@@ -166,6 +166,10 @@ struct _coarse_info_t {
 
     /* case 10525: leave stubs as writable if written too many times */
     uint stubs_write_count;
+    /* MEMPROT_ protection of the stubs while stubs_readonly, restored after
+     * each write to them.
+     */
+    uint stubs_prot;
 
     /* case 9521: we can have a second unit in the same region for new,
      * non-frozen coarse code if the primary unit is frozen.
@@ -52,6 +52,10 @@ void
 unit_test_vmareas(void);
 void
 unit_test_utils(void);
+void
+unit_test_vmm_heap(void);
+void
+unit_test_heap_magazines(void);
 #ifdef WINDOWS
 void
 unit_test_drwinapi(void);
@@ -79,6 +83,8 @@ main(int argc, char **argv, char **envp)
     unit_test_memquery();
 #endif
     unit_test_utils();
+    unit_test_vmm_heap();
+    unit_test_heap_magazines();
     unit_test_options();
     unit_test_vmareas();
 #ifdef WINDOWS
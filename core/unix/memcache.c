@@ -95,7 +95,8 @@ void
 memcache_init(void)
 {
     /* Need to be after heap_init */
-    VMVECTOR_ALLOC_VECTOR(all_memory_areas, GLOBAL_DCONTEXT, VECTOR_SHARED,
+    /* Every mmap lands here, so this can grow large. */
+    VMVECTOR_ALLOC_VECTOR(all_memory_areas, GLOBAL_DCONTEXT, VECTOR_SHARED | VECTOR_BTREE,
                           all_memory_areas);
     vmvector_set_callbacks(all_memory_areas, allmem_info_free, allmem_info_dup,
                            allmem_should_merge, allmem_info_merge);
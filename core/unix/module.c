@@ -197,7 +197,17 @@ os_module_area_init(module_area_t *ma, app_pc base, size_t view_size, bool at_ma
         /* Use something so we have usable pcache names */
         ma->os_data.checksum = d_r_crc32((const char *)ma->start, PAGE_SIZE);
     }
-    /* Timestamp we just leave as 0 */
+#    ifdef LINUX
+    /* There is no link timestamp, but the build ID identifies the build in the
+     * same way, so it goes into both the pcache name and its validation.
+     */
+    if (ma->os_data.timestamp == 0 && ma->os_data.build_id_len > 0 &&
+        (DYNAMO_OPTION(coarse_enable_freeze) || DYNAMO_OPTION(use_persisted))) {
+        ma->os_data.timestamp =
+            d_r_crc32((const char *)ma->os_data.build_id, ma->os_data.build_id_len);
+    }
+#    endif
+    /* Otherwise timestamp we just leave as 0 */
 
 #    ifdef LINUX
     rseq_module_init(ma, at_map);
@@ -432,8 +442,14 @@ os_get_module_info(const app_pc pc, uint *checksum, uint *timestamp, size_t *siz
             *code_size = rx_sz;
         }
         if (file_version != NULL) {
-            /* FIXME: NYI: make windows-only everywhere if no good linux source */
             *file_version = 0;
+#    ifdef LINUX
+            /* The leading build ID bytes stand in for a version resource, giving
+             * pcache validation more of the build ID than the timestamp hash.
+             */
+            memcpy(file_version, ma->os_data.build_id,
+                   MIN(sizeof(*file_version), ma->os_data.build_id_len));
+#    endif
         }
     }
 
@@ -51,6 +51,13 @@ typedef struct _module_segment_t {
     uint64 offset;
 } module_segment_t;
 
+#ifdef LINUX
+/* The longest build ID we keep: a SHA-1, the linker default.  Longer ones are
+ * truncated.
+ */
+#    define MODULE_BUILD_ID_MAX_LEN 20
+#endif
+
 typedef struct _os_module_data_t {
     /* To compute the base address, one determines the memory address associated with
      * the lowest p_vaddr value for a PT_LOAD segment. One then obtains the base
@@ -91,6 +98,9 @@ typedef struct _os_module_data_t {
     ptr_uint_t gnu_shift;
     ptr_uint_t gnu_bitidx;
     size_t gnu_symbias; /* .dynsym index of first export */
+    /* GNU build ID from the NT_GNU_BUILD_ID note, used to identify pcaches */
+    byte build_id[MODULE_BUILD_ID_MAX_LEN];
+    uint build_id_len; /* 0 if the module has no build ID */
 #else                   /* MACOS */
     byte *exports;     /* absolute addr of exports trie */
     size_t exports_sz; /* size of exports trie */
@@ -329,6 +329,52 @@ module_fill_os_data(ELF_PROGRAM_HEADER_TYPE *prog_hdr, /* PT_DYNAMIC entry */
     return res;
 }
 
+/* Copies the GNU build ID out of a PT_NOTE entry into out_data, if present.
+ * The notes are normally in the first segment, so at_map they are readable.
+ */
+static void
+module_fill_build_id(ELF_PROGRAM_HEADER_TYPE *prog_hdr, /* PT_NOTE entry */
+                     app_pc base, size_t view_size, bool at_map, ptr_int_t load_delta,
+                     OUT os_module_data_t *out_data)
+{
+    byte *note = at_map ? base + prog_hdr->p_offset
+                        : (byte *)prog_hdr->p_vaddr + load_delta;
+    byte *note_end = note + prog_hdr->p_filesz;
+    /* Notes are 4-byte aligned except in 8-byte-aligned segments like
+     * .note.gnu.property.
+     */
+    size_t align = prog_hdr->p_align == 8 ? 8 : 4;
+    dcontext_t *dcontext = get_thread_private_dcontext();
+    ASSERT(prog_hdr->p_type == PT_NOTE);
+    if (out_data->build_id_len > 0 || (at_map && note_end > base + view_size))
+        return;
+    TRY_EXCEPT_ALLOW_NO_DCONTEXT(
+        dcontext,
+        {
+            while (note + sizeof(ELF_NOTE_HEADER_TYPE) <= note_end) {
+                ELF_NOTE_HEADER_TYPE *nhdr = (ELF_NOTE_HEADER_TYPE *)note;
+                byte *name = note + sizeof(*nhdr);
+                byte *desc = name + ALIGN_FORWARD(nhdr->n_namesz, align);
+                if (desc + nhdr->n_descsz > note_end)
+                    break;
+                if (nhdr->n_type == NT_GNU_BUILD_ID &&
+                    nhdr->n_namesz == sizeof(ELF_NOTE_GNU) &&
+                    memcmp(name, ELF_NOTE_GNU, sizeof(ELF_NOTE_GNU)) == 0 &&
+                    nhdr->n_descsz > 0) {
+                    out_data->build_id_len =
+                        MIN(nhdr->n_descsz, BUFFER_SIZE_BYTES(out_data->build_id));
+                    memcpy(out_data->build_id, desc, out_data->build_id_len);
+                    break;
+                }
+                note = desc + ALIGN_FORWARD(nhdr->n_descsz, align);
+            }
+        },
+        { /* EXCEPT */
+          ASSERT_CURIOSITY(false && "crashed while walking notes");
+          out_data->build_id_len = 0;
+        });
+}
+
 /* Identifies the bounds of each segment in the ELF at base.
  * Returned addresses out_base and out_end are relative to the actual
  * loaded module base, so the "base" param should be added to produce
@@ -390,6 +436,10 @@ module_walk_program_headers(app_pc base, size_t view_size, bool at_map, bool dyn
                 }
                 found_load = true;
             }
+            if (out_data != NULL && prog_hdr->p_type == PT_NOTE) {
+                module_fill_build_id(prog_hdr, base, view_size, at_map, load_delta,
+                                     out_data);
+            }
             if ((out_soname != NULL || out_data != NULL) &&
                 prog_hdr->p_type == PT_DYNAMIC) {
                 module_fill_os_data(prog_hdr, mod_base, max_end, base, view_size, at_map,
@@ -48,6 +48,7 @@
 #    define ELF_PROGRAM_HEADER_TYPE Elf64_Phdr
 #    define ELF_SECTION_HEADER_TYPE Elf64_Shdr
 #    define ELF_DYNAMIC_ENTRY_TYPE Elf64_Dyn
+#    define ELF_NOTE_HEADER_TYPE Elf64_Nhdr
 #    define ELF_ADDR Elf64_Addr
 #    define ELF_WORD Elf64_Xword
 #    define ELF_SWORD Elf64_Sxword
@@ -69,6 +70,7 @@
 #    define ELF_PROGRAM_HEADER_TYPE Elf32_Phdr
 #    define ELF_SECTION_HEADER_TYPE Elf32_Shdr
 #    define ELF_DYNAMIC_ENTRY_TYPE Elf32_Dyn
+#    define ELF_NOTE_HEADER_TYPE Elf32_Nhdr
 #    define ELF_ADDR Elf32_Addr
 #    define ELF_WORD Elf32_Word
 #    define ELF_SWORD Elf32_Sword
@@ -1438,19 +1438,20 @@ hashtable_num_bits(uint size)
 /****************************************************************************/
 /* BITMAP */
 
-/* Since there is no ffs() on windows we use the one from
- *  /usr/src/linux-2.4/include/linux/bitops.h.  TODO: An easier
- *  x86-specific way using BSF is
- *  /usr/src/linux-2.4/include/asm/bitops.h
- */
-
 /* Returns the position of the first set bit - betwen 0 and 31 */
 static inline uint
 bitmap_find_first_set_bit(bitmap_element_t x)
 {
-    int r = 0;
-
     ASSERT(x);
+#if defined(__GNUC__) && (defined(X86) || defined(AARCHXX))
+    /* This is a single instruction or two on these architectures. */
+    return (uint)__builtin_ctz(x);
+#else
+    /* Since there is no ffs() on windows we use the one from
+     * /usr/src/linux-2.4/include/linux/bitops.h.  We avoid the builtin elsewhere
+     * as it can turn into a call to a libgcc routine, which we do not link.
+     */
+    int r = 0;
     if (!(x & 0xffff)) {
         x >>= 16;
         r += 16;
@@ -1472,100 +1473,185 @@ bitmap_find_first_set_bit(bitmap_element_t x)
         r += 1;
     }
     return r;
+#endif
+}
+
+/* Returns a mask of num bits starting at bit pos, where pos + num <= 32. */
+static inline bitmap_element_t
+bitmap_range_mask(uint pos, uint num)
+{
+    ASSERT(num > 0 && pos + num <= BITMAP_DENSITY);
+    if (num == BITMAP_DENSITY)
+        return ~(bitmap_element_t)0;
+    return (((bitmap_element_t)1 << num) - 1) << pos;
+}
+
+/* Returns the index of the first element at or after index that has a set bit, or
+ * BITMAP_NOT_FOUND.  The summary lets us skip 32 full elements at a time.
+ */
+static inline uint
+bitmap_find_nonempty_element(bitmap_t summary, uint num_elements, uint index)
+{
+    uint last_summary = BITMAP_INDEX(num_elements + BITMAP_DENSITY - 1);
+    uint s = BITMAP_INDEX(index);
+    bitmap_element_t w;
+    if (index >= num_elements)
+        return BITMAP_NOT_FOUND;
+    /* Drop the bits for the elements before index. */
+    w = summary[s] & ~(bitmap_range_mask(0, index % BITMAP_DENSITY + 1) >> 1);
+    while (w == 0) {
+        if (++s >= last_summary)
+            return BITMAP_NOT_FOUND;
+        w = summary[s];
+    }
+    return s * BITMAP_DENSITY + bitmap_find_first_set_bit(w);
 }
 
 /* A block is marked free with a set bit.
    Returns -1 if no block is found!
 */
 static inline uint
-bitmap_find_set_block(bitmap_t b, uint bitmap_size)
+bitmap_find_set_block(bitmap_t b, bitmap_t summary, uint bitmap_size)
 {
-    uint i = 0;
-    uint last_index = BITMAP_INDEX(bitmap_size);
-
-    while (b[i] == 0 && i < last_index)
-        i++;
-    if (i == last_index)
+    uint i = bitmap_find_nonempty_element(summary, BITMAP_INDEX(bitmap_size), 0);
+    if (i == BITMAP_NOT_FOUND)
         return BITMAP_NOT_FOUND;
     return i * BITMAP_DENSITY + bitmap_find_first_set_bit(b[i]);
 }
 
 /* Looks for a sequence of free blocks
  * Returns -1 if no such sequence is found!
-
- * Considering the fact that the majority of our allocations will be
- * for a single block this operation is not terribly efficient.
+ *
+ * We walk the runs of set and clear bits in each element with bit scans rather
+ * than testing one bit at a time, and use the summary to skip fully allocated
+ * elements, which end any run in progress.
  */
 static uint
-bitmap_find_set_block_sequence(bitmap_t b, uint bitmap_size, uint requested)
+bitmap_find_set_block_sequence(bitmap_t b, bitmap_t summary, uint bitmap_size,
+                               uint requested)
+{
+    uint num_elements = BITMAP_INDEX(bitmap_size);
+    uint run_start = 0, run_len = 0;
+    uint i = bitmap_find_nonempty_element(summary, num_elements, 0);
+    while (i != BITMAP_NOT_FOUND) {
+        bitmap_element_t w = b[i];
+        uint pos = 0;
+        if (run_len > 0 && run_start + run_len != i * BITMAP_DENSITY)
+            run_len = 0;
+        while (pos < BITMAP_DENSITY) {
+            bitmap_element_t rest = w >> pos;
+            uint len;
+            if (rest == 0) {
+                run_len = 0;
+                break;
+            }
+            if ((rest & 1) == 0) {
+                uint skip = bitmap_find_first_set_bit(rest);
+                pos += skip;
+                rest >>= skip;
+                run_len = 0;
+            }
+            /* rest has its top pos bits clear, so ~rest is zero only if pos is 0. */
+            len = (~rest == 0) ? BITMAP_DENSITY : bitmap_find_first_set_bit(~rest);
+            if (run_len == 0)
+                run_start = i * BITMAP_DENSITY + pos;
+            run_len += len;
+            if (run_len >= requested)
+                return run_start;
+            pos += len;
+        }
+        i = bitmap_find_nonempty_element(summary, num_elements, i + 1);
+    }
+    return BITMAP_NOT_FOUND;
+}
+
+/* Returns whether all of the blocks in [first_block, first_block + num) are set. */
+static bool
+bitmap_are_set_blocks(bitmap_t b, uint first_block, uint num)
 {
-    uint last_bit = bitmap_size - requested + 1;
-    /* find quickly at least a single block */
-    uint first = bitmap_find_set_block(b, bitmap_size);
-    if (first == BITMAP_NOT_FOUND)
-        return BITMAP_NOT_FOUND;
+    while (num > 0) {
+        uint pos = first_block % BITMAP_DENSITY;
+        uint len = MIN(num, BITMAP_DENSITY - pos);
+        bitmap_element_t mask = bitmap_range_mask(pos, len);
+        if ((b[BITMAP_INDEX(first_block)] & mask) != mask)
+            return false;
+        first_block += len;
+        num -= len;
+    }
+    return true;
+}
 
-    do {
-        /* now check if there is room for the requested number of bits */
-        uint hole_size = 1;
-        while (hole_size < requested && bitmap_test(b, first + hole_size)) {
-            hole_size++;
+/* Sets or clears the blocks in [first_block, first_block + num) and keeps the
+ * summary in sync.
+ */
+static void
+bitmap_update_blocks(bitmap_t b, bitmap_t summary, uint first_block, uint num, bool set)
+{
+    while (num > 0) {
+        uint index = BITMAP_INDEX(first_block);
+        uint pos = first_block % BITMAP_DENSITY;
+        uint len = MIN(num, BITMAP_DENSITY - pos);
+        bitmap_element_t mask = bitmap_range_mask(pos, len);
+        if (set) {
+            ASSERT((b[index] & mask) == 0);
+            b[index] |= mask;
+            summary[BITMAP_INDEX(index)] |= bitmap_range_mask(index % BITMAP_DENSITY, 1);
+        } else {
+            ASSERT((b[index] & mask) == mask);
+            b[index] &= ~mask;
+            if (b[index] == 0) {
+                summary[BITMAP_INDEX(index)] &=
+                    ~bitmap_range_mask(index % BITMAP_DENSITY, 1);
+            }
         }
-        if (hole_size == requested)
-            return first;
-        /* otherwise first + hole_size is not set, so we should skip that */
-        first += hole_size + 1;
-        while (first < last_bit && !bitmap_test(b, first))
-            first++;
-    } while (first < last_bit);
-
-    return BITMAP_NOT_FOUND;
+        first_block += len;
+        num -= len;
+    }
 }
 
 void
-bitmap_initialize_free(bitmap_t b, uint bitmap_size)
-{
-    memset(b, 0xff, BITMAP_INDEX(bitmap_size) * sizeof(bitmap_element_t));
+bitmap_initialize_free(bitmap_t b, bitmap_t summary, uint bitmap_size)
+{
+    uint num_elements = BITMAP_INDEX(bitmap_size);
+    memset(b, 0xff, num_elements * sizeof(bitmap_element_t));
+    memset(summary, 0, BITMAP_SUMMARY_ELEMENTS(bitmap_size) * sizeof(bitmap_element_t));
+    memset(summary, 0xff, BITMAP_INDEX(num_elements) * sizeof(bitmap_element_t));
+    if (num_elements % BITMAP_DENSITY != 0) {
+        summary[BITMAP_INDEX(num_elements)] =
+            bitmap_range_mask(0, num_elements % BITMAP_DENSITY);
+    }
 }
 
 uint
-bitmap_allocate_blocks(bitmap_t b, uint bitmap_size, uint request_blocks,
-                       uint start_block)
+bitmap_allocate_blocks(bitmap_t b, bitmap_t summary, uint bitmap_size,
+                       uint request_blocks, uint start_block)
 {
-    uint i, res;
+    uint res;
+    ASSERT(request_blocks > 0);
     if (start_block != UINT_MAX) {
-        if (start_block + request_blocks > bitmap_size)
+        /* Only whole elements are ever marked free. */
+        if (start_block + request_blocks > BITMAP_INDEX(bitmap_size) * BITMAP_DENSITY)
             return BITMAP_NOT_FOUND;
-        uint hole_size = 0;
-        while (hole_size < request_blocks && bitmap_test(b, start_block + hole_size)) {
-            hole_size++;
-        }
-        if (hole_size == request_blocks)
-            res = start_block;
-        else
+        if (!bitmap_are_set_blocks(b, start_block, request_blocks))
             return BITMAP_NOT_FOUND;
+        res = start_block;
     } else if (request_blocks == 1) {
-        res = bitmap_find_set_block(b, bitmap_size);
+        res = bitmap_find_set_block(b, summary, bitmap_size);
     } else {
-        res = bitmap_find_set_block_sequence(b, bitmap_size, request_blocks);
+        res = bitmap_find_set_block_sequence(b, summary, bitmap_size, request_blocks);
     }
     if (res == BITMAP_NOT_FOUND)
         return BITMAP_NOT_FOUND;
-    i = res;
-    do {
-        bitmap_clear(b, i++);
-    } while (--request_blocks);
+    bitmap_update_blocks(b, summary, res, request_blocks, false /*clear*/);
     return res;
 }
 
 void
-bitmap_free_blocks(bitmap_t b, uint bitmap_size, uint first_block, uint num_free)
+bitmap_free_blocks(bitmap_t b, bitmap_t summary, uint bitmap_size, uint first_block,
+                   uint num_free)
 {
     ASSERT(first_block + num_free <= bitmap_size);
-    do {
-        ASSERT(!bitmap_test(b, first_block));
-        bitmap_set(b, first_block++);
-    } while (--num_free);
+    bitmap_update_blocks(b, summary, first_block, num_free, true /*set*/);
 }
 
 #ifdef DEBUG
@@ -1598,13 +1684,16 @@ bitmap_count_set_bits(bitmap_element_t x)
 }
 
 bool
-bitmap_check_consistency(bitmap_t b, uint bitmap_size, uint expect_free)
+bitmap_check_consistency(bitmap_t b, bitmap_t summary, uint bitmap_size,
+                         uint expect_free)
 {
     uint last_index = BITMAP_INDEX(bitmap_size);
     uint i;
     uint current = 0;
     for (i = 0; i < last_index; i++) {
         current += bitmap_count_set_bits(b[i]);
+        if ((b[i] != 0) != bitmap_test(summary, i))
+            return false;
     }
 
     LOG(GLOBAL, LOG_HEAP, 3,
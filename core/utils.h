@@ -1154,14 +1154,23 @@ bitmap_clear(bitmap_t b, uint i)
     b[BITMAP_INDEX(i)] &= ~BITMAP_MASK(i);
 }
 
+/* A block bitmap is paired with a summary bitmap holding one bit per element of
+ * the block bitmap, set iff that element has any free block, so that searches can
+ * skip over fully allocated elements a whole summary element at a time.
+ * The summary needs BITMAP_SUMMARY_ELEMENTS(bitmap_size) elements.
+ */
+#define BITMAP_SUMMARY_ELEMENTS(bitmap_size) \
+    BITMAP_INDEX(BITMAP_INDEX(bitmap_size) + BITMAP_DENSITY - 1)
+
 /* bitmap_size is number of bits in the bitmap_t */
 void
-bitmap_initialize_free(bitmap_t b, uint bitmap_size);
+bitmap_initialize_free(bitmap_t b, bitmap_t summary, uint bitmap_size);
 uint
-bitmap_allocate_blocks(bitmap_t b, uint bitmap_size, uint request_blocks,
-                       uint start_block);
+bitmap_allocate_blocks(bitmap_t b, bitmap_t summary, uint bitmap_size,
+                       uint request_blocks, uint start_block);
 void
-bitmap_free_blocks(bitmap_t b, uint bitmap_size, uint first_block, uint num_free);
+bitmap_free_blocks(bitmap_t b, bitmap_t summary, uint bitmap_size, uint first_block,
+                   uint num_free);
 
 #ifdef DEBUG
 /* used only for ASSERTs */
@@ -1169,7 +1178,8 @@ bool
 bitmap_are_reserved_blocks(bitmap_t b, uint bitmap_size, uint first_block,
                            uint num_blocks);
 bool
-bitmap_check_consistency(bitmap_t b, uint bitmap_size, uint expect_free);
+bitmap_check_consistency(bitmap_t b, bitmap_t summary, uint bitmap_size,
+                         uint expect_free);
 #endif /* DEBUG */
 
 /* logging functions */
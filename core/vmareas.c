@@ -209,6 +209,35 @@ typedef struct vm_area_t {
     } custom;
 } vm_area_t;
 
+/* The B-tree used by VECTOR_BTREE vectors.  Leaves hold the areas themselves, in
+ * order.  An internal node records for each child the start of its first area, for
+ * searching by address, and the number of areas under it, for finding the area at a
+ * given index.  Every node but the root is at least half full.
+ */
+#define VM_AREA_BTREE_ENTRIES 32
+#define VM_AREA_BTREE_MIN_ENTRIES (VM_AREA_BTREE_ENTRIES / 2)
+
+typedef struct vm_area_node_t {
+    int count; /* areas in a leaf, children in an internal node */
+    union {
+        vm_area_t area[VM_AREA_BTREE_ENTRIES];
+        struct {
+            app_pc start[VM_AREA_BTREE_ENTRIES];
+            int length[VM_AREA_BTREE_ENTRIES];
+            struct vm_area_node_t *child[VM_AREA_BTREE_ENTRIES];
+        } in;
+    } u;
+} vm_area_node_t;
+
+static vm_area_t *
+vm_area_btree_at(vm_area_vector_t *v, int i);
+
+/* The i-th area of v.  N.B.: like the pointers returned by binary_search(), this is
+ * only valid until v is next modified.
+ */
+#define VM_AREA(v, i) \
+    (TEST(VECTOR_BTREE, (v)->flags) ? vm_area_btree_at((v), (i)) : &(v)->buf[(i)])
+
 /* for each thread we record all executable areas, to make it faster
  * to decide whether we need to flush any fragments on an munmap
  */
@@ -794,7 +823,7 @@ print_vm_areas(vm_area_vector_t *v, file_t outf)
     int i;
     ASSERT_VMAREA_VECTOR_PROTECTED(v, READWRITE);
     for (i = 0; i < v->length; i++) {
-        print_vm_area(v, &v->buf[i], outf, "  ");
+        print_vm_area(v, VM_AREA(v, i), outf, "  ");
     }
 }
 
@@ -865,6 +894,380 @@ vm_area_vector_check_size(vm_area_vector_t *v)
     }
 }
 
+/* Allocates enough spare nodes for any one insertion into v: a split at each level
+ * plus a new root.  This must be done before the tree is touched, as for
+ * dynamo_areas an allocation can create a new heap unit, which is added to this
+ * same vector.  Such a nested insertion sees a consistent tree and may use up
+ * spares, so we re-check until there are enough.
+ */
+static void
+vm_area_btree_reserve_nodes(vm_area_vector_t *v)
+{
+    while (v->num_spare_nodes < (v->tree == NULL ? 1 : v->tree_height + 2)) {
+        vm_area_node_t *node = (vm_area_node_t *)global_heap_alloc(
+            sizeof(vm_area_node_t) HEAPACCT(ACCT_VMAREAS));
+        node->u.in.child[0] = v->spare_nodes;
+        v->spare_nodes = node;
+        v->num_spare_nodes++;
+    }
+}
+
+/* Takes a node from those set aside by vm_area_btree_reserve_nodes() */
+static vm_area_node_t *
+vm_area_btree_new_node(vm_area_vector_t *v)
+{
+    vm_area_node_t *node = v->spare_nodes;
+    ASSERT(node != NULL && v->num_spare_nodes > 0);
+    v->spare_nodes = node->u.in.child[0];
+    v->num_spare_nodes--;
+    node->count = 0;
+    return node;
+}
+
+static void
+vm_area_btree_free(vm_area_node_t *node, int height)
+{
+    int c;
+    if (height > 0) {
+        for (c = 0; c < node->count; c++)
+            vm_area_btree_free(node->u.in.child[c], height - 1);
+    }
+    global_heap_free(node, sizeof(vm_area_node_t) HEAPACCT(ACCT_VMAREAS));
+}
+
+/* Returns the number of areas under node, which has height levels below it */
+static int
+vm_area_btree_length(vm_area_node_t *node, int height)
+{
+    int c, length = 0;
+    if (height == 0)
+        return node->count;
+    for (c = 0; c < node->count; c++)
+        length += node->u.in.length[c];
+    return length;
+}
+
+static app_pc
+vm_area_btree_start(vm_area_node_t *node, int height)
+{
+    ASSERT(node->count > 0);
+    return height == 0 ? node->u.area[0].start : node->u.in.start[0];
+}
+
+/* Refreshes what internal node records about its c-th child */
+static void
+vm_area_btree_update_child(vm_area_node_t *node, int height, int c)
+{
+    node->u.in.start[c] = vm_area_btree_start(node->u.in.child[c], height - 1);
+    node->u.in.length[c] = vm_area_btree_length(node->u.in.child[c], height - 1);
+}
+
+/* Moves num entries between two nodes of the given height, or within one node */
+static void
+vm_area_btree_move(vm_area_node_t *dst, int dst_idx, vm_area_node_t *src, int src_idx,
+                   int num, int height)
+{
+    if (num <= 0)
+        return;
+    if (height == 0) {
+        memmove(&dst->u.area[dst_idx], &src->u.area[src_idx], num * sizeof(vm_area_t));
+    } else {
+        memmove(&dst->u.in.start[dst_idx], &src->u.in.start[src_idx],
+                num * sizeof(app_pc));
+        memmove(&dst->u.in.length[dst_idx], &src->u.in.length[src_idx],
+                num * sizeof(int));
+        memmove(&dst->u.in.child[dst_idx], &src->u.in.child[src_idx],
+                num * sizeof(vm_area_node_t *));
+    }
+}
+
+/* Returns the child of internal node holding the *idx-th area under node, and
+ * makes *idx relative to that child.  When inserting, an index just past the end
+ * of a child selects that child.
+ */
+static int
+vm_area_btree_child(vm_area_node_t *node, int *idx, bool insert)
+{
+    int c;
+    for (c = 0; c < node->count - 1; c++) {
+        int length = node->u.in.length[c];
+        if (*idx < length || (insert && *idx == length))
+            break;
+        *idx -= length;
+    }
+    return c;
+}
+
+static vm_area_t *
+vm_area_btree_at(vm_area_vector_t *v, int i)
+{
+    vm_area_node_t *node = v->tree;
+    int height;
+    ASSERT(i >= 0 && i < v->length);
+    for (height = v->tree_height; height > 0; height--)
+        node = node->u.in.child[vm_area_btree_child(node, &i, false)];
+    return &node->u.area[i];
+}
+
+/* Returns the index of the last area in v that starts at or before pc, or -1 */
+static int
+vm_area_btree_last_start(vm_area_vector_t *v, app_pc pc)
+{
+    vm_area_node_t *node = v->tree;
+    int height, c, i, base = 0;
+    if (node == NULL)
+        return -1;
+    for (height = v->tree_height; height > 0; height--) {
+        for (c = node->count - 1; c > 0 && node->u.in.start[c] > pc; c--)
+            ; /* nothing */
+        for (i = 0; i < c; i++)
+            base += node->u.in.length[i];
+        node = node->u.in.child[c];
+    }
+    for (c = node->count - 1; c >= 0 && node->u.area[c].start > pc; c--)
+        ; /* nothing */
+    return base + c;
+}
+
+/* Inserts area as the idx-th area under node, splitting node if it is full.
+ * Returns the new right half of node if it was split, else NULL.
+ */
+static vm_area_node_t *
+vm_area_btree_insert(vm_area_vector_t *v, vm_area_node_t *node, int height, int idx,
+                     vm_area_t *area)
+{
+    vm_area_node_t *split = NULL, *new_child = NULL;
+    if (height > 0) {
+        int c = vm_area_btree_child(node, &idx, true);
+        new_child =
+            vm_area_btree_insert(v, node->u.in.child[c], height - 1, idx, area);
+        vm_area_btree_update_child(node, height, c);
+        if (new_child == NULL)
+            return NULL;
+        idx = c + 1;
+    }
+    if (node->count == VM_AREA_BTREE_ENTRIES) {
+        split = vm_area_btree_new_node(v);
+        split->count = VM_AREA_BTREE_ENTRIES - VM_AREA_BTREE_MIN_ENTRIES;
+        node->count = VM_AREA_BTREE_MIN_ENTRIES;
+        vm_area_btree_move(split, 0, node, node->count, split->count, height);
+        if (idx > node->count) {
+            idx -= node->count;
+            node = split;
+        }
+    }
+    vm_area_btree_move(node, idx + 1, node, idx, node->count - idx, height);
+    node->count++;
+    if (height == 0)
+        node->u.area[idx] = *area;
+    else {
+        node->u.in.child[idx] = new_child;
+        vm_area_btree_update_child(node, height, idx);
+    }
+    return split;
+}
+
+/* Refills the c-th child of internal node, which has become less than half full,
+ * from a sibling: the two are merged if they fit in one node, else their entries
+ * are split evenly between them.
+ */
+static void
+vm_area_btree_rebalance(vm_area_node_t *node, int height, int c)
+{
+    int l = (c > 0) ? c - 1 : c;
+    vm_area_node_t *left = node->u.in.child[l];
+    vm_area_node_t *right = node->u.in.child[l + 1];
+    int total = left->count + right->count;
+    ASSERT(l + 1 < node->count);
+    if (total <= VM_AREA_BTREE_ENTRIES) {
+        vm_area_btree_move(left, left->count, right, 0, right->count, height - 1);
+        left->count = total;
+        global_heap_free(right, sizeof(vm_area_node_t) HEAPACCT(ACCT_VMAREAS));
+        vm_area_btree_move(node, l + 1, node, l + 2, node->count - l - 2, height);
+        node->count--;
+    } else {
+        int num = total / 2;
+        if (left->count > num) {
+            int shift = left->count - num;
+            vm_area_btree_move(right, shift, right, 0, right->count, height - 1);
+            vm_area_btree_move(right, 0, left, num, shift, height - 1);
+        } else {
+            int shift = num - left->count;
+            vm_area_btree_move(left, left->count, right, 0, shift, height - 1);
+            vm_area_btree_move(right, 0, right, shift, right->count - shift,
+                               height - 1);
+        }
+        left->count = num;
+        right->count = total - num;
+        vm_area_btree_update_child(node, height, l + 1);
+    }
+    vm_area_btree_update_child(node, height, l);
+}
+
+/* Removes the idx-th area under node.  Returns whether node is left less than
+ * half full.
+ */
+static bool
+vm_area_btree_remove(vm_area_node_t *node, int height, int idx)
+{
+    if (height == 0)
+        vm_area_btree_move(node, idx, node, idx + 1, node->count - idx - 1, height);
+    else {
+        int c = vm_area_btree_child(node, &idx, false);
+        if (!vm_area_btree_remove(node->u.in.child[c], height - 1, idx)) {
+            vm_area_btree_update_child(node, height, c);
+            return false;
+        }
+        vm_area_btree_rebalance(node, height, c);
+        return node->count < VM_AREA_BTREE_MIN_ENTRIES;
+    }
+    node->count--;
+    return node->count < VM_AREA_BTREE_MIN_ENTRIES;
+}
+
+/* Refreshes the starts recorded on the path to the idx-th area under node */
+static void
+vm_area_btree_refresh(vm_area_node_t *node, int height, int idx)
+{
+    if (height > 0) {
+        int c = vm_area_btree_child(node, &idx, false);
+        vm_area_btree_refresh(node->u.in.child[c], height - 1, idx);
+        node->u.in.start[c] = vm_area_btree_start(node->u.in.child[c], height - 1);
+    }
+}
+
+/* The equivalent of binary_search() for a VECTOR_BTREE vector, except that the
+ * area returned is always the first overlapping one.
+ */
+static bool
+vm_area_btree_search(vm_area_vector_t *v, app_pc start, app_pc end,
+                     vm_area_t **area /*OUT*/, int *index /*OUT*/)
+{
+    /* Only the last area starting at or before start, or the one after it, can be
+     * the first to overlap start..end.
+     */
+    int i = vm_area_btree_last_start(v, start);
+    int found = -1;
+    if (start == end) {
+        /* never a match, but *index must precede the empty range */
+        if (i >= 0 && VM_AREA(v, i)->start == start)
+            i--;
+    } else if (i >= 0 && VM_AREA(v, i)->end > start)
+        found = i;
+    else if (i + 1 < v->length && (end == NULL || VM_AREA(v, i + 1)->start < end))
+        found = i + 1;
+    if (found == -1) {
+        if (index != NULL)
+            *index = i;
+        return false;
+    }
+    if (area != NULL)
+        *area = VM_AREA(v, found);
+    if (index != NULL)
+        *index = found;
+    return true;
+}
+
+/* Inserts a copy of area as the i-th area of v */
+static void
+vm_area_vector_insert(vm_area_vector_t *v, int i, vm_area_t *area)
+{
+    if (TEST(VECTOR_BTREE, v->flags)) {
+        vm_area_node_t *split;
+        vm_area_btree_reserve_nodes(v);
+        if (v->tree == NULL) {
+            v->tree = vm_area_btree_new_node(v);
+            v->tree_height = 0;
+        }
+        split = vm_area_btree_insert(v, v->tree, v->tree_height, i, area);
+        if (split != NULL) {
+            vm_area_node_t *root = vm_area_btree_new_node(v);
+            root->count = 2;
+            root->u.in.child[0] = v->tree;
+            root->u.in.child[1] = split;
+            v->tree_height++;
+            vm_area_btree_update_child(root, v->tree_height, 0);
+            vm_area_btree_update_child(root, v->tree_height, 1);
+            v->tree = root;
+        }
+    } else {
+        int j;
+        vm_area_vector_check_size(v);
+        /* shift subsequent entries */
+        for (j = v->length; j > i; j--)
+            v->buf[j] = v->buf[j - 1];
+        v->buf[i] = *area;
+    }
+    v->length++;
+}
+
+/* Removes num areas from v starting with the i-th */
+static void
+vm_area_vector_remove(vm_area_vector_t *v, int i, int num)
+{
+    int j;
+    ASSERT(i >= 0 && num >= 0 && i + num <= v->length);
+    if (TEST(VECTOR_BTREE, v->flags)) {
+        for (j = 0; j < num; j++) {
+            vm_area_node_t *root = v->tree;
+            vm_area_btree_remove(root, v->tree_height, i);
+            if (v->tree_height > 0 && root->count == 1) {
+                v->tree = root->u.in.child[0];
+                v->tree_height--;
+                global_heap_free(root, sizeof(vm_area_node_t) HEAPACCT(ACCT_VMAREAS));
+            } else if (root->count == 0) {
+                vm_area_btree_free(root, v->tree_height);
+                v->tree = NULL;
+            }
+        }
+    } else {
+        for (j = i; j < v->length - num; j++)
+            v->buf[j] = v->buf[j + num];
+#ifdef DEBUG
+        memset(v->buf + v->length - num, 0, num * sizeof(vm_area_t));
+#endif
+    }
+    v->length -= num;
+}
+
+/* Must be called after moving the start of the i-th area of v */
+static void
+vm_area_vector_start_changed(vm_area_vector_t *v, int i)
+{
+    if (TEST(VECTOR_BTREE, v->flags))
+        vm_area_btree_refresh(v->tree, v->tree_height, i);
+}
+
+/* Returns the index of the first area in v that ends at or after pc, or v->length.
+ * No earlier area can overlap or be adjacent to a region starting at pc.
+ */
+static int
+vm_area_first_from(vm_area_vector_t *v, app_pc pc)
+{
+    int min, max;
+    if (TEST(VECTOR_BTREE, v->flags)) {
+        min = vm_area_btree_last_start(v, pc);
+        if (min < 0)
+            return 0;
+        if (VM_AREA(v, min)->end < pc)
+            return min + 1;
+        /* the previous area can end right at pc */
+        if (min > 0 && VM_AREA(v, min - 1)->end >= pc)
+            return min - 1;
+        return min;
+    }
+    min = 0;
+    max = v->length;
+    while (min < max) {
+        int i = (min + max) / 2;
+        if (v->buf[i].end < pc)
+            min = i + 1;
+        else
+            max = i;
+    }
+    return min;
+}
+
 static void
 vm_area_merge_fraglists(vm_area_t *dst, vm_area_t *src)
 {
@@ -916,7 +1319,7 @@ static void
 add_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, uint vm_flags, uint frag_flags,
             void *data _IF_DEBUG(const char *comment))
 {
-    int i, j, diff;
+    int i;
     /* if we have overlap, we extend an existing area -- else we add a new area */
     int overlap_start = -1, overlap_end = -1;
     DEBUG_DECLARE(uint flagignore;)
@@ -932,19 +1335,20 @@ add_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, uint vm_flags, uint f
                                       : (v == dynamo_areas ? " dynamo_areas" : ""))),
         start, end, comment);
     /* N.B.: new area could span multiple existing areas! */
-    for (i = 0; i < v->length; i++) {
+    for (i = vm_area_first_from(v, start); i < v->length; i++) {
+        vm_area_t *area = VM_AREA(v, i);
         /* look for overlap, or adjacency of same type (including all flags, and never
          * merge adjacent if keeping write counts)
          */
-        if ((start < v->buf[i].end && end > v->buf[i].start) ||
-            (start <= v->buf[i].end && end >= v->buf[i].start &&
-             vm_flags == v->buf[i].vm_flags && frag_flags == v->buf[i].frag_flags &&
+        if ((start < area->end && end > area->start) ||
+            (start <= area->end && end >= area->start && vm_flags == area->vm_flags &&
+             frag_flags == area->frag_flags &&
              /* never merge coarse-grain */
-             !TEST(FRAG_COARSE_GRAIN, v->buf[i].frag_flags) &&
+             !TEST(FRAG_COARSE_GRAIN, area->frag_flags) &&
              !TEST(VECTOR_NEVER_MERGE_ADJACENT, v->flags) &&
              (v->should_merge_func == NULL ||
-              v->should_merge_func(true /*adjacent*/, data, v->buf[i].custom.client)))) {
-            ASSERT(!(start < v->buf[i].end && end > v->buf[i].start) ||
+              v->should_merge_func(true /*adjacent*/, data, area->custom.client)))) {
+            ASSERT(!(start < area->end && end > area->start) ||
                    !TEST(VECTOR_NEVER_OVERLAP, v->flags));
             if (overlap_start == -1) {
                 /* assume we'll simply expand an existing area rather than
@@ -959,9 +1363,8 @@ add_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, uint vm_flags, uint f
                     "==================================================\n"
                     "add_vm_area " PFX "-" PFX " %s %x-%x overlaps " PFX "-" PFX
                     " %s %x-%x\n",
-                    start, end, comment, vm_flags, frag_flags, v->buf[i].start,
-                    v->buf[i].end, v->buf[i].comment, v->buf[i].vm_flags,
-                    v->buf[i].frag_flags);
+                    start, end, comment, vm_flags, frag_flags, area->start, area->end,
+                    area->comment, area->vm_flags, area->frag_flags);
                 print_vm_areas(v, GLOBAL);
                 /* rank order problem if holding heap_unit_lock, so only print
                  * if not holding a lock for v right now, though ok to print
@@ -986,34 +1389,31 @@ add_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, uint vm_flags, uint f
              * not was future and old region is then should drop from old
              * region FIXME : partial overlap? we don't really care about
              * this flag anyways */
-            if (TEST(VM_WAS_FUTURE, v->buf[i].vm_flags) &&
-                !TEST(VM_WAS_FUTURE, vm_flags)) {
-                v->buf[i].vm_flags &= ~VM_WAS_FUTURE;
+            if (TEST(VM_WAS_FUTURE, area->vm_flags) && !TEST(VM_WAS_FUTURE, vm_flags)) {
+                area->vm_flags &= ~VM_WAS_FUTURE;
                 LOG(GLOBAL, LOG_VMAREAS, 1,
                     "Warning : removing was_future flag from area " PFX "-" PFX
                     " %s that overlaps new area " PFX "-" PFX " %s\n",
-                    v->buf[i].start, v->buf[i].end, v->buf[i].comment, start, end,
-                    comment);
+                    area->start, area->end, area->comment, start, end, comment);
             }
             /* no restrictions on ONCE_ONLY flag, but if new region is not
              * should drop fom existing region FIXME : partial overlap? is
              * not much of an additional security risk */
-            if (TEST(VM_ONCE_ONLY, v->buf[i].vm_flags) && !TEST(VM_ONCE_ONLY, vm_flags)) {
-                v->buf[i].vm_flags &= ~VM_ONCE_ONLY;
+            if (TEST(VM_ONCE_ONLY, area->vm_flags) && !TEST(VM_ONCE_ONLY, vm_flags)) {
+                area->vm_flags &= ~VM_ONCE_ONLY;
                 LOG(GLOBAL, LOG_VMAREAS, 1,
                     "Warning : removing once_only flag from area " PFX "-" PFX
                     " %s that overlaps new area " PFX "-" PFX " %s\n",
-                    v->buf[i].start, v->buf[i].end, v->buf[i].comment, start, end,
-                    comment);
+                    area->start, area->end, area->comment, start, end, comment);
             }
             /* shouldn't be adding unmod image over existing not unmod image,
              * reverse could happen with os region merging though */
-            ASSERT(TEST(VM_UNMOD_IMAGE, v->buf[i].vm_flags) ||
+            ASSERT(TEST(VM_UNMOD_IMAGE, area->vm_flags) ||
                    !TEST(VM_UNMOD_IMAGE, vm_flags));
             /* for VM_WRITABLE only allow new region to not be writable and
              * existing region to be writable to handle cases of os region
              * merging due to our consistency protection changes */
-            ASSERT(TEST(VM_WRITABLE, v->buf[i].vm_flags) ||
+            ASSERT(TEST(VM_WRITABLE, area->vm_flags) ||
                    !TEST(VM_WRITABLE, vm_flags) ||
                    !INTERNAL_OPTION(hw_cache_consistency));
             /* FIXME: case 7877: if new is VM_MADE_READONLY and old is not, we
@@ -1037,48 +1437,46 @@ add_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, uint vm_flags, uint f
 #ifdef PROGRAM_SHEPHERDING
             DODEBUG({ flagignore = flagignore | VM_PATTERN_REVERIFY; });
 #endif
-            ASSERT((v->buf[i].vm_flags & ~flagignore) == (vm_flags & ~flagignore));
+            ASSERT((area->vm_flags & ~flagignore) == (vm_flags & ~flagignore));
 
             /* new region must be more innocent with respect to selfmod */
-            ASSERT(TEST(FRAG_SELFMOD_SANDBOXED, v->buf[i].frag_flags) ||
+            ASSERT(TEST(FRAG_SELFMOD_SANDBOXED, area->frag_flags) ||
                    !TEST(FRAG_SELFMOD_SANDBOXED, frag_flags));
             /* disallow other frag_flag differences */
 #ifndef PROGRAM_SHEPHERDING
-            ASSERT((v->buf[i].frag_flags & ~FRAG_SELFMOD_SANDBOXED) ==
+            ASSERT((area->frag_flags & ~FRAG_SELFMOD_SANDBOXED) ==
                    (frag_flags & ~FRAG_SELFMOD_SANDBOXED));
 #else
 #    ifdef DGC_DIAGNOSTICS
             /* FIXME : no restrictions on differing FRAG_DYNGEN_RESTRICTED
              * flags? */
-            ASSERT((v->buf[i].frag_flags &
+            ASSERT((area->frag_flags &
                     ~(FRAG_SELFMOD_SANDBOXED | FRAG_DYNGEN | FRAG_DYNGEN_RESTRICTED)) ==
                    (frag_flags &
                     ~(FRAG_SELFMOD_SANDBOXED | FRAG_DYNGEN | FRAG_DYNGEN_RESTRICTED)));
 #    else
-            ASSERT((v->buf[i].frag_flags & ~(FRAG_SELFMOD_SANDBOXED | FRAG_DYNGEN)) ==
+            ASSERT((area->frag_flags & ~(FRAG_SELFMOD_SANDBOXED | FRAG_DYNGEN)) ==
                    (frag_flags & ~(FRAG_SELFMOD_SANDBOXED | FRAG_DYNGEN)));
 #    endif
             /* shouldn't add non-dyngen overlapping existing dyngen, FIXME
              * is the reverse possible? right now we allow it */
-            ASSERT(TEST(FRAG_DYNGEN, frag_flags) ||
-                   !TEST(FRAG_DYNGEN, v->buf[i].frag_flags));
+            ASSERT(TEST(FRAG_DYNGEN, frag_flags) || !TEST(FRAG_DYNGEN, area->frag_flags));
 #endif
             /* Never split FRAG_COARSE_GRAIN */
             ASSERT(TEST(FRAG_COARSE_GRAIN, frag_flags) ||
-                   !TEST(FRAG_COARSE_GRAIN, v->buf[i].frag_flags));
+                   !TEST(FRAG_COARSE_GRAIN, area->frag_flags));
 
             /* for overlapping region: must overlap same type -- else split */
-            if ((vm_flags != v->buf[i].vm_flags || frag_flags != v->buf[i].frag_flags) &&
+            if ((vm_flags != area->vm_flags || frag_flags != area->frag_flags) &&
                 (v->should_merge_func == NULL ||
                  !v->should_merge_func(false /*not adjacent*/, data,
-                                       v->buf[i].custom.client))) {
+                                       area->custom.client))) {
                 LOG(GLOBAL, LOG_VMAREAS, 1,
                     "add_vm_area " PFX "-" PFX " %s vm_flags=0x%08x "
                     "frag_flags=0x%08x\n  overlaps diff type " PFX "-" PFX " %s"
                     "vm_flags=0x%08x frag_flags=0x%08x\n  in vect at " PFX "\n",
-                    start, end, comment, vm_flags, frag_flags, v->buf[i].start,
-                    v->buf[i].end, v->buf[i].comment, v->buf[i].vm_flags,
-                    v->buf[i].frag_flags, v);
+                    start, end, comment, vm_flags, frag_flags, area->start, area->end,
+                    area->comment, area->vm_flags, area->frag_flags, v);
                 LOG(GLOBAL, LOG_VMAREAS, 3,
                     "before splitting b/c adding " PFX "-" PFX ":\n", start, end);
                 DOLOG(3, LOG_VMAREAS, { print_vm_areas(v, GLOBAL); });
@@ -1090,23 +1488,25 @@ add_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, uint vm_flags, uint f
                  * since we never split the old region, we don't need to worry
                  * about splitting its frags list.
                  */
-                if (start < v->buf[i].start) {
-                    if (end > v->buf[i].end) {
+                if (start < area->start) {
+                    if (end > area->end) {
                         void *add_data = data;
                         /* need two areas, one for either side */
                         LOG(GLOBAL, LOG_VMAREAS, 3,
-                            "=> will add " PFX "-" PFX " after i\n", v->buf[i].end, end);
+                            "=> will add " PFX "-" PFX " after i\n", area->end, end);
                         /* safe to recurse here, new area will be after the area
                          * we are currently looking at in the vector */
                         if (v->split_payload_func != NULL)
                             add_data = v->split_payload_func(data);
-                        add_vm_area(v, v->buf[i].end, end, vm_flags, frag_flags,
+                        add_vm_area(v, area->end, end, vm_flags, frag_flags,
                                     add_data _IF_DEBUG(comment));
+                        /* the vector has changed under area */
+                        area = VM_AREA(v, i);
                     }
                     /* if had been merging, let this routine finish that off -- else,
                      * need to add a new area
                      */
-                    end = v->buf[i].start;
+                    end = area->start;
                     if (overlap_start == i) {
                         /* no merging */
                         overlap_start = -1;
@@ -1115,14 +1515,14 @@ add_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, uint vm_flags, uint f
                         "=> will add/merge " PFX "-" PFX " before i\n", start, end);
                     overlap_end = i;
                     break;
-                } else if (end > v->buf[i].end) {
+                } else if (end > area->end) {
                     /* shift area of consideration to end of i, and keep going,
                      * can't act now since don't know areas overlapping beyond i
                      */
                     LOG(GLOBAL, LOG_VMAREAS, 3,
                         "=> ignoring " PFX "-" PFX ", only adding " PFX "-" PFX "\n",
-                        start, v->buf[i].end, v->buf[i].end, end);
-                    start = v->buf[i].end;
+                        start, area->end, area->end, end);
+                    start = area->end;
                     /* reset overlap vars */
                     ASSERT(overlap_start <= i);
                     overlap_start = -1;
@@ -1131,14 +1531,14 @@ add_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, uint vm_flags, uint f
                     LOG(GLOBAL, LOG_VMAREAS, 3,
                         "=> ignoring " PFX "-" PFX ", forcing to be part of " PFX "-" PFX
                         "\n",
-                        start, end, v->buf[i].start, v->buf[i].end);
+                        start, end, area->start, area->end);
                 }
                 ASSERT(end > start);
             }
         } else if (overlap_start > -1) {
             overlap_end = i; /* not inclusive */
             break;
-        } else if (end <= v->buf[i].start)
+        } else if (end <= area->start)
             break;
     }
 
@@ -1155,24 +1555,20 @@ add_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, uint vm_flags, uint f
 #endif
         new_area.custom.client = data;
         LOG(GLOBAL, LOG_VMAREAS, 3, "=> adding " PFX "-" PFX "\n", start, end);
-        vm_area_vector_check_size(v);
-        /* shift subsequent entries */
-        for (j = v->length; j > i; j--)
-            v->buf[j] = v->buf[j - 1];
-        v->buf[i] = new_area;
+        vm_area_vector_insert(v, i, &new_area);
         /* assumption: no overlaps between areas in list! */
 #ifdef DEBUG
-        if (!((i == 0 || v->buf[i - 1].end <= v->buf[i].start) &&
-              (i == v->length || v->buf[i].end <= v->buf[i + 1].start))) {
+        if (!((i == 0 || VM_AREA(v, i - 1)->end <= VM_AREA(v, i)->start) &&
+              (i == v->length - 1 ||
+               VM_AREA(v, i)->end <= VM_AREA(v, i + 1)->start))) {
             LOG(GLOBAL, LOG_VMAREAS, 1,
                 "ERROR: add_vm_area illegal overlap " PFX " " PFX " %s\n", start, end,
                 comment);
             print_vm_areas(v, GLOBAL);
         }
 #endif
-        ASSERT((i == 0 || v->buf[i - 1].end <= v->buf[i].start) &&
-               (i == v->length || v->buf[i].end <= v->buf[i + 1].start));
-        v->length++;
+        ASSERT((i == 0 || VM_AREA(v, i - 1)->end <= VM_AREA(v, i)->start) &&
+               (i == v->length - 1 || VM_AREA(v, i)->end <= VM_AREA(v, i + 1)->start));
         STATS_TRACK_MAX(max_vmareas_length, v->length);
         DOSTATS({
             if (v == dynamo_areas)
@@ -1194,39 +1590,42 @@ add_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, uint vm_flags, uint f
         if (overlap_end == -1)
             overlap_end = v->length;
         LOG(GLOBAL, LOG_VMAREAS, 3, "=> changing " PFX "-" PFX,
-            v->buf[overlap_start].start, v->buf[overlap_start].end);
-        if (start < v->buf[overlap_start].start)
-            v->buf[overlap_start].start = start;
-        if (end > v->buf[overlap_end - 1].end)
-            v->buf[overlap_start].end = end;
+            VM_AREA(v, overlap_start)->start, VM_AREA(v, overlap_start)->end);
+        if (start < VM_AREA(v, overlap_start)->start) {
+            VM_AREA(v, overlap_start)->start = start;
+            vm_area_vector_start_changed(v, overlap_start);
+        }
+        if (end > VM_AREA(v, overlap_end - 1)->end)
+            VM_AREA(v, overlap_start)->end = end;
         else
-            v->buf[overlap_start].end = v->buf[overlap_end - 1].end;
+            VM_AREA(v, overlap_start)->end = VM_AREA(v, overlap_end - 1)->end;
         if (v->merge_payload_func != NULL) {
-            v->buf[overlap_start].custom.client =
-                v->merge_payload_func(data, v->buf[overlap_start].custom.client);
+            VM_AREA(v, overlap_start)->custom.client =
+                v->merge_payload_func(data, VM_AREA(v, overlap_start)->custom.client);
         } else if (v->free_payload_func != NULL) {
             /* if a merge exists we assume it will free if necessary */
-            v->free_payload_func(v->buf[overlap_start].custom.client);
+            v->free_payload_func(VM_AREA(v, overlap_start)->custom.client);
         }
-        LOG(GLOBAL, LOG_VMAREAS, 3, " to " PFX "-" PFX "\n", v->buf[overlap_start].start,
-            v->buf[overlap_start].end);
+        LOG(GLOBAL, LOG_VMAREAS, 3, " to " PFX "-" PFX "\n",
+            VM_AREA(v, overlap_start)->start, VM_AREA(v, overlap_start)->end);
         /* when merge, use which comment?  could combine them all
          * FIXME
          */
         /* now delete */
         for (i = overlap_start + 1; i < overlap_end; i++) {
             LOG(GLOBAL, LOG_VMAREAS, 3, "=> completely removing " PFX "-" PFX " %s\n",
-                v->buf[i].start, v->buf[i].end, v->buf[i].comment);
+                VM_AREA(v, i)->start, VM_AREA(v, i)->end, VM_AREA(v, i)->comment);
 #ifdef DEBUG
-            global_heap_free(v->buf[i].comment,
-                             strlen(v->buf[i].comment) + 1 HEAPACCT(ACCT_VMAREAS));
+            global_heap_free(VM_AREA(v, i)->comment,
+                             strlen(VM_AREA(v, i)->comment) + 1 HEAPACCT(ACCT_VMAREAS));
 #endif
             if (v->merge_payload_func != NULL) {
-                v->buf[overlap_start].custom.client = v->merge_payload_func(
-                    v->buf[overlap_start].custom.client, v->buf[i].custom.client);
+                VM_AREA(v, overlap_start)->custom.client =
+                    v->merge_payload_func(VM_AREA(v, overlap_start)->custom.client,
+                                          VM_AREA(v, i)->custom.client);
             } else if (v->free_payload_func != NULL) {
                 /* if a merge exists we assume it will free if necessary */
-                v->free_payload_func(v->buf[i].custom.client);
+                v->free_payload_func(VM_AREA(v, i)->custom.client);
             }
             /* See the XXX comment in remove_vm_area about using a free_payload_func.
              * Here we have to handle ld.so using an initial +rx map which triggers
@@ -1238,7 +1637,7 @@ add_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, uint vm_flags, uint f
              * first-execution or something.)
              */
             if (v == executable_areas) {
-                coarse_info_t *info = (coarse_info_t *)v->buf[i].custom.client;
+                coarse_info_t *info = (coarse_info_t *)VM_AREA(v, i)->custom.client;
                 if (info != NULL) {
                     /* Should be un-executed from, and thus requires no reset and
                      * thus no complex delayed deletion via coarse_to_delete.
@@ -1254,19 +1653,17 @@ add_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, uint vm_flags, uint f
              * vm_area_clean_fraglist() on each merge, but we could then get
              * rid of VECTOR_FRAGMENT_LIST.
              */
-            if (TEST(VECTOR_FRAGMENT_LIST, v->flags) && v->buf[i].custom.frags != NULL)
-                vm_area_merge_fraglists(&v->buf[overlap_start], &v->buf[i]);
+            if (TEST(VECTOR_FRAGMENT_LIST, v->flags) &&
+                VM_AREA(v, i)->custom.frags != NULL)
+                vm_area_merge_fraglists(VM_AREA(v, overlap_start), VM_AREA(v, i));
         }
-        diff = overlap_end - (overlap_start + 1);
-        for (i = overlap_start + 1; i < v->length - diff; i++)
-            v->buf[i] = v->buf[i + diff];
-        v->length -= diff;
+        vm_area_vector_remove(v, overlap_start + 1, overlap_end - (overlap_start + 1));
         i = overlap_start; /* for return value */
-        if (TEST(VECTOR_FRAGMENT_LIST, v->flags) && v->buf[i].custom.frags != NULL) {
+        if (TEST(VECTOR_FRAGMENT_LIST, v->flags) && VM_AREA(v, i)->custom.frags != NULL) {
             dcontext_t *dcontext = get_thread_private_dcontext();
             ASSERT(dcontext != NULL);
             /* have to remove all alsos that are now in same area as frag */
-            vm_area_clean_fraglist(dcontext, &v->buf[i]);
+            vm_area_clean_fraglist(dcontext, VM_AREA(v, i));
         }
     }
     DOLOG(5, LOG_VMAREAS, { print_vm_areas(v, GLOBAL); });
@@ -1323,7 +1720,7 @@ adjust_coarse_unit_bounds(vm_area_t *area, bool if_invalid)
 static bool
 remove_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, bool restore_prot)
 {
-    int i, diff;
+    int i;
     int overlap_start = -1, overlap_end = -1;
     bool add_new_area = false;
     vm_area_t new_area = { 0 }; /* used only when add_new_area, wimpy compiler */
@@ -1335,15 +1732,16 @@ remove_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, bool restore_prot)
     ASSERT_VMAREA_VECTOR_PROTECTED(v, WRITE);
     LOG(GLOBAL, LOG_VMAREAS, 4, "in remove_vm_area " PFX " " PFX "\n", start, end);
     /* N.B.: removed area could span multiple areas! */
-    for (i = 0; i < v->length; i++) {
+    for (i = vm_area_first_from(v, start); i < v->length; i++) {
+        vm_area_t *area = VM_AREA(v, i);
         /* look for overlap */
-        if (start < v->buf[i].end && end > v->buf[i].start) {
+        if (start < area->end && end > area->start) {
             if (overlap_start == -1)
                 overlap_start = i;
         } else if (overlap_start > -1) {
             overlap_end = i; /* not inclusive */
             break;
-        } else if (end <= v->buf[i].start)
+        } else if (end <= area->start)
             break;
     }
     if (overlap_start == -1)
@@ -1353,68 +1751,71 @@ remove_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, bool restore_prot)
     /* since it's sorted and there are no overlaps, we do not have to re-sort.
      * we just delete entire intervals affected, and shorten non-entire
      */
-    if (start > v->buf[overlap_start].start) {
+    if (start > VM_AREA(v, overlap_start)->start) {
         /* need to split? */
-        if (overlap_start == overlap_end - 1 && end < v->buf[overlap_start].end) {
+        if (overlap_start == overlap_end - 1 && end < VM_AREA(v, overlap_start)->end) {
             /* don't call add_vm_area now, that will mess up our vector */
-            new_area = v->buf[overlap_start]; /* make a copy */
+            new_area = *VM_AREA(v, overlap_start); /* make a copy */
             new_area.start = end;
             /* rest of fields are correct */
             add_new_area = true;
         }
         /* move ending bound backward */
         LOG(GLOBAL, LOG_VMAREAS, 3, "\tchanging " PFX "-" PFX " to " PFX "-" PFX "\n",
-            v->buf[overlap_start].start, v->buf[overlap_start].end,
-            v->buf[overlap_start].start, start);
-        if (restore_prot && DR_MADE_READONLY(v->buf[overlap_start].vm_flags)) {
+            VM_AREA(v, overlap_start)->start, VM_AREA(v, overlap_start)->end,
+            VM_AREA(v, overlap_start)->start, start);
+        if (restore_prot && DR_MADE_READONLY(VM_AREA(v, overlap_start)->vm_flags)) {
             vm_make_writable(start, end - start);
         }
-        v->buf[overlap_start].end = start;
+        VM_AREA(v, overlap_start)->end = start;
         /* FIXME: add a vmvector callback function for changing bounds? */
-        if (TEST(FRAG_COARSE_GRAIN, v->buf[overlap_start].frag_flags) &&
+        if (TEST(FRAG_COARSE_GRAIN, VM_AREA(v, overlap_start)->frag_flags) &&
             official_coarse_vector) {
-            adjust_coarse_unit_bounds(&v->buf[overlap_start], false /*leave invalid*/);
+            adjust_coarse_unit_bounds(VM_AREA(v, overlap_start),
+                                      false /*leave invalid*/);
         }
         overlap_start++; /* don't delete me */
     }
-    if (end < v->buf[overlap_end - 1].end) {
+    if (end < VM_AREA(v, overlap_end - 1)->end) {
         /* move starting bound forward */
         LOG(GLOBAL, LOG_VMAREAS, 3, "\tchanging " PFX "-" PFX " to " PFX "-" PFX "\n",
-            v->buf[overlap_end - 1].start, v->buf[overlap_end - 1].end, end,
-            v->buf[overlap_end - 1].end);
-        if (restore_prot && DR_MADE_READONLY(v->buf[overlap_end - 1].vm_flags)) {
-            vm_make_writable(v->buf[overlap_end - 1].start,
-                             end - v->buf[overlap_end - 1].start);
-        }
-        v->buf[overlap_end - 1].start = end;
+            VM_AREA(v, overlap_end - 1)->start, VM_AREA(v, overlap_end - 1)->end, end,
+            VM_AREA(v, overlap_end - 1)->end);
+        if (restore_prot && DR_MADE_READONLY(VM_AREA(v, overlap_end - 1)->vm_flags)) {
+            vm_make_writable(VM_AREA(v, overlap_end - 1)->start,
+                             end - VM_AREA(v, overlap_end - 1)->start);
+        }
+        VM_AREA(v, overlap_end - 1)->start = end;
+        vm_area_vector_start_changed(v, overlap_end - 1);
         /* FIXME: add a vmvector callback function for changing bounds? */
-        if (TEST(FRAG_COARSE_GRAIN, v->buf[overlap_end - 1].frag_flags) &&
+        if (TEST(FRAG_COARSE_GRAIN, VM_AREA(v, overlap_end - 1)->frag_flags) &&
             official_coarse_vector) {
-            adjust_coarse_unit_bounds(&v->buf[overlap_end - 1], false /*leave invalid*/);
+            adjust_coarse_unit_bounds(VM_AREA(v, overlap_end - 1),
+                                      false /*leave invalid*/);
         }
         overlap_end--; /* don't delete me */
     }
     /* now delete */
     if (overlap_start < overlap_end) {
         for (i = overlap_start; i < overlap_end; i++) {
+            vm_area_t *area = VM_AREA(v, i);
             LOG(GLOBAL, LOG_VMAREAS, 3, "\tcompletely removing " PFX "-" PFX " %s\n",
-                v->buf[i].start, v->buf[i].end, v->buf[i].comment);
-            if (restore_prot && DR_MADE_READONLY(v->buf[i].vm_flags)) {
-                vm_make_writable(v->buf[i].start, v->buf[i].end - v->buf[i].start);
+                area->start, area->end, area->comment);
+            if (restore_prot && DR_MADE_READONLY(area->vm_flags)) {
+                vm_make_writable(area->start, area->end - area->start);
             }
             /* XXX: Better to use a free_payload_func instead of this custom
              * code.  But then we couldn't assert on the bounds and on
              * VM_EXECUTED_FROM.  Could add bounds to callback params, but
              * vm_flags are not exposed to vmvector interface...
              */
-            if (TEST(FRAG_COARSE_GRAIN, v->buf[i].frag_flags) && official_coarse_vector) {
-                coarse_info_t *info = (coarse_info_t *)v->buf[i].custom.client;
+            if (TEST(FRAG_COARSE_GRAIN, area->frag_flags) && official_coarse_vector) {
+                coarse_info_t *info = (coarse_info_t *)area->custom.client;
                 coarse_info_t *next_info;
                 ASSERT(info != NULL);
                 ASSERT(!RUNNING_WITHOUT_CODE_CACHE());
                 while (info != NULL) { /* loop over primary and secondary unit */
-                    ASSERT(info->base_pc >= v->buf[i].start &&
-                           info->end_pc <= v->buf[i].end);
+                    ASSERT(info->base_pc >= area->start && info->end_pc <= area->end);
                     ASSERT(info->frozen || info->non_frozen == NULL);
                     /* Should have already freed fields (unless we flushed a region
                      * that has not been executed from (case 10995)).
@@ -1423,7 +1824,7 @@ remove_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, bool restore_prot)
                      */
                     if (info->cache != NULL) {
                         ASSERT(info->persisted);
-                        ASSERT(!TEST(VM_EXECUTED_FROM, v->buf[i].vm_flags));
+                        ASSERT(!TEST(VM_EXECUTED_FROM, area->vm_flags));
                         ASSERT(info->non_frozen != NULL);
                         ASSERT(coarse_to_delete != NULL);
                         /* Both primary and secondary must be un-executed */
@@ -1438,27 +1839,20 @@ remove_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, bool restore_prot)
                         ASSERT(info == NULL || !info->frozen);
                     }
                 }
-                v->buf[i].custom.client = NULL;
+                area->custom.client = NULL;
             }
             if (v->free_payload_func != NULL) {
-                v->free_payload_func(v->buf[i].custom.client);
+                v->free_payload_func(area->custom.client);
             }
 #ifdef DEBUG
-            global_heap_free(v->buf[i].comment,
-                             strlen(v->buf[i].comment) + 1 HEAPACCT(ACCT_VMAREAS));
+            global_heap_free(area->comment,
+                             strlen(area->comment) + 1 HEAPACCT(ACCT_VMAREAS));
 #endif
             /* frags list should always be null here (flush should have happened,
              * etc.) */
-            ASSERT(!TEST(VECTOR_FRAGMENT_LIST, v->flags) ||
-                   v->buf[i].custom.frags == NULL);
+            ASSERT(!TEST(VECTOR_FRAGMENT_LIST, v->flags) || area->custom.frags == NULL);
         }
-        diff = overlap_end - overlap_start;
-        for (i = overlap_start; i < v->length - diff; i++)
-            v->buf[i] = v->buf[i + diff];
-#ifdef DEBUG
-        memset(v->buf + v->length - diff, 0, diff * sizeof(vm_area_t));
-#endif
-        v->length -= diff;
+        vm_area_vector_remove(v, overlap_start, overlap_end - overlap_start);
     }
     if (add_new_area) {
         /* Case 8640: Do not propagate coarse-grain-ness to split-off region,
@@ -1517,6 +1911,8 @@ binary_search(vm_area_vector_t *v, app_pc start, app_pc end, vm_area_t **area /*
     LOG(GLOBAL, LOG_VMAREAS, 7, "Binary search for " PFX "-" PFX " on this vector:\n",
         start, end);
     DOLOG(7, LOG_VMAREAS, { print_vm_areas(v, GLOBAL); });
+    if (TEST(VECTOR_BTREE, v->flags))
+        return vm_area_btree_search(v, start, end, area, index);
     /* binary search */
     while (max >= min) {
         int i = (min + max) / 2;
@@ -1596,7 +1992,8 @@ vm_areas_reset_init(void)
 void
 dynamo_vm_areas_init()
 {
-    VMVECTOR_ALLOC_VECTOR(dynamo_areas, GLOBAL_DCONTEXT, VECTOR_SHARED, dynamo_areas);
+    VMVECTOR_ALLOC_VECTOR(dynamo_areas, GLOBAL_DCONTEXT, VECTOR_SHARED | VECTOR_BTREE,
+                          dynamo_areas);
 }
 
 void
@@ -1782,7 +2179,7 @@ vm_areas_exit()
     vmvector_delete_vector(GLOBAL_DCONTEXT, executable_areas);
     executable_areas = NULL;
     DOLOG(1, LOG_VMAREAS, {
-        if (dynamo_areas->buf != NULL) {
+        if (!vmvector_empty(dynamo_areas)) {
             LOG(GLOBAL, LOG_VMAREAS, 1, "DR regions at exit are:\n");
             print_dynamo_areas(GLOBAL);
             LOG(GLOBAL, LOG_VMAREAS, 1, "\n");
@@ -2067,9 +2464,9 @@ vmvector_lookup_prev_next(vm_area_vector_t *v, app_pc pc, OUT app_pc *prev_start
                 *prev_end = NULL;
         } else {
             if (prev_start != NULL)
-                *prev_start = v->buf[index].start;
+                *prev_start = VM_AREA(v, index)->start;
             if (prev_end != NULL)
-                *prev_end = v->buf[index].end;
+                *prev_end = VM_AREA(v, index)->end;
         }
         if (index >= v->length - 1) {
             if (next_start != NULL)
@@ -2078,9 +2475,9 @@ vmvector_lookup_prev_next(vm_area_vector_t *v, app_pc pc, OUT app_pc *prev_start
                 *next_end = (app_pc)POINTER_MAX;
         } else {
             if (next_start != NULL)
-                *next_start = v->buf[index + 1].start;
+                *next_start = VM_AREA(v, index + 1)->start;
             if (next_end != NULL)
-                *next_end = v->buf[index + 1].end;
+                *next_end = VM_AREA(v, index + 1)->end;
         }
     }
     UNLOCK_VECTOR(v, release_lock, read);
@@ -2111,6 +2508,8 @@ vmvector_modify_data(vm_area_vector_t *v, app_pc start, app_pc end, void *data)
 void
 vmvector_init_vector(vm_area_vector_t *v, uint flags)
 {
+    /* the fragment list routines index buf directly */
+    ASSERT(!TEST(VECTOR_BTREE, flags) || !TEST(VECTOR_FRAGMENT_LIST, flags));
     memset(v, 0, sizeof(*v));
     v->flags = flags;
 }
@@ -2134,12 +2533,12 @@ vmvector_reset_vector(dcontext_t *dcontext, vm_area_vector_t *v)
         /* walk areas and delete coarse info and comments */
         for (i = 0; i < v->length; i++) {
             /* FIXME: this code is duplicated in remove_vm_area() */
-            if (TEST(FRAG_COARSE_GRAIN, v->buf[i].frag_flags) &&
+            if (TEST(FRAG_COARSE_GRAIN, VM_AREA(v, i)->frag_flags) &&
                 /* FIXME: cleaner test? shared_data copies flags, but uses
                  * custom.frags and not custom.client
                  */
                 v == executable_areas) {
-                coarse_info_t *info = (coarse_info_t *)v->buf[i].custom.client;
+                coarse_info_t *info = (coarse_info_t *)VM_AREA(v, i)->custom.client;
                 coarse_info_t *next_info;
                 ASSERT(!RUNNING_WITHOUT_CODE_CACHE());
                 ASSERT(info != NULL);
@@ -2150,28 +2549,40 @@ vmvector_reset_vector(dcontext_t *dcontext, vm_area_vector_t *v)
                     info = next_info;
                     ASSERT(info == NULL || !info->frozen);
                 }
-                v->buf[i].custom.client = NULL;
+                VM_AREA(v, i)->custom.client = NULL;
             }
-            global_heap_free(v->buf[i].comment,
-                             strlen(v->buf[i].comment) + 1 HEAPACCT(ACCT_VMAREAS));
+            global_heap_free(VM_AREA(v, i)->comment,
+                             strlen(VM_AREA(v, i)->comment) + 1 HEAPACCT(ACCT_VMAREAS));
         }
     });
     /* with thread shared cache it is in fact possible to have no thread local vmareas */
-    if (v->buf != NULL) {
+    if (v->buf != NULL || v->tree != NULL) {
         if (v->free_payload_func != NULL) {
             int i;
             for (i = 0; i < v->length; i++) {
-                v->free_payload_func(v->buf[i].custom.client);
+                v->free_payload_func(VM_AREA(v, i)->custom.client);
             }
         }
         /* FIXME: walk through and make sure frags lists are all freed */
-        global_heap_free(v->buf,
-                         v->size * sizeof(struct vm_area_t) HEAPACCT(ACCT_VMAREAS));
+        if (v->tree != NULL) {
+            vm_area_btree_free(v->tree, v->tree_height);
+            v->tree = NULL;
+            v->tree_height = 0;
+        } else {
+            global_heap_free(v->buf,
+                             v->size * sizeof(struct vm_area_t) HEAPACCT(ACCT_VMAREAS));
+        }
         v->size = 0;
         v->length = 0;
         v->buf = NULL;
     } else
         ASSERT(v->size == 0 && v->length == 0);
+    while (v->spare_nodes != NULL) {
+        vm_area_node_t *node = v->spare_nodes;
+        v->spare_nodes = node->u.in.child[0];
+        global_heap_free(node, sizeof(vm_area_node_t) HEAPACCT(ACCT_VMAREAS));
+    }
+    v->num_spare_nodes = 0;
 }
 
 static void
@@ -2239,10 +2650,10 @@ vmvector_iterator_peek(vmvector_iterator_t *vmvi, /* IN/OUT */
     ASSERT_VMAREA_VECTOR_PROTECTED(vmvi->vector, READWRITE);
     ASSERT(idx < vmvi->vector->length);
     if (area_start != NULL)
-        *area_start = vmvi->vector->buf[idx].start;
+        *area_start = VM_AREA(vmvi->vector, idx)->start;
     if (area_end != NULL)
-        *area_end = vmvi->vector->buf[idx].end;
-    return vmvi->vector->buf[idx].custom.client;
+        *area_end = VM_AREA(vmvi->vector, idx)->end;
+    return VM_AREA(vmvi->vector, idx)->custom.client;
 }
 
 /* iterator accessor
@@ -3727,6 +4138,8 @@ add_dynamo_heap_vm_area(app_pc start, app_pc end, bool writable,
 /* breaking most abstractions here we return whether current vmarea
  * vector starts at given heap_pc.  The price of circular dependency
  * is that abstractions can no longer be safely used.  case 4196
+ * A VECTOR_BTREE dynamo_areas has no buf and never frees a node while adding,
+ * so this is then always false.
  */
 bool
 is_dynamo_area_buffer(byte *heap_unit_start_pc)
@@ -3746,9 +4159,9 @@ remove_dynamo_heap_areas()
     LOG(GLOBAL, LOG_VMAREAS, 4, "remove_dynamo_heap_areas:\n");
     /* walk backwards to avoid O(n^2) */
     for (i = dynamo_areas->length - 1; i >= 0; i--) {
-        if (TEST(VM_DR_HEAP, dynamo_areas->buf[i].vm_flags)) {
-            app_pc start = dynamo_areas->buf[i].start;
-            app_pc end = dynamo_areas->buf[i].end;
+        if (TEST(VM_DR_HEAP, VM_AREA(dynamo_areas, i)->vm_flags)) {
+            app_pc start = VM_AREA(dynamo_areas, i)->start;
+            app_pc end = VM_AREA(dynamo_areas, i)->end;
             /* ASSUMPTION: remove_vm_area, given exact bounds, simply shifts later
              * areas down in vector!
              */
@@ -11658,11 +12071,11 @@ check_vec(vm_area_vector_t *v, int i, app_pc start, app_pc end, uint vm_flags,
           uint frag_flags, void *data)
 {
     ASSERT(i < v->length);
-    ASSERT(v->buf[i].start == start);
-    ASSERT(v->buf[i].end == end);
-    ASSERT(v->buf[i].vm_flags == vm_flags);
-    ASSERT(v->buf[i].frag_flags == frag_flags);
-    ASSERT(v->buf[i].custom.client == data);
+    ASSERT(VM_AREA(v, i)->start == start);
+    ASSERT(VM_AREA(v, i)->end == end);
+    ASSERT(VM_AREA(v, i)->vm_flags == vm_flags);
+    ASSERT(VM_AREA(v, i)->frag_flags == frag_flags);
+    ASSERT(VM_AREA(v, i)->custom.client == data);
 }
 
 void
@@ -11709,10 +12122,10 @@ vmvector_tests()
  * FIXME: should add a lot more, esp. wrt other flags -- these only
  * test no flags or interactions w/ selfmod flag
  */
-void
-unit_test_vmareas(void)
+static void
+vm_area_vector_tests(uint flags)
 {
-    vm_area_vector_t v = { 0, 0, 0, false };
+    vm_area_vector_t v = { 0, 0, 0, flags };
     /* not needed yet: dcontext_t *dcontext = */
     ASSIGN_INIT_READWRITE_LOCK_FREE(v.lock, thread_vm_areas);
 
@@ -11864,6 +12277,187 @@ unit_test_vmareas(void)
     EXPECT(found, false);
     EXPECT(index, 2);
 
+    vmvector_reset_vector(GLOBAL_DCONTEXT, &v);
+    DELETE_READWRITE_LOCK(v.lock);
+}
+
+#    define TEST_VMVECTOR_CHECKED_OPS 20000
+#    define TEST_VMVECTOR_REGIONS 100000
+
+static uint test_vmvector_seed;
+
+static uint
+test_vmvector_rand(uint max)
+{
+    test_vmvector_seed = test_vmvector_seed * 1103515245 + 12345;
+    return (test_vmvector_seed >> 8) % max;
+}
+
+static void
+test_vmvector_shuffle(app_pc *pcs, uint num)
+{
+    uint i;
+    for (i = num - 1; i > 0; i--) {
+        uint j = test_vmvector_rand(i + 1);
+        app_pc tmp = pcs[i];
+        pcs[i] = pcs[j];
+        pcs[j] = tmp;
+    }
+}
+
+static void
+test_vmvector_compare(vm_area_vector_t *array, vm_area_vector_t *tree)
+{
+    int i;
+    EXPECT(tree->length, array->length);
+    for (i = 0; i < array->length; i++) {
+        EXPECT(VM_AREA(tree, i)->start, VM_AREA(array, i)->start);
+        EXPECT(VM_AREA(tree, i)->end, VM_AREA(array, i)->end);
+        EXPECT(VM_AREA(tree, i)->custom.client, VM_AREA(array, i)->custom.client);
+    }
+}
+
+/* Performs the same random adds, removes, and lookups on an array-backed and a
+ * VECTOR_BTREE vector, which must agree throughout.  The regions are small and
+ * crowded so that most adds merge with or split existing areas.
+ */
+static void
+test_vmvector_btree_random(void)
+{
+    vm_area_vector_t *array, *tree;
+    uint op;
+    VMVECTOR_ALLOC_VECTOR(array, GLOBAL_DCONTEXT, VECTOR_SHARED, thread_vm_areas);
+    VMVECTOR_ALLOC_VECTOR(tree, GLOBAL_DCONTEXT, VECTOR_SHARED | VECTOR_BTREE,
+                          thread_vm_areas);
+    for (op = 0; op < TEST_VMVECTOR_CHECKED_OPS; op++) {
+        app_pc start = INT_TO_PC(0x10000 + test_vmvector_rand(0x10000));
+        /* mostly tiny regions, with the odd one spanning many areas */
+        uint size = 1 + test_vmvector_rand(test_vmvector_rand(8) == 0 ? 0x400 : 8);
+        app_pc end = start + size;
+        app_pc prev_start[2], prev_end[2], next_start[2], next_end[2];
+        app_pc found_end[2] = { NULL, NULL };
+        void *data[2] = { NULL, NULL };
+        bool found;
+        switch (test_vmvector_rand(6)) {
+        case 0:
+        case 1:
+        case 2: {
+            void *payload = (void *)(ptr_uint_t)(op + 1);
+            vmvector_add(array, start, end, payload);
+            vmvector_add(tree, start, end, payload);
+            break;
+        }
+        case 3:
+            found = vmvector_remove(array, start, end);
+            EXPECT(vmvector_remove(tree, start, end), found);
+            break;
+        case 4:
+            found = vmvector_remove_containing_area(array, start, NULL, &found_end[0]);
+            EXPECT(vmvector_remove_containing_area(tree, start, NULL, &found_end[1]),
+                   found);
+            if (found)
+                EXPECT(found_end[1], found_end[0]);
+            break;
+        default:
+            found = vmvector_overlap(array, start, end);
+            EXPECT(vmvector_overlap(tree, start, end), found);
+            found = vmvector_lookup_data(array, start, NULL, &found_end[0], &data[0]);
+            EXPECT(vmvector_lookup_data(tree, start, NULL, &found_end[1], &data[1]),
+                   found);
+            if (found) {
+                EXPECT(found_end[1], found_end[0]);
+                EXPECT(data[1], data[0]);
+            }
+            found = vmvector_lookup_prev_next(array, start, &prev_start[0], &prev_end[0],
+                                              &next_start[0], &next_end[0]);
+            EXPECT(vmvector_lookup_prev_next(tree, start, &prev_start[1], &prev_end[1],
+                                             &next_start[1], &next_end[1]),
+                   found);
+            if (found) {
+                EXPECT(prev_start[1], prev_start[0]);
+                EXPECT(prev_end[1], prev_end[0]);
+                EXPECT(next_start[1], next_start[0]);
+                EXPECT(next_end[1], next_end[0]);
+            }
+        }
+        if (op % 256 == 0)
+            test_vmvector_compare(array, tree);
+    }
+    test_vmvector_compare(array, tree);
+    vmvector_delete_vector(GLOBAL_DCONTEXT, array);
+    vmvector_delete_vector(GLOBAL_DCONTEXT, tree);
+}
+
+/* Adds and then removes TEST_VMVECTOR_REGIONS regions in random order. */
+static void
+test_vmvector_btree_stress(void)
+{
+    vm_area_vector_t *v;
+    app_pc *pcs = (app_pc *)global_heap_alloc(TEST_VMVECTOR_REGIONS *
+                                              sizeof(app_pc) HEAPACCT(ACCT_OTHER));
+    vmvector_iterator_t vmvi;
+    app_pc start, end;
+    uint64 time, add_micros;
+    uint i;
+    VMVECTOR_ALLOC_VECTOR(v, GLOBAL_DCONTEXT, VECTOR_SHARED | VECTOR_BTREE,
+                          thread_vm_areas);
+    /* leave gaps so that nothing merges */
+    for (i = 0; i < TEST_VMVECTOR_REGIONS; i++)
+        pcs[i] = INT_TO_PC(0x10000 + i * 0x200);
+    test_vmvector_shuffle(pcs, TEST_VMVECTOR_REGIONS);
+    time = query_time_micros();
+    for (i = 0; i < TEST_VMVECTOR_REGIONS; i++)
+        vmvector_add(v, pcs[i], pcs[i] + 0x100, pcs[i]);
+    add_micros = query_time_micros() - time;
+    EXPECT(v->length, TEST_VMVECTOR_REGIONS);
+
+    i = 0;
+    vmvector_iterator_start(v, &vmvi);
+    while (vmvector_iterator_hasnext(&vmvi)) {
+        void *data = vmvector_iterator_next(&vmvi, &start, &end);
+        EXPECT(start, 0x10000 + i * 0x200);
+        EXPECT(end, start + 0x100);
+        EXPECT(data, start);
+        i++;
+    }
+    vmvector_iterator_stop(&vmvi);
+    EXPECT(i, TEST_VMVECTOR_REGIONS);
+    for (i = 0; i < TEST_VMVECTOR_REGIONS; i++) {
+        EXPECT(vmvector_lookup(v, pcs[i] + 0xff), pcs[i]);
+        EXPECT(vmvector_lookup(v, pcs[i] + 0x100), NULL);
+    }
+
+    test_vmvector_shuffle(pcs, TEST_VMVECTOR_REGIONS);
+    time = query_time_micros();
+    for (i = 0; i < TEST_VMVECTOR_REGIONS; i++) {
+        if (i % 2 == 0)
+            EXPECT(vmvector_remove(v, pcs[i], pcs[i] + 0x100), true);
+        else {
+            EXPECT(vmvector_remove_containing_area(v, pcs[i] + 1, &start, &end), true);
+            EXPECT(start, pcs[i]);
+            EXPECT(end, pcs[i] + 0x100);
+        }
+        if (i % 1024 == 0) {
+            EXPECT(v->length, TEST_VMVECTOR_REGIONS - i - 1);
+            EXPECT(vmvector_overlap(v, pcs[i], pcs[i] + 0x100), false);
+        }
+    }
+    time = query_time_micros() - time;
+    EXPECT(vmvector_empty(v), true);
+    EXPECT(v->tree, NULL);
+    print_file(STDERR, "vmvector b-tree: %d regions added in %d ms, removed in %d ms\n",
+               TEST_VMVECTOR_REGIONS, (int)(add_micros / 1000), (int)(time / 1000));
+    vmvector_delete_vector(GLOBAL_DCONTEXT, v);
+    global_heap_free(pcs, TEST_VMVECTOR_REGIONS * sizeof(app_pc) HEAPACCT(ACCT_OTHER));
+}
+
+void
+unit_test_vmareas(void)
+{
+    vm_area_vector_tests(0);
+    vm_area_vector_tests(VECTOR_BTREE);
     vmvector_tests();
+    test_vmvector_btree_random();
+    test_vmvector_btree_stress();
 }
 #endif /* STANDALONE_UNIT_TEST */
@@ -52,8 +52,9 @@
 /* really open-ended would make this wrap around to 0 */
 #define UNIVERSAL_REGION_END ((app_pc)POINTER_MAX)
 
-/* opaque struct */
+/* opaque structs */
 struct vm_area_t;
+struct vm_area_node_t;
 
 enum {
     /* these are bitmask flags */
@@ -67,6 +68,12 @@ enum {
      * flag to avoid the redundant vector-level lock
      */
     VECTOR_NO_LOCK = 0x0010,
+    /* Keep the areas in a B-tree rather than in a sorted array, so that adding or
+     * removing an area does not shift all later areas.  Meant for vectors that can
+     * grow to many thousands of areas.  Only the vmvector_* interface supports
+     * this; not compatible with VECTOR_FRAGMENT_LIST.
+     */
+    VECTOR_BTREE = 0x0020,
 };
 
 #define VECTOR_NEVER_MERGE (VECTOR_NEVER_MERGE_ADJACENT | VECTOR_NEVER_OVERLAP)
@@ -111,6 +118,15 @@ struct vm_area_vector_t {
      * If non-NULL, the free_payload_func will NOT be called.
      */
     void *(*merge_payload_func)(void *dst, void *src);
+
+    /* For VECTOR_BTREE the areas are in this tree instead of in buf, with
+     * tree_height levels of internal nodes above the leaves.
+     */
+    struct vm_area_node_t *tree;
+    int tree_height;
+    /* Nodes allocated ahead of an insertion, linked through their first child */
+    struct vm_area_node_t *spare_nodes;
+    int num_spare_nodes;
 }; /* typedef-ed in globals.h */
 
 /* vm_area_vectors should NOT be declared statically if their locks need to be
@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2011-2020 Google, Inc.  All rights reserved.
+ * Copyright (c) 2011-2022 Google, Inc.  All rights reserved.
  * Copyright (c) 2007-2010 VMware, Inc.  All rights reserved.
  * **********************************************************/
 
@@ -148,13 +148,14 @@ hash_free(void *ptr, size_t size)
         dr_global_free(ptr, size);
 }
 
-#define HASH_MASK(num_bits) ((~0U) >> (32 - (num_bits)))
+/* A shift by 32 is undefined, so we special-case a single-bucket table. */
+#define HASH_MASK(num_bits) ((num_bits) == 0 ? 0 : (~0U) >> (32 - (num_bits)))
 #define HASH_FUNC_BITS(val, num_bits) ((val) & (HASH_MASK(num_bits)))
 #define HASH_FUNC(val, mask) ((val) & (mask))
 
-/* caller must hold lock */
+/* Hashes key for a bucket array of HASHTABLE_SIZE(num_bits) entries. */
 static uint
-hash_key(hashtable_t *table, void *key)
+hash_key_bits(hashtable_t *table, void *key, uint num_bits)
 {
     uint hash = 0;
     if (table->hash_key_func != NULL) {
@@ -163,7 +164,7 @@ hash_key(hashtable_t *table, void *key)
         const char *s = (const char *)key;
         char c;
         uint i, shift;
-        uint max_shift = ALIGN_FORWARD(table->table_bits, 8);
+        uint max_shift = ALIGN_FORWARD(num_bits, 8);
         /* XXX: share w/ core's hash_value() function */
         for (i = 0; s[i] != '\0'; i++) {
             c = s[i];
@@ -180,7 +181,14 @@ hash_key(hashtable_t *table, void *key)
                "hashtable.c hash_key internal error: invalid hash type");
         hash = (uint)(ptr_uint_t)key;
     }
-    return HASH_FUNC_BITS(hash, table->table_bits);
+    return HASH_FUNC_BITS(hash, num_bits);
+}
+
+/* caller must hold lock */
+static uint
+hash_key(hashtable_t *table, void *key)
+{
+    return hash_key_bits(table, key, table->table_bits);
 }
 
 static bool
@@ -200,15 +208,353 @@ keys_equal(hashtable_t *table, void *key1, void *key2)
     }
 }
 
+static void *
+dup_key(hashtable_t *table, void *key)
+{
+    if (table->str_dup) {
+        const char *s = (const char *)key;
+        char *dup = (char *)hash_alloc(strlen(s) + 1);
+        strncpy(dup, s, strlen(s) + 1);
+        return dup;
+    }
+    return key;
+}
+
+static void
+free_key(hashtable_t *table, void *key)
+{
+    if (table->str_dup)
+        hash_free(key, strlen((const char *)key) + 1);
+    else if (table->config.free_key_func != NULL)
+        (table->config.free_key_func)(key);
+}
+
+/***************************************************************************
+ * READ-MOSTLY TABLES
+ *
+ * Lookups in a read-mostly table take no lock.  Updates remain serialized and
+ * never modify an entry or bucket array that a reader may have reached: a new
+ * entry is fully initialized before a release store links it in, an entry is
+ * removed or replaced by a single such store to the link that reached it, and
+ * a resize or clear publishes a new bucket array holding new copies of the
+ * entries.  A reader thus always walks a consistent, if possibly stale, set of
+ * chains.  Each bucket array is preceded by a word holding its size, so that a
+ * reader never pairs one array with the size of another.  Whatever an update
+ * unlinks is retired rather than freed, and is only freed by
+ * hashtable_free_retired() or hashtable_delete(), whose callers guarantee that
+ * no lookup is in progress.
+ */
+
+/* Memory unlinked from a read-mostly table that a reader may still reach. */
+typedef struct _retired_t {
+    /* Either a single entry... */
+    hash_entry_t *entry;
+    /* ...or a bucket array, along with the entries in its chains. */
+    hash_entry_t **buckets;
+    uint bits;
+    bool free_keys;
+    bool free_payloads;
+    struct _retired_t *next;
+} retired_t;
+
+static hash_entry_t **
+buckets_alloc(uint num_bits)
+{
+    size_t sz = ((size_t)HASHTABLE_SIZE(num_bits) + 1) * sizeof(hash_entry_t *);
+    hash_entry_t **alloc = (hash_entry_t **)hash_alloc(sz);
+    memset(alloc, 0, sz);
+    alloc[0] = (hash_entry_t *)(ptr_uint_t)num_bits;
+    return alloc + 1;
+}
+
+static void
+buckets_free(hash_entry_t **buckets, uint num_bits)
+{
+    hash_free(buckets - 1,
+              ((size_t)HASHTABLE_SIZE(num_bits) + 1) * sizeof(hash_entry_t *));
+}
+
+/* Stores val to *dst such that a reader that loads val also sees every prior store
+ * by this thread, in particular those initializing what val points to.
+ */
+static void
+publish_ptr(void *dst, void *val)
+{
+#ifdef X64
+    dr_atomic_store64((volatile int64 *)dst, (int64)val);
+#else
+    dr_atomic_store32((volatile int *)dst, (int)val);
+#endif
+}
+
+/* caller must hold lock */
+static void
+set_link(hashtable_t *table, hash_entry_t **link, hash_entry_t *val)
+{
+    if (table->config.read_mostly)
+        publish_ptr(link, val);
+    else
+        *link = val;
+}
+
+/* caller must hold lock */
+static void
+retire(hashtable_t *table, hash_entry_t *entry, hash_entry_t **buckets, uint bits,
+       bool free_keys, bool free_payloads)
+{
+    retired_t *r = (retired_t *)hash_alloc(sizeof(*r));
+    r->entry = entry;
+    r->buckets = buckets;
+    r->bits = bits;
+    r->free_keys = free_keys;
+    r->free_payloads = free_payloads;
+    r->next = (retired_t *)table->retired;
+    table->retired = r;
+}
+
+static void
+free_retired_entry(hashtable_t *table, retired_t *r, hash_entry_t *e)
+{
+    if (r->free_keys)
+        free_key(table, e->key);
+    if (r->free_payloads && table->free_payload_func != NULL)
+        (table->free_payload_func)(e->payload);
+    hash_free(e, sizeof(*e));
+}
+
+/* caller must hold lock */
+static void
+free_retired(hashtable_t *table)
+{
+    retired_t *r, *next_r;
+    uint i;
+    for (r = (retired_t *)table->retired; r != NULL; r = next_r) {
+        next_r = r->next;
+        if (r->entry != NULL)
+            free_retired_entry(table, r, r->entry);
+        else {
+            for (i = 0; i < HASHTABLE_SIZE(r->bits); i++) {
+                hash_entry_t *e = r->buckets[i];
+                while (e != NULL) {
+                    hash_entry_t *nexte = e->next;
+                    free_retired_entry(table, r, e);
+                    e = nexte;
+                }
+            }
+            buckets_free(r->buckets, r->bits);
+        }
+        hash_free(r, sizeof(*r));
+    }
+    table->retired = NULL;
+}
+
+static void *
+read_mostly_lookup(hashtable_t *table, void *key)
+{
+    /* The volatile loads keep the compiler from re-reading links that an update
+     * may change; the hardware orders each load after the one it depends on.
+     */
+    hash_entry_t **buckets = *(hash_entry_t **volatile *)&table->table;
+    uint bits = (uint)(ptr_uint_t)buckets[-1];
+    uint hindex = hash_key_bits(table, key, bits);
+    hash_entry_t *e = *(hash_entry_t *volatile *)&buckets[hindex];
+    for (; e != NULL; e = *(hash_entry_t *volatile *)&e->next) {
+        if (keys_equal(table, e->key, key))
+            return e->payload;
+    }
+    return NULL;
+}
+
+/***************************************************************************
+ * OPEN ADDRESSING
+ *
+ * An open-address table keeps its entries in one array of slots, probed
+ * linearly using Robin Hood hashing: an insertion takes the slot of any entry
+ * that is nearer its home slot than the new entry is to its own, which keeps
+ * probe sequences short and lets a lookup stop at the first entry nearer its
+ * home than the key being sought would be.  A removal shifts the rest of the
+ * run back a slot rather than leaving a tombstone.  Each slot caches the full
+ * hash of its key, so resizing never rehashes keys and most mismatches are
+ * rejected without comparing keys.  The table always keeps an empty slot so
+ * that every probe terminates.
+ *
+ * Long runs cost far more here than long chains do in a chained table, so we
+ * do not use hash_key(): its string hash collides often and it takes the low
+ * bits of pointers as is.  We instead use a full string hash and pick the home
+ * slot from the top bits of a multiplicative (Fibonacci) hash.
+ */
+
+#define SLOT_MASK(num_bits) (HASHTABLE_SIZE(num_bits) - 1)
+#define SLOT_HOME(hash, num_bits) ((num_bits) == 0 ? 0 : (hash) >> (32 - (num_bits)))
+/* How far slot idx is from the home slot of hash. */
+#define SLOT_DIST(idx, hash, num_bits, mask) \
+    (((idx) - SLOT_HOME(hash, num_bits)) & (mask))
+
+/* caller must hold lock */
+static uint
+open_hash(hashtable_t *table, void *key)
+{
+    uint hash;
+    if (table->hash_key_func != NULL) {
+        hash = table->hash_key_func(key);
+    } else if (table->hashtype == HASH_STRING || table->hashtype == HASH_STRING_NOCASE) {
+        /* FNV-1a. */
+        const char *s = (const char *)key;
+        hash = 2166136261U;
+        for (; *s != '\0'; s++) {
+            char c = *s;
+            if (table->hashtype == HASH_STRING_NOCASE)
+                c = (char)tolower(c);
+            hash = (hash ^ (byte)c) * 16777619U;
+        }
+    } else {
+        ptr_uint_t val = (ptr_uint_t)key;
+        ASSERT(table->hashtype == HASH_INTPTR,
+               "hashtable.c open_hash internal error: invalid hash type");
+#ifdef X64
+        val ^= val >> 32;
+#endif
+        hash = (uint)val;
+    }
+    return hash * 0x9e3779b1;
+}
+
+static hash_slot_t *
+open_find(hashtable_t *table, void *key, uint hash)
+{
+    uint bits = table->table_bits, mask = SLOT_MASK(bits);
+    uint i, dist;
+    for (i = SLOT_HOME(hash, bits), dist = 0;; i = (i + 1) & mask, dist++) {
+        hash_slot_t *slot = &table->slots[i];
+        if (slot->payload == NULL || SLOT_DIST(i, slot->hash, bits, mask) < dist)
+            return NULL;
+        if (slot->hash == hash && keys_equal(table, slot->key, key))
+            return slot;
+    }
+}
+
+/* The key must not already be present. */
+static void
+open_insert(hashtable_t *table, void *key, void *payload, uint hash)
+{
+    uint bits = table->table_bits, mask = SLOT_MASK(bits);
+    hash_slot_t carry, tmp;
+    uint i, dist;
+    carry.key = key;
+    carry.payload = payload;
+    carry.hash = hash;
+    for (i = SLOT_HOME(hash, bits), dist = 0;; i = (i + 1) & mask, dist++) {
+        hash_slot_t *slot = &table->slots[i];
+        uint slot_dist;
+        if (slot->payload == NULL) {
+            *slot = carry;
+            return;
+        }
+        slot_dist = SLOT_DIST(i, slot->hash, bits, mask);
+        if (slot_dist < dist) {
+            tmp = *slot;
+            *slot = carry;
+            carry = tmp;
+            dist = slot_dist;
+        }
+    }
+}
+
+/* Empties the slot, whose key and payload the caller has freed. */
+static void
+open_remove_slot(hashtable_t *table, hash_slot_t *slot)
+{
+    uint bits = table->table_bits, mask = SLOT_MASK(bits);
+    uint i = (uint)(slot - table->slots);
+    for (;;) {
+        uint next = (i + 1) & mask;
+        hash_slot_t *next_slot = &table->slots[next];
+        if (next_slot->payload == NULL ||
+            SLOT_DIST(next, next_slot->hash, bits, mask) == 0)
+            break;
+        table->slots[i] = *next_slot;
+        i = next;
+    }
+    memset(&table->slots[i], 0, sizeof(table->slots[i]));
+}
+
+static hash_slot_t *
+open_alloc_slots(uint num_bits)
+{
+    size_t sz = (size_t)HASHTABLE_SIZE(num_bits) * sizeof(hash_slot_t);
+    hash_slot_t *slots = (hash_slot_t *)hash_alloc(sz);
+    memset(slots, 0, sz);
+    return slots;
+}
+
+/* caller must hold lock */
+static void
+open_resize(hashtable_t *table, uint new_bits)
+{
+    hash_slot_t *old_slots = table->slots;
+    uint old_bits = table->table_bits;
+    uint i;
+    table->slots = open_alloc_slots(new_bits);
+    table->table_bits = new_bits;
+    for (i = 0; i < HASHTABLE_SIZE(old_bits); i++) {
+        if (old_slots[i].payload != NULL) {
+            open_insert(table, old_slots[i].key, old_slots[i].payload,
+                        old_slots[i].hash);
+        }
+    }
+    hash_free(old_slots, (size_t)HASHTABLE_SIZE(old_bits) * sizeof(hash_slot_t));
+}
+
+/* Moves the entries between chains and slots.  Caller must hold lock. */
+static void
+hashtable_set_open_address(hashtable_t *table, bool open_address)
+{
+    uint i;
+    if (open_address == table->config.open_address)
+        return;
+    table->config.open_address = open_address;
+    if (open_address) {
+        hash_entry_t **chains = table->table;
+        uint chain_bits = table->table_bits;
+        /* The chains may hold more entries than there are buckets. */
+        while (table->entries + 1 >= HASHTABLE_SIZE(table->table_bits))
+            table->table_bits++;
+        table->slots = open_alloc_slots(table->table_bits);
+        table->table = NULL;
+        for (i = 0; i < HASHTABLE_SIZE(chain_bits); i++) {
+            hash_entry_t *e = chains[i];
+            while (e != NULL) {
+                hash_entry_t *nexte = e->next;
+                open_insert(table, e->key, e->payload, open_hash(table, e->key));
+                hash_free(e, sizeof(*e));
+                e = nexte;
+            }
+        }
+        buckets_free(chains, chain_bits);
+    } else {
+        hash_slot_t *slots = table->slots;
+        table->table = buckets_alloc(table->table_bits);
+        table->slots = NULL;
+        for (i = 0; i < HASHTABLE_SIZE(table->table_bits); i++) {
+            if (slots[i].payload != NULL) {
+                hash_entry_t *e = (hash_entry_t *)hash_alloc(sizeof(*e));
+                uint hindex = hash_key(table, slots[i].key);
+                e->key = slots[i].key;
+                e->payload = slots[i].payload;
+                e->next = table->table[hindex];
+                table->table[hindex] = e;
+            }
+        }
+        hash_free(slots, (size_t)HASHTABLE_SIZE(table->table_bits) * sizeof(hash_slot_t));
+    }
+}
+
 void
 hashtable_init_ex(hashtable_t *table, uint num_bits, hash_type_t hashtype, bool str_dup,
                   bool synch, void (*free_payload_func)(void *),
                   uint (*hash_key_func)(void *), bool (*cmp_key_func)(void *, void *))
 {
-    hash_entry_t **alloc = (hash_entry_t **)hash_alloc((size_t)HASHTABLE_SIZE(num_bits) *
-                                                       sizeof(hash_entry_t *));
-    memset(alloc, 0, (size_t)HASHTABLE_SIZE(num_bits) * sizeof(hash_entry_t *));
-    table->table = alloc;
+    table->table = buckets_alloc(num_bits);
     table->hashtype = hashtype;
     table->str_dup = str_dup;
     ASSERT(!str_dup || hashtype == HASH_STRING || hashtype == HASH_STRING_NOCASE,
@@ -227,6 +573,10 @@ hashtable_init_ex(hashtable_t *table, uint num_bits, hash_type_t hashtype, bool
     table->config.resizable = true;
     table->config.resize_threshold = 75;
     table->config.free_key_func = NULL;
+    table->config.open_address = false;
+    table->config.read_mostly = false;
+    table->slots = NULL;
+    table->retired = NULL;
 }
 
 void
@@ -246,6 +596,18 @@ hashtable_configure(hashtable_t *table, hashtable_config_t *config)
         table->config.resize_threshold = config->resize_threshold;
     if (config->size > offsetof(hashtable_config_t, free_key_func))
         table->config.free_key_func = config->free_key_func;
+    if (config->size > offsetof(hashtable_config_t, read_mostly))
+        table->config.read_mostly = config->read_mostly;
+    if (config->size > offsetof(hashtable_config_t, open_address)) {
+        ASSERT(!config->open_address || !table->config.read_mostly,
+               "a read-mostly table cannot use open addressing");
+        if (table->synch)
+            dr_mutex_lock(table->lock);
+        hashtable_set_open_address(table,
+                                   config->open_address && !table->config.read_mostly);
+        if (table->synch)
+            dr_mutex_unlock(table->lock);
+    }
 }
 
 void
@@ -273,14 +635,22 @@ hashtable_lookup(hashtable_t *table, void *key)
 {
     void *res = NULL;
     hash_entry_t *e;
+    if (table->config.read_mostly)
+        return read_mostly_lookup(table, key);
     if (table->synch) {
         dr_mutex_lock(table->lock);
     }
-    uint hindex = hash_key(table, key);
-    for (e = table->table[hindex]; e != NULL; e = e->next) {
-        if (keys_equal(table, e->key, key)) {
-            res = e->payload;
-            break;
+    if (table->config.open_address) {
+        hash_slot_t *slot = open_find(table, key, open_hash(table, key));
+        if (slot != NULL)
+            res = slot->payload;
+    } else {
+        uint hindex = hash_key(table, key);
+        for (e = table->table[hindex]; e != NULL; e = e->next) {
+            if (keys_equal(table, e->key, key)) {
+                res = e->payload;
+                break;
+            }
         }
     }
     if (table->synch)
@@ -293,31 +663,51 @@ static bool
 hashtable_check_for_resize(hashtable_t *table)
 {
     size_t capacity = (size_t)HASHTABLE_SIZE(table->table_bits);
+    if (table->config.open_address) {
+        if ((table->config.resizable &&
+             table->entries * 100 > table->config.resize_threshold * capacity) ||
+            table->entries + 1 >= capacity) {
+            open_resize(table, table->table_bits + 1);
+            return true;
+        }
+        return false;
+    }
     if (table->config.resizable &&
         /* avoid fp ops.  should check for overflow. */
         table->entries * 100 > table->config.resize_threshold * capacity) {
         hash_entry_t **new_table;
-        size_t new_sz;
         uint i, old_bits;
         /* double the size */
         old_bits = table->table_bits;
         table->table_bits++;
-        new_sz = (size_t)HASHTABLE_SIZE(table->table_bits) * sizeof(hash_entry_t *);
-        new_table = (hash_entry_t **)hash_alloc(new_sz);
-        memset(new_table, 0, new_sz);
+        new_table = buckets_alloc(table->table_bits);
         /* rehash the old table into the new */
         for (i = 0; i < HASHTABLE_SIZE(old_bits); i++) {
             hash_entry_t *e = table->table[i];
             while (e != NULL) {
                 hash_entry_t *nexte = e->next;
                 uint hindex = hash_key(table, e->key);
-                e->next = new_table[hindex];
-                new_table[hindex] = e;
+                if (table->config.read_mostly) {
+                    /* Readers may be walking the old chains: leave them intact. */
+                    hash_entry_t *copy = (hash_entry_t *)hash_alloc(sizeof(*copy));
+                    copy->key = e->key;
+                    copy->payload = e->payload;
+                    copy->next = new_table[hindex];
+                    new_table[hindex] = copy;
+                } else {
+                    e->next = new_table[hindex];
+                    new_table[hindex] = e;
+                }
                 e = nexte;
             }
         }
-        hash_free(table->table, capacity * sizeof(hash_entry_t *));
-        table->table = new_table;
+        if (table->config.read_mostly) {
+            retire(table, NULL, table->table, old_bits, false, false);
+            publish_ptr(&table->table, new_table);
+        } else {
+            buckets_free(table->table, old_bits);
+            table->table = new_table;
+        }
         return true;
     }
     return false;
@@ -331,6 +721,19 @@ hashtable_add(hashtable_t *table, void *key, void *payload)
     if (table->synch) {
         dr_mutex_lock(table->lock);
     }
+    if (table->config.open_address) {
+        uint hash = open_hash(table, key);
+        bool added = false;
+        if (open_find(table, key, hash) == NULL) {
+            open_insert(table, dup_key(table, key), payload, hash);
+            table->entries++;
+            hashtable_check_for_resize(table);
+            added = true;
+        }
+        if (table->synch)
+            dr_mutex_unlock(table->lock);
+        return added;
+    }
     uint hindex = hash_key(table, key);
     hash_entry_t *e;
     for (e = table->table[hindex]; e != NULL; e = e->next) {
@@ -350,7 +753,7 @@ hashtable_add(hashtable_t *table, void *key, void *payload)
         e->key = key;
     e->payload = payload;
     e->next = table->table[hindex];
-    table->table[hindex] = e;
+    set_link(table, &table->table[hindex], e);
     table->entries++;
     hashtable_check_for_resize(table);
     if (table->synch)
@@ -367,6 +770,24 @@ hashtable_add_replace(hashtable_t *table, void *key, void *payload)
         dr_mutex_lock(table->lock);
     }
     void *old_payload = NULL;
+    if (table->config.open_address) {
+        uint hash = open_hash(table, key);
+        hash_slot_t *slot = open_find(table, key, hash);
+        if (slot != NULL) {
+            free_key(table, slot->key);
+            slot->key = dup_key(table, key);
+            /* up to caller to free payload */
+            old_payload = slot->payload;
+            slot->payload = payload;
+        } else {
+            open_insert(table, dup_key(table, key), payload, hash);
+            table->entries++;
+            hashtable_check_for_resize(table);
+        }
+        if (table->synch)
+            dr_mutex_unlock(table->lock);
+        return old_payload;
+    }
     uint hindex = hash_key(table, key);
     hash_entry_t *e, *new_e, *prev_e;
     new_e = (hash_entry_t *)hash_alloc(sizeof(*new_e));
@@ -379,24 +800,26 @@ hashtable_add_replace(hashtable_t *table, void *key, void *payload)
     new_e->payload = payload;
     for (e = table->table[hindex], prev_e = NULL; e != NULL; prev_e = e, e = e->next) {
         if (keys_equal(table, e->key, key)) {
-            if (prev_e == NULL)
-                table->table[hindex] = new_e;
-            else
-                prev_e->next = new_e;
             new_e->next = e->next;
-            if (table->str_dup)
-                hash_free(e->key, strlen((const char *)e->key) + 1);
-            else if (table->config.free_key_func != NULL)
-                (table->config.free_key_func)(e->key);
+            set_link(table, prev_e == NULL ? &table->table[hindex] : &prev_e->next,
+                     new_e);
             /* up to caller to free payload */
             old_payload = e->payload;
-            hash_free(e, sizeof(*e));
+            if (table->config.read_mostly)
+                retire(table, e, NULL, 0, true, false);
+            else {
+                if (table->str_dup)
+                    hash_free(e->key, strlen((const char *)e->key) + 1);
+                else if (table->config.free_key_func != NULL)
+                    (table->config.free_key_func)(e->key);
+                hash_free(e, sizeof(*e));
+            }
             break;
         }
     }
     if (old_payload == NULL) {
         new_e->next = table->table[hindex];
-        table->table[hindex] = new_e;
+        set_link(table, &table->table[hindex], new_e);
         table->entries++;
         hashtable_check_for_resize(table);
     }
@@ -413,20 +836,36 @@ hashtable_remove(hashtable_t *table, void *key)
     if (table->synch) {
         dr_mutex_lock(table->lock);
     }
+    if (table->config.open_address) {
+        hash_slot_t *slot = open_find(table, key, open_hash(table, key));
+        if (slot != NULL) {
+            free_key(table, slot->key);
+            if (table->free_payload_func != NULL)
+                (table->free_payload_func)(slot->payload);
+            open_remove_slot(table, slot);
+            table->entries--;
+            res = true;
+        }
+        if (table->synch)
+            dr_mutex_unlock(table->lock);
+        return res;
+    }
     uint hindex = hash_key(table, key);
     for (e = table->table[hindex], prev_e = NULL; e != NULL; prev_e = e, e = e->next) {
         if (keys_equal(table, e->key, key)) {
-            if (prev_e == NULL)
-                table->table[hindex] = e->next;
-            else
-                prev_e->next = e->next;
-            if (table->str_dup)
-                hash_free(e->key, strlen((const char *)e->key) + 1);
-            else if (table->config.free_key_func != NULL)
-                (table->config.free_key_func)(e->key);
-            if (table->free_payload_func != NULL)
-                (table->free_payload_func)(e->payload);
-            hash_free(e, sizeof(*e));
+            set_link(table, prev_e == NULL ? &table->table[hindex] : &prev_e->next,
+                     e->next);
+            if (table->config.read_mostly)
+                retire(table, e, NULL, 0, true, true);
+            else {
+                if (table->str_dup)
+                    hash_free(e->key, strlen((const char *)e->key) + 1);
+                else if (table->config.free_key_func != NULL)
+                    (table->config.free_key_func)(e->key);
+                if (table->free_payload_func != NULL)
+                    (table->free_payload_func)(e->payload);
+                hash_free(e, sizeof(*e));
+            }
             res = true;
             table->entries--;
             break;
@@ -445,21 +884,43 @@ hashtable_remove_range(hashtable_t *table, void *start, void *end)
     hash_entry_t *e, *prev_e, *next_e;
     if (table->synch)
         hashtable_lock(table);
+    if (table->config.open_address) {
+        for (i = 0; i < HASHTABLE_SIZE(table->table_bits);) {
+            hash_slot_t *slot = &table->slots[i];
+            if (slot->payload != NULL && slot->key >= start && slot->key < end) {
+                free_key(table, slot->key);
+                if (table->free_payload_func != NULL)
+                    (table->free_payload_func)(slot->payload);
+                /* This shifts a later entry, or an already-visited one from the
+                 * start of the array, into this slot, so we visit it again.
+                 */
+                open_remove_slot(table, slot);
+                table->entries--;
+                res = true;
+            } else
+                i++;
+        }
+        if (table->synch)
+            hashtable_unlock(table);
+        return res;
+    }
     for (i = 0; i < HASHTABLE_SIZE(table->table_bits); i++) {
         for (e = table->table[i], prev_e = NULL; e != NULL; e = next_e) {
             next_e = e->next;
             if (e->key >= start && e->key < end) {
-                if (prev_e == NULL)
-                    table->table[i] = e->next;
-                else
-                    prev_e->next = e->next;
-                if (table->str_dup)
-                    hash_free(e->key, strlen((const char *)e->key) + 1);
-                else if (table->config.free_key_func != NULL)
-                    (table->config.free_key_func)(e->key);
-                if (table->free_payload_func != NULL)
-                    (table->free_payload_func)(e->payload);
-                hash_free(e, sizeof(*e));
+                set_link(table, prev_e == NULL ? &table->table[i] : &prev_e->next,
+                         e->next);
+                if (table->config.read_mostly)
+                    retire(table, e, NULL, 0, true, true);
+                else {
+                    if (table->str_dup)
+                        hash_free(e->key, strlen((const char *)e->key) + 1);
+                    else if (table->config.free_key_func != NULL)
+                        (table->config.free_key_func)(e->key);
+                    if (table->free_payload_func != NULL)
+                        (table->free_payload_func)(e->payload);
+                    hash_free(e, sizeof(*e));
+                }
                 table->entries--;
                 res = true;
             } else
@@ -476,6 +937,13 @@ hashtable_apply_to_all_payloads(hashtable_t *table, void (*apply_func)(void *pay
 {
     DR_ASSERT_MSG(apply_func != NULL, "The apply_func ptr cannot be NULL.");
     uint i;
+    if (table->config.open_address) {
+        for (i = 0; i < HASHTABLE_SIZE(table->table_bits); i++) {
+            if (table->slots[i].payload != NULL)
+                apply_func(table->slots[i].payload);
+        }
+        return;
+    }
     for (i = 0; i < HASHTABLE_SIZE(table->table_bits); i++) {
         hash_entry_t *e = table->table[i];
         while (e != NULL) {
@@ -494,6 +962,13 @@ hashtable_apply_to_all_payloads_user_data(hashtable_t *table,
 {
     DR_ASSERT_MSG(apply_func != NULL, "The apply_func ptr cannot be NULL.");
     uint i;
+    if (table->config.open_address) {
+        for (i = 0; i < HASHTABLE_SIZE(table->table_bits); i++) {
+            if (table->slots[i].payload != NULL)
+                apply_func(table->slots[i].payload, user_data);
+        }
+        return;
+    }
     for (i = 0; i < HASHTABLE_SIZE(table->table_bits); i++) {
         hash_entry_t *e = table->table[i];
         while (e != NULL) {
@@ -508,6 +983,26 @@ static void
 hashtable_clear_internal(hashtable_t *table)
 {
     uint i;
+    if (table->config.open_address) {
+        for (i = 0; i < HASHTABLE_SIZE(table->table_bits); i++) {
+            hash_slot_t *slot = &table->slots[i];
+            if (slot->payload != NULL) {
+                free_key(table, slot->key);
+                if (table->free_payload_func != NULL)
+                    (table->free_payload_func)(slot->payload);
+            }
+        }
+        memset(table->slots, 0,
+               (size_t)HASHTABLE_SIZE(table->table_bits) * sizeof(hash_slot_t));
+        table->entries = 0;
+        return;
+    }
+    if (table->config.read_mostly) {
+        retire(table, NULL, table->table, table->table_bits, true, true);
+        publish_ptr(&table->table, buckets_alloc(table->table_bits));
+        table->entries = 0;
+        return;
+    }
     for (i = 0; i < HASHTABLE_SIZE(table->table_bits); i++) {
         hash_entry_t *e = table->table[i];
         while (e != NULL) {
@@ -536,14 +1031,29 @@ hashtable_clear(hashtable_t *table)
         dr_mutex_unlock(table->lock);
 }
 
+void
+hashtable_free_retired(hashtable_t *table)
+{
+    if (table->synch)
+        dr_mutex_lock(table->lock);
+    free_retired(table);
+    if (table->synch)
+        dr_mutex_unlock(table->lock);
+}
+
 void
 hashtable_delete(hashtable_t *table)
 {
     if (table->synch)
         dr_mutex_lock(table->lock);
     hashtable_clear_internal(table);
-    hash_free(table->table,
-              (size_t)HASHTABLE_SIZE(table->table_bits) * sizeof(hash_entry_t *));
+    if (table->config.open_address) {
+        hash_free(table->slots,
+                  (size_t)HASHTABLE_SIZE(table->table_bits) * sizeof(hash_slot_t));
+        table->slots = NULL;
+    } else
+        buckets_free(table->table, table->table_bits);
+    free_retired(table);
     table->table = NULL;
     table->entries = 0;
     if (table->synch)
@@ -575,12 +1085,12 @@ hashtable_delete(hashtable_t *table)
  */
 
 static bool
-key_in_range(hashtable_t *table, hash_entry_t *he, ptr_uint_t start, size_t size)
+key_in_range(hashtable_t *table, void *key, ptr_uint_t start, size_t size)
 {
     if (table->hashtype != HASH_INTPTR || size == 0)
         return true;
     /* avoiding overflow by subtracting one */
-    return ((ptr_uint_t)he->key >= start && (ptr_uint_t)he->key <= (start + (size - 1)));
+    return ((ptr_uint_t)key >= start && (ptr_uint_t)key <= (start + (size - 1)));
 }
 
 static bool
@@ -589,6 +1099,33 @@ hash_write_file(file_t fd, void *ptr, size_t sz)
     return (dr_write_file(fd, ptr, sz) == (ssize_t)sz);
 }
 
+static bool
+key_to_persist(void *drcontext, hashtable_t *table, void *key, void *perscxt,
+               ptr_uint_t start, size_t size, hasthable_persist_flags_t flags)
+{
+    return (!TEST(DR_HASHPERS_ONLY_IN_RANGE, flags) ||
+            key_in_range(table, key, start, size)) &&
+        (!TEST(DR_HASHPERS_ONLY_PERSISTED, flags) ||
+         dr_fragment_persistable(drcontext, perscxt, key));
+}
+
+static bool
+persist_entry(hashtable_t *table, size_t entry_size, file_t fd, void *key,
+              void *payload, hasthable_persist_flags_t flags)
+{
+    if (!hash_write_file(fd, &key, sizeof(key)))
+        return false;
+    if (TEST(DR_HASHPERS_PAYLOAD_IS_POINTER, flags)) {
+        if (!hash_write_file(fd, payload, entry_size))
+            return false;
+    } else {
+        ASSERT(entry_size <= sizeof(void *), "inlined data too large");
+        if (!hash_write_file(fd, &payload, entry_size))
+            return false;
+    }
+    return true;
+}
+
 size_t
 hashtable_persist_size(void *drcontext, hashtable_t *table, size_t entry_size,
                        void *perscxt, hasthable_persist_flags_t flags)
@@ -607,11 +1144,16 @@ hashtable_persist_size(void *drcontext, hashtable_t *table, size_t entry_size,
         count = 0;
         for (i = 0; i < HASHTABLE_SIZE(table->table_bits); i++) {
             hash_entry_t *he;
+            if (table->config.open_address) {
+                if (table->slots[i].payload != NULL &&
+                    key_to_persist(drcontext, table, table->slots[i].key, perscxt, start,
+                                   size, flags))
+                    count++;
+                continue;
+            }
             for (he = table->table[i]; he != NULL; he = he->next) {
-                if ((!TEST(DR_HASHPERS_ONLY_IN_RANGE, flags) ||
-                     key_in_range(table, he, start, size)) &&
-                    (!TEST(DR_HASHPERS_ONLY_PERSISTED, flags) ||
-                     dr_fragment_persistable(drcontext, perscxt, he->key)))
+                if (key_to_persist(drcontext, table, he->key, perscxt, start, size,
+                                   flags))
                     count++;
             }
         }
@@ -651,22 +1193,23 @@ hashtable_persist(void *drcontext, hashtable_t *table, size_t entry_size, file_t
     /* synch is already provided */
     for (i = 0; i < HASHTABLE_SIZE(table->table_bits); i++) {
         hash_entry_t *he;
+        if (table->config.open_address) {
+            hash_slot_t *slot = &table->slots[i];
+            if (slot->payload != NULL &&
+                key_to_persist(drcontext, table, slot->key, perscxt, start, size,
+                               flags)) {
+                IF_DEBUG(count_check++;)
+                if (!persist_entry(table, entry_size, fd, slot->key, slot->payload,
+                                   flags))
+                    return false;
+            }
+            continue;
+        }
         for (he = table->table[i]; he != NULL; he = he->next) {
-            if ((!TEST(DR_HASHPERS_ONLY_IN_RANGE, flags) ||
-                 key_in_range(table, he, start, size)) &&
-                (!TEST(DR_HASHPERS_ONLY_PERSISTED, flags) ||
-                 dr_fragment_persistable(drcontext, perscxt, he->key))) {
+            if (key_to_persist(drcontext, table, he->key, perscxt, start, size, flags)) {
                 IF_DEBUG(count_check++;)
-                if (!hash_write_file(fd, &he->key, sizeof(he->key)))
+                if (!persist_entry(table, entry_size, fd, he->key, he->payload, flags))
                     return false;
-                if (TEST(DR_HASHPERS_PAYLOAD_IS_POINTER, flags)) {
-                    if (!hash_write_file(fd, he->payload, entry_size))
-                        return false;
-                } else {
-                    ASSERT(entry_size <= sizeof(void *), "inlined data too large");
-                    if (!hash_write_file(fd, &he->payload, entry_size))
-                        return false;
-                }
             }
         }
     }
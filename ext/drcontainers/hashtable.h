@@ -75,6 +75,12 @@ typedef struct _hash_entry_t {
     struct _hash_entry_t *next;
 } hash_entry_t;
 
+typedef struct _hash_slot_t {
+    void *key;
+    void *payload; /* NULL if the slot is empty. */
+    uint hash;
+} hash_slot_t;
+
 /** Configuration parameters for a hashtable. */
 typedef struct _hashtable_config_t {
     size_t size;           /**< The size of the hashtable_config_t struct used */
@@ -85,6 +91,32 @@ typedef struct _hashtable_config_t {
      * to true in hashtable_init() or hashtable_init_ex(), this field is ignored.
      */
     void (*free_key_func)(void *);
+    /**
+     * Whether to store the entries in a single array using open addressing rather
+     * than in separately allocated entries chained from each bucket.  This avoids
+     * an allocation per entry and the pointer chasing of chains, making lookups,
+     * additions, and removals faster and the table smaller, and suits large or
+     * heavily queried tables.  The table may be switched at any time, rehashing
+     * its entries.  An open-address table has no chains in its \p table field:
+     * use hashtable_apply_to_all_payloads() rather than walking it directly.
+     * It is grown when full regardless of \p resizable.
+     */
+    bool open_address;
+    /**
+     * Whether hashtable_lookup() should proceed without acquiring the table lock,
+     * for tables that are queried far more often than they are updated.
+     * Updates are still serialized, by the table lock if the table is
+     * synchronized and otherwise by the caller, and may run concurrently with
+     * lookups.  Lookups may miss an entry added, or find an entry removed, by an
+     * update that is still in progress.  The memory behind removed entries and
+     * replaced bucket arrays is retired rather than freed, and the free routines
+     * for the keys and payloads of removed entries are not called, until
+     * hashtable_free_retired() or hashtable_delete().  The payload returned by
+     * hashtable_add_replace() is freed by the caller as usual and so must not be
+     * freed while a lookup may still return it.  Cannot be combined with \p
+     * open_address.  Must be set before the table is shared between threads.
+     */
+    bool read_mostly;
 } hashtable_config_t;
 
 typedef struct _hashtable_t {
@@ -100,6 +132,8 @@ typedef struct _hashtable_t {
     uint entries;
     hashtable_config_t config;
     uint persist_count;
+    hash_slot_t *slots; /* Replaces table when config.open_address is set. */
+    void *retired;      /* Memory awaiting hashtable_free_retired(). */
 } hashtable_t;
 
 /* should move back to utils.c once have iterator and alloc_exit
@@ -154,8 +188,10 @@ hashtable_init(hashtable_t *table, uint num_bits, hash_type_t hashtype, bool str
  *   Leave it NULL if no callback is needed and the default is to be used.
  *   For HASH_CUSTOM, a callback must be provided.
  *
- * This hashtable uses closed addressing.
- * For an open-address hashtable, consider dr_hashtable_create().
+ * This hashtable uses closed addressing unless configured otherwise via
+ * the \p open_address field of hashtable_config_t.
+ * For an open-address hashtable with integer keys, also consider
+ * dr_hashtable_create().
  */
 void
 hashtable_init_ex(hashtable_t *table, uint num_bits, hash_type_t hashtype, bool str_dup,
@@ -231,6 +267,18 @@ hashtable_apply_to_all_payloads_user_data(hashtable_t *table,
 void
 hashtable_clear(hashtable_t *table);
 
+/**
+ * Frees the memory that updates to a table configured as \p read_mostly have
+ * retired, calling the key and payload free routines for removed entries.
+ * The caller must guarantee that no thread is in the middle of a lookup on the
+ * table, such as from the process exit event, while all other threads are
+ * suspended by dr_suspend_all_other_threads() at a point where none of them
+ * can be in a lookup, or after the caller's own synchronization with every
+ * thread that performs lookups.
+ */
+void
+hashtable_free_retired(hashtable_t *table);
+
 /**
  * Destroys all storage for the table, including all entries and the
  * table itself.  If free_payload_func was specified calls it for each
@@ -0,0 +1,231 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Hashtable benchmarking standalone app. */
+
+/* This is a standalone app for comparing the chained and open-address layouts of
+ * hashtable_t.  For pointer and string keys we time adding entries, looking up
+ * present and absent keys, and removing entries, and we report the memory held
+ * by each table once filled.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dr_api.h"
+#include "hashtable.h"
+
+#define DEFAULT_ENTRIES 1000000
+/* The number of passes over the keys when timing lookups. */
+#define LOOKUP_ROUNDS 4
+#define KEY_LEN 24
+
+typedef struct _bench_keys_t {
+    hash_type_t hashtype;
+    const char *name;
+    void **present;
+    void **absent;
+    size_t count;
+} bench_keys_t;
+
+static size_t heap_in_use;
+
+static void *
+bench_alloc(size_t size)
+{
+    heap_in_use += size;
+    return dr_global_alloc(size);
+}
+
+static void
+bench_free(void *ptr, size_t size)
+{
+    heap_in_use -= size;
+    dr_global_free(ptr, size);
+}
+
+/* Shuffles both key arrays in the same way, deterministically. */
+static void
+shuffle_keys(bench_keys_t *keys)
+{
+    uint seed = 42;
+    size_t i;
+    for (i = keys->count - 1; i > 0; i--) {
+        size_t j;
+        void *tmp;
+        seed = seed * 1103515245 + 12345;
+        j = (size_t)seed % (i + 1);
+        tmp = keys->present[i];
+        keys->present[i] = keys->present[j];
+        keys->present[j] = tmp;
+        tmp = keys->absent[i];
+        keys->absent[i] = keys->absent[j];
+        keys->absent[j] = tmp;
+    }
+}
+
+static int
+usage(const char *msg)
+{
+    if (msg != NULL)
+        dr_fprintf(STDERR, "%s\n", msg);
+    dr_fprintf(STDERR, "usage: hashtable_bench [num_entries]\n");
+    return 1;
+}
+
+static void
+report(const char *what, uint64 ops, uint64 start)
+{
+    uint64 time = dr_get_milliseconds() - start;
+    dr_printf("  %-14s " UINT64_FORMAT_STRING " ops/second\n", what,
+              ops * 1000 / (time == 0 ? 1 : time));
+}
+
+static void
+run_bench(bench_keys_t *keys, bool open_address)
+{
+    hashtable_t table;
+    hashtable_config_t config;
+    uint64 start;
+    size_t i, heap_base = heap_in_use;
+    uint round, found = 0;
+
+    dr_printf("%s keys, %s:\n", keys->name, open_address ? "open address" : "chained");
+    /* Start small so that resizing is part of the cost of adding. */
+    hashtable_init_ex(&table, 8, keys->hashtype, false /*!str_dup*/, false /*!synch*/,
+                      NULL, NULL, NULL);
+    config.size = sizeof(config);
+    config.resizable = true;
+    config.resize_threshold = 75;
+    config.free_key_func = NULL;
+    config.open_address = open_address;
+    config.read_mostly = false;
+    hashtable_configure(&table, &config);
+
+    start = dr_get_milliseconds();
+    for (i = 0; i < keys->count; i++)
+        hashtable_add(&table, keys->present[i], (void *)(ptr_uint_t)(i + 1));
+    report("add", keys->count, start);
+    dr_printf("  %-14s " SZFMT " bytes for " SZFMT " entries\n", "memory",
+              heap_in_use - heap_base, keys->count);
+
+    start = dr_get_milliseconds();
+    for (round = 0; round < LOOKUP_ROUNDS; round++) {
+        for (i = 0; i < keys->count; i++) {
+            if (hashtable_lookup(&table, keys->present[i]) != NULL)
+                found++;
+        }
+    }
+    report("lookup hit", (uint64)keys->count * LOOKUP_ROUNDS, start);
+
+    start = dr_get_milliseconds();
+    for (round = 0; round < LOOKUP_ROUNDS; round++) {
+        for (i = 0; i < keys->count; i++) {
+            if (hashtable_lookup(&table, keys->absent[i]) != NULL)
+                found++;
+        }
+    }
+    report("lookup miss", (uint64)keys->count * LOOKUP_ROUNDS, start);
+    if (found != keys->count * LOOKUP_ROUNDS)
+        dr_fprintf(STDERR, "error: found %u of the present keys\n", found);
+
+    start = dr_get_milliseconds();
+    for (i = 0; i < keys->count; i++)
+        hashtable_remove(&table, keys->present[i]);
+    report("remove", keys->count, start);
+
+    hashtable_delete(&table);
+}
+
+int
+main(int argc, char **argv)
+{
+    bench_keys_t keys;
+    char *strings;
+    size_t i, count = DEFAULT_ENTRIES;
+
+    dr_standalone_init();
+    hashtable_global_config(bench_alloc, bench_free, NULL);
+
+    if (argc > 2)
+        return usage(NULL);
+    if (argc == 2) {
+        count = (size_t)atol(argv[1]);
+        if (count == 0)
+            return usage("Invalid entry count.");
+    }
+    keys.count = count;
+    keys.present = (void **)malloc(count * sizeof(void *));
+    keys.absent = (void **)malloc(count * sizeof(void *));
+    strings = (char *)malloc(count * 2 * KEY_LEN);
+    if (keys.present == NULL || keys.absent == NULL || strings == NULL)
+        return usage("Out of memory.");
+
+    /* Pointer keys look like the aligned addresses of heap objects or code,
+     * interleaving the present and absent keys.  We visit them in random order:
+     * in address order, consecutive keys hit neighbouring chained buckets, which
+     * says more about the cache than about the table.
+     */
+    keys.hashtype = HASH_INTPTR;
+    keys.name = "Pointer";
+    for (i = 0; i < count; i++) {
+        keys.present[i] = (void *)(ptr_uint_t)(0x10000 + i * 16);
+        keys.absent[i] = (void *)(ptr_uint_t)(0x10000 + i * 16 + 8);
+    }
+    shuffle_keys(&keys);
+    run_bench(&keys, false);
+    run_bench(&keys, true);
+
+    /* String keys look like symbol names. */
+    keys.hashtype = HASH_STRING;
+    keys.name = "String";
+    for (i = 0; i < count; i++) {
+        char *present = strings + i * 2 * KEY_LEN;
+        char *absent = present + KEY_LEN;
+        dr_snprintf(present, KEY_LEN, "symbol_%x_present", (uint)i);
+        present[KEY_LEN - 1] = '\0';
+        dr_snprintf(absent, KEY_LEN, "symbol_%x_absent", (uint)i);
+        absent[KEY_LEN - 1] = '\0';
+        keys.present[i] = present;
+        keys.absent[i] = absent;
+    }
+    shuffle_keys(&keys);
+    run_bench(&keys, false);
+    run_bench(&keys, true);
+
+    free(keys.present);
+    free(keys.absent);
+    free(strings);
+    dr_standalone_exit();
+    return 0;
+}
@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2011-2014 Google, Inc.  All rights reserved.
+ * Copyright (c) 2011-2022 Google, Inc.  All rights reserved.
  * Copyright (c) 2009-2010 VMware, Inc.  All rights reserved.
  * **********************************************************/
 
@@ -239,6 +239,38 @@ drsym_error_t
 drsym_lookup_address(const char *modpath, size_t modoffs, drsym_info_t *info /*INOUT*/,
                      uint flags);
 
+DR_EXPORT
+/**
+ * Retrieves symbol information for each of a series of offsets in one module,
+ * as drsym_lookup_address() would for each.  This resolves and locks the module
+ * once for the whole series.  For ELF and PE COFF symbol tables and DWARF line
+ * information, offsets sorted in ascending order are further resolved in a
+ * single sweep over the symbol table and line tables.  Unsorted offsets are
+ * also supported but do not benefit from the sweep.
+ *
+ * @param[in] modpath The full path to the module to be queried.
+ * @param[in] modoffs An array of \p count offsets from the base of the module,
+ *   preferably in ascending order.
+ *   For Mach-O executables, the module base is after any __PAGEZERO segment.
+ * @param[in] count   The number of entries in each of \p modoffs, \p info,
+ *   and \p results.
+ * @param[in,out] info An array of \p count structures, each set up as for
+ *   drsym_lookup_address() with \p struct_size of sizeof(drsym_info_t), to
+ *   receive information about the symbol at the corresponding offset.
+ * @param[out] results An array of \p count values receiving the status of each
+ *   lookup, as drsym_lookup_address() would return it.
+ * @param[in]  flags   Options for the operation as a combination of drsym_flags_t
+ *    values.  Ignored for Windows PDB (DRSYM_PDB) except for
+ *    DRSYM_DEMANGLE_PDB_TEMPLATES.
+ *
+ * \return DRSYM_SUCCESS if \p results was filled in, or else the error that
+ * prevented any lookup, such as failing to load the module.
+ */
+drsym_error_t
+drsym_lookup_addresses(const char *modpath, const size_t *modoffs, size_t count,
+                       drsym_info_t *info /*INOUT*/, drsym_error_t *results /*OUT*/,
+                       uint flags);
+
 enum {
     DRSYM_TYPE_OTHER,    /**< Unknown type, cannot downcast. */
     DRSYM_TYPE_INT,      /**< Integer, cast to drsym_int_type_t. */
@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2011-2020 Google, Inc.  All rights reserved.
+ * Copyright (c) 2011-2022 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -32,8 +32,11 @@
 
 /* DRSyms benchmarking standalone app. */
 
-/* This is a standalone app for benchmarking drsyms.  Currently we just time
- * symbol enumeration of an arbitrary object file.
+/* This is a standalone app for benchmarking drsyms.  We time symbol
+ * enumeration of an arbitrary object file and then address lookups, with line
+ * information, scattered across its symbols.  Given a thread count, we also time
+ * the same lookups issued from that many threads at once.  Finally, we time them
+ * sorted and passed in batches to drsym_lookup_addresses().
  */
 
 #include <stdio.h>
@@ -43,8 +46,36 @@
 #include "dr_api.h"
 #include "drsyms.h"
 
+#ifdef UNIX
+#    include <pthread.h>
+#endif
+
+#define MAX_THREADS 64
+
 static char sym_buf[4096];
 
+/* The number of lookups per symbol, at increasing offsets into it. */
+#define LOOKUPS_PER_SYMBOL 4
+/* The number of offsets passed to each drsym_lookup_addresses() call. */
+#define BATCH_SIZE 1024
+#define BATCH_NAME_SIZE 256
+
+typedef struct _offs_array_t {
+    size_t *offs;
+    size_t count;
+    size_t capacity;
+} offs_array_t;
+
+/* The lookups done by one thread. */
+typedef struct _lookup_work_t {
+    const char *modpath;
+    offs_array_t *array;
+    size_t stride;
+    size_t first;
+    uint64 lookups;
+    uint64 lines_found;
+} lookup_work_t;
+
 static int
 usage(const char *msg)
 {
@@ -58,7 +89,7 @@ usage(const char *msg)
     if (msg != NULL && msg[0] != '\0') {
         dr_fprintf(STDERR, "%s\n", msg);
     }
-    dr_fprintf(STDERR, "usage: bench <modpath>\n");
+    dr_fprintf(STDERR, "usage: bench <modpath> [num_threads]\n");
     return 1;
 }
 
@@ -103,10 +134,238 @@ enumerate_with_flags(const char *modpath, drsym_flags_t flags)
     dr_printf("Took %d.%03d seconds.\n", (int)(time / 1000), (int)(time % 1000));
 }
 
+static bool
+collect_callback(const char *name, size_t modoffs, void *data)
+{
+    offs_array_t *array = (offs_array_t *)data;
+    if (array->count == array->capacity) {
+        array->capacity = array->capacity == 0 ? 1024 : array->capacity * 2;
+        array->offs = (size_t *)realloc(array->offs, array->capacity * sizeof(size_t));
+        if (array->offs == NULL)
+            return false;
+    }
+    array->offs[array->count++] = modoffs;
+    return true;
+}
+
+static size_t
+gcd(size_t a, size_t b)
+{
+    while (b != 0) {
+        size_t tmp = a % b;
+        a = b;
+        b = tmp;
+    }
+    return a;
+}
+
+static int
+compare_offs(const void *a_in, const void *b_in)
+{
+    size_t a = *(const size_t *)a_in;
+    size_t b = *(const size_t *)b_in;
+    if (a > b)
+        return 1;
+    if (a < b)
+        return -1;
+    return 0;
+}
+
+/* Looks up the same addresses as do_lookups(), but sorted and in batches. */
+static void
+time_batch_lookups(const char *modpath, offs_array_t *array)
+{
+    size_t count = array->count * LOOKUPS_PER_SYMBOL;
+    size_t *offs = (size_t *)malloc(count * sizeof(*offs));
+    drsym_info_t *info = (drsym_info_t *)malloc(BATCH_SIZE * sizeof(*info));
+    drsym_error_t *results = (drsym_error_t *)malloc(BATCH_SIZE * sizeof(*results));
+    char *names = (char *)malloc(BATCH_SIZE * BATCH_NAME_SIZE);
+    char *files = (char *)malloc(BATCH_SIZE * MAXIMUM_PATH);
+    uint64 start, end, time;
+    uint64 lines_found = 0;
+    size_t i, j;
+
+    if (offs == NULL || info == NULL || results == NULL || names == NULL ||
+        files == NULL) {
+        dr_printf("Out of memory.\n");
+        goto batch_exit;
+    }
+    for (i = 0; i < array->count; i++) {
+        for (j = 0; j < LOOKUPS_PER_SYMBOL; j++)
+            offs[i * LOOKUPS_PER_SYMBOL + j] = array->offs[i] + j * 4;
+    }
+    for (i = 0; i < BATCH_SIZE; i++) {
+        info[i].struct_size = sizeof(info[i]);
+        info[i].name = names + i * BATCH_NAME_SIZE;
+        info[i].name_size = BATCH_NAME_SIZE;
+        info[i].file = files + i * MAXIMUM_PATH;
+        info[i].file_size = MAXIMUM_PATH;
+    }
+
+    dr_printf("Beginning batched address lookups\n");
+    start = dr_get_milliseconds();
+    /* Sorting is part of the cost a caller pays for the batch sweep. */
+    qsort(offs, count, sizeof(*offs), compare_offs);
+    for (i = 0; i < count; i += BATCH_SIZE) {
+        size_t num = count - i < BATCH_SIZE ? count - i : BATCH_SIZE;
+        if (drsym_lookup_addresses(modpath, offs + i, num, info, results,
+                                   DRSYM_DEFAULT_FLAGS) != DRSYM_SUCCESS)
+            break;
+        for (j = 0; j < num; j++) {
+            if (results[j] == DRSYM_SUCCESS)
+                lines_found++;
+        }
+    }
+    end = dr_get_milliseconds();
+    dr_printf("Finished batched address lookups.\n");
+
+    time = end - start;
+    dr_printf("Took %d.%03d seconds for " UINT64_FORMAT_STRING
+              " lookups (" UINT64_FORMAT_STRING " with lines).\n",
+              (int)(time / 1000), (int)(time % 1000), (uint64)count, lines_found);
+    dr_printf(UINT64_FORMAT_STRING " lookups/second.\n",
+              (uint64)count * 1000 / (time == 0 ? 1 : time));
+
+batch_exit:
+    free(offs);
+    free(info);
+    free(results);
+    free(names);
+    free(files);
+}
+
+/* Looks up addresses in a scattered order so that consecutive queries land in
+ * different compilation units, as when symbolizing the PCs in a trace.
+ */
+static void
+do_lookups(lookup_work_t *work)
+{
+    char name[256];
+    char file[MAXIMUM_PATH];
+    size_t i, idx = work->first;
+    int j;
+
+    for (j = 0; j < LOOKUPS_PER_SYMBOL; j++) {
+        for (i = 0; i < work->array->count; i++) {
+            drsym_info_t info;
+            drsym_error_t res;
+            idx = (idx + work->stride) % work->array->count;
+            info.struct_size = sizeof(info);
+            info.name = name;
+            info.name_size = sizeof(name);
+            info.file = file;
+            info.file_size = sizeof(file);
+            res = drsym_lookup_address(work->modpath, work->array->offs[idx] + j * 4,
+                                       &info, DRSYM_DEFAULT_FLAGS);
+            work->lookups++;
+            if (res == DRSYM_SUCCESS)
+                work->lines_found++;
+        }
+    }
+}
+
+#ifdef UNIX
+static void *
+lookup_thread(void *arg)
+{
+    do_lookups((lookup_work_t *)arg);
+    return NULL;
+}
+#else
+static DWORD WINAPI
+lookup_thread(LPVOID arg)
+{
+    do_lookups((lookup_work_t *)arg);
+    return 0;
+}
+#endif
+
+/* Runs the lookups on each of num_threads threads at once, each starting at a
+ * different symbol, and reports the aggregate rate.
+ */
+static void
+time_lookups(const char *modpath, offs_array_t *array, size_t stride, int num_threads)
+{
+    lookup_work_t work[MAX_THREADS];
+#ifdef UNIX
+    pthread_t threads[MAX_THREADS];
+#else
+    HANDLE threads[MAX_THREADS];
+#endif
+    uint64 start, end, time;
+    uint64 lookups = 0, lines_found = 0;
+    int i;
+
+    dr_printf("Beginning address lookups on %d thread(s)\n", num_threads);
+    start = dr_get_milliseconds();
+    for (i = 0; i < num_threads; i++) {
+        work[i].modpath = modpath;
+        work[i].array = array;
+        work[i].stride = stride;
+        work[i].first = (array->count / num_threads) * i;
+        work[i].lookups = 0;
+        work[i].lines_found = 0;
+        if (num_threads == 1)
+            do_lookups(&work[i]);
+        else {
+#ifdef UNIX
+            pthread_create(&threads[i], NULL, lookup_thread, &work[i]);
+#else
+            threads[i] = CreateThread(NULL, 0, lookup_thread, &work[i], 0, NULL);
+#endif
+        }
+    }
+    for (i = 0; i < num_threads; i++) {
+        if (num_threads > 1) {
+#ifdef UNIX
+            pthread_join(threads[i], NULL);
+#else
+            WaitForSingleObject(threads[i], INFINITE);
+            CloseHandle(threads[i]);
+#endif
+        }
+        lookups += work[i].lookups;
+        lines_found += work[i].lines_found;
+    }
+    end = dr_get_milliseconds();
+    dr_printf("Finished address lookups.\n");
+
+    time = end - start;
+    dr_printf("Took %d.%03d seconds for " UINT64_FORMAT_STRING
+              " lookups (" UINT64_FORMAT_STRING " with lines).\n",
+              (int)(time / 1000), (int)(time % 1000), lookups, lines_found);
+    dr_printf(UINT64_FORMAT_STRING " lookups/second.\n",
+              lookups * 1000 / (time == 0 ? 1 : time));
+}
+
+static void
+lookup_addresses(const char *modpath, int num_threads)
+{
+    offs_array_t array = { NULL, 0, 0 };
+    size_t stride;
+
+    drsym_enumerate_symbols(modpath, collect_callback, &array, DRSYM_DEFAULT_FLAGS);
+    if (array.count == 0) {
+        dr_printf("No symbols to look up.\n");
+        return;
+    }
+    /* Any stride coprime with the count visits every symbol once. */
+    stride = array.count / 2 + 1;
+    while (gcd(stride, array.count) != 1)
+        stride++;
+
+    time_lookups(modpath, &array, stride, 1);
+    if (num_threads > 1)
+        time_lookups(modpath, &array, stride, num_threads);
+    time_batch_lookups(modpath, &array);
+    free(array.offs);
+}
+
 int
 main(int argc, char **argv)
 {
     const char *modpath;
+    int num_threads = 1;
 #ifdef WINDOWS
     char full_path[2048];
 #endif
@@ -114,10 +373,15 @@ main(int argc, char **argv)
     dr_standalone_init();
     drsym_init(0);
 
-    if (argc != 2) {
+    if (argc != 2 && argc != 3) {
         return usage(NULL);
     }
     modpath = argv[1];
+    if (argc == 3) {
+        num_threads = atoi(argv[2]);
+        if (num_threads < 1 || num_threads > MAX_THREADS)
+            return usage("Invalid thread count.");
+    }
 #ifdef WINDOWS
     /* Work around i#289. */
     if (GetFullPathName(modpath, sizeof(full_path), full_path, NULL) == 0) {
@@ -135,6 +399,8 @@ main(int argc, char **argv)
     enumerate_with_flags(modpath, DRSYM_DEFAULT_FLAGS);
     enumerate_with_flags(modpath, DRSYM_DEFAULT_FLAGS);
 
+    lookup_addresses(modpath, num_threads);
+
     drsym_exit();
     dr_standalone_exit();
 }
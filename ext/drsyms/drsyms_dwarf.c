@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2011-2015 Google, Inc.  All rights reserved.
+ * Copyright (c) 2011-2022 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -54,13 +54,63 @@ static bool verbose = false;
         }                                                                      \
     } while (0)
 
+/* An address range covered by one CU.  The module's ranges are sorted by lo and
+ * max_hi holds the highest hi of this and all prior entries, so a backward walk
+ * from the last entry with lo <= pc can stop as soon as max_hi <= pc.
+ */
+typedef struct _cu_range_t {
+    Dwarf_Addr lo;
+    Dwarf_Addr hi;
+    Dwarf_Addr max_hi;
+    Dwarf_Off cu_offs;
+    /* Resolved on first use for ranges from .debug_aranges.  libdwarf allocates a
+     * new DIE on every dwarf_offdie() call, so we must not repeat it per query.
+     */
+    Dwarf_Die cu_die;
+} cu_range_t;
+
+/* A line table entry with its address pulled out for binary search. */
+typedef struct _sorted_line_t {
+    Dwarf_Addr addr;
+    Dwarf_Line line;
+} sorted_line_t;
+
+/* The sorted line table of one CU.  A NULL lines with num_lines of -1 caches
+ * a CU without line info.
+ */
+typedef struct _line_table_t {
+    Dwarf_Off cu_offs;
+    Dwarf_Line *lines;
+    Dwarf_Signed num_lines;
+    sorted_line_t *sorted;
+    /* 0 means unused.  Stamped under the read lock, so only accessed atomically. */
+    volatile int last_use;
+} line_table_t;
+
+/* The number of sorted line tables kept per module.  Symbolizing addresses
+ * from a trace tends to revisit a modest set of hot CUs.
+ */
+#define LINE_TABLE_CACHE_SIZE 16
+
 typedef struct _dwarf_module_t {
     byte *load_base;
     Dwarf_Debug dbg;
-    /* we cache the last CU we looked up */
-    Dwarf_Die lines_cu;
-    Dwarf_Line *lines;
-    Dwarf_Signed num_lines;
+    /* Guards the fields below and libdwarf's state.  Queries whose line tables
+     * are cached share it, while building the CU ranges, loading a line table, and
+     * enumerating hold it exclusively.
+     */
+    void *lock;
+    /* Lazily built on the first address lookup. */
+    bool cu_ranges_built;
+    cu_range_t *cu_ranges;
+    size_t num_cu_ranges;
+    size_t cu_ranges_capacity;
+    /* LRU cache of sorted line tables.  The clock advances atomically on each
+     * use, hit or load, and the table is stamped with the new value, so
+     * concurrent queries under the read lock never share a stamp.
+     */
+    line_table_t line_tables[LINE_TABLE_CACHE_SIZE];
+    int line_table_clock;
     /* Amount to adjust all offsets for __PAGEZERO + PIE (i#1365) */
     ssize_t offs_adjust;
 } dwarf_module_t;
@@ -69,10 +119,28 @@ typedef enum {
     SEARCH_FOUND = 0,
     SEARCH_MAYBE = 1,
     SEARCH_NOT_FOUND = 2,
+    /* A line table is needed that only an exclusive query can load. */
+    SEARCH_NEED_LOAD = 3,
 } search_result_t;
 
+/* Where the last of a series of queries at ascending PCs left off, so the next
+ * can resume walking the CU ranges and its line table rather than searching.
+ */
+typedef struct _line_cursor_t {
+    Dwarf_Addr pc;
+    ptr_int_t cu_idx; /* find_cu_range() for pc */
+    /* The table last searched and the number of its lines at or below line_pc.
+     * The cu_offs check catches the table's slot being reused.
+     */
+    line_table_t *table;
+    Dwarf_Off cu_offs;
+    Dwarf_Addr line_pc;
+    Dwarf_Signed line_idx;
+} line_cursor_t;
+
 static search_result_t
-search_addr2line_in_cu(dwarf_module_t *mod, Dwarf_Addr pc, Dwarf_Die cu_die,
+search_addr2line_in_cu(dwarf_module_t *mod, Dwarf_Addr pc, cu_range_t *range,
+                       bool may_load, line_cursor_t *cursor,
                        drsym_info_t *sym_info INOUT);
 
 /******************************************************************************
@@ -101,100 +169,197 @@ next_die_matching_tag(Dwarf_Debug dbg, Dwarf_Tag search_tag)
     return die;
 }
 
-/* Iterate over all the CUs in the module to find the CU containing the given
- * PC.
+static void
+add_cu_range(dwarf_module_t *mod, Dwarf_Addr lo, Dwarf_Addr hi, Dwarf_Off cu_offs,
+             Dwarf_Die cu_die)
+{
+    if (lo >= hi)
+        return;
+    if (mod->num_cu_ranges == mod->cu_ranges_capacity) {
+        size_t new_capacity =
+            mod->cu_ranges_capacity == 0 ? 64 : mod->cu_ranges_capacity * 2;
+        cu_range_t *grown =
+            (cu_range_t *)dr_global_alloc(new_capacity * sizeof(*grown));
+        if (mod->cu_ranges != NULL) {
+            memcpy(grown, mod->cu_ranges, mod->num_cu_ranges * sizeof(*grown));
+            dr_global_free(mod->cu_ranges, mod->cu_ranges_capacity * sizeof(*grown));
+        }
+        mod->cu_ranges = grown;
+        mod->cu_ranges_capacity = new_capacity;
+    }
+    mod->cu_ranges[mod->num_cu_ranges].lo = lo;
+    mod->cu_ranges[mod->num_cu_ranges].hi = hi;
+    mod->cu_ranges[mod->num_cu_ranges].cu_offs = cu_offs;
+    mod->cu_ranges[mod->num_cu_ranges].cu_die = cu_die;
+    mod->num_cu_ranges++;
+}
+
+/* Adds the ranges listed in the CU's own attributes.  Returns whether any
+ * were found.
  */
-static Dwarf_Die
-find_cu_die_via_iter(Dwarf_Debug dbg, Dwarf_Addr pc)
+static bool
+add_cu_die_ranges(dwarf_module_t *mod, Dwarf_Die cu_die, Dwarf_Off cu_offs)
 {
-    Dwarf_Die die = NULL;
-    Dwarf_Unsigned cu_offset = 0;
     Dwarf_Error de; /* expensive to init (DrM#1770) */
-    Dwarf_Die cu_die = NULL;
-
-    while (dwarf_next_cu_header(dbg, NULL, NULL, NULL, NULL, &cu_offset, &de) ==
-           DW_DLV_OK) {
-        /* Scan forward in the tag soup for a CU DIE. */
-        die = next_die_matching_tag(dbg, DW_TAG_compile_unit);
-
-        /* We found a CU die, now check if it's the one we wanted. */
-        if (die != NULL) {
-            Dwarf_Addr lo_pc, hi_pc;
-            if (dwarf_lowpc(die, &lo_pc, &de) != DW_DLV_OK ||
-                dwarf_highpc(die, &hi_pc, &de) != DW_DLV_OK) {
-                NOTIFY_DWARF(de);
-                break;
-            }
-
-            if (lo_pc <= pc && pc < hi_pc) {
-                cu_die = die;
+    Dwarf_Addr lo_pc = 0, hi_pc;
+    Dwarf_Half form;
+    enum Dwarf_Form_Class form_class;
+    Dwarf_Unsigned ranges_offs;
+    bool has_lo_pc = (dwarf_lowpc(cu_die, &lo_pc, &de) == DW_DLV_OK);
+
+    /* Since DWARF 4 the high pc is usually an offset from the low pc. */
+    if (has_lo_pc &&
+        dwarf_highpc_b(cu_die, &hi_pc, &form, &form_class, &de) == DW_DLV_OK) {
+        if (form_class == DW_FORM_CLASS_CONSTANT)
+            hi_pc += lo_pc;
+        add_cu_range(mod, lo_pc, hi_pc, cu_offs, cu_die);
+        return true;
+    }
+    /* Non-contiguous CUs (e.g., from -ffunction-sections or hot/cold splitting)
+     * list their ranges relative to the CU base address.
+     */
+    if (dwarf_attrval_unsigned(cu_die, DW_AT_ranges, &ranges_offs, &de) ==
+        DW_DLV_OK) {
+        Dwarf_Ranges *ranges;
+        Dwarf_Signed num_ranges, i;
+        Dwarf_Unsigned bytes;
+        Dwarf_Addr base = lo_pc;
+        size_t prior = mod->num_cu_ranges;
+        if (dwarf_get_ranges_a(mod->dbg, (Dwarf_Off)ranges_offs, cu_die, &ranges,
+                               &num_ranges, &bytes, &de) != DW_DLV_OK) {
+            NOTIFY_DWARF(de);
+            return false;
+        }
+        for (i = 0; i < num_ranges; i++) {
+            if (ranges[i].dwr_type == DW_RANGES_END)
                 break;
+            if (ranges[i].dwr_type == DW_RANGES_ADDRESS_SELECTION)
+                base = ranges[i].dwr_addr2;
+            else {
+                add_cu_range(mod, base + ranges[i].dwr_addr1,
+                             base + ranges[i].dwr_addr2, cu_offs, cu_die);
             }
         }
+        dwarf_ranges_dealloc(mod->dbg, ranges, num_ranges);
+        return mod->num_cu_ranges > prior;
     }
-
-    while (dwarf_next_cu_header(dbg, NULL, NULL, NULL, NULL, &cu_offset, &de) ==
-           DW_DLV_OK) {
-        /* Reset the internal CU header state. */
-    }
-
-    return cu_die;
+    return false;
 }
 
-static Dwarf_Die
-find_cu_die(Dwarf_Debug dbg, Dwarf_Addr pc)
+/* Adds the span of the CU's line table, for CUs that carry no ranges.  Some
+ * compilers (clang) don't put lo_pc hi_pc attributes on compilation units, and
+ * Cygwin and MinGW gcc don't seem to include them either.
+ */
+static void
+add_cu_line_span(dwarf_module_t *mod, Dwarf_Die cu_die, Dwarf_Off cu_offs)
 {
     Dwarf_Error de; /* expensive to init (DrM#1770) */
-    Dwarf_Die cu_die = NULL;
-    Dwarf_Arange *arlist;
-    Dwarf_Signed arcnt;
-    Dwarf_Arange ar;
-    Dwarf_Off die_offs;
-    if (dwarf_get_aranges(dbg, &arlist, &arcnt, &de) != DW_DLV_OK ||
-        dwarf_get_arange(arlist, arcnt, pc, &ar, &de) != DW_DLV_OK ||
-        dwarf_get_cu_die_offset(ar, &die_offs, &de) != DW_DLV_OK ||
-        dwarf_offdie(dbg, die_offs, &cu_die, &de) != DW_DLV_OK) {
-        NOTIFY_DWARF(de);
-        /* Try to find it by walking all CU's and looking at their lowpc+highpc
-         * entries, which should work if each has a single contiguous
-         * range.  Note that Cygwin and MinGW gcc don't seen to include
-         * lowpc+highpc in their CU's.
-         */
-        cu_die = find_cu_die_via_iter(dbg, pc);
+    Dwarf_Line *lines;
+    Dwarf_Signed num_lines, i;
+    Dwarf_Addr addr, lo = (Dwarf_Addr)-1, hi = 0;
+    if (dwarf_srclines(cu_die, &lines, &num_lines, &de) != DW_DLV_OK)
+        return;
+    for (i = 0; i < num_lines; i++) {
+        if (dwarf_lineaddr(lines[i], &addr, &de) != DW_DLV_OK)
+            continue;
+        if (addr < lo)
+            lo = addr;
+        if (addr >= hi)
+            hi = addr + 1;
     }
-    return cu_die;
+    dwarf_srclines_dealloc(mod->dbg, lines, num_lines);
+    add_cu_range(mod, lo, hi, cu_offs, cu_die);
 }
 
 static int
-compare_lines(const void *a_in, const void *b_in)
+compare_cu_ranges(const void *a_in, const void *b_in)
 {
-    const Dwarf_Line a = *(const Dwarf_Line *)a_in;
-    const Dwarf_Line b = *(const Dwarf_Line *)b_in;
-    Dwarf_Addr addr_a, addr_b;
-    Dwarf_Error de; /* expensive to init (DrM#1770) */
-    if (dwarf_lineaddr(a, &addr_a, &de) != DW_DLV_OK ||
-        dwarf_lineaddr(b, &addr_b, &de) != DW_DLV_OK)
-        return 0;
-    if (addr_a > addr_b)
-        return 1;
-    if (addr_a < addr_b)
-        return -1;
+    const cu_range_t *a = (const cu_range_t *)a_in;
+    const cu_range_t *b = (const cu_range_t *)b_in;
+    if (a->lo != b->lo)
+        return a->lo > b->lo ? 1 : -1;
+    if (a->hi != b->hi)
+        return a->hi > b->hi ? 1 : -1;
     return 0;
 }
 
-/* Given a function DIE and a PC, fill out sym_info with line information.
+/* Builds the sorted interval index from .debug_aranges plus a single walk over
+ * every CU, replacing the per-query walks over all CUs that we used to do
+ * whenever .debug_aranges was missing or incomplete.
  */
-bool
-drsym_dwarf_search_addr2line(void *mod_in, Dwarf_Addr pc, drsym_info_t *sym_info INOUT)
+static void
+build_cu_ranges(dwarf_module_t *mod)
 {
-    dwarf_module_t *mod = (dwarf_module_t *)mod_in;
     Dwarf_Error de; /* expensive to init (DrM#1770) */
-    Dwarf_Die cu_die;
+    Dwarf_Arange *arlist;
+    Dwarf_Signed arcnt, i;
     Dwarf_Unsigned cu_offset = 0;
-    bool success = false;
-    search_result_t res;
+    Dwarf_Die cu_die;
+    Dwarf_Addr max_hi = 0;
+    size_t j;
+
+    mod->cu_ranges_built = true;
+    if (dwarf_get_aranges(mod->dbg, &arlist, &arcnt, &de) == DW_DLV_OK) {
+        for (i = 0; i < arcnt; i++) {
+            Dwarf_Addr start;
+            Dwarf_Unsigned length;
+            Dwarf_Off die_offs;
+            if (dwarf_get_arange_info(arlist[i], &start, &length, &die_offs, &de) ==
+                DW_DLV_OK)
+                add_cu_range(mod, start, start + length, die_offs, NULL);
+        }
+    }
 
-    pc += mod->offs_adjust;
+    while (dwarf_next_cu_header(mod->dbg, NULL, NULL, NULL, NULL, &cu_offset, &de) ==
+           DW_DLV_OK) {
+        Dwarf_Off die_offs;
+        /* Scan forward in the tag soup for a CU DIE. */
+        cu_die = next_die_matching_tag(mod->dbg, DW_TAG_compile_unit);
+        if (cu_die == NULL || dwarf_dieoffset(cu_die, &die_offs, &de) != DW_DLV_OK)
+            continue;
+        if (!add_cu_die_ranges(mod, cu_die, die_offs))
+            add_cu_line_span(mod, cu_die, die_offs);
+    }
+    while (dwarf_next_cu_header(mod->dbg, NULL, NULL, NULL, NULL, &cu_offset, &de) ==
+           DW_DLV_OK) {
+        /* Reset the internal CU header state. */
+    }
+
+    if (mod->num_cu_ranges == 0)
+        return;
+    qsort(mod->cu_ranges, mod->num_cu_ranges, sizeof(*mod->cu_ranges),
+          compare_cu_ranges);
+    for (j = 0; j < mod->num_cu_ranges; j++) {
+        if (mod->cu_ranges[j].hi > max_hi)
+            max_hi = mod->cu_ranges[j].hi;
+        mod->cu_ranges[j].max_hi = max_hi;
+    }
+    NOTIFY("%s: indexed %d CU ranges\n", __FUNCTION__, (int)mod->num_cu_ranges);
+}
+
+/* Returns the index of the last CU range starting at or below pc, or -1. */
+static ptr_int_t
+find_cu_range(dwarf_module_t *mod, Dwarf_Addr pc)
+{
+    size_t lo = 0, hi = mod->num_cu_ranges;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (mod->cu_ranges[mid].lo <= pc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return (ptr_int_t)lo - 1;
+}
+
+/* Searches the CUs containing pc.  cursor is NULL for a one-off query. */
+static search_result_t
+search_cu_ranges(dwarf_module_t *mod, Dwarf_Addr pc, bool may_load,
+                 line_cursor_t *cursor, drsym_info_t *sym_info INOUT)
+{
+    search_result_t res, best = SEARCH_NOT_FOUND;
+    bool contained = false;
+    ptr_int_t idx, i;
 
     /* On failure, these should be zeroed.
      */
@@ -204,120 +369,268 @@ drsym_dwarf_search_addr2line(void *mod_in, Dwarf_Addr pc, drsym_info_t *sym_info
     sym_info->line = 0;
     sym_info->line_offs = 0;
 
-    /* First try cutting down the search space by finding the CU (i.e., the .c
-     * file) that this function belongs to.
-     */
-    cu_die = find_cu_die(mod->dbg, pc);
-    if (cu_die == NULL) {
-        NOTIFY("%s: failed to find CU die for " PFX ", searching all CUs\n", __FUNCTION__,
+    if (!mod->cu_ranges_built) {
+        if (!may_load)
+            return SEARCH_NEED_LOAD;
+        build_cu_ranges(mod);
+    }
+
+    if (cursor == NULL || pc < cursor->pc)
+        idx = find_cu_range(mod, pc);
+    else {
+        idx = cursor->cu_idx;
+        while (idx + 1 < (ptr_int_t)mod->num_cu_ranges &&
+               mod->cu_ranges[idx + 1].lo <= pc)
+            idx++;
+    }
+    if (cursor != NULL) {
+        cursor->pc = pc;
+        cursor->cu_idx = idx;
+    }
+
+    /* Search each CU (i.e., .c file) whose ranges contain this PC. */
+    for (i = idx; i >= 0 && mod->cu_ranges[i].max_hi > pc; i--) {
+        if (pc >= mod->cu_ranges[i].hi)
+            continue;
+        contained = true;
+        res = search_addr2line_in_cu(mod, pc, &mod->cu_ranges[i], may_load, cursor,
+                                     sym_info);
+        if (res == SEARCH_FOUND || res == SEARCH_NEED_LOAD)
+            return res;
+        else if (res == SEARCH_MAYBE) {
+            best = SEARCH_MAYBE;
+            /* try to find a better fit: continue searching */
+        }
+    }
+    if (!contained && idx >= 0) {
+        /* The PC lies past the end of every CU that starts below it, which
+         * happens for the tail of a CU whose span came from its line table.
+         * The nearest preceding CU gives the best available fit.
+         */
+        NOTIFY("%s: no CU contains " PFX ", trying the preceding CU\n", __FUNCTION__,
                (ptr_uint_t)pc);
+        return search_addr2line_in_cu(mod, pc, &mod->cu_ranges[idx], may_load, cursor,
+                                      sym_info);
+    }
+    return best;
+}
+
+/* Given a function DIE and a PC, fill out sym_info with line information.
+ */
+bool
+drsym_dwarf_search_addr2line(void *mod_in, Dwarf_Addr pc, drsym_info_t *sym_info INOUT)
+{
+    dwarf_module_t *mod = (dwarf_module_t *)mod_in;
+    search_result_t res;
+
+    pc += mod->offs_adjust;
+
+    if (dr_rwlock_self_owns_write_lock(mod->lock)) {
+        /* A query from an enumeration callback. */
+        res = search_cu_ranges(mod, pc, true, NULL, sym_info);
     } else {
-        return (search_addr2line_in_cu(mod, pc, cu_die, sym_info) != SEARCH_NOT_FOUND);
+        /* Most queries hit cached line tables and proceed in parallel.  Only on a
+         * miss do we retry with exclusive access.
+         */
+        dr_rwlock_read_lock(mod->lock);
+        res = search_cu_ranges(mod, pc, false, NULL, sym_info);
+        dr_rwlock_read_unlock(mod->lock);
+        if (res == SEARCH_NEED_LOAD) {
+            dr_rwlock_write_lock(mod->lock);
+            res = search_cu_ranges(mod, pc, true, NULL, sym_info);
+            dr_rwlock_write_unlock(mod->lock);
+        }
     }
+    return (res == SEARCH_FOUND || res == SEARCH_MAYBE);
+}
 
-    /* We failed to find a CU containing this PC.  Some compilers (clang) don't
-     * put lo_pc hi_pc attributes on compilation units.  In this case, we
-     * iterate all the CUs and dig into the dwarf tag soup for all of them.
+void
+drsym_dwarf_search_addr2line_sorted(void *mod_in, Dwarf_Addr base, const size_t *modoffs,
+                                    size_t count, drsym_info_t *sym_info INOUT,
+                                    drsym_error_t *results INOUT)
+{
+    dwarf_module_t *mod = (dwarf_module_t *)mod_in;
+    bool exclusive = dr_rwlock_self_owns_write_lock(mod->lock);
+    line_cursor_t cursor;
+    size_t i;
+
+    memset(&cursor, 0, sizeof(cursor));
+    cursor.cu_idx = -1;
+    /* We share the lock for the whole batch, taking it exclusively only to load
+     * a line table, just as for a single query.
      */
-    while (dwarf_next_cu_header(mod->dbg, NULL, NULL, NULL, NULL, &cu_offset, &de) ==
-           DW_DLV_OK) {
-        /* Scan forward in the tag soup for a CU DIE. */
-        cu_die = next_die_matching_tag(mod->dbg, DW_TAG_compile_unit);
-
-        /* We found a CU die, now check if it's the one we wanted. */
-        if (cu_die != NULL) {
-            res = search_addr2line_in_cu(mod, pc, cu_die, sym_info);
-            if (res == SEARCH_FOUND) {
-                success = true;
-                break;
-            } else if (res == SEARCH_MAYBE) {
-                success = true;
-                /* try to find a better fit: continue searching */
-            }
+    if (!exclusive)
+        dr_rwlock_read_lock(mod->lock);
+    for (i = 0; i < count; i++) {
+        Dwarf_Addr pc = base + modoffs[i] + mod->offs_adjust;
+        search_result_t res;
+        if (results[i] != DRSYM_SUCCESS)
+            continue;
+        res = search_cu_ranges(mod, pc, exclusive, &cursor, &sym_info[i]);
+        if (res == SEARCH_NEED_LOAD) {
+            dr_rwlock_read_unlock(mod->lock);
+            dr_rwlock_write_lock(mod->lock);
+            res = search_cu_ranges(mod, pc, true, &cursor, &sym_info[i]);
+            dr_rwlock_write_unlock(mod->lock);
+            dr_rwlock_read_lock(mod->lock);
         }
+        if (res != SEARCH_FOUND && res != SEARCH_MAYBE)
+            results[i] = DRSYM_ERROR_LINE_NOT_AVAILABLE;
     }
+    if (!exclusive)
+        dr_rwlock_read_unlock(mod->lock);
+}
 
-    while (dwarf_next_cu_header(mod->dbg, NULL, NULL, NULL, NULL, &cu_offset, &de) ==
-           DW_DLV_OK) {
-        /* Reset the internal CU header state. */
+static void
+free_line_table(dwarf_module_t *mod, line_table_t *table)
+{
+    if (table->lines != NULL)
+        dwarf_srclines_dealloc(mod->dbg, table->lines, table->num_lines);
+    if (table->sorted != NULL) {
+        dr_global_free(table->sorted, (size_t)table->num_lines * sizeof(*table->sorted));
     }
+    memset(table, 0, sizeof(*table));
+}
 
-    return success;
+static int
+compare_lines(const void *a_in, const void *b_in)
+{
+    const sorted_line_t *a = (const sorted_line_t *)a_in;
+    const sorted_line_t *b = (const sorted_line_t *)b_in;
+    if (a->addr > b->addr)
+        return 1;
+    if (a->addr < b->addr)
+        return -1;
+    return 0;
 }
 
-static Dwarf_Signed
-get_lines_from_cu(dwarf_module_t *mod, Dwarf_Die cu_die, Dwarf_Line **lines_out OUT)
+/* Reads the CU's line table into table, sorted by address.  Leaves num_lines at
+ * -1 if the CU has no line info.
+ */
+static void
+load_line_table(dwarf_module_t *mod, Dwarf_Off cu_offs, Dwarf_Die cu_die,
+                line_table_t *table)
 {
-    if (mod->lines_cu != cu_die) {
-        Dwarf_Line *lines;
-        Dwarf_Signed num_lines;
-        Dwarf_Error de; /* expensive to init (DrM#1770) */
-        if (dwarf_srclines(cu_die, &lines, &num_lines, &de) != DW_DLV_OK) {
-            NOTIFY_DWARF(de);
-            return -1;
-        }
-        /* XXX: we should fix libelftc to sort as it builds the table but for now
-         * it's easier to sort and store here
+    Dwarf_Error de; /* expensive to init (DrM#1770) */
+    Dwarf_Signed i;
+
+    table->cu_offs = cu_offs;
+    if (dwarf_srclines(cu_die, &table->lines, &table->num_lines, &de) != DW_DLV_OK) {
+        NOTIFY_DWARF(de);
+        table->lines = NULL;
+        table->num_lines = -1;
+    } else if (table->num_lines > 0) {
+        /* XXX: we should fix libelftc to sort as it builds the table but for
+         * now it's easier to sort and store here.  We pull out the addresses
+         * so neither the sort nor the lookups need to call into libdwarf.
          */
-        qsort(lines, (size_t)num_lines, sizeof(*lines), compare_lines);
-        /* Save for next query */
-        dwarf_srclines_dealloc(mod->dbg, mod->lines, mod->num_lines);
-        mod->lines_cu = cu_die;
-        mod->lines = lines;
-        mod->num_lines = num_lines;
+        table->sorted = (sorted_line_t *)dr_global_alloc((size_t)table->num_lines *
+                                                         sizeof(*table->sorted));
+        for (i = 0; i < table->num_lines; i++) {
+            table->sorted[i].line = table->lines[i];
+            if (dwarf_lineaddr(table->lines[i], &table->sorted[i].addr, &de) !=
+                DW_DLV_OK)
+                table->sorted[i].addr = 0;
+        }
+        qsort(table->sorted, (size_t)table->num_lines, sizeof(*table->sorted),
+              compare_lines);
+    }
+}
+
+/* Returns the line table for the CU through an LRU cache, so that queries
+ * alternating between CUs neither re-read nor re-sort the tables.  Returns NULL
+ * if the table is not cached and !may_load.
+ */
+static line_table_t *
+get_lines_from_cu(dwarf_module_t *mod, cu_range_t *range, bool may_load)
+{
+    line_table_t *table = NULL;
+    Dwarf_Error de; /* expensive to init (DrM#1770) */
+    uint i;
+    int oldest_use = 0;
+
+    for (i = 0; i < LINE_TABLE_CACHE_SIZE; i++) {
+        line_table_t *cand = &mod->line_tables[i];
+        int last_use = dr_atomic_load32(&cand->last_use);
+        if (last_use != 0 && cand->cu_offs == range->cu_offs) {
+            dr_atomic_store32(&cand->last_use,
+                              dr_atomic_add32_return_sum(&mod->line_table_clock, 1));
+            return cand;
+        }
+        if (table == NULL || last_use < oldest_use) {
+            table = cand;
+            oldest_use = last_use;
+        }
     }
-    *lines_out = mod->lines;
-    return mod->num_lines;
+    if (!may_load)
+        return NULL;
+    if (range->cu_die == NULL &&
+        dwarf_offdie(mod->dbg, range->cu_offs, &range->cu_die, &de) != DW_DLV_OK) {
+        NOTIFY_DWARF(de);
+        range->cu_die = NULL;
+        return NULL;
+    }
+    /* Evict the least recently used table and load this CU's. */
+    free_line_table(mod, table);
+    load_line_table(mod, range->cu_offs, range->cu_die, table);
+    dr_atomic_store32(&table->last_use,
+                      dr_atomic_add32_return_sum(&mod->line_table_clock, 1));
+    return table;
 }
 
 static search_result_t
-search_addr2line_in_cu(dwarf_module_t *mod, Dwarf_Addr pc, Dwarf_Die cu_die,
+search_addr2line_in_cu(dwarf_module_t *mod, Dwarf_Addr pc, cu_range_t *range,
+                       bool may_load, line_cursor_t *cursor,
                        drsym_info_t *sym_info INOUT)
 {
-    Dwarf_Line *lines;
-    Dwarf_Signed num_lines;
-    int i;
-    Dwarf_Addr lineaddr, next_lineaddr = 0;
+    line_table_t *table;
+    sorted_line_t *lines;
+    Dwarf_Signed num_lines, lo, hi;
+    Dwarf_Addr lineaddr;
     Dwarf_Line dw_line;
     Dwarf_Error de; /* expensive to init (DrM#1770) */
     search_result_t res = SEARCH_NOT_FOUND;
 
-    num_lines = get_lines_from_cu(mod, cu_die, &lines);
-    if (num_lines < 0)
+    table = get_lines_from_cu(mod, range, may_load);
+    if (table == NULL)
+        return may_load ? SEARCH_NOT_FOUND : SEARCH_NEED_LOAD;
+    lines = table->sorted;
+    num_lines = table->num_lines;
+    if (num_lines <= 0)
         return SEARCH_NOT_FOUND;
 
-    if (verbose) {
-        char *name;
-        if (dwarf_diename(cu_die, &name, &de) == DW_DLV_OK) {
-            NOTIFY("%s: searching cu %s for pc 0" PFX "\n", __FUNCTION__, name,
-                   (ptr_uint_t)pc);
+    if (cursor != NULL && cursor->table == table && cursor->cu_offs == table->cu_offs &&
+        pc >= cursor->line_pc) {
+        /* Merge forward from where the prior query in this table stopped. */
+        lo = cursor->line_idx;
+        while (lo < num_lines && lines[lo].addr <= pc)
+            lo++;
+    } else {
+        /* Binary search for the last line starting at or below pc. */
+        lo = 0;
+        hi = num_lines;
+        while (lo < hi) {
+            Dwarf_Signed mid = lo + (hi - lo) / 2;
+            if (lines[mid].addr <= pc)
+                lo = mid + 1;
+            else
+                hi = mid;
         }
     }
-
-    /* We could binary search this, but we assume dwarf_srclines is the
-     * bottleneck.
-     */
-    dw_line = NULL;
-    for (i = 0; i < num_lines - 1; i++) {
-        if (dwarf_lineaddr(lines[i], &lineaddr, &de) != DW_DLV_OK ||
-            dwarf_lineaddr(lines[i + 1], &next_lineaddr, &de) != DW_DLV_OK) {
-            NOTIFY_DWARF(de);
-            break;
-        }
-        NOTIFY("%s: pc " PFX " vs line " PFX "-" PFX "\n", __FUNCTION__, (ptr_uint_t)pc,
-               (ptr_uint_t)lineaddr, (ptr_uint_t)next_lineaddr);
-        if (lineaddr <= pc && pc < next_lineaddr) {
-            dw_line = lines[i];
-            res = SEARCH_FOUND;
-            break;
-        }
+    if (cursor != NULL) {
+        cursor->table = table;
+        cursor->cu_offs = table->cu_offs;
+        cursor->line_pc = pc;
+        cursor->line_idx = lo;
     }
-    /* Handle the case when the PC is from the last line of the CU. */
-    if (i == num_lines - 1 && dw_line == NULL && next_lineaddr <= pc) {
-        NOTIFY("%s: pc " PFX " vs last line " PFX "\n", __FUNCTION__, (ptr_uint_t)pc,
-               (ptr_uint_t)next_lineaddr);
-        dw_line = lines[num_lines - 1];
-        res = SEARCH_MAYBE;
+    dw_line = NULL;
+    if (lo > 0) {
+        dw_line = lines[lo - 1].line;
+        /* A PC from the last line of the CU may lie beyond its end. */
+        res = (lo == num_lines) ? SEARCH_MAYBE : SEARCH_FOUND;
+        NOTIFY("%s: pc " PFX " in line " PFX " of cu @" PFX "\n", __FUNCTION__,
+               (ptr_uint_t)pc, (ptr_uint_t)lines[lo - 1].addr,
+               (ptr_uint_t)range->cu_offs);
     }
 
     /* If we found dw_line, use it to fill out sym_info. */
@@ -354,9 +667,10 @@ static int
 enumerate_lines_in_cu(dwarf_module_t *mod, Dwarf_Die cu_die,
                       drsym_enumerate_lines_cb callback, void *data)
 {
-    Dwarf_Line *lines;
-    Dwarf_Signed num_lines;
-    int i;
+    line_table_t table;
+    sorted_line_t *lines;
+    Dwarf_Off cu_offs;
+    int i, res = 1;
     Dwarf_Error de; /* expensive to init (DrM#1770) */
     drsym_line_info_t info;
 
@@ -366,8 +680,14 @@ enumerate_lines_in_cu(dwarf_module_t *mod, Dwarf_Die cu_die,
         NOTIFY_DWARF(de);
     }
 
-    num_lines = get_lines_from_cu(mod, cu_die, &lines);
-    if (num_lines < 0) {
+    /* We bypass the cache: a full enumeration would just flush it. */
+    memset(&table, 0, sizeof(table));
+    if (dwarf_dieoffset(cu_die, &cu_offs, &de) != DW_DLV_OK) {
+        NOTIFY_DWARF(de);
+        table.num_lines = -1;
+    } else
+        load_line_table(mod, cu_offs, cu_die, &table);
+    if (table.num_lines < 0) {
         /* This cu has no line info.  Don't bail: keep going. */
         info.file = NULL;
         info.line = 0;
@@ -377,36 +697,39 @@ enumerate_lines_in_cu(dwarf_module_t *mod, Dwarf_Die cu_die,
         return 1;
     }
 
-    for (i = 0; i < num_lines; i++) {
+    lines = table.sorted;
+    for (i = 0; i < table.num_lines; i++) {
         Dwarf_Unsigned lineno;
-        Dwarf_Addr lineaddr;
 
         /* We do not want to bail on failure of any of these: we want to
          * provide as much information as possible.
          */
-        if (dwarf_linesrc(lines[i], (char **)&info.file, &de) != DW_DLV_OK) {
+        if (dwarf_linesrc(lines[i].line, (char **)&info.file, &de) != DW_DLV_OK) {
             NOTIFY_DWARF(de);
             info.file = NULL;
         }
 
-        if (dwarf_lineno(lines[i], &lineno, &de) != DW_DLV_OK) {
+        if (dwarf_lineno(lines[i].line, &lineno, &de) != DW_DLV_OK) {
             NOTIFY_DWARF(de);
             info.line = 0;
         } else
             info.line = lineno;
 
-        if (dwarf_lineaddr(lines[i], &lineaddr, &de) != DW_DLV_OK) {
-            NOTIFY_DWARF(de);
+        if (lines[i].addr == 0)
             info.line_addr = 0;
-        } else {
-            info.line_addr = (size_t)(lineaddr - (Dwarf_Addr)(ptr_uint_t)mod->load_base -
+        else {
+            info.line_addr = (size_t)(lines[i].addr -
+                                      (Dwarf_Addr)(ptr_uint_t)mod->load_base -
                                       mod->offs_adjust);
         }
-        if (!(*callback)(&info, data))
-            return 0;
+        if (!(*callback)(&info, data)) {
+            res = 0;
+            break;
+        }
     }
 
-    return 1;
+    free_line_table(mod, &table);
+    return res;
 }
 
 drsym_error_t
@@ -418,6 +741,12 @@ drsym_dwarf_enumerate_lines(void *mod_in, drsym_enumerate_lines_cb callback, voi
     Dwarf_Die cu_die;
     Dwarf_Unsigned cu_offset = 0;
 
+    /* Callbacks may issue queries, which detect that we hold the lock. */
+    dr_rwlock_write_lock(mod->lock);
+    /* Build the ranges now as that walk would disrupt ours if done by a query. */
+    if (!mod->cu_ranges_built)
+        build_cu_ranges(mod);
+
     /* Enumerate all CU's */
     while (dwarf_next_cu_header(mod->dbg, NULL, NULL, NULL, NULL, &cu_offset, &de) ==
            DW_DLV_OK) {
@@ -437,6 +766,7 @@ drsym_dwarf_enumerate_lines(void *mod_in, drsym_enumerate_lines_cb callback, voi
         /* Reset the internal CU header state. */
     }
 
+    dr_rwlock_write_unlock(mod->lock);
     return success;
 }
 
@@ -446,6 +776,7 @@ drsym_dwarf_init(Dwarf_Debug dbg)
     dwarf_module_t *mod = (dwarf_module_t *)dr_global_alloc(sizeof(*mod));
     memset(mod, 0, sizeof(*mod));
     mod->dbg = dbg;
+    mod->lock = dr_rwlock_create();
     return mod;
 }
 
@@ -453,9 +784,15 @@ void
 drsym_dwarf_exit(void *mod_in)
 {
     dwarf_module_t *mod = (dwarf_module_t *)mod_in;
-    if (mod->lines != NULL)
-        dwarf_srclines_dealloc(mod->dbg, mod->lines, mod->num_lines);
+    uint i;
+    for (i = 0; i < LINE_TABLE_CACHE_SIZE; i++)
+        free_line_table(mod, &mod->line_tables[i]);
+    if (mod->cu_ranges != NULL) {
+        dr_global_free(mod->cu_ranges,
+                       mod->cu_ranges_capacity * sizeof(*mod->cu_ranges));
+    }
     dwarf_finish(mod->dbg, NULL);
+    dr_rwlock_destroy(mod->lock);
     dr_global_free(mod, sizeof(*mod));
 }
 
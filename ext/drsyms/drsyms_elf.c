@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2011-2020 Google, Inc.  All rights reserved.
+ * Copyright (c) 2011-2022 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -48,19 +48,12 @@
 #include <unistd.h>
 #include <errno.h>
 #include <limits.h>
+#include <stdlib.h> /* qsort */
 
 #ifndef MIN
 #    define MIN(x, y) ((x) <= (y) ? (x) : (y))
 #endif
 
-#ifndef SIZE_T_MAX
-#    ifdef X64
-#        define SIZE_T_MAX ULLONG_MAX
-#    else
-#        define SIZE_T_MAX UINT_MAX
-#    endif
-#endif
-
 static bool verbose = 0;
 
 #undef NOTIFY
@@ -118,11 +111,25 @@ static bool verbose = 0;
 #    define ELF_ST_TYPE ELF32_ST_TYPE
 #endif
 
+/* An entry in the address-sorted view of the symbol table.  max_hi holds the
+ * highest end offset of this and all prior entries, bounding how far back a
+ * lookup must walk to find every symbol containing an offset.
+ */
+typedef struct _sym_order_t {
+    size_t lo_offs;
+    size_t max_hi;
+    uint idx;
+} sym_order_t;
+
 typedef struct _elf_info_t {
     Elf *elf;
     Elf_Sym *syms;
     int strtab_idx;
     int num_syms;
+    /* Built at load time, like the sorted symbols of the other formats, so that
+     * concurrent lookups only read it.  It depends on load_base.
+     */
+    sym_order_t *sym_order;
     byte *map_base;
     ptr_uint_t load_base;
     drsym_debug_kind_t debug_kind;
@@ -258,6 +265,43 @@ drsym_obj_init(void)
     elf_version(EV_CURRENT);
 }
 
+static int
+compare_sym_order(const void *a_in, const void *b_in)
+{
+    const sym_order_t *a = (const sym_order_t *)a_in;
+    const sym_order_t *b = (const sym_order_t *)b_in;
+    if (a->lo_offs != b->lo_offs)
+        return a->lo_offs > b->lo_offs ? 1 : -1;
+    if (a->idx != b->idx)
+        return a->idx > b->idx ? 1 : -1;
+    return 0;
+}
+
+static void
+build_sym_order(elf_info_t *mod)
+{
+    size_t max_hi = 0;
+    int i;
+    if (mod->syms == NULL || mod->num_syms == 0)
+        return;
+    if (mod->sym_order != NULL)
+        dr_global_free(mod->sym_order, mod->num_syms * sizeof(*mod->sym_order));
+    mod->sym_order =
+        (sym_order_t *)dr_global_alloc(mod->num_syms * sizeof(*mod->sym_order));
+    for (i = 0; i < mod->num_syms; i++) {
+        mod->sym_order[i].lo_offs = mod->syms[i].st_value - mod->load_base;
+        mod->sym_order[i].idx = i;
+    }
+    qsort(mod->sym_order, mod->num_syms, sizeof(*mod->sym_order), compare_sym_order);
+    for (i = 0; i < mod->num_syms; i++) {
+        sym_order_t *entry = &mod->sym_order[i];
+        size_t hi_offs = entry->lo_offs + mod->syms[entry->idx].st_size;
+        if (hi_offs > max_hi)
+            max_hi = hi_offs;
+        mod->sym_order[i].max_hi = max_hi;
+    }
+}
+
 void *
 drsym_obj_mod_init_pre(byte *map_base, size_t map_size)
 {
@@ -304,6 +348,17 @@ drsym_obj_mod_init_pre(byte *map_base, size_t map_size)
         }
     }
 
+    if (mod->num_syms > 0) {
+        /* A module whose DWARF is in a separate debuglink file keeps a load_base
+         * of 0, while drsym_obj_mod_init_post() re-sorts the rest.
+         */
+        build_sym_order(mod);
+        /* libelf reads in the string table on first use: do so now, while we
+         * have exclusive access to the module.
+         */
+        drsym_obj_symbol_name(mod, 0);
+    }
+
     if (find_elf_section_by_name(mod->elf, ".debug_line") != NULL) {
         mod->debug_kind |= DRSYM_LINE_NUMS | DRSYM_DWARF_LINE;
     }
@@ -319,6 +374,8 @@ drsym_obj_mod_init_post(void *mod_in, byte *map_base, void *dwarf_info)
     elf_info_t *mod = (elf_info_t *)mod_in;
     mod->map_base = map_base; /* shouldn't change, though */
     mod->load_base = find_load_base(mod->elf);
+    if (mod->load_base != 0)
+        build_sym_order(mod);
     return true;
 }
 
@@ -344,6 +401,8 @@ drsym_obj_mod_exit(void *mod_in)
         return;
     if (mod->elf != NULL)
         elf_end(mod->elf);
+    if (mod->sym_order != NULL)
+        dr_global_free(mod->sym_order, mod->num_syms * sizeof(*mod->sym_order));
     dr_global_free(mod, sizeof(*mod));
 }
 
@@ -432,46 +491,59 @@ drsym_obj_symbol_offs(void *mod_in, uint idx, size_t *offs_start OUT,
     return DRSYM_SUCCESS;
 }
 
-drsym_error_t
-drsym_obj_addrsearch_symtab(void *mod_in, size_t modoffs, uint *idx OUT)
+/* Returns the number of sym_order entries starting at or below modoffs. */
+static int
+find_sym_order(elf_info_t *mod, size_t modoffs)
+{
+    int lo = 0, hi = mod->num_syms;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (mod->sym_order[mid].lo_offs <= modoffs)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Finds the symbol for modoffs given the count lo from find_sym_order(). */
+static drsym_error_t
+addrsearch_sym_order(elf_info_t *mod, size_t modoffs, int lo, uint *idx OUT)
 {
-    elf_info_t *mod = (elf_info_t *)mod_in;
     int i;
+    int found_idx = -1;
     int closest_idx = -1;
-    size_t closest_diff = SIZE_T_MAX;
-
-    if (mod == NULL || mod->syms == NULL || idx == NULL)
-        return DRSYM_ERROR;
 
-    NOTIFY(1, "%s: +" PIFX "\n", __FUNCTION__, modoffs);
-    /* XXX: if a function is split into non-contiguous pieces, will it
+    /* Where several symbols contain modoffs we return the first in the table.
+     * XXX: if a function is split into non-contiguous pieces, will it
      * have multiple entries?
      */
-    for (i = 0; i < mod->num_syms; i++) {
-        size_t lo_offs = mod->syms[i].st_value - mod->load_base;
-        size_t hi_offs = lo_offs + mod->syms[i].st_size;
-        NOTIFY(3, "\tcomparing +" PIFX " to " PIFX "-" PIFX "\n", modoffs, lo_offs,
-               hi_offs);
-        if (lo_offs <= modoffs && modoffs < hi_offs) {
-            NOTIFY(2, "\tfound +" PIFX " in " PIFX "-" PIFX "\n", modoffs, lo_offs,
-                   hi_offs);
-            *idx = i;
-            return DRSYM_SUCCESS;
-        }
-        /* i#1337: handle st_size==0 asm routines */
-        if (modoffs >= lo_offs) {
-            if (modoffs - lo_offs < closest_diff) {
-                closest_idx = i;
-                closest_diff = modoffs - lo_offs;
-                NOTIFY(3, "\tclosest diff is now " PIFX "\n", closest_diff);
-            }
-        }
+    for (i = lo - 1; i >= 0 && mod->sym_order[i].max_hi > modoffs; i--) {
+        const sym_order_t *entry = &mod->sym_order[i];
+        size_t hi_offs = entry->lo_offs + mod->syms[entry->idx].st_size;
+        NOTIFY(3, "\tcomparing +" PIFX " to " PIFX "-" PIFX "\n", modoffs,
+               entry->lo_offs, hi_offs);
+        if (modoffs < hi_offs && (found_idx < 0 || (int)entry->idx < found_idx))
+            found_idx = entry->idx;
+    }
+    if (found_idx >= 0) {
+        NOTIFY(2, "\tfound +" PIFX " in symbol %d\n", modoffs, found_idx);
+        *idx = found_idx;
+        return DRSYM_SUCCESS;
     }
 
+    /* i#1337: handle st_size==0 asm routines.  The closest symbol is the first
+     * in the table among those with the highest start at or below modoffs.
+     */
+    if (lo > 0) {
+        size_t closest_offs = mod->sym_order[lo - 1].lo_offs;
+        for (i = lo - 1; i >= 0 && mod->sym_order[i].lo_offs == closest_offs; i--)
+            closest_idx = mod->sym_order[i].idx;
+    }
     if (closest_idx >= 0 && mod->syms[closest_idx].st_size == 0) {
         /* i#1337: rule out anything without a name */
-        const char *name = drsym_obj_symbol_name(mod_in, closest_idx);
-        NOTIFY(2, "\tusing closest +" PIFX " diff " PIFX "\n", modoffs, closest_diff);
+        const char *name = drsym_obj_symbol_name(mod, closest_idx);
+        NOTIFY(2, "\tusing closest +" PIFX " symbol %d\n", modoffs, closest_idx);
         if (name != NULL && name[0] != '\0') {
             *idx = closest_idx;
             return DRSYM_SUCCESS;
@@ -481,6 +553,43 @@ drsym_obj_addrsearch_symtab(void *mod_in, size_t modoffs, uint *idx OUT)
     return DRSYM_ERROR_SYMBOL_NOT_FOUND;
 }
 
+drsym_error_t
+drsym_obj_addrsearch_symtab(void *mod_in, size_t modoffs, uint *idx OUT)
+{
+    elf_info_t *mod = (elf_info_t *)mod_in;
+
+    if (mod == NULL || mod->syms == NULL || idx == NULL)
+        return DRSYM_ERROR;
+
+    NOTIFY(1, "%s: +" PIFX "\n", __FUNCTION__, modoffs);
+    return addrsearch_sym_order(mod, modoffs, find_sym_order(mod, modoffs), idx);
+}
+
+drsym_error_t
+drsym_obj_addrsearch_symtab_sorted(void *mod_in, size_t modoffs, uint *cursor INOUT,
+                                   uint *idx OUT)
+{
+    elf_info_t *mod = (elf_info_t *)mod_in;
+    int lo;
+
+    if (mod == NULL || mod->syms == NULL || cursor == NULL || idx == NULL)
+        return DRSYM_ERROR;
+
+    NOTIFY(1, "%s: +" PIFX "\n", __FUNCTION__, modoffs);
+    /* The cursor holds the count from the prior query, so for ascending queries
+     * we merge forward through the sorted symbols rather than searching anew.
+     */
+    lo = (int)*cursor;
+    if (lo > mod->num_syms || (lo > 0 && mod->sym_order[lo - 1].lo_offs > modoffs))
+        lo = find_sym_order(mod, modoffs);
+    else {
+        while (lo < mod->num_syms && mod->sym_order[lo].lo_offs <= modoffs)
+            lo++;
+    }
+    *cursor = (uint)lo;
+    return addrsearch_sym_order(mod, modoffs, lo, idx);
+}
+
 const char *
 drsym_obj_build_id(void *mod_in)
 {
@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2011-2020 Google, Inc.  All rights reserved.
+ * Copyright (c) 2011-2022 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -95,6 +95,13 @@ drsym_obj_symbol_offs(void *mod_in, uint idx, size_t *offs_start OUT,
 drsym_error_t
 drsym_obj_addrsearch_symtab(void *mod_in, size_t modoffs, uint *idx OUT);
 
+/* Like drsym_obj_addrsearch_symtab() but faster for a series of queries in
+ * ascending order of modoffs, which pass the same *cursor, initially 0.
+ */
+drsym_error_t
+drsym_obj_addrsearch_symtab_sorted(void *mod_in, size_t modoffs, uint *cursor INOUT,
+                                   uint *idx OUT);
+
 bool
 drsym_obj_same_file(const char *path1, const char *path2);
 
@@ -123,6 +130,15 @@ drsym_dwarf_set_load_base(void *mod_in, byte *load_base);
 bool
 drsym_dwarf_search_addr2line(void *mod_in, Dwarf_Addr pc, drsym_info_t *sym_info INOUT);
 
+/* Fills in line information for each entry whose result is DRSYM_SUCCESS, at
+ * base plus its modoffs, which should ascend for best performance.  Sets the
+ * result to DRSYM_ERROR_LINE_NOT_AVAILABLE where none is found.
+ */
+void
+drsym_dwarf_search_addr2line_sorted(void *mod_in, Dwarf_Addr base, const size_t *modoffs,
+                                    size_t count, drsym_info_t *sym_info INOUT,
+                                    drsym_error_t *results INOUT);
+
 drsym_error_t
 drsym_dwarf_enumerate_lines(void *mod_in, drsym_enumerate_lines_cb callback, void *data);
 
@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2012-2020 Google, Inc.  All rights reserved.
+ * Copyright (c) 2012-2022 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -574,6 +574,16 @@ drsym_obj_addrsearch_symtab(void *mod_in, size_t modoffs, uint *idx OUT)
     return DRSYM_ERROR_SYMBOL_NOT_FOUND;
 }
 
+drsym_error_t
+drsym_obj_addrsearch_symtab_sorted(void *mod_in, size_t modoffs, uint *cursor INOUT,
+                                   uint *idx OUT)
+{
+    /* XXX: we could merge forward through sorted_syms[] from the cursor as ELF
+     * does, but these formats are rarely symbolized in bulk.
+     */
+    return drsym_obj_addrsearch_symtab(mod_in, modoffs, idx);
+}
+
 /******************************************************************************
  * Exports-only
  */
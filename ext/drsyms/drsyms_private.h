@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2011-2016 Google, Inc.  All rights reserved.
+ * Copyright (c) 2011-2022 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -82,7 +82,9 @@ pool_alloc(mempool_t *pool, size_t sz);
 
 /***************************************************************************
  * Cygwin interface from Unix to Windows
- * For all of these, the caller is responsible for synchronization
+ * For all of these, the caller is responsible for synchronization, except that
+ * lookups of addresses and symbols in an already loaded module may run
+ * concurrently with each other.
  */
 
 void
@@ -101,6 +103,11 @@ drsym_error_t
 drsym_unix_lookup_address(void *moddata, size_t modoffs, drsym_info_t *out INOUT,
                           uint flags);
 
+drsym_error_t
+drsym_unix_lookup_addresses(void *moddata, const size_t *modoffs, size_t count,
+                            drsym_info_t *info INOUT, drsym_error_t *results OUT,
+                            uint flags);
+
 drsym_error_t
 drsym_unix_lookup_symbol(void *moddata, const char *symbol, size_t *modoffs OUT,
                          uint flags);
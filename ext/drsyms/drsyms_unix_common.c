@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2011-2020 Google, Inc.  All rights reserved.
+ * Copyright (c) 2011-2022 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -76,6 +76,8 @@ typedef struct _dbg_module_t {
     struct _dbg_module_t *mod_with_dwarf;
 #define SYMTABLE_HASH_BITS 12
     hashtable_t symtable;
+    /* Guards the lazy filling of symtable, after which lookups share it. */
+    void *symtable_lock;
 } dbg_module_t;
 
 /******************************************************************************
@@ -151,7 +153,11 @@ load_module(const char *modpath)
     config.resizable = true;
     config.resize_threshold = 70;
     config.free_key_func = drsym_free_hash_key;
+    /* The table is filled once and then only queried. */
+    config.open_address = true;
+    config.read_mostly = false;
     hashtable_configure(&mod->symtable, &config);
+    mod->symtable_lock = dr_rwlock_create();
 
     /* We need to partially initialize in order to get the debug info */
     mod->obj_info = drsym_obj_mod_init_pre(mod->map_base, mod->file_size);
@@ -326,6 +332,8 @@ unload_module(dbg_module_t *mod)
         drsym_obj_mod_exit(mod->obj_info);
     if (mod->symtable.table != NULL)
         hashtable_delete(&mod->symtable);
+    if (mod->symtable_lock != NULL)
+        dr_rwlock_destroy(mod->symtable_lock);
     if (mod->map_base != NULL)
         dr_unmap_file(mod->map_base, mod->map_size);
     if (mod->fd != INVALID_FILE)
@@ -428,16 +436,12 @@ symsearch_symtab(dbg_module_t *mod, drsym_enumerate_cb callback,
     return res;
 }
 
+/* Fills in the name and bounds of symbol idx. */
 static drsym_error_t
-addrsearch_symtab(dbg_module_t *mod, size_t modoffs, drsym_info_t *info INOUT, uint flags)
+fill_symbol_info(dbg_module_t *mod, uint idx, drsym_info_t *info INOUT, uint flags)
 {
     const char *symbol;
     size_t name_len = 0;
-    uint idx;
-    drsym_error_t res = drsym_obj_addrsearch_symtab(mod->obj_info, modoffs, &idx);
-
-    if (res != DRSYM_SUCCESS)
-        return res;
 
     symbol = drsym_obj_symbol_name(mod->obj_info, idx);
     if (symbol == NULL)
@@ -460,6 +464,17 @@ addrsearch_symtab(dbg_module_t *mod, size_t modoffs, drsym_info_t *info INOUT, u
     return drsym_obj_symbol_offs(mod->obj_info, idx, &info->start_offs, &info->end_offs);
 }
 
+static drsym_error_t
+addrsearch_symtab(dbg_module_t *mod, size_t modoffs, drsym_info_t *info INOUT, uint flags)
+{
+    uint idx;
+    drsym_error_t res = drsym_obj_addrsearch_symtab(mod->obj_info, modoffs, &idx);
+
+    if (res != DRSYM_SUCCESS)
+        return res;
+    return fill_symbol_info(mod, idx, info, flags);
+}
+
 /******************************************************************************
  * Hashtable building for symbol lookup.
  *
@@ -651,12 +666,20 @@ drsym_unix_lookup_symbol(void *mod_in, const char *symbol, size_t *modoffs OUT,
     }
 
     if (*modoffs == 0) {
+        dr_rwlock_read_lock(mod->symtable_lock);
         if (mod->symtable.entries == 0) {
-            /* Initialize the hashtable. */
-            symsearch_symtab(mod, drsym_fill_symtable_cb, NULL, sizeof(drsym_info_t), mod,
-                             DRSYM_LEAVE_MANGLED);
+            dr_rwlock_read_unlock(mod->symtable_lock);
+            dr_rwlock_write_lock(mod->symtable_lock);
+            if (mod->symtable.entries == 0) {
+                /* Initialize the hashtable. */
+                symsearch_symtab(mod, drsym_fill_symtable_cb, NULL, sizeof(drsym_info_t),
+                                 mod, DRSYM_LEAVE_MANGLED);
+            }
+            dr_rwlock_write_unlock(mod->symtable_lock);
+            dr_rwlock_read_lock(mod->symtable_lock);
         }
         *modoffs = (size_t)hashtable_lookup(&mod->symtable, (void *)sym_no_mod);
+        dr_rwlock_read_unlock(mod->symtable_lock);
     }
     if (*modoffs == 0)
         return DRSYM_ERROR_SYMBOL_NOT_FOUND;
@@ -699,6 +722,65 @@ drsym_unix_lookup_address(void *mod_in, size_t modoffs, drsym_info_t *out INOUT,
     return r;
 }
 
+drsym_error_t
+drsym_unix_lookup_addresses(void *mod_in, const size_t *modoffs, size_t count,
+                            drsym_info_t *info INOUT, drsym_error_t *results OUT,
+                            uint flags)
+{
+    dbg_module_t *mod = (dbg_module_t *)mod_in;
+    dbg_module_t *mod4line = mod;
+    drsym_info_t *prev = NULL;
+    uint cursor = 0, idx, prev_idx = 0;
+    size_t i;
+
+    /* Sweep the symbol table first.  A run of offsets in one symbol shares its
+     * name rather than demangling it again for each.
+     */
+    for (i = 0; i < count; i++) {
+        drsym_info_t *out = &info[i];
+        results[i] =
+            drsym_obj_addrsearch_symtab_sorted(mod->obj_info, modoffs[i], &cursor, &idx);
+        if (results[i] == DRSYM_SUCCESS) {
+            if (prev != NULL && idx == prev_idx && out->name != NULL &&
+                strlen(prev->name) + 1 < prev->name_size) {
+                strncpy(out->name, prev->name, out->name_size);
+                out->name[out->name_size - 1] = '\0';
+                out->name_available_size = prev->name_available_size;
+                out->start_offs = prev->start_offs;
+                out->end_offs = prev->end_offs;
+            } else {
+                results[i] = fill_symbol_info(mod, idx, out, flags);
+                if (results[i] == DRSYM_SUCCESS && out->name != NULL) {
+                    prev = out;
+                    prev_idx = idx;
+                }
+            }
+        }
+        out->debug_kind = mod->debug_kind;
+        /* Fields beyond name require compatibility checks */
+        if (out->struct_size > offsetof(drsym_info_t, flags)) {
+            /* Remove unsupported flags */
+            out->flags = flags & ~(UNSUPPORTED_NONPDB_FLAGS);
+        }
+    }
+
+    /* Then sweep the line tables for the offsets with symbols. */
+    if (mod->mod_with_dwarf != NULL)
+        mod4line = mod->mod_with_dwarf;
+    if (mod4line->dwarf_info != NULL) {
+        drsym_dwarf_search_addr2line_sorted(
+            mod4line->dwarf_info,
+            (Dwarf_Addr)(ptr_uint_t)drsym_obj_load_base(mod->obj_info), modoffs, count,
+            info, results);
+    } else {
+        for (i = 0; i < count; i++) {
+            if (results[i] == DRSYM_SUCCESS)
+                results[i] = DRSYM_ERROR_LINE_NOT_AVAILABLE;
+        }
+    }
+    return DRSYM_SUCCESS;
+}
+
 drsym_error_t
 drsym_unix_enumerate_lines(void *mod_in, drsym_enumerate_lines_cb callback, void *data)
 {
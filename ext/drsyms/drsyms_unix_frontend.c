@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2011-2014 Google, Inc.  All rights reserved.
+ * Copyright (c) 2011-2022 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -47,13 +47,20 @@
 #include "drsyms_private.h"
 #include "hashtable.h"
 
-/* Guards our internal state and libdwarf's modifications of mod->dbg.
- * We use a recursive lock to allow queries to be called from enumerate callbacks.
+/* Guards modtable and the lifetime of the modules in it.  Lookups in a loaded
+ * module hold it for reading and run concurrently, relying on each module to
+ * guard any state it builds lazily.  Loading, freeing, and enumerating hold it for
+ * writing.  Queries from enumeration callbacks find it already held by their
+ * thread and proceed without it; for the same reason, we must not free a module
+ * from such a callback.
  */
 static void *symbol_lock;
 
-/* We have to restrict operations when operating in a nested query from a callback */
-static bool recursive_context;
+typedef enum {
+    MODULE_UNLOCKED, /* The thread already holds symbol_lock for writing. */
+    MODULE_READ_LOCKED,
+    MODULE_WRITE_LOCKED,
+} module_lock_t;
 
 /* Hashtable for mapping module paths to dbg_module_t*. */
 #define MODTABLE_HASH_BITS 8
@@ -81,29 +88,73 @@ lookup_or_load(const char *modpath)
     return mod;
 }
 
+/* Returns the module, loading it if necessary, with symbol_lock held for reading
+ * if it was already loaded and for writing otherwise.  The caller must pass
+ * *lock to release_module() even when NULL is returned.
+ */
+static void *
+acquire_module(const char *modpath, module_lock_t *lock OUT)
+{
+    void *mod;
+    if (dr_rwlock_self_owns_write_lock(symbol_lock)) {
+        *lock = MODULE_UNLOCKED;
+        return lookup_or_load(modpath);
+    }
+    dr_rwlock_read_lock(symbol_lock);
+    mod = hashtable_lookup(&modtable, (void *)modpath);
+    if (mod != NULL) {
+        *lock = MODULE_READ_LOCKED;
+        return mod;
+    }
+    dr_rwlock_read_unlock(symbol_lock);
+    dr_rwlock_write_lock(symbol_lock);
+    *lock = MODULE_WRITE_LOCKED;
+    return lookup_or_load(modpath);
+}
+
+static void
+release_module(module_lock_t lock)
+{
+    if (lock == MODULE_READ_LOCKED)
+        dr_rwlock_read_unlock(symbol_lock);
+    else if (lock == MODULE_WRITE_LOCKED)
+        dr_rwlock_write_unlock(symbol_lock);
+}
+
+/* Like acquire_module() but always with exclusive access. */
+static void *
+acquire_module_exclusive(const char *modpath, module_lock_t *lock OUT)
+{
+    if (dr_rwlock_self_owns_write_lock(symbol_lock))
+        *lock = MODULE_UNLOCKED;
+    else {
+        dr_rwlock_write_lock(symbol_lock);
+        *lock = MODULE_WRITE_LOCKED;
+    }
+    return lookup_or_load(modpath);
+}
+
 static drsym_error_t
 drsym_enumerate_symbols_local(const char *modpath, drsym_enumerate_cb callback,
                               drsym_enumerate_ex_cb callback_ex, size_t info_size,
                               void *data, uint flags)
 {
     void *mod;
+    module_lock_t lock;
     drsym_error_t r;
 
     if (modpath == NULL || (callback == NULL && callback_ex == NULL))
         return DRSYM_ERROR_INVALID_PARAMETER;
 
-    dr_recurlock_lock(symbol_lock);
-    mod = lookup_or_load(modpath);
+    mod = acquire_module_exclusive(modpath, &lock);
     if (mod == NULL) {
-        dr_recurlock_unlock(symbol_lock);
+        release_module(lock);
         return DRSYM_ERROR_LOAD_FAILED;
     }
 
-    recursive_context = true;
     r = drsym_unix_enumerate_symbols(mod, callback, callback_ex, info_size, data, flags);
-    recursive_context = false;
 
-    dr_recurlock_unlock(symbol_lock);
+    release_module(lock);
     return r;
 }
 
@@ -112,21 +163,21 @@ drsym_lookup_symbol_local(const char *modpath, const char *symbol, size_t *modof
                           uint flags)
 {
     void *mod;
+    module_lock_t lock;
     drsym_error_t r;
 
     if (modpath == NULL || symbol == NULL || modoffs == NULL)
         return DRSYM_ERROR_INVALID_PARAMETER;
 
-    dr_recurlock_lock(symbol_lock);
-    mod = lookup_or_load(modpath);
+    mod = acquire_module(modpath, &lock);
     if (mod == NULL) {
-        dr_recurlock_unlock(symbol_lock);
+        release_module(lock);
         return DRSYM_ERROR_LOAD_FAILED;
     }
 
     r = drsym_unix_lookup_symbol(mod, symbol, modoffs, flags);
 
-    dr_recurlock_unlock(symbol_lock);
+    release_module(lock);
     return r;
 }
 
@@ -135,6 +186,7 @@ drsym_lookup_address_local(const char *modpath, size_t modoffs, drsym_info_t *ou
                            uint flags)
 {
     void *mod;
+    module_lock_t lock;
     drsym_error_t r;
 
     if (modpath == NULL || out == NULL)
@@ -143,16 +195,45 @@ drsym_lookup_address_local(const char *modpath, size_t modoffs, drsym_info_t *ou
     if (out->struct_size != sizeof(*out))
         return DRSYM_ERROR_INVALID_SIZE;
 
-    dr_recurlock_lock(symbol_lock);
-    mod = lookup_or_load(modpath);
+    mod = acquire_module(modpath, &lock);
     if (mod == NULL) {
-        dr_recurlock_unlock(symbol_lock);
+        release_module(lock);
         return DRSYM_ERROR_LOAD_FAILED;
     }
 
     r = drsym_unix_lookup_address(mod, modoffs, out, flags);
 
-    dr_recurlock_unlock(symbol_lock);
+    release_module(lock);
+    return r;
+}
+
+static drsym_error_t
+drsym_lookup_addresses_local(const char *modpath, const size_t *modoffs, size_t count,
+                             drsym_info_t *info INOUT, drsym_error_t *results OUT,
+                             uint flags)
+{
+    void *mod;
+    module_lock_t lock;
+    drsym_error_t r;
+    size_t i;
+
+    if (modpath == NULL || (count > 0 && (modoffs == NULL || info == NULL ||
+                                          results == NULL)))
+        return DRSYM_ERROR_INVALID_PARAMETER;
+    for (i = 0; i < count; i++) {
+        if (info[i].struct_size != sizeof(info[i]))
+            return DRSYM_ERROR_INVALID_SIZE;
+    }
+
+    mod = acquire_module(modpath, &lock);
+    if (mod == NULL) {
+        release_module(lock);
+        return DRSYM_ERROR_LOAD_FAILED;
+    }
+
+    r = drsym_unix_lookup_addresses(mod, modoffs, count, info, results, flags);
+
+    release_module(lock);
     return r;
 }
 
@@ -161,21 +242,21 @@ drsym_enumerate_lines_local(const char *modpath, drsym_enumerate_lines_cb callba
                             void *data)
 {
     void *mod;
+    module_lock_t lock;
     drsym_error_t res;
 
     if (modpath == NULL || callback == NULL)
         return DRSYM_ERROR_INVALID_PARAMETER;
 
-    dr_recurlock_lock(symbol_lock);
-    mod = lookup_or_load(modpath);
+    mod = acquire_module_exclusive(modpath, &lock);
     if (mod == NULL) {
-        dr_recurlock_unlock(symbol_lock);
+        release_module(lock);
         return DRSYM_ERROR_LOAD_FAILED;
     }
 
     res = drsym_unix_enumerate_lines(mod, callback, data);
 
-    dr_recurlock_unlock(symbol_lock);
+    release_module(lock);
     return res;
 }
 
@@ -196,7 +277,7 @@ drsym_init(int shmid_in)
 
     shmid = shmid_in;
 
-    symbol_lock = dr_recurlock_create();
+    symbol_lock = dr_rwlock_create();
 
     drsym_unix_init();
 
@@ -229,7 +310,7 @@ drsym_exit(void)
         /* FIXME NYI i#446 */
     }
     hashtable_delete(&modtable);
-    dr_recurlock_destroy(symbol_lock);
+    dr_rwlock_destroy(symbol_lock);
     return res;
 }
 
@@ -245,6 +326,19 @@ drsym_lookup_address(const char *modpath, size_t modoffs, drsym_info_t *out INOU
     }
 }
 
+DR_EXPORT
+drsym_error_t
+drsym_lookup_addresses(const char *modpath, const size_t *modoffs, size_t count,
+                       drsym_info_t *info INOUT, drsym_error_t *results OUT, uint flags)
+{
+    if (IS_SIDELINE) {
+        return DRSYM_ERROR_NOT_IMPLEMENTED;
+    } else {
+        return drsym_lookup_addresses_local(modpath, modoffs, count, info, results,
+                                            flags);
+    }
+}
+
 DR_EXPORT
 drsym_error_t
 drsym_lookup_symbol(const char *modpath, const char *symbol, size_t *modoffs OUT,
@@ -322,15 +416,15 @@ drsym_get_module_debug_kind(const char *modpath, drsym_debug_kind_t *kind OUT)
         return DRSYM_ERROR_NOT_IMPLEMENTED;
     } else {
         void *mod;
+        module_lock_t lock;
         drsym_error_t r;
 
         if (modpath == NULL || kind == NULL)
             return DRSYM_ERROR_INVALID_PARAMETER;
 
-        dr_recurlock_lock(symbol_lock);
-        mod = lookup_or_load(modpath);
+        mod = acquire_module(modpath, &lock);
         r = drsym_unix_get_module_debug_kind(mod, kind);
-        dr_recurlock_unlock(symbol_lock);
+        release_module(lock);
         return r;
     }
 }
@@ -359,12 +453,12 @@ drsym_free_resources(const char *modpath)
             return DRSYM_ERROR_INVALID_PARAMETER;
 
         /* unsafe to free during iteration */
-        if (recursive_context)
+        if (dr_rwlock_self_owns_write_lock(symbol_lock))
             return DRSYM_ERROR_RECURSIVE;
 
-        dr_recurlock_lock(symbol_lock);
+        dr_rwlock_write_lock(symbol_lock);
         found = hashtable_remove(&modtable, (void *)modpath);
-        dr_recurlock_unlock(symbol_lock);
+        dr_rwlock_write_unlock(symbol_lock);
 
         return (found ? DRSYM_SUCCESS : DRSYM_ERROR);
     }
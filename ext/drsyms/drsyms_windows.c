@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2011-2020 Google, Inc.  All rights reserved.
+ * Copyright (c) 2011-2022 Google, Inc.  All rights reserved.
  * Copyright (c) 2009-2010 VMware, Inc.  All rights reserved.
  * **********************************************************/
 
@@ -696,6 +696,41 @@ drsym_lookup_address_local(const char *modpath, size_t modoffs, drsym_info_t *ou
     return DRSYM_SUCCESS;
 }
 
+static drsym_error_t
+drsym_lookup_addresses_local(const char *modpath, const size_t *modoffs, size_t count,
+                             drsym_info_t *info INOUT, drsym_error_t *results OUT,
+                             uint flags)
+{
+    mod_entry_t *mod;
+    size_t i;
+
+    if (modpath == NULL || (count > 0 && (modoffs == NULL || info == NULL ||
+                                          results == NULL)))
+        return DRSYM_ERROR_INVALID_PARAMETER;
+    for (i = 0; i < count; i++) {
+        if (info[i].struct_size != sizeof(info[i]))
+            return DRSYM_ERROR_INVALID_SIZE;
+    }
+
+    dr_recurlock_lock(symbol_lock);
+    mod = lookup_or_load(modpath, true /*use dbghelp*/);
+    if (mod == NULL) {
+        dr_recurlock_unlock(symbol_lock);
+        return DRSYM_ERROR_LOAD_FAILED;
+    }
+    if (mod->use_pecoff_symtable) {
+        drsym_error_t symerr = drsym_unix_lookup_addresses(mod->u.pecoff_data, modoffs,
+                                                           count, info, results, flags);
+        dr_recurlock_unlock(symbol_lock);
+        return symerr;
+    }
+    /* XXX: dbghelp has no batch query, so we query each offset in turn. */
+    for (i = 0; i < count; i++)
+        results[i] = drsym_lookup_address_local(modpath, modoffs[i], &info[i], flags);
+    dr_recurlock_unlock(symbol_lock);
+    return DRSYM_SUCCESS;
+}
+
 static drsym_error_t
 drsym_lookup_symbol_local(const char *modpath, const char *symbol, size_t *modoffs OUT,
                           uint flags)
@@ -1454,6 +1489,19 @@ drsym_lookup_address(const char *modpath, size_t modoffs, drsym_info_t *out INOU
     }
 }
 
+DR_EXPORT
+drsym_error_t
+drsym_lookup_addresses(const char *modpath, const size_t *modoffs, size_t count,
+                       drsym_info_t *info INOUT, drsym_error_t *results OUT, uint flags)
+{
+    if (IS_SIDELINE) {
+        return DRSYM_ERROR_NOT_IMPLEMENTED;
+    } else {
+        return drsym_lookup_addresses_local(modpath, modoffs, count, info, results,
+                                            flags);
+    }
+}
+
 DR_EXPORT
 drsym_error_t
 drsym_lookup_symbol(const char *modpath, const char *symbol, size_t *modoffs OUT,
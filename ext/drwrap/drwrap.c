@@ -135,6 +135,13 @@ get_cur_xsp(void);
 #define REPLACE_TABLE_HASH_BITS 6
 /* i#1689: we store the decorated (LSB=1) pc (passed from client) in the table */
 static hashtable_t replace_table;
+/* replace_table is read_mostly: lookups take no lock, and what an update unlinks
+ * is retired until hashtable_free_retired().  We count the lookups in progress
+ * and free the retired memory after an update that finds none.
+ */
+static int replace_table_lookups;
+/* Serializes replace_table updates with freeing what they retire. */
+static void *replace_lock;
 
 /* Native replacements need to store the stack adjust and user data */
 typedef struct _replace_native_t {
@@ -210,6 +217,15 @@ static int tls_idx;
 /* Lazy removal and flushing.  Protected by wrap_lock. */
 static uint disabled_count;
 
+/* A direct-mapped per-thread cache of post-call sites known to be in
+ * post_call_table, so that calls from familiar sites take no shared lock.
+ */
+#define POSTCALL_CACHE_BITS 6
+#define POSTCALL_CACHE_SIZE (1 << POSTCALL_CACHE_BITS)
+#define POSTCALL_CACHE_INDEX(pc)                                       \
+    (((ptr_uint_t)(pc) ^ ((ptr_uint_t)(pc) >> POSTCALL_CACHE_BITS)) & \
+     (POSTCALL_CACHE_SIZE - 1))
+
 /* i#1713: per-thread state, similar to where_am_i_t */
 typedef enum _drwrap_where_t {
     DRWRAP_WHERE_OUTSIDE_CALLBACK,
@@ -240,6 +256,11 @@ typedef struct _per_thread_t {
     app_pc retaddr[MAX_WRAP_NESTING];
     /* For drbbdup don't-wrap cases. */
     bool cleanup_only;
+    /* Only valid while postcall_cache_generation matches postcall_generation. */
+    app_pc postcall_cache[POSTCALL_CACHE_SIZE];
+    int postcall_cache_generation;
+    /* Hits not yet added to drwrap_stats, which we batch to avoid sharing. */
+    atomic_int_t postcall_cache_hits;
 } per_thread_t;
 
 /***************************************************************************
@@ -310,12 +331,18 @@ typedef struct _post_call_notify_t {
 /* protected by post_call_rwlock */
 post_call_notify_t *post_call_notify_list;
 
-/* FIFO cache read w/o a lock (which we assume is fine b/c it's word-aligned
- * and thus does not cross a cache line) and written under post_call_rwlock
+/* Incremented under the post_call_rwlock write lock whenever a site is removed
+ * from post_call_table, invalidating every thread's postcall_cache.
  */
-static uint postcall_cache_idx;
-#define POSTCALL_CACHE_SIZE 8
-static app_pc postcall_cache[POSTCALL_CACHE_SIZE];
+static int postcall_generation;
+
+/* caller must hold write lock */
+static void
+postcall_cache_invalidate(void)
+{
+    ASSERT(dr_rwlock_self_owns_write_lock(post_call_rwlock), "must hold write lock");
+    dr_atomic_add32_return_sum(&postcall_generation, 1);
+}
 
 static void
 post_call_entry_free(void *v)
@@ -396,7 +423,6 @@ post_call_lookup_for_instru(app_pc pc)
     if (e != NULL) {
         res = post_call_consistent(pc, e);
         if (!res) {
-            int i;
             /* need the write lock */
             dr_rwlock_read_unlock(post_call_rwlock);
             e = NULL; /* no longer safe */
@@ -404,11 +430,7 @@ post_call_lookup_for_instru(app_pc pc)
             /* might not be found now if racily removed: but that's fine */
             NOTIFY(2, "%s: removing %p\n", __FUNCTION__, pc);
             hashtable_remove(&post_call_table, (void *)pc);
-            /* invalidate cache */
-            for (i = 0; i < POSTCALL_CACHE_SIZE; i++) {
-                if (pc == postcall_cache[i])
-                    postcall_cache[i] = NULL;
-            }
+            postcall_cache_invalidate();
             dr_rwlock_write_unlock(post_call_rwlock);
             return res;
         } else {
@@ -961,6 +983,14 @@ drwrap_init(void)
 
     hashtable_init(&replace_table, REPLACE_TABLE_HASH_BITS, HASH_INTPTR,
                    false /*!strdup*/);
+    /* Every basic block looks up each of its instructions, while replacements
+     * rarely change.
+     */
+    hashtable_config_t config = { sizeof(config) };
+    config.resizable = true;
+    config.resize_threshold = 75;
+    config.read_mostly = true;
+    hashtable_configure(&replace_table, &config);
     hashtable_init_ex(&replace_native_table, REPLACE_NATIVE_TABLE_HASH_BITS, HASH_INTPTR,
                       false /*!strdup*/, false /*!synch*/, replace_native_free, NULL,
                       NULL);
@@ -970,6 +1000,7 @@ drwrap_init(void)
                       false /*!str_dup*/, false /*!synch*/, post_call_entry_free, NULL,
                       NULL);
     post_call_rwlock = dr_rwlock_create();
+    replace_lock = dr_mutex_create();
     /* This lock may have been set up by drwrap_set_global_flags() (in this thread). */
     if (wrap_lock == NULL)
         wrap_lock = dr_recurlock_create();
@@ -1038,10 +1069,6 @@ drwrap_exit(void)
 
     if (dr_is_detaching()) {
         memset(&drwrap_stats, 0, sizeof(drwrap_stats_t));
-        for (int i = 0; i < POSTCALL_CACHE_SIZE; i++) {
-            postcall_cache[i] = NULL;
-        }
-        postcall_cache_idx = 0;
 #ifdef WINDOWS
         sysnum_NtContinue = -1;
 #endif
@@ -1053,6 +1080,7 @@ drwrap_exit(void)
     hashtable_delete(&wrap_table);
     hashtable_delete(&post_call_table);
     dr_rwlock_destroy(post_call_rwlock);
+    dr_mutex_destroy(replace_lock);
     dr_recurlock_destroy(wrap_lock);
     wrap_lock = NULL; /* For early drwrap_set_global_flags() after re-attach. */
     global_flags = 0; /* For re-attach. */
@@ -1102,6 +1130,8 @@ drwrap_thread_exit(void *drcontext)
     for (i = 0; i < MAX_WRAP_NESTING; i++) {
         drwrap_free_user_data(drcontext, pt, i);
     }
+    dr_atomic_add_stat_return_sum(&drwrap_stats.postcall_cache_hits,
+                                  pt->postcall_cache_hits);
     dr_thread_free(drcontext, pt, sizeof(*pt));
 }
 
@@ -1242,11 +1272,24 @@ replace_native_ret_stub(uint stack_adjust)
     }
 }
 
+static void *
+replace_table_lookup(app_pc pc)
+{
+    void *res;
+    /* The locked add is a full barrier: if an update reads a zero count after
+     * it, our lookup below sees that update's unlinking stores.
+     */
+    dr_atomic_add32_return_sum(&replace_table_lookups, 1);
+    res = hashtable_lookup(&replace_table, pc);
+    dr_atomic_add32_return_sum(&replace_table_lookups, -1);
+    return res;
+}
+
 DR_EXPORT
 bool
 drwrap_is_replaced(app_pc func)
 {
-    return hashtable_lookup(&replace_table, func) != NULL;
+    return replace_table_lookup(func) != NULL;
 }
 
 DR_EXPORT
@@ -1306,7 +1349,16 @@ drwrap_replace(app_pc original, app_pc replacement, bool override)
          */
         return false;
     }
-    return drwrap_replace_common(&replace_table, original, replacement, override, false);
+    bool res;
+    dr_mutex_lock(replace_lock);
+    res = drwrap_replace_common(&replace_table, original, replacement, override, false);
+    /* Any lookup that starts after our count read below cannot reach what we
+     * retired, so a zero count means nothing retired is in use.
+     */
+    if (dr_atomic_add32_return_sum(&replace_table_lookups, 0) == 0)
+        hashtable_free_retired(&replace_table);
+    dr_mutex_unlock(replace_lock);
+    return res;
 }
 
 DR_EXPORT
@@ -1620,7 +1672,7 @@ drwrap_event_bb_app2app(void *drcontext, void *tag, instrlist_t *bb, bool for_tr
         pc = dr_app_pc_as_jump_target(instr_get_isa_mode(inst), instr_get_app_pc(inst));
         /* non-native takes precedence */
         if (replace_table.entries > 0) {
-            replace = hashtable_lookup(&replace_table, pc);
+            replace = replace_table_lookup(pc);
             if (replace != NULL) {
                 drwrap_replace_bb(drcontext, bb, inst, pc, replace);
                 break;
@@ -1902,8 +1954,8 @@ drwrap_ensure_postcall(void *drcontext, per_thread_t *pt, wrap_entry_t *wrap,
     if (TEST(DRWRAP_NO_DYNAMIC_RETADDRS, wrap->flags)) {
         /* i#0470: On a large multithreaded app, using shared memory here and especially
          * a lock (even an rwlock where the read path is always taken) causes noticeable
-         * overhead.  The postcall_cache is often not enough.  Maybe a per-thread cache
-         * could help.  For now we provide an option to completely skip the retaddr
+         * overhead.  The per-thread postcall_cache avoids both for familiar call
+         * sites, but we also provide an option to completely skip the retaddr
          * check and rely on post-call sites found for direct calls.
          * If this ends up seeing some use we could invest in also detecting targets
          * for PLT or IAT indirect calls.
@@ -1925,29 +1977,36 @@ drwrap_ensure_postcall(void *drcontext, per_thread_t *pt, wrap_entry_t *wrap,
 #endif
         return;
     }
-    int i;
-    /* avoid lock and hashtable lookup by caching prior retaddrs */
-    for (i = 0; i < POSTCALL_CACHE_SIZE; i++) {
-        if (retaddr == postcall_cache[i])
-            return;
+    /* Avoid the lock and hashtable lookup by caching prior retaddrs.  We read the
+     * generation before the lookup so that a removal racing with it invalidates
+     * what we cache.
+     */
+    int generation = dr_atomic_load32(&postcall_generation);
+    uint idx = POSTCALL_CACHE_INDEX(retaddr);
+    bool known;
+    if (pt->postcall_cache_generation != generation) {
+        memset(pt->postcall_cache, 0, sizeof(pt->postcall_cache));
+        pt->postcall_cache_generation = generation;
+    } else if (pt->postcall_cache[idx] == retaddr) {
+        pt->postcall_cache_hits++;
+        return;
     }
+    dr_atomic_add_stat_return_sum(&drwrap_stats.postcall_cache_hits,
+                                  pt->postcall_cache_hits);
+    pt->postcall_cache_hits = 0;
+    dr_atomic_add_stat_return_sum(&drwrap_stats.postcall_cache_misses, 1);
 
-    /* to write to the cache we need a write lock */
-    dr_rwlock_write_lock(post_call_rwlock);
-
-    /* add to FIFO cache */
-    postcall_cache_idx++;
-    if (postcall_cache_idx >= POSTCALL_CACHE_SIZE)
-        postcall_cache_idx = 0;
-    postcall_cache[postcall_cache_idx] = retaddr;
-
-    if (hashtable_lookup(&post_call_table, (void *)retaddr) == NULL) {
+    dr_rwlock_read_lock(post_call_rwlock);
+    known = hashtable_lookup(&post_call_table, (void *)retaddr) != NULL;
+    dr_rwlock_read_unlock(post_call_rwlock);
+    if (known)
+        pt->postcall_cache[idx] = retaddr;
+    else {
         bool enabled = wrap->enabled;
         /* this function may not return: but in that case it will redirect
          * and we'll come back here to do the wrapping.
          * release all locks.
          */
-        dr_rwlock_write_unlock(post_call_rwlock);
         if (!TEST(DRWRAP_NO_FRILLS, global_flags))
             dr_recurlock_unlock(wrap_lock);
         drwrap_mark_retaddr_for_instru(drcontext, pt, decorated_pc, wrapcxt, enabled);
@@ -1955,8 +2014,7 @@ drwrap_ensure_postcall(void *drcontext, per_thread_t *pt, wrap_entry_t *wrap,
         if (!TEST(DRWRAP_NO_FRILLS, global_flags))
             dr_recurlock_lock(wrap_lock);
         wrap = wrap_table_lookup_normalized_pc(plain_pc);
-    } else
-        dr_rwlock_write_unlock(post_call_rwlock);
+    }
 }
 
 /* called via clean call at the top of callee */
@@ -2498,12 +2556,8 @@ drwrap_event_module_unload(void *drcontext, const module_data_t *info)
      */
     NOTIFY(2, "%s: removing %p..%p\n", __FUNCTION__, info->start, info->end);
     dr_rwlock_write_lock(post_call_rwlock);
-    hashtable_remove_range(&post_call_table, (void *)info->start, (void *)info->end);
-    /* Invalidate cache. */
-    for (int i = 0; i < POSTCALL_CACHE_SIZE; i++) {
-        if (postcall_cache[i] >= info->start && postcall_cache[i] < info->end)
-            postcall_cache[i] = NULL;
-    }
+    if (hashtable_remove_range(&post_call_table, (void *)info->start, (void *)info->end))
+        postcall_cache_invalidate();
     dr_rwlock_write_unlock(post_call_rwlock);
 
     /* XXX: It's arguable whether we should remove from replace_table,
@@ -2739,9 +2793,16 @@ DR_EXPORT
 bool
 drwrap_get_stats(INOUT drwrap_stats_t *stats)
 {
-    if (stats == NULL || stats->size != sizeof(*stats))
+    if (stats == NULL ||
+        stats->size < offsetof(drwrap_stats_t, flush_count) + sizeof(stats->flush_count))
         return false;
     stats->flush_count = dr_atomic_load_stat(&drwrap_stats.flush_count);
+    if (stats->size >= sizeof(*stats)) {
+        stats->postcall_cache_hits =
+            dr_atomic_load_stat(&drwrap_stats.postcall_cache_hits);
+        stats->postcall_cache_misses =
+            dr_atomic_load_stat(&drwrap_stats.postcall_cache_misses);
+    }
     return true;
 }
 
@@ -872,6 +872,17 @@ typedef struct _drwrap_stats_t {
      * removing wrap or replace instrumentation.
      */
     atomic_int_t flush_count;
+    /**
+     * The number of wrapped calls whose return address each thread found in its
+     * cache of known post-call sites.  A thread's hits are only added here upon
+     * its next miss or its exit.
+     */
+    atomic_int_t postcall_cache_hits;
+    /**
+     * The number of wrapped calls whose return address was not in the calling
+     * thread's cache, requiring a lookup under a shared lock.
+     */
+    atomic_int_t postcall_cache_misses;
 } drwrap_stats_t;
 
 DR_EXPORT
@@ -0,0 +1,251 @@
+/* **********************************************************
+ * Copyright (c) 2022 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* IR allocation benchmark.
+ *
+ * We encode the instructions that the api.ir test creates, and then repeatedly
+ * decode them into block-sized instruction lists, re-encode every instruction
+ * from its operands, and destroy the lists, much as building a basic block does.
+ * We report instructions decoded and encoded per second with IR memory taken
+ * from the heap and with it taken from an IR arena (dr_ir_arena_begin()).
+ */
+
+#include "configure.h"
+#include "dr_api.h"
+#include "tools.h"
+
+#ifdef WINDOWS
+#    define _USE_MATH_DEFINES 1
+#    include <math.h> /* for M_PI, M_LN2, and M_LN10 for OP_fldpi, etc. */
+#endif
+#include <stdlib.h>
+
+#define ASSERT(x)                                                                 \
+    ((void)((!(x)) ? (dr_fprintf(STDERR, "ASSERT FAILURE: %s:%d: %s\n", __FILE__, \
+                                 __LINE__, #x),                                   \
+                      dr_abort(), 0)                                              \
+                   : 0))
+
+/* The default keeps the test quick; pass a larger count for stable numbers. */
+#define DEFAULT_ROUNDS 20
+/* Instructions per list, in the range of a large basic block. */
+#define BLOCK_INSTRS 32
+
+static byte code[65536];
+static byte *code_end = code;
+
+/* These are used by the ir_x86_*args*.h files, as in ir_x86.c. */
+static int memarg_disp = 0x37;
+#define MEMARG(sz) (opnd_create_base_disp(DR_REG_XCX, DR_REG_NULL, 0, memarg_disp, sz))
+#define IMMARG(sz) opnd_create_immed_int(37, sz)
+#define TGTARG opnd_create_instr(instrlist_last(ilist))
+#define REGARG(reg) opnd_create_reg(DR_REG_##reg)
+#define REGARG_PARTIAL(reg, sz) opnd_create_reg_partial(DR_REG_##reg, sz)
+#define VSIBX6(sz) (opnd_create_base_disp(DR_REG_XCX, DR_REG_XMM6, 2, 0x42, sz))
+#define VSIBY6(sz) (opnd_create_base_disp(DR_REG_XDX, DR_REG_YMM6, 2, 0x17, sz))
+#define VSIBZ6(sz) (opnd_create_base_disp(DR_REG_XDX, DR_REG_ZMM6, 2, 0x35, sz))
+#define VSIBX15(sz) (opnd_create_base_disp(DR_REG_XCX, DR_REG_XMM15, 2, 0x42, sz))
+#define VSIBY15(sz) (opnd_create_base_disp(DR_REG_XDX, DR_REG_YMM15, 2, 0x17, sz))
+#define VSIBZ31(sz) (opnd_create_base_disp(DR_REG_XDX, DR_REG_ZMM31, 2, 0x35, sz))
+
+#define X86_ONLY 1
+#define X64_ONLY 2
+#define VERIFY_EVEX 4
+
+#define SKIP_OPCODE(flags) TEST(IF_X64_ELSE(X86_ONLY, X64_ONLY), flags)
+
+static void
+encode_ilist(void *dc, instrlist_t *ilist)
+{
+    code_end = instrlist_encode(dc, ilist, code_end, true);
+    ASSERT(code_end != NULL && code_end <= code + sizeof(code));
+    instrlist_clear_and_destroy(dc, ilist);
+}
+
+static void
+create_0args(void *dc)
+{
+    instrlist_t *ilist = instrlist_create(dc);
+#define OPCODE(name, opc, icnm, flags)                        \
+    do {                                                      \
+        if (!SKIP_OPCODE(flags))                              \
+            instrlist_append(ilist, INSTR_CREATE_##icnm(dc)); \
+    } while (0);
+#define XOPCODE(name, opc, icnm, flags)                       \
+    do {                                                      \
+        if (!SKIP_OPCODE(flags))                              \
+            instrlist_append(ilist, XINST_CREATE_##icnm(dc)); \
+    } while (0);
+#include "ir_x86_0args.h"
+#undef OPCODE
+#undef XOPCODE
+    encode_ilist(dc, ilist);
+}
+
+#define OPCODE(name, opc, icnm, flags, ...)                                \
+    do {                                                                   \
+        if (!SKIP_OPCODE(flags))                                           \
+            instrlist_append(ilist, INSTR_CREATE_##icnm(dc, __VA_ARGS__)); \
+    } while (0);
+#define XOPCODE(name, opc, icnm, flags, ...)                               \
+    do {                                                                   \
+        if (!SKIP_OPCODE(flags))                                           \
+            instrlist_append(ilist, XINST_CREATE_##icnm(dc, __VA_ARGS__)); \
+    } while (0);
+
+static void
+create_1args(void *dc)
+{
+    instrlist_t *ilist = instrlist_create(dc);
+#include "ir_x86_1args.h"
+    encode_ilist(dc, ilist);
+}
+
+static void
+create_2args(void *dc)
+{
+    instrlist_t *ilist = instrlist_create(dc);
+#include "ir_x86_2args.h"
+    encode_ilist(dc, ilist);
+}
+
+static void
+create_2args_mm(void *dc)
+{
+    instrlist_t *ilist = instrlist_create(dc);
+#include "ir_x86_2args_mm.h"
+    encode_ilist(dc, ilist);
+}
+
+static void
+create_3args(void *dc)
+{
+    instrlist_t *ilist = instrlist_create(dc);
+#include "ir_x86_3args.h"
+    encode_ilist(dc, ilist);
+}
+
+static void
+create_3args_avx(void *dc)
+{
+    instrlist_t *ilist = instrlist_create(dc);
+#include "ir_x86_3args_avx.h"
+    encode_ilist(dc, ilist);
+}
+
+static void
+create_4args(void *dc)
+{
+    instrlist_t *ilist = instrlist_create(dc);
+#include "ir_x86_4args.h"
+    encode_ilist(dc, ilist);
+}
+
+#undef OPCODE
+#undef XOPCODE
+
+/* Decodes the code in lists of BLOCK_INSTRS instructions, re-encodes each one from
+ * its operands, and returns how many instructions were handled.
+ */
+static uint64
+decode_and_encode(void *dc, bool use_arena)
+{
+    byte scratch[MAX_INSTR_LENGTH];
+    byte *pc = code;
+    uint64 count = 0;
+    while (pc < code_end) {
+        instrlist_t *ilist;
+        instr_t *instr;
+        int i;
+        if (use_arena)
+            dr_ir_arena_begin(dc);
+        ilist = instrlist_create(dc);
+        for (i = 0; i < BLOCK_INSTRS && pc < code_end; i++) {
+            instr = instr_create(dc);
+            pc = decode(dc, pc, instr);
+            ASSERT(pc != NULL);
+            instrlist_append(ilist, instr);
+        }
+        for (instr = instrlist_first(ilist); instr != NULL;
+             instr = instr_get_next(instr)) {
+            byte *orig_pc = instr_get_raw_bits(instr);
+            /* Encode from the operands rather than copying the raw bits. */
+            instr_set_raw_bits_valid(instr, false);
+            ASSERT(instr_encode_to_copy(dc, instr, scratch, orig_pc) != NULL);
+            count++;
+        }
+        instrlist_clear_and_destroy(dc, ilist);
+        if (use_arena)
+            dr_ir_arena_end(dc);
+    }
+    return count;
+}
+
+static void
+run_bench(void *dc, bool use_arena, int rounds)
+{
+    uint64 count = 0, start, time;
+    int i;
+    start = dr_get_milliseconds();
+    for (i = 0; i < rounds; i++)
+        count += decode_and_encode(dc, use_arena);
+    time = dr_get_milliseconds() - start;
+    dr_printf("%-6s " UINT64_FORMAT_STRING " instrs decoded+encoded per second\n",
+              use_arena ? "arena:" : "heap:", count * 1000 / (time == 0 ? 1 : time));
+}
+
+int
+main(int argc, char *argv[])
+{
+    void *dcontext = dr_standalone_init();
+    int rounds = DEFAULT_ROUNDS;
+    if (argc > 1)
+        rounds = atoi(argv[1]);
+
+    create_0args(dcontext);
+    create_1args(dcontext);
+    create_2args(dcontext);
+    create_2args_mm(dcontext);
+    create_3args(dcontext);
+    create_3args_avx(dcontext);
+    create_4args(dcontext);
+
+    /* Warm up the heap and the arena before timing either. */
+    decode_and_encode(dcontext, false);
+    decode_and_encode(dcontext, true);
+    run_bench(dcontext, false, rounds);
+    run_bench(dcontext, true, rounds);
+
+    dr_printf("all done\n");
+    dr_standalone_exit();
+    return 0;
+}
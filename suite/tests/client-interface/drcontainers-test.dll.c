@@ -182,6 +182,105 @@ test_hashtable_apply_all_user_data(void)
     hashtable_delete(&hash_table);
 }
 
+static void
+test_hashtable_open_address(void)
+{
+    hashtable_t hash_table;
+    hashtable_config_t config;
+    uintptr_t i;
+    hashtable_init_ex(&hash_table, 2, HASH_INTPTR, false, false, NULL, NULL, NULL);
+    config.size = sizeof(config);
+    config.resizable = true;
+    config.resize_threshold = 75;
+    config.free_key_func = NULL;
+    config.open_address = true;
+    config.read_mostly = false;
+    hashtable_configure(&hash_table, &config);
+
+    /* Aligned keys, enough to force several resizes. */
+    for (i = 1; i <= 100; i++)
+        CHECK(hashtable_add(&hash_table, (void *)(i * 16), (void *)i), "add failed");
+    CHECK(!hashtable_add(&hash_table, (void *)16, (void *)1), "duplicate add succeeded");
+    CHECK(hash_table.entries == 100, "wrong entry count");
+    for (i = 1; i <= 100; i++) {
+        CHECK(hashtable_lookup(&hash_table, (void *)(i * 16)) == (void *)i,
+              "lookup failed");
+        CHECK(hashtable_lookup(&hash_table, (void *)(i * 16 + 8)) == NULL,
+              "lookup of absent key succeeded");
+    }
+    for (i = 1; i <= 100; i += 2)
+        CHECK(hashtable_remove(&hash_table, (void *)(i * 16)), "remove failed");
+    CHECK(hashtable_remove_range(&hash_table, (void *)(2 * 16), (void *)(11 * 16)),
+          "remove_range failed");
+    for (i = 1; i <= 100; i++) {
+        CHECK(hashtable_lookup(&hash_table, (void *)(i * 16)) ==
+                  ((i % 2 == 0 && i > 10) ? (void *)i : NULL),
+              "lookup after removal failed");
+    }
+
+    c = 0;
+    total = 0;
+    hashtable_apply_to_all_payloads(&hash_table, count);
+    hashtable_apply_to_all_payloads(&hash_table, sum);
+    CHECK(c == hash_table.entries && c == 45, "open address count test failed");
+    CHECK(total == 2520, "open address sum test failed");
+
+    /* Switch back to chaining and make sure nothing is lost. */
+    config.open_address = false;
+    hashtable_configure(&hash_table, &config);
+    CHECK(hashtable_lookup(&hash_table, (void *)(100 * 16)) == (void *)100,
+          "lookup after switching to chaining failed");
+    c = 0;
+    hashtable_apply_to_all_payloads(&hash_table, count);
+    CHECK(c == 45, "switching to chaining lost entries");
+
+    hashtable_clear(&hash_table);
+    CHECK(hash_table.entries == 0, "clear failed");
+    hashtable_delete(&hash_table);
+}
+
+static uint payloads_freed;
+
+static void
+count_free(void *payload)
+{
+    payloads_freed++;
+}
+
+static void
+test_hashtable_read_mostly(void)
+{
+    hashtable_t hash_table;
+    hashtable_config_t config = { sizeof(config) };
+    uintptr_t i;
+    hashtable_init_ex(&hash_table, 2, HASH_INTPTR, false, true, count_free, NULL, NULL);
+    config.resizable = true;
+    config.resize_threshold = 75;
+    config.read_mostly = true;
+    hashtable_configure(&hash_table, &config);
+
+    for (i = 1; i <= 100; i++)
+        CHECK(hashtable_add(&hash_table, (void *)i, (void *)i), "add failed");
+    for (i = 1; i <= 100; i += 2)
+        CHECK(hashtable_remove(&hash_table, (void *)i), "remove failed");
+    CHECK(hashtable_add_replace(&hash_table, (void *)2, (void *)4) == (void *)2,
+          "replace failed");
+    for (i = 1; i <= 100; i++) {
+        CHECK(hashtable_lookup(&hash_table, (void *)i) ==
+                  (i == 2 ? (void *)4 : (i % 2 == 0 ? (void *)i : NULL)),
+              "lookup failed");
+    }
+    /* Removed payloads are only freed once retired memory is. */
+    CHECK(payloads_freed == 0, "payload freed while lookups may see it");
+    hashtable_free_retired(&hash_table);
+    CHECK(payloads_freed == 50, "retired payloads not freed");
+
+    hashtable_clear(&hash_table);
+    CHECK(hashtable_lookup(&hash_table, (void *)4) == NULL, "clear failed");
+    hashtable_delete(&hash_table);
+    CHECK(payloads_freed == 100, "cleared payloads not freed");
+}
+
 #define KEY 42
 #define PAYLOAD ((void *)12)
 static bool free_func_called;
@@ -211,12 +310,34 @@ test_dr_hashtable(void)
     dr_hashtable_destroy(dcxt, table);
 }
 
+static void
+test_hashtable_single_bucket(void)
+{
+    hashtable_t hash_table;
+    hashtable_config_t config = { sizeof(config) };
+    uintptr_t i;
+    /* A table with 0 bits has one bucket, so every key must hash to index 0. */
+    hashtable_init(&hash_table, 0, HASH_INTPTR, false);
+    config.resizable = false;
+    hashtable_configure(&hash_table, &config);
+    for (i = 1; i <= 16; i++)
+        CHECK(hashtable_add(&hash_table, (void *)i, (void *)i), "add failed");
+    for (i = 1; i <= 16; i++) {
+        CHECK(hashtable_lookup(&hash_table, (void *)i) == (void *)i,
+              "single-bucket lookup failed");
+    }
+    hashtable_delete(&hash_table);
+}
+
 DR_EXPORT void
 dr_init(client_id_t id)
 {
     test_vector();
     test_hashtable_apply_all();
     test_hashtable_apply_all_user_data();
+    test_hashtable_open_address();
+    test_hashtable_read_mostly();
+    test_hashtable_single_bucket();
     test_dr_hashtable();
 
     /* XXX: test other data structures */
@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2011-2020 Google, Inc.  All rights reserved.
+ * Copyright (c) 2011-2022 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -276,6 +276,45 @@ lookup_and_wrap(const char *modpath, app_pc modbase, const char *modname,
     return modoffs;
 }
 
+/* Test that a batch lookup agrees with individual lookups. */
+static void
+lookup_addresses_batch(const char *modpath, size_t offs_a, size_t offs_b)
+{
+    size_t modoffs[2];
+    drsym_info_t info[2];
+    drsym_error_t results[2];
+    char names[2][MAX_FUNC_LEN];
+    drsym_error_t r;
+    int i;
+
+    modoffs[0] = offs_a < offs_b ? offs_a : offs_b;
+    modoffs[1] = offs_a < offs_b ? offs_b : offs_a;
+    for (i = 0; i < 2; i++) {
+        info[i].struct_size = sizeof(info[i]);
+        info[i].name = names[i];
+        info[i].name_size = MAX_FUNC_LEN;
+        info[i].file = NULL;
+        info[i].file_size = 0;
+    }
+    r = drsym_lookup_addresses(modpath, modoffs, 2, info, results, DRSYM_DEMANGLE);
+    ASSERT(r == DRSYM_SUCCESS);
+    for (i = 0; i < 2; i++) {
+        drsym_info_t sym_info;
+        char name[MAX_FUNC_LEN];
+        sym_info.struct_size = sizeof(sym_info);
+        sym_info.name = name;
+        sym_info.name_size = MAX_FUNC_LEN;
+        sym_info.file = NULL;
+        sym_info.file_size = 0;
+        r = drsym_lookup_address(modpath, modoffs[i], &sym_info, DRSYM_DEMANGLE);
+        ASSERT(r == results[i]);
+        ASSERT(strcmp(name, names[i]) == 0);
+        ASSERT(sym_info.start_offs == info[i].start_offs);
+        if (r == DRSYM_SUCCESS)
+            ASSERT(sym_info.line == info[i].line);
+    }
+}
+
 /* Lookup symbols in the exe and wrap them. */
 static void
 lookup_exe_syms(void)
@@ -287,6 +326,7 @@ lookup_exe_syms(void)
     size_t exe_export_offs;
     size_t exe_public_offs;
     drsym_info_t unused_info;
+    drsym_error_t unused_result;
     drsym_error_t r;
     drsym_debug_kind_t debug_kind;
     const char *appname = dr_get_application_name();
@@ -320,7 +360,9 @@ lookup_exe_syms(void)
     /* exe_public is a function in the exe we wouldn't be able to find without
      * drsyms and debug info.
      */
-    (void)lookup_and_wrap(exe_path, exe_base, appbase, "exe_public", DRSYM_DEFAULT_FLAGS);
+    exe_public_offs =
+        lookup_and_wrap(exe_path, exe_base, appbase, "exe_public", DRSYM_DEFAULT_FLAGS);
+    lookup_addresses_batch(exe_path, exe_export_offs, exe_public_offs);
 
     /* Test symbol not found error handling. */
     r = drsym_lookup_symbol(exe_path, "nonexistent_sym", &exe_public_offs,
@@ -336,6 +378,9 @@ lookup_exe_syms(void)
     ASSERT(r == DRSYM_ERROR_INVALID_PARAMETER);
     r = drsym_lookup_address(NULL, 0xDEADBEEFUL, &unused_info, DRSYM_DEFAULT_FLAGS);
     ASSERT(r == DRSYM_ERROR_INVALID_PARAMETER);
+    r = drsym_lookup_addresses(NULL, &exe_public_offs, 1, &unused_info, &unused_result,
+                               DRSYM_DEFAULT_FLAGS);
+    ASSERT(r == DRSYM_ERROR_INVALID_PARAMETER);
 
 #ifdef WINDOWS
     if (TEST(DRSYM_PDB, debug_kind)) { /* else NYI */
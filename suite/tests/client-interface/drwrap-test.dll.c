@@ -362,6 +362,7 @@ event_exit(void)
     bool ok = drwrap_get_stats(&stats);
     CHECK(ok, "get_stats failed");
     CHECK(stats.flush_count > 0, "force-replaces should result in some flushes");
+    CHECK(stats.postcall_cache_misses > 0, "first calls should miss the postcall cache");
     drmgr_unregister_tls_field(tls_idx);
     drwrap_exit();
     drmgr_exit();
@@ -35,6 +35,11 @@
 
 #include "client_tools.h" /* For ASSERT; DR_ASSERT raises a message box. */
 
+#ifdef LINUX
+#    include <elf.h>
+#    include <string.h>
+#endif
+
 static byte *mybase;
 static uint bb_execs;
 static uint resurrect_success;
@@ -210,6 +215,89 @@ event_bb(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, bool trans
     return DR_EMIT_DEFAULT | DR_EMIT_PERSISTABLE;
 }
 
+#ifdef LINUX
+#    ifdef X64
+typedef Elf64_Ehdr elf_header_t;
+typedef Elf64_Phdr elf_program_header_t;
+typedef Elf64_Nhdr elf_note_header_t;
+#    else
+typedef Elf32_Ehdr elf_header_t;
+typedef Elf32_Phdr elf_program_header_t;
+typedef Elf32_Nhdr elf_note_header_t;
+#    endif
+
+/* The same crc32 that DR uses for module checksums. */
+static uint
+crc32(const byte *buf, size_t len)
+{
+    uint crc = 0xffffffff;
+    size_t i;
+    int bit;
+    for (i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+    }
+    return crc;
+}
+
+/* Returns the hash of the module's GNU build ID note, or 0 if it has none. */
+static uint
+build_id_hash(const module_data_t *mod)
+{
+    elf_header_t *ehdr = (elf_header_t *)mod->start;
+    elf_program_header_t *phdr = (elf_program_header_t *)(mod->start + ehdr->e_phoff);
+    ptr_int_t delta = 0;
+    bool found_load = false;
+    int i;
+    for (i = 0; i < ehdr->e_phnum; i++) {
+        if (phdr[i].p_type == PT_LOAD && !found_load) {
+            delta = mod->start -
+                (byte *)(phdr[i].p_vaddr & ~(ptr_uint_t)(dr_page_size() - 1));
+            found_load = true;
+        }
+    }
+    for (i = 0; i < ehdr->e_phnum; i++) {
+        byte *note, *end;
+        size_t align = phdr[i].p_align == 8 ? 8 : 4;
+        if (phdr[i].p_type != PT_NOTE)
+            continue;
+        note = (byte *)phdr[i].p_vaddr + delta;
+        end = note + phdr[i].p_memsz;
+        while (note + sizeof(elf_note_header_t) <= end) {
+            elf_note_header_t *nhdr = (elf_note_header_t *)note;
+            byte *name = note + sizeof(*nhdr);
+            byte *desc = name + ALIGN_FORWARD(nhdr->n_namesz, align);
+            if (nhdr->n_type == NT_GNU_BUILD_ID &&
+                nhdr->n_namesz == sizeof(ELF_NOTE_GNU) &&
+                memcmp(name, ELF_NOTE_GNU, sizeof(ELF_NOTE_GNU)) == 0)
+                return crc32(desc, nhdr->n_descsz);
+            note = desc + ALIGN_FORWARD(nhdr->n_descsz, align);
+        }
+    }
+    return 0;
+}
+
+/* The pcache name and its validation both use the module timestamp, which for an
+ * ELF module with a build ID is the build ID's hash.
+ */
+static void
+event_module_load(void *drcontext, const module_data_t *mod, bool loaded)
+{
+    module_data_t *main_mod = dr_get_main_module();
+    if (mod->start == main_mod->start) {
+        uint hash = build_id_hash(mod);
+        if (hash == 0)
+            dr_fprintf(STDERR, "app has no build ID\n");
+        else if (mod->timestamp != hash) {
+            dr_fprintf(STDERR, "module timestamp 0x%08x is not build ID hash 0x%08x\n",
+                       mod->timestamp, hash);
+        }
+    }
+    dr_free_module_data(main_mod);
+}
+#endif
+
 static void
 event_exit(void)
 {
@@ -227,6 +315,9 @@ dr_init(client_id_t id)
     dr_fprintf(STDERR, "thank you for testing the client interface\n");
     dr_register_exit_event(event_exit);
     dr_register_bb_event(event_bb);
+#ifdef LINUX
+    dr_register_module_load_event(event_module_load);
+#endif
     if (!dr_register_persist_ro(event_persist_ro_size, event_persist_ro,
                                 event_resurrect_ro))
         dr_fprintf(STDERR, "failed to register ro");